@@ -0,0 +1,335 @@
+/*
+ * benchmark.c - 2016 Jani Tammi <janitammi@gmail.com>
+ *
+ *      Storage benchmark. See benchmark.h.
+ */
+#include <stdio.h>
+#include <stdlib.h>             // EXIT_SUCCESS, EXIT_FAILURE
+#include <stdbool.h>            // true, false
+#include <unistd.h>             // unlink()
+#include <errno.h>
+#include <sqlite3.h>
+
+#include "benchmark.h"
+#include "storage.h"            // storage_testwriteperf()
+#include "spool.h"              // spool_testwriteperf()
+#include "config.h"             // cfg.database.journal, .synchronous
+#include "logwrite.h"
+#include "util.h"               // xtmr()
+
+static const struct
+{
+    int batch;
+    int persistent;
+} connection[] =
+{
+    {   1, true  },
+    {  10, true  },
+    { 100, true  },
+    {   1, false }
+};
+#define BENCHMARK_CONNECTIONS   (int)(sizeof(connection) / sizeof(connection[0]))
+
+#define SCHEMA_NAME(s)          ((s) == DATABASE_SCHEMA_COMPACT ? "compact" : "legacy")
+#define CONNECTION_NAME(p)      ((p) ? "persistent" : "per-row")
+
+long long benchmark_writebytes()
+{
+    FILE     *f;
+    char      line[128];
+    long long bytes = -1;
+
+    // Kernel without CONFIG_TASK_IO_ACCOUNTING
+    if (!(f = fopen("/proc/self/io", "r")))
+        return (errno = 0, -1);
+    while (fgets(line, sizeof(line), f))
+        if (sscanf(line, "write_bytes: %lld", &bytes) == 1)
+            break;
+    fclose(f);
+    return bytes;
+}
+
+/*
+ * Scratch datafile and its journal, WAL and shared memory files
+ */
+static void benchmark_remove(char *datafile)
+{
+    char aux[CFG_MAX_FILENAME_LEN + 16];
+
+    unlink(datafile);
+    snprintf(aux, sizeof(aux), "%s-journal", datafile);
+    unlink(aux);
+    snprintf(aux, sizeof(aux), "%s-wal", datafile);
+    unlink(aux);
+    snprintf(aux, sizeof(aux), "%s-shm", datafile);
+    unlink(aux);
+    errno = 0;
+}
+
+/*
+ * New scratch datafile. Legacy schema is the data table of the earlier
+ * versions, upgraded like the daemon upgrades an existing datafile.
+ */
+static int benchmark_create(char *datafile, int schema)
+{
+    sqlite3 *db;
+    int      rc;
+
+    benchmark_remove(datafile);
+    if (schema == DATABASE_SCHEMA_COMPACT)
+        return database_initialize(datafile);           // database.c
+    if ((rc = sqlite3_open(datafile, &db)) == SQLITE_OK &&
+        (rc = sqlite3_exec(db, SQL_CREATE_TABLE_DATA, NULL, NULL, NULL)) != SQLITE_OK)
+        logmsg(LOG_ERR, "Unable to create legacy datafile \"%s\": %s", datafile, sqlite3_errmsg(db));
+    sqlite3_close(db);
+    return rc ? rc : database_upgrade(datafile);        // database.c
+}
+
+/*
+ * Write nsamples rows, throughput and write_bytes from around the whole
+ * run. Closing a WAL datafile checkpoints it, the bytes include that.
+ */
+static int benchmark_measure(
+                            benchmark_t *result,
+                            const storage_backend_t *backend,
+                            char *datafile,
+                            int nsamples
+                            )
+{
+    dbperf_t  *perf;
+    xtmr_t    *t = xtmr();
+    long long  before = benchmark_writebytes();
+    double     ms;
+
+    perf = storage_testwriteperf(backend, datafile, nsamples, result->batch, result->persistent);
+    ms = xtmrlap(t);
+    free(t);
+    if (!perf)
+        return EXIT_FAILURE;
+    result->perf       = *perf;    // static struct, next call overwrites
+    result->rowspersec = ms > 0.0 ? nsamples * 1000.0 / ms : 0.0;
+    result->writebytes = before < 0 ? -1 : benchmark_writebytes() - before;
+    return EXIT_SUCCESS;
+}
+
+int benchmark_recommend(benchmark_t *results, int n, int *spool)
+{
+    int i, best = -1;
+
+    for (i = 0; i < n; i++)
+    {
+        // OFF may lose or corrupt the datafile in a power cut
+        if (!results[i].persistent ||
+            results[i].schema != DATABASE_SCHEMA_COMPACT ||
+            results[i].synchronous == CFG_SYNCHRONOUS_OFF)
+            continue;
+        if (best < 0 || results[i].rowspersec > results[best].rowspersec)
+            best = i;
+    }
+    *spool = best >= 0 &&
+             (results[best].perf.mean > CFG_MAX_INSERT_DELAY_MEAN ||
+              results[best].perf.max  > CFG_MAX_INSERT_DELAY_MAX);
+    return best;
+}
+
+/******************************************************************************
+ * Report
+ */
+static char *benchmark_kb(char *buffer, long long bytes)
+{
+    if (bytes < 0)
+        sprintf(buffer, "n/a");
+    else
+        sprintf(buffer, "%.1f", bytes / 1024.0);
+    return buffer;
+}
+
+static void benchmark_log(const char *name, benchmark_t *r)
+{
+    char kb[32];
+
+    logmsg(
+          LOG_ERR,
+          "%-37s %9.1f %8.2f %8.2f %8.2f %10s",
+          name,
+          r->rowspersec,
+          r->perf.p50,
+          r->perf.p99,
+          r->perf.max,
+          benchmark_kb(kb, r->writebytes)
+          );
+}
+
+static void benchmark_json(FILE *json, benchmark_t *r)
+{
+    fprintf(
+           json,
+           "\"rows_per_s\": %.1f, \"p50_ms\": %.3f, \"p99_ms\": %.3f, \"max_ms\": %.3f, ",
+           r->rowspersec,
+           r->perf.p50,
+           r->perf.p99,
+           r->perf.max
+           );
+    if (r->writebytes < 0)
+        fprintf(json, "\"write_bytes\": null }");
+    else
+        fprintf(json, "\"write_bytes\": %lld }", r->writebytes);
+}
+
+static void benchmark_report(
+                            benchmark_t *results,
+                            int n,
+                            benchmark_t *memory,
+                            benchmark_t *spooled,
+                            int nsamples,
+                            FILE *json
+                            )
+{
+    char name[64];
+    int  i, best, spool;
+
+    best = benchmark_recommend(results, n, &spool);
+    logmsg(LOG_ERR, "Results: (n=%d rows per combination, latency per commit)", nsamples);
+    logmsg(LOG_ERR, "Journal Sync   Connection Batch Schema     rows/s   p50 ms   p99 ms   max ms kB written");
+    for (i = 0; i < n; i++)
+    {
+        snprintf(
+                name,
+                sizeof(name),
+                "%-7s %-6s %-10s %5d %-7s",
+                CFG_JOURNAL_NAME(results[i].journal),
+                CFG_SYNCHRONOUS_NAME(results[i].synchronous),
+                CONNECTION_NAME(results[i].persistent),
+                results[i].batch,
+                SCHEMA_NAME(results[i].schema)
+                );
+        benchmark_log(name, &results[i]);
+    }
+    benchmark_log("MEMORY (no storage)", memory);
+    benchmark_log("Spool (fdatasync() per row)", spooled);
+    if (best < 0)
+        logmsg(LOG_ERR, "No recommendation, no durable combination completed");
+    else
+    {
+        logmsg(
+              LOG_ERR,
+              "Recommended for this device: journal = %s, synchronous = %s, commitrows = %d",
+              CFG_JOURNAL_NAME(results[best].journal),
+              CFG_SYNCHRONOUS_NAME(results[best].synchronous),
+              results[best].batch
+              );
+        if (spool)
+            logmsg(
+                  LOG_ERR,
+                  "Commits miss the insert delay limits (mean < %.0f ms, max < %.0f ms), configure spool too",
+                  (double)CFG_MAX_INSERT_DELAY_MEAN,
+                  (double)CFG_MAX_INSERT_DELAY_MAX
+                  );
+    }
+
+    if (!json)
+        return;
+    fprintf(json, "{\n  \"rows\": %d,\n  \"results\": [\n", nsamples);
+    for (i = 0; i < n; i++)
+    {
+        fprintf(
+               json,
+               "    { \"journal\": \"%s\", \"synchronous\": \"%s\", \"connection\": \"%s\", "
+               "\"batch\": %d, \"schema\": \"%s\", ",
+               CFG_JOURNAL_NAME(results[i].journal),
+               CFG_SYNCHRONOUS_NAME(results[i].synchronous),
+               CONNECTION_NAME(results[i].persistent),
+               results[i].batch,
+               SCHEMA_NAME(results[i].schema)
+               );
+        benchmark_json(json, &results[i]);
+        fprintf(json, "%s\n", i < n - 1 ? "," : "");
+    }
+    fprintf(json, "  ],\n  \"reference\": {\n    \"memory\": { ");
+    benchmark_json(json, memory);
+    fprintf(json, ",\n    \"spool\": { ");
+    benchmark_json(json, spooled);
+    fprintf(json, "\n  },\n  \"recommended\": ");
+    if (best < 0)
+        fprintf(json, "null\n}\n");
+    else
+        fprintf(
+               json,
+               "{ \"journal\": \"%s\", \"synchronous\": \"%s\", \"commitrows\": %d, \"spool\": %s }\n}\n",
+               CFG_JOURNAL_NAME(results[best].journal),
+               CFG_SYNCHRONOUS_NAME(results[best].synchronous),
+               results[best].batch,
+               spool ? "true" : "false"
+               );
+    fflush(json);
+}
+
+/******************************************************************************
+ * Sweep
+ */
+int benchmark_run(char *datafile, char *spoolfile, int nsamples, FILE *json)
+{
+    benchmark_t  results[BENCHMARK_COMBINATIONS];
+    benchmark_t  memory  = { .batch = 1, .persistent = true };
+    benchmark_t  spooled = { .batch = 1, .persistent = true };
+    benchmark_t *r = results;
+    dbperf_t    *perf;
+    xtmr_t      *t;
+    long long    before;
+    double       ms;
+    int          journal     = cfg.database.journal;
+    int          synchronous = cfg.database.synchronous;
+    int          j, s, c, schema, rc = EXIT_SUCCESS;
+
+    if (nsamples < 1)
+        return (errno = EINVAL, EXIT_FAILURE);
+    for (j = CFG_JOURNAL_DELETE; j <= CFG_JOURNAL_WAL && !rc; j++)
+        for (s = CFG_SYNCHRONOUS_OFF; s <= CFG_SYNCHRONOUS_FULL && !rc; s++)
+            for (c = 0; c < BENCHMARK_CONNECTIONS && !rc; c++)
+                for (schema = DATABASE_SCHEMA_COMPACT; schema >= DATABASE_SCHEMA_LEGACY && !rc; schema--, r++)
+                {
+                    // Applied by database_open()
+                    cfg.database.journal     = j;
+                    cfg.database.synchronous = s;
+                    r->journal     = j;
+                    r->synchronous = s;
+                    r->batch       = connection[c].batch;
+                    r->persistent  = connection[c].persistent;
+                    r->schema      = schema;
+                    if ((rc = benchmark_create(datafile, schema)) ||
+                        (rc = benchmark_measure(r, &storage_sqlite, datafile, nsamples)))
+                        logmsg(
+                              LOG_ERR,
+                              "Benchmark %s/%s/%s/%d/%s failed!",
+                              CFG_JOURNAL_NAME(j),
+                              CFG_SYNCHRONOUS_NAME(s),
+                              CONNECTION_NAME(r->persistent),
+                              r->batch,
+                              SCHEMA_NAME(schema)
+                              );
+                }
+    cfg.database.journal     = journal;
+    cfg.database.synchronous = synchronous;
+    if (!rc)
+        rc = benchmark_measure(&memory, &storage_memory, datafile, nsamples);
+    benchmark_remove(datafile);
+    if (rc)
+        return EXIT_FAILURE;
+
+    // Spool appends one row at a time
+    t      = xtmr();
+    before = benchmark_writebytes();
+    perf   = spool_testwriteperf(spoolfile, nsamples);     // spool.c
+    ms     = xtmrlap(t);
+    free(t);
+    if (!perf)
+        return EXIT_FAILURE;
+    spooled.perf       = *perf;
+    spooled.rowspersec = ms > 0.0 ? nsamples * 1000.0 / ms : 0.0;
+    spooled.writebytes = before < 0 ? -1 : benchmark_writebytes() - before;
+
+    benchmark_report(results, BENCHMARK_COMBINATIONS, &memory, &spooled, nsamples, json);
+    return (errno = 0, EXIT_SUCCESS);
+}
+
+/* EOF benchmark.c */
@@ -0,0 +1,69 @@
+/*
+ * benchmark.h - 2016 Jani Tammi <janitammi@gmail.com>
+ *
+ *      Storage benchmark (-testdbwriteperf=N).
+ *
+ *      Datafile settings that matter on an SD card or a USB stick cannot
+ *      be judged from one configuration. The benchmark sweeps them against
+ *      a scratch datafile on the target volume:
+ *
+ *          journal         DELETE, WAL                     (cfg.database.journal)
+ *          synchronous     OFF, NORMAL, FULL               (cfg.database.synchronous)
+ *          batch           1, 10, 100 rows per commit      (cfg.database.commitrows)
+ *          connection      persistent (database writer), or open per row
+ *                          (worker inserting directly)
+ *          schema          compact (samples table), legacy (REAL data table)
+ *
+ *      Each combination writes N rows through storage_testwriteperf()
+ *      (storage.c) into a new scratch datafile. Reported per combination:
+ *      throughput (rows/s), commit latency p50/p99/max, and the bytes the
+ *      process caused to be written to the device ("write_bytes" of
+ *      /proc/self/io; n/a without task I/O accounting). MEMORY backend and
+ *      the spool (append + fdatasync() per row) are reference rows.
+ *
+ *      Recommendation is the fastest combination that survives a power cut
+ *      (synchronous NORMAL or FULL) over a persistent connection and the
+ *      compact schema. If even that misses the insert delay limits
+ *      (CFG_MAX_INSERT_DELAY_MEAN, _MAX), the spool is recommended too.
+ */
+#include <stdio.h>              /* FILE                                     */
+
+#include "database.h"           /* dbperf_t                                 */
+
+#ifndef __BENCHMARK_H__
+#define __BENCHMARK_H__
+
+#define BENCHMARK_COMBINATIONS      48          // 2 journal * 3 sync * 4 connection/batch * 2 schema
+
+typedef struct
+{
+    int         journal;                        // CFG_JOURNAL_*
+    int         synchronous;                    // CFG_SYNCHRONOUS_*
+    int         batch;                          // rows per commit
+    int         persistent;                     // false: open per row
+    int         schema;                         // DATABASE_SCHEMA_*
+    double      rowspersec;
+    long long   writebytes;                     // -1 == n/a
+    dbperf_t    perf;                           // per commit (ms)
+} benchmark_t;
+
+/*
+ *  benchmark_writebytes()  "write_bytes" of /proc/self/io, -1 if not
+ *                          available.
+ *  benchmark_recommend()   Index of the recommended result, -1 if none.
+ *                          *spool is set if the insert delay limits are
+ *                          not met.
+ *  benchmark_run()         Sweep with nsamples rows per combination.
+ *                          datafile and spoolfile are scratch files, both
+ *                          are removed. Table and recommendation are
+ *                          logged, JSON is written into json (may be NULL).
+ *                          cfg.database.journal and .synchronous are
+ *                          restored.
+ */
+long long benchmark_writebytes();
+int       benchmark_recommend(benchmark_t *results, int n, int *spool);
+int       benchmark_run(char *datafile, char *spoolfile, int nsamples, FILE *json);
+
+#endif /* __BENCHMARK_H__ */
+
+/* EOF benchmark.h */
@@ -0,0 +1,110 @@
+/*
+ * breaker.c - 2016 Jani Tammi <janitammi@gmail.com>
+ *
+ *      Circuit breaker for line data collectors. See breaker.h.
+ */
+#include <string.h>             // memset()
+
+#include "breaker.h"
+#include "logwrite.h"
+
+void breaker_init(breaker_t *b, const char *name)
+{
+    memset(b, 0, sizeof(breaker_t));
+    b->name    = name;
+    b->state   = BREAKER_CLOSED;
+    b->backoff = BREAKER_BACKOFF_MIN;
+}
+
+char *breaker_statestr(breaker_t *b)
+{
+    switch (b->state)
+    {
+        case BREAKER_OPEN:
+            return "OPEN";
+        case BREAKER_HALFOPEN:
+            return "HALF-OPEN";
+    }
+    return "CLOSED";
+}
+
+int breaker_allow(breaker_t *b, time_t now)
+{
+    switch (b->state)
+    {
+        case BREAKER_CLOSED:
+            return 1;
+        case BREAKER_OPEN:
+            if (now < b->retry)
+            {
+                b->n_skipped++;
+                return 0;
+            }
+            logmsg(LOG_INFO, "%s collector: trying to recover (half-open)", b->name);
+            b->state = BREAKER_HALFOPEN;
+            // fall through
+        case BREAKER_HALFOPEN:
+            // Only one trial at a time
+            if (b->trial)
+            {
+                b->n_skipped++;
+                return 0;
+            }
+            b->trial = 1;
+            return 1;
+    }
+    return 1;
+}
+
+static void breaker_open(breaker_t *b, time_t now)
+{
+    b->state = BREAKER_OPEN;
+    b->retry = now + b->backoff;
+    b->n_trips++;
+    logmsg(
+          LOG_INFO,
+          "%s collector: %d consecutive failures, backing off for %d seconds",
+          b->name,
+          b->n_failures,
+          b->backoff
+          );
+    // Next time, wait longer
+    b->backoff = b->backoff * 2 > BREAKER_BACKOFF_MAX ? BREAKER_BACKOFF_MAX : b->backoff * 2;
+}
+
+void breaker_report(breaker_t *b, int result, time_t now)
+{
+    if (result == BREAKER_NORESULT)
+    {
+        // Trial was not actually made - let the next attempt be the trial
+        b->trial = 0;
+        return;
+    }
+    if (result == BREAKER_SUCCESS)
+    {
+        if (b->state != BREAKER_CLOSED)
+            logmsg(
+                  LOG_INFO,
+                  "%s collector: recovered after %d failures",
+                  b->name,
+                  b->n_failures
+                  );
+        b->state      = BREAKER_CLOSED;
+        b->n_failures = 0;
+        b->trial      = 0;
+        b->backoff    = BREAKER_BACKOFF_MIN;
+        return;
+    }
+    // BREAKER_FAILURE
+    b->n_failures++;
+    if (b->state == BREAKER_HALFOPEN)
+    {
+        b->trial = 0;
+        breaker_open(b, now);
+    }
+    else if (b->state == BREAKER_CLOSED && b->n_failures >= BREAKER_THRESHOLD)
+        breaker_open(b, now);
+    // else already open (late report of an attempt made before opening)
+}
+
+/* EOF breaker.c */
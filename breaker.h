@@ -0,0 +1,72 @@
+/*
+ * breaker.h - 2016 Jani Tammi <janitammi@gmail.com>
+ *
+ *      Circuit breaker for line data collectors.
+ *
+ *      When the modem is rebooting (or its WebUI / SNMP agent hangs), every
+ *      collection attempt burns the full collector timeout and gets killed.
+ *      Breaker keeps count of consecutive failed attempts and, when
+ *      BREAKER_THRESHOLD is reached, stops further attempts ("open") for a
+ *      backoff period. When the period expires, ONE attempt is let through
+ *      ("half-open"). Success closes the breaker, failure re-opens it with
+ *      doubled backoff (up to the maximum).
+ *
+ *          CLOSED ---(threshold failures)---> OPEN
+ *            ^                                 |
+ *            |                          (backoff expires)
+ *            |                                 v
+ *            +-----------(success)------- HALF-OPEN ---(failure)---> OPEN
+ *
+ *      Attempts that produce no result (collector was not run, because the
+ *      modem did not answer ping) do not affect the state, but in half-open
+ *      state they allow the next attempt to be the trial.
+ *
+ *      Breakers are owned by the daemon (state must outlive workers) and
+ *      results are reported from the SIGCHLD handler.
+ */
+#include <time.h>           /* time_t                                       */
+#include <stdint.h>         /* uint32_t                                     */
+
+#ifndef __BREAKER_H__
+#define __BREAKER_H__
+
+#define BREAKER_THRESHOLD           3       // consecutive failures to open
+#define BREAKER_BACKOFF_MIN         30      // (seconds) first open period
+#define BREAKER_BACKOFF_MAX         900     // (seconds) 15 minutes
+
+#define BREAKER_CLOSED              0
+#define BREAKER_OPEN                1
+#define BREAKER_HALFOPEN            2
+
+// breaker_report() results
+#define BREAKER_SUCCESS             0
+#define BREAKER_FAILURE             1
+#define BREAKER_NORESULT            2       // attempt was not made (gated)
+
+typedef struct
+{
+    const char *    name;                   // for log messages
+    int             state;                  // BREAKER_CLOSED|OPEN|HALFOPEN
+    int             n_failures;             // consecutive failures
+    int             backoff;                // seconds, current open period
+    int             trial;                  // half-open attempt in progress
+    time_t          retry;                  // OPEN -> HALFOPEN at this time
+    uint32_t        n_trips;                // times opened
+    uint32_t        n_skipped;              // attempts refused
+} breaker_t;
+
+/*
+ *  breaker_init()      Reset breaker into closed state.
+ *  breaker_allow()     Returns true if an attempt may be made now. Moves
+ *                      expired open breaker into half-open state.
+ *  breaker_report()    Report the result of an allowed attempt.
+ *  breaker_statestr()  "CLOSED", "OPEN" or "HALF-OPEN"
+ */
+void    breaker_init(breaker_t *b, const char *name);
+int     breaker_allow(breaker_t *b, time_t now);
+void    breaker_report(breaker_t *b, int result, time_t now);
+char *  breaker_statestr(breaker_t *b);
+
+#endif /* __BREAKER_H__ */
+
+/* EOF breaker.h */
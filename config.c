@@ -21,6 +21,7 @@
 #include "event.h"
 #include "keyval.h"
 #include "util.h"
+#include "database.h"
 
 /******************************************************************************
  * Global storage of config.
@@ -35,7 +36,24 @@ config_t cfg =
     .database =
     {
         .filename           = { CFG_DEFAULT_FILEDATABASE },
-        .tmpfsfilename      = NULL
+        .tmpfsfilename      = NULL,
+        .commitrows         = CFG_DEFAULT_DB_COMMITROWS,
+        .commitinterval     = CFG_DEFAULT_DB_COMMITINTERVAL,
+        .backend            = CFG_DEFAULT_DB_BACKEND,
+        .journal            = CFG_DEFAULT_DB_JOURNAL,
+        .synchronous        = CFG_DEFAULT_DB_SYNCHRONOUS,
+        .checkpointinterval = CFG_DEFAULT_DB_CHECKPOINTINTERVAL,
+        .walmaxsize         = CFG_DEFAULT_DB_WALMAXSIZE,
+        .partition          = CFG_DEFAULT_DB_PARTITION,
+        .keeppartitions     = CFG_DEFAULT_DB_KEEPPARTITIONS,
+        .retention          = CFG_DEFAULT_DB_RETENTION,
+        .retentionlock      = CFG_DEFAULT_DB_RETENTIONLOCK,
+        .samplelog          = { CFG_DEFAULT_DB_SAMPLELOG },
+        .spool              = { CFG_DEFAULT_DB_SPOOL },
+        .replica            = { CFG_DEFAULT_DB_REPLICA },
+        .replicainterval    = CFG_DEFAULT_DB_REPLICAINTERVAL,
+        .keyframeinterval   = CFG_DEFAULT_DB_KEYFRAMEINTERVAL,
+        .changeepsilon      = CFG_DEFAULT_DB_CHANGEEPSILON
     },
     .inet =
     {
@@ -46,13 +64,21 @@ config_t cfg =
     {
         .createdatabase     = false,
         .createconfigfile   = false,
-        .testdbwriteperf    = false
+        .testdbwriteperf    = false,
+        .migratedatabase    = false,
+        .rebuildrollups     = false,
+        .exportsqlite       = false,
+        .export             = false,
+        .exportformat       = CFG_EXPORT_CSV,
+        .exportstep         = 0,
+        .importcsv          = { "" }
     },
     .execute =
     {
         .as_daemon          = CFG_DEFAULT_EXE_ASDAEMON,
         .tmpfs              = CFG_DEFAULT_EXE_TMPFS,
         .interval           = CFG_DEFAULT_EXE_INTERVAL,
+        .pinginterval       = CFG_DEFAULT_EXE_PINGINTERVAL,
         .loglevel           = CFG_DEFAULT_EXE_LOGLEVEL
     },
     .modem =
@@ -61,10 +87,19 @@ config_t cfg =
         .powerupdelay       = CFG_DEFAULT_MODEM_POWERUPDELAY,
         .ip                 = { CFG_DEFAULT_MODEM_IP },
         .pingtimeout        = CFG_DEFAULT_MODEM_PINGTIMEOUT,
+        .collector          = CFG_DEFAULT_MODEM_COLLECTOR,
         .scrubber =
         {
             .filename       = { CFG_DEFAULT_MODEM_SCRUBBER },
             .timeout        = CFG_DEFAULT_MODEM_SCRUBBERTIMEOUT
+        },
+        .snmp =
+        {
+            .community      = { CFG_DEFAULT_MODEM_SNMPCOMMUNITY }
+        },
+        .http =
+        {
+            .path           = { CFG_DEFAULT_MODEM_HTTPPATH }
         }
     },
     .event =
@@ -236,6 +271,20 @@ void cfg_prog_usage()
     fprintf(stderr, "    -testdbwrite Measure SQLite3 write performance.\n");
     fprintf(stderr, "                 Optionally number of samples can be defined;\n");
     fprintf(stderr, "                  \"-testdbwrite=40\"\n");
+    fprintf(stderr, "    -migratedb   Convert database into the compact schema:\n");
+    fprintf(stderr, "                 \"%s\"\n", cfg.database.filename);
+    fprintf(stderr, "    -rebuildrollups Recompute rollup tables of the database (and its\n");
+    fprintf(stderr, "                 partitions) and report buckets that differed.\n");
+    fprintf(stderr, "    -export-sqlite Write the rows of the sample log into the database:\n");
+    fprintf(stderr, "                 \"%s\"\n", cfg.database.filename);
+    fprintf(stderr, "    -export=<from>,<to> Write the samples of the range into stdout.\n");
+    fprintf(stderr, "                 Unix time, YYYY-MM-DD or \"YYYY-MM-DD hh:mm:ss\" (inclusive);\n");
+    fprintf(stderr, "                  \"-export=2016-10-01,2016-10-31 > october.csv\"\n");
+    fprintf(stderr, "                 -exportformat=CSV|JSON|BINARY (default CSV)\n");
+    fprintf(stderr, "                 -exportstep=<seconds> averages rows into buckets\n");
+    fprintf(stderr, "    -importcsv=<file> Import the CSV history of cisco_docsis_logger\n");
+    fprintf(stderr, "                 into the database (existing timestamps are kept);\n");
+    fprintf(stderr, "                  \"-importcsv=/var/log/cisco.csv\"\n");
     fprintf(stderr, "\n");
     fprintf(stderr, "NOTE:  Please make sure the config file is readable to the daemon process,\n");
     fprintf(stderr, "       if you want to be able to update config via config file and\n");
@@ -270,9 +319,27 @@ void cfg_init(config_t *new)
     new->execute.as_daemon      = CFG_DEFAULT_EXE_ASDAEMON;
     new->execute.tmpfs          = CFG_DEFAULT_EXE_TMPFS;
     new->execute.interval       = CFG_DEFAULT_EXE_INTERVAL;
+    new->execute.pinginterval   = CFG_DEFAULT_EXE_PINGINTERVAL;
     new->execute.loglevel       = CFG_DEFAULT_EXE_LOGLEVEL;
     strncpy(new->database.filename, CFG_DEFAULT_FILEDATABASE, sizeof(new->database.filename));
     new->database.tmpfsfilename = NULL;
+    new->database.commitrows    = CFG_DEFAULT_DB_COMMITROWS;
+    new->database.commitinterval= CFG_DEFAULT_DB_COMMITINTERVAL;
+    new->database.backend       = CFG_DEFAULT_DB_BACKEND;
+    new->database.journal       = CFG_DEFAULT_DB_JOURNAL;
+    new->database.synchronous   = CFG_DEFAULT_DB_SYNCHRONOUS;
+    new->database.checkpointinterval = CFG_DEFAULT_DB_CHECKPOINTINTERVAL;
+    new->database.walmaxsize    = CFG_DEFAULT_DB_WALMAXSIZE;
+    new->database.partition     = CFG_DEFAULT_DB_PARTITION;
+    new->database.keeppartitions= CFG_DEFAULT_DB_KEEPPARTITIONS;
+    new->database.retention     = CFG_DEFAULT_DB_RETENTION;
+    new->database.retentionlock = CFG_DEFAULT_DB_RETENTIONLOCK;
+    strncpy(new->database.samplelog, CFG_DEFAULT_DB_SAMPLELOG, sizeof(new->database.samplelog));
+    strncpy(new->database.spool, CFG_DEFAULT_DB_SPOOL, sizeof(new->database.spool));
+    strncpy(new->database.replica, CFG_DEFAULT_DB_REPLICA, sizeof(new->database.replica));
+    new->database.replicainterval = CFG_DEFAULT_DB_REPLICAINTERVAL;
+    new->database.keyframeinterval = CFG_DEFAULT_DB_KEYFRAMEINTERVAL;
+    new->database.changeepsilon = CFG_DEFAULT_DB_CHANGEEPSILON;
     new->inet.pingtimeout       = CFG_DEFAULT_INET_PINGTIMEOUT;
     if (new->inet.pinghosts)
         free(new->inet.pinghosts);
@@ -283,9 +350,19 @@ void cfg_init(config_t *new)
     new->modem.pingtimeout      = CFG_DEFAULT_MODEM_PINGTIMEOUT;
     strncpy(new->modem.scrubber.filename, CFG_DEFAULT_MODEM_SCRUBBER, sizeof(new->modem.scrubber.filename));
     new->modem.scrubber.timeout = CFG_DEFAULT_MODEM_SCRUBBERTIMEOUT;
+    new->modem.collector        = CFG_DEFAULT_MODEM_COLLECTOR;
+    strncpy(new->modem.snmp.community, CFG_DEFAULT_MODEM_SNMPCOMMUNITY, sizeof(new->modem.snmp.community));
+    strncpy(new->modem.http.path, CFG_DEFAULT_MODEM_HTTPPATH, sizeof(new->modem.http.path));
     new->cmd.createdatabase     = false;    // Obviously, no defaults for these two...
     new->cmd.createconfigfile   = false;
     new->cmd.testdbwriteperf    = false;
+    new->cmd.migratedatabase    = false;
+    new->cmd.rebuildrollups     = false;
+    new->cmd.exportsqlite       = false;
+    new->cmd.export             = false;
+    new->cmd.exportformat       = CFG_EXPORT_CSV;
+    new->cmd.exportstep         = 0;
+    new->cmd.importcsv[0]       = '\0';
     new->event.apply_dst        = CFG_DEFAULT_EVENT_APPLYDST;
     // Avoid empty strings, use NULL instead
     if (new->event.liststring)
@@ -505,6 +582,28 @@ int cfg_read_file(config_t *tmpcfg)
                 free(kv);
                 continue;
             }
+// PINGINTERVAL (cfg.execute.pinginterval)
+            else if (keyval_iskey(kv, "pinginterval"))
+            {
+                tmpcfg->execute.pinginterval = atoi(kv[1]);
+                if (tmpcfg->execute.pinginterval &&
+                    (tmpcfg->execute.pinginterval < CFG_MIN_EXE_PINGINTERVAL ||
+                     tmpcfg->execute.pinginterval > CFG_MAX_EXE_INTERVAL))
+                {
+                    logmsg(
+                          LOG_ERR,
+                          "%s(%d): parameter 'pinginterval' (%d) out of bounds [0, %d-%d].",
+                          tmpcfg->filename,
+                          n_line,
+                          tmpcfg->execute.pinginterval,
+                          CFG_MIN_EXE_PINGINTERVAL,
+                          CFG_MAX_EXE_INTERVAL
+                          );
+                    n_errors++;
+                }
+                free(kv);
+                continue;
+            }
 // LOGLEVEL (cfg.execute.loglevel)
             else if (keyval_iskey(kv, "loglevel"))
             {
@@ -569,14 +668,424 @@ int cfg_read_file(config_t *tmpcfg)
                         strcpy(tmpcfg->database.filename, kv[1]);
                     }
                 }
-                else
+                else
+                {
+                    logmsg(
+                          LOG_ERR,
+                          "%s(%d): parameter 'database' is too long [max %d characters].",
+                          tmpcfg->filename,
+                          n_line,
+                          CFG_MAX_FILENAME_LEN
+                          );
+                    n_errors++;
+                }
+                free(kv);
+                continue;
+            }
+// COMMITROWS (cfg.database.commitrows)
+            else if (keyval_iskey(kv, "commitrows"))
+            {
+                tmpcfg->database.commitrows = atoi(kv[1]);
+                if (tmpcfg->database.commitrows < CFG_MIN_DB_COMMITROWS ||
+                    tmpcfg->database.commitrows > CFG_MAX_DB_COMMITROWS)
+                {
+                    logmsg(
+                          LOG_ERR,
+                          "%s(%d): parameter 'commitrows' (%d) out of bounds [%d-%d].",
+                          tmpcfg->filename,
+                          n_line,
+                          tmpcfg->database.commitrows,
+                          CFG_MIN_DB_COMMITROWS,
+                          CFG_MAX_DB_COMMITROWS
+                          );
+                    n_errors++;
+                }
+                free(kv);
+                continue;
+            }
+// COMMITINTERVAL (cfg.database.commitinterval)
+            else if (keyval_iskey(kv, "commitinterval"))
+            {
+                tmpcfg->database.commitinterval = atoi(kv[1]);
+                if (tmpcfg->database.commitinterval < CFG_MIN_DB_COMMITINTERVAL ||
+                    tmpcfg->database.commitinterval > CFG_MAX_DB_COMMITINTERVAL)
+                {
+                    logmsg(
+                          LOG_ERR,
+                          "%s(%d): parameter 'commitinterval' (%d) out of bounds [%d-%d].",
+                          tmpcfg->filename,
+                          n_line,
+                          tmpcfg->database.commitinterval,
+                          CFG_MIN_DB_COMMITINTERVAL,
+                          CFG_MAX_DB_COMMITINTERVAL
+                          );
+                    n_errors++;
+                }
+                free(kv);
+                continue;
+            }
+// BACKEND (cfg.database.backend)
+            else if (keyval_iskey(kv, "backend"))
+            {
+                if (eqlstrnocase(kv[1], "SQLITE"))
+                {
+                    tmpcfg->database.backend = CFG_BACKEND_SQLITE;
+                }
+                else if (eqlstrnocase(kv[1], "MEMORY"))
+                {
+                    tmpcfg->database.backend = CFG_BACKEND_MEMORY;
+                }
+                else
+                {
+                    logmsg(
+                          LOG_INFO,
+                          "%s(%d): parameter for key 'backend' (\"%s\") unrecognized [SQLITE|MEMORY].",
+                          tmpcfg->filename,
+                          n_line,
+                          kv[1]
+                          );
+                    n_errors++;
+                }
+                free(kv);
+                continue;
+            }
+// JOURNAL (cfg.database.journal)
+            else if (keyval_iskey(kv, "journal"))
+            {
+                if (eqlstrnocase(kv[1], "DELETE"))
+                {
+                    tmpcfg->database.journal = CFG_JOURNAL_DELETE;
+                }
+                else if (eqlstrnocase(kv[1], "WAL"))
+                {
+                    tmpcfg->database.journal = CFG_JOURNAL_WAL;
+                }
+                else
+                {
+                    logmsg(
+                          LOG_INFO,
+                          "%s(%d): parameter for key 'journal' (\"%s\") unrecognized [DELETE|WAL].",
+                          tmpcfg->filename,
+                          n_line,
+                          kv[1]
+                          );
+                    n_errors++;
+                }
+                free(kv);
+                continue;
+            }
+// SYNCHRONOUS (cfg.database.synchronous)
+            else if (keyval_iskey(kv, "synchronous"))
+            {
+                if (eqlstrnocase(kv[1], "AUTO"))
+                {
+                    tmpcfg->database.synchronous = CFG_SYNCHRONOUS_AUTO;
+                }
+                else if (eqlstrnocase(kv[1], "OFF"))
+                {
+                    tmpcfg->database.synchronous = CFG_SYNCHRONOUS_OFF;
+                }
+                else if (eqlstrnocase(kv[1], "NORMAL"))
+                {
+                    tmpcfg->database.synchronous = CFG_SYNCHRONOUS_NORMAL;
+                }
+                else if (eqlstrnocase(kv[1], "FULL"))
+                {
+                    tmpcfg->database.synchronous = CFG_SYNCHRONOUS_FULL;
+                }
+                else
+                {
+                    logmsg(
+                          LOG_INFO,
+                          "%s(%d): parameter for key 'synchronous' (\"%s\") unrecognized [AUTO|OFF|NORMAL|FULL].",
+                          tmpcfg->filename,
+                          n_line,
+                          kv[1]
+                          );
+                    n_errors++;
+                }
+                free(kv);
+                continue;
+            }
+// CHECKPOINTINTERVAL (cfg.database.checkpointinterval)
+            else if (keyval_iskey(kv, "checkpointinterval"))
+            {
+                tmpcfg->database.checkpointinterval = atoi(kv[1]);
+                if (tmpcfg->database.checkpointinterval &&
+                    (tmpcfg->database.checkpointinterval < CFG_MIN_DB_CHECKPOINTINTERVAL ||
+                     tmpcfg->database.checkpointinterval > CFG_MAX_DB_CHECKPOINTINTERVAL))
+                {
+                    logmsg(
+                          LOG_ERR,
+                          "%s(%d): parameter 'checkpointinterval' (%d) out of bounds [0, %d-%d].",
+                          tmpcfg->filename,
+                          n_line,
+                          tmpcfg->database.checkpointinterval,
+                          CFG_MIN_DB_CHECKPOINTINTERVAL,
+                          CFG_MAX_DB_CHECKPOINTINTERVAL
+                          );
+                    n_errors++;
+                }
+                free(kv);
+                continue;
+            }
+// WALMAXSIZE (cfg.database.walmaxsize)
+            else if (keyval_iskey(kv, "walmaxsize"))
+            {
+                tmpcfg->database.walmaxsize = atoi(kv[1]);
+                if (tmpcfg->database.walmaxsize < CFG_MIN_DB_WALMAXSIZE ||
+                    tmpcfg->database.walmaxsize > CFG_MAX_DB_WALMAXSIZE)
+                {
+                    logmsg(
+                          LOG_ERR,
+                          "%s(%d): parameter 'walmaxsize' (%d) out of bounds [%d-%d].",
+                          tmpcfg->filename,
+                          n_line,
+                          tmpcfg->database.walmaxsize,
+                          CFG_MIN_DB_WALMAXSIZE,
+                          CFG_MAX_DB_WALMAXSIZE
+                          );
+                    n_errors++;
+                }
+                free(kv);
+                continue;
+            }
+// RETENTION (cfg.database.retention)
+            else if (keyval_iskey(kv, "retention"))
+            {
+                tmpcfg->database.retention = atoi(kv[1]);
+                if (tmpcfg->database.retention < 0 ||
+                    tmpcfg->database.retention > CFG_MAX_DB_RETENTION)
+                {
+                    logmsg(
+                          LOG_ERR,
+                          "%s(%d): parameter 'retention' (%d) out of bounds [0-%d].",
+                          tmpcfg->filename,
+                          n_line,
+                          tmpcfg->database.retention,
+                          CFG_MAX_DB_RETENTION
+                          );
+                    n_errors++;
+                }
+                free(kv);
+                continue;
+            }
+// RETENTIONLOCK (cfg.database.retentionlock)
+            else if (keyval_iskey(kv, "retentionlock"))
+            {
+                tmpcfg->database.retentionlock = atoi(kv[1]);
+                if (tmpcfg->database.retentionlock < CFG_MIN_DB_RETENTIONLOCK ||
+                    tmpcfg->database.retentionlock > CFG_MAX_DB_RETENTIONLOCK)
+                {
+                    logmsg(
+                          LOG_ERR,
+                          "%s(%d): parameter 'retentionlock' (%d) out of bounds [%d-%d].",
+                          tmpcfg->filename,
+                          n_line,
+                          tmpcfg->database.retentionlock,
+                          CFG_MIN_DB_RETENTIONLOCK,
+                          CFG_MAX_DB_RETENTIONLOCK
+                          );
+                    n_errors++;
+                }
+                free(kv);
+                continue;
+            }
+// PARTITION (cfg.database.partition)
+            else if (keyval_iskey(kv, "partition"))
+            {
+                if (eqlstrnocase(kv[1], "NONE"))
+                {
+                    tmpcfg->database.partition = CFG_PARTITION_NONE;
+                }
+                else if (eqlstrnocase(kv[1], "DAY"))
+                {
+                    tmpcfg->database.partition = CFG_PARTITION_DAY;
+                }
+                else if (eqlstrnocase(kv[1], "MONTH"))
+                {
+                    tmpcfg->database.partition = CFG_PARTITION_MONTH;
+                }
+                else if (eqlstrnocase(kv[1], "YEAR"))
+                {
+                    tmpcfg->database.partition = CFG_PARTITION_YEAR;
+                }
+                else
+                {
+                    logmsg(
+                          LOG_INFO,
+                          "%s(%d): parameter for key 'partition' (\"%s\") unrecognized [NONE|DAY|MONTH|YEAR].",
+                          tmpcfg->filename,
+                          n_line,
+                          kv[1]
+                          );
+                    n_errors++;
+                }
+                free(kv);
+                continue;
+            }
+// SAMPLELOG (cfg.database.samplelog)
+            else if (keyval_iskey(kv, "samplelog"))
+            {
+                keyval_remove_empty_values(kv);
+                if (!keyval_nvalues(kv))
+                {
+                    // No value, samples are written into the datafile
+                    tmpcfg->database.samplelog[0] = '\0';
+                }
+                else if (keyval_nvalues(kv) == 1 && kv[1][0] == '/' && strlen(kv[1]) <= CFG_MAX_FILENAME_LEN)
+                {
+                    strcpy(tmpcfg->database.samplelog, kv[1]);
+                }
+                else
+                {
+                    logmsg(
+                          LOG_ERR,
+                          "%s(%d): parameter 'samplelog' malformed [absolute path, max %d characters]. (\"%s\")",
+                          tmpcfg->filename,
+                          n_line,
+                          CFG_MAX_FILENAME_LEN,
+                          kv[1]
+                          );
+                    n_errors++;
+                }
+                free(kv);
+                continue;
+            }
+// SPOOL (cfg.database.spool)
+            else if (keyval_iskey(kv, "spool"))
+            {
+                keyval_remove_empty_values(kv);
+                if (!keyval_nvalues(kv))
+                {
+                    // No value, workers send their rows to the daemon
+                    tmpcfg->database.spool[0] = '\0';
+                }
+                else if (keyval_nvalues(kv) == 1 && kv[1][0] == '/' && strlen(kv[1]) <= CFG_MAX_FILENAME_LEN)
+                {
+                    strcpy(tmpcfg->database.spool, kv[1]);
+                }
+                else
+                {
+                    logmsg(
+                          LOG_ERR,
+                          "%s(%d): parameter 'spool' malformed [absolute path, max %d characters]. (\"%s\")",
+                          tmpcfg->filename,
+                          n_line,
+                          CFG_MAX_FILENAME_LEN,
+                          kv[1]
+                          );
+                    n_errors++;
+                }
+                free(kv);
+                continue;
+            }
+// REPLICA (cfg.database.replica)
+            else if (keyval_iskey(kv, "replica"))
+            {
+                keyval_remove_empty_values(kv);
+                if (!keyval_nvalues(kv))
+                {
+                    // No value, no replica
+                    tmpcfg->database.replica[0] = '\0';
+                }
+                else if (keyval_nvalues(kv) == 1 && kv[1][0] == '/' &&
+                         strlen(kv[1]) + strlen(DATABASE_REPLICA_SUFFIX) <= CFG_MAX_FILENAME_LEN)
+                {
+                    strcpy(tmpcfg->database.replica, kv[1]);
+                }
+                else
+                {
+                    logmsg(
+                          LOG_ERR,
+                          "%s(%d): parameter 'replica' malformed [absolute path, max %d characters]. (\"%s\")",
+                          tmpcfg->filename,
+                          n_line,
+                          CFG_MAX_FILENAME_LEN - (int)strlen(DATABASE_REPLICA_SUFFIX),
+                          kv[1]
+                          );
+                    n_errors++;
+                }
+                free(kv);
+                continue;
+            }
+// REPLICAINTERVAL (cfg.database.replicainterval)
+            else if (keyval_iskey(kv, "replicainterval"))
+            {
+                tmpcfg->database.replicainterval = atoi(kv[1]);
+                if (tmpcfg->database.replicainterval < CFG_MIN_DB_REPLICAINTERVAL ||
+                    tmpcfg->database.replicainterval > CFG_MAX_DB_REPLICAINTERVAL)
+                {
+                    logmsg(
+                          LOG_ERR,
+                          "%s(%d): parameter 'replicainterval' (%d) out of bounds [%d-%d].",
+                          tmpcfg->filename,
+                          n_line,
+                          tmpcfg->database.replicainterval,
+                          CFG_MIN_DB_REPLICAINTERVAL,
+                          CFG_MAX_DB_REPLICAINTERVAL
+                          );
+                    n_errors++;
+                }
+                free(kv);
+                continue;
+            }
+// KEYFRAMEINTERVAL (cfg.database.keyframeinterval)
+            else if (keyval_iskey(kv, "keyframeinterval"))
+            {
+                tmpcfg->database.keyframeinterval = atoi(kv[1]);
+                if (tmpcfg->database.keyframeinterval &&
+                    (tmpcfg->database.keyframeinterval < CFG_MIN_DB_KEYFRAMEINTERVAL ||
+                     tmpcfg->database.keyframeinterval > CFG_MAX_DB_KEYFRAMEINTERVAL))
+                {
+                    logmsg(
+                          LOG_ERR,
+                          "%s(%d): parameter 'keyframeinterval' (%d) out of bounds [0, %d-%d].",
+                          tmpcfg->filename,
+                          n_line,
+                          tmpcfg->database.keyframeinterval,
+                          CFG_MIN_DB_KEYFRAMEINTERVAL,
+                          CFG_MAX_DB_KEYFRAMEINTERVAL
+                          );
+                    n_errors++;
+                }
+                free(kv);
+                continue;
+            }
+// CHANGEEPSILON (cfg.database.changeepsilon)
+            else if (keyval_iskey(kv, "changeepsilon"))
+            {
+                tmpcfg->database.changeepsilon = atoi(kv[1]);
+                if (tmpcfg->database.changeepsilon < 0 ||
+                    tmpcfg->database.changeepsilon > CFG_MAX_DB_CHANGEEPSILON)
+                {
+                    logmsg(
+                          LOG_ERR,
+                          "%s(%d): parameter 'changeepsilon' (%d) out of bounds [0-%d].",
+                          tmpcfg->filename,
+                          n_line,
+                          tmpcfg->database.changeepsilon,
+                          CFG_MAX_DB_CHANGEEPSILON
+                          );
+                    n_errors++;
+                }
+                free(kv);
+                continue;
+            }
+// KEEPPARTITIONS (cfg.database.keeppartitions)
+            else if (keyval_iskey(kv, "keeppartitions"))
+            {
+                tmpcfg->database.keeppartitions = atoi(kv[1]);
+                if (tmpcfg->database.keeppartitions < 0 ||
+                    tmpcfg->database.keeppartitions > CFG_MAX_DB_KEEPPARTITIONS)
                 {
                     logmsg(
                           LOG_ERR,
-                          "%s(%d): parameter 'database' is too long [max %d characters].",
+                          "%s(%d): parameter 'keeppartitions' (%d) out of bounds [0-%d].",
                           tmpcfg->filename,
                           n_line,
-                          CFG_MAX_FILENAME_LEN
+                          tmpcfg->database.keeppartitions,
+                          CFG_MAX_DB_KEEPPARTITIONS
                           );
                     n_errors++;
                 }
@@ -826,6 +1335,79 @@ int cfg_read_file(config_t *tmpcfg)
                 free(kv);
                 continue;
             }
+// MODEM COLLECTOR (cfg.modem.collector)
+            else if (keyval_iskey(kv, "modem collector"))
+            {
+                if (eqlstrnocase(kv[1], "SCRUBBER"))
+                {
+                    tmpcfg->modem.collector = CFG_COLLECTOR_SCRUBBER;
+                }
+                else if (eqlstrnocase(kv[1], "SNMP"))
+                {
+                    tmpcfg->modem.collector = CFG_COLLECTOR_SNMP;
+                }
+                else if (eqlstrnocase(kv[1], "HTTP"))
+                {
+                    tmpcfg->modem.collector = CFG_COLLECTOR_HTTP;
+                }
+                else
+                {
+                    logmsg(
+                          LOG_INFO,
+                          "%s(%d): parameter for key 'modem collector' (\"%s\") unrecognized [SCRUBBER|SNMP|HTTP].",
+                          tmpcfg->filename,
+                          n_line,
+                          kv[1]
+                          );
+                    n_errors++;
+                }
+                free(kv);
+                continue;
+            }
+// MODEM SNMPCOMMUNITY (cfg.modem.snmp.community)
+            else if (keyval_iskey(kv, "modem snmpcommunity"))
+            {
+                if (keyval_nvalues(kv) == 1 && strlen(kv[1]) && strlen(kv[1]) <= CFG_MAX_SNMPCOMMUNITY_LEN)
+                {
+                    snprintf(tmpcfg->modem.snmp.community, sizeof(tmpcfg->modem.snmp.community), "%s", kv[1]);
+                }
+                else
+                {
+                    logmsg(
+                          LOG_INFO,
+                          "%s(%d): parameter 'modem snmpcommunity' malformed [1-%d characters]. (\"%s\")",
+                          tmpcfg->filename,
+                          n_line,
+                          CFG_MAX_SNMPCOMMUNITY_LEN,
+                          kv[1]
+                          );
+                    n_errors++;
+                }
+                free(kv);
+                continue;
+            }
+// MODEM HTTPPATH (cfg.modem.http.path)
+            else if (keyval_iskey(kv, "modem httppath"))
+            {
+                if (keyval_nvalues(kv) == 1 && kv[1][0] == '/' && strlen(kv[1]) <= CFG_MAX_HTTPPATH_LEN)
+                {
+                    snprintf(tmpcfg->modem.http.path, sizeof(tmpcfg->modem.http.path), "%s", kv[1]);
+                }
+                else
+                {
+                    logmsg(
+                          LOG_INFO,
+                          "%s(%d): parameter 'modem httppath' malformed [absolute path, max %d characters]. (\"%s\")",
+                          tmpcfg->filename,
+                          n_line,
+                          CFG_MAX_HTTPPATH_LEN,
+                          kv[1]
+                          );
+                    n_errors++;
+                }
+                free(kv);
+                continue;
+            }
 // SCHEDULE APPLYDST (cfg.event.apply_dst)
             if (keyval_iskey(kv, "schedule dst"))
             {
@@ -929,6 +1511,37 @@ int cfg_read_file(config_t *tmpcfg)
 }
 
 
+/*
+ * Export range limit: Unix time, YYYY-MM-DD or YYYY-MM-DD hh:mm:ss (local
+ * time). Date of the end of the range includes the whole day.
+ * Returns -1 if malformed.
+ */
+static time_t cfg_exporttime(const char *str, int end)
+{
+    struct tm   tm;
+    char       *rest;
+    long long   t;
+
+    t = strtoll(str, &rest, 10);
+    if (*str && !*rest)
+        return t < 0 ? -1 : (time_t)t;
+    memset(&tm, 0, sizeof(tm));
+    if ((rest = strptime(str, "%Y-%m-%d", &tm)) && !*rest)
+    {
+        if (end)
+        {
+            tm.tm_hour = 23;
+            tm.tm_min  = 59;
+            tm.tm_sec  = 59;
+        }
+    }
+    else if (!(rest = strptime(str, "%Y-%m-%d %H:%M:%S", &tm)) || *rest)
+        return -1;
+    tm.tm_isdst = -1;
+    return mktime(&tm);
+}
+
+
 /*
  * cfg_read_argv()
  *
@@ -1163,6 +1776,135 @@ int cfg_read_argv(config_t *tmpcfg, /*int argc,*/ char **argv)
                 tmpcfg->cmd.testdbwriteperf = 6;
             free(kv);
         }
+        /*
+         * -migratedb
+         */
+        else if (isopt("-migratedb"))
+        {
+            //
+            // Special command that converts the database into the
+            // compact schema and exits.
+            //
+            tmpcfg->cmd.migratedatabase = true;
+            free(kv);
+        }
+        /*
+         * -rebuildrollups
+         */
+        else if (isopt("-rebuildrollups"))
+        {
+            //
+            // Special command that recomputes the rollup tables
+            // and exits.
+            //
+            tmpcfg->cmd.rebuildrollups = true;
+            free(kv);
+        }
+        /*
+         * -export-sqlite
+         */
+        else if (isopt("-export-sqlite"))
+        {
+            //
+            // Special command that converts the sample log
+            // into the datafile and exits.
+            //
+            tmpcfg->cmd.exportsqlite = true;
+            free(kv);
+        }
+        /*
+         * -exportformat=<CSV|JSON|BINARY>
+         */
+        else if (isopt("-exportformat="))
+        {
+            if (keyval_nvalues(kv) == 1 && eqlstrnocase(kv[1], "CSV"))
+                tmpcfg->cmd.exportformat = CFG_EXPORT_CSV;
+            else if (keyval_nvalues(kv) == 1 && eqlstrnocase(kv[1], "JSON"))
+                tmpcfg->cmd.exportformat = CFG_EXPORT_JSON;
+            else if (keyval_nvalues(kv) == 1 && eqlstrnocase(kv[1], "BINARY"))
+                tmpcfg->cmd.exportformat = CFG_EXPORT_BINARY;
+            else
+            {
+                logmsg(
+                      LOG_ERR,
+                      "%s: parameter unrecognized [CSV|JSON|BINARY] -- '%s'\n",
+                      DAEMON_NAME,
+                      argv[argvidx]
+                      );
+                n_errors++;
+            }
+            free(kv);
+        }
+        /*
+         * -exportstep=<seconds>
+         */
+        else if (isopt("-exportstep="))
+        {
+            tmpcfg->cmd.exportstep = keyval_nvalues(kv) == 1 ? atoi(kv[1]) : -1;
+            if (tmpcfg->cmd.exportstep < 0 ||
+                tmpcfg->cmd.exportstep > CFG_MAX_EXPORT_STEP)
+            {
+                logmsg(
+                      LOG_ERR,
+                      "%s: parameter out of bounds -- '%s'\n",
+                      DAEMON_NAME,
+                      argv[argvidx]
+                      );
+                n_errors++;
+            }
+            free(kv);
+        }
+        /*
+         * -importcsv=<filepath string>
+         */
+        else if (isopt("-importcsv="))
+        {
+            //
+            // Special command that imports cisco_docsis_logger
+            // history into the datafile and exits.
+            //
+            if (strlen(argv[argvidx] + sizeof("-importcsv=") - 1) > CFG_MAX_FILENAME_LEN ||
+                !argv[argvidx][sizeof("-importcsv=") - 1])
+            {
+                logmsg(
+                      LOG_ERR,
+                      "%s: parameter malformed [max %d characters] -- '%s'\n",
+                      DAEMON_NAME,
+                      CFG_MAX_FILENAME_LEN,
+                      argv[argvidx]
+                      );
+                n_errors++;
+            }
+            else
+                strcpy(tmpcfg->cmd.importcsv, argv[argvidx] + sizeof("-importcsv=") - 1);
+            free(kv);
+        }
+        /*
+         * -export=<from>,<to>
+         */
+        else if (isopt("-export="))
+        {
+            //
+            // Special command that writes the samples of a time
+            // range into stdout and exits.
+            //
+            if (keyval_nvalues(kv) != 2 ||
+                (tmpcfg->cmd.exportfrom = cfg_exporttime(kv[1], false)) < 0 ||
+                (tmpcfg->cmd.exportto   = cfg_exporttime(kv[2], true)) < 0 ||
+                tmpcfg->cmd.exportfrom > tmpcfg->cmd.exportto)
+            {
+                logmsg(
+                      LOG_ERR,
+                      "%s: parameter malformed [<from>,<to>] -- '%s'\n",
+                      DAEMON_NAME,
+                      argv[argvidx]
+                      );
+                n_errors++;
+            }
+            else
+                tmpcfg->cmd.export = true;
+            free(kv);
+        }
         else
         {
             logmsg(
@@ -1315,44 +2057,76 @@ int cfg_check(config_t *config)
     /*
      * Check existance and access of scrubber script
      *
+     *      Built-in collectors do not need the script.
      */
-    if (!file_exist(config->modem.scrubber.filename))
-    {
-        logmsg(
-              LOG_ERR,
-              "scrubber file \"%s\" does not exist.",
-              config->modem.scrubber.filename
-              );
-        return (errno = ENOENT, EXIT_FAILURE);
-    }
-    if(!file_useraccess(config->modem.scrubber.filename, executing_username, X_OK))
+    if (config->modem.collector == CFG_COLLECTOR_SCRUBBER)
     {
-        logmsg(
-              LOG_ERR,
-              "user '%s' does not have execute rights to scrubber file \"%s\".",
-              executing_username,
-              config->modem.scrubber.filename
-              );
-        logmsg(LOG_ERR, "No data can be retrieved from modem.");
-        return (errno = EACCES, EXIT_FAILURE);
+        if (!file_exist(config->modem.scrubber.filename))
+        {
+            logmsg(
+                  LOG_ERR,
+                  "scrubber file \"%s\" does not exist.",
+                  config->modem.scrubber.filename
+                  );
+            return (errno = ENOENT, EXIT_FAILURE);
+        }
+        if(!file_useraccess(config->modem.scrubber.filename, executing_username, X_OK))
+        {
+            logmsg(
+                  LOG_ERR,
+                  "user '%s' does not have execute rights to scrubber file \"%s\".",
+                  executing_username,
+                  config->modem.scrubber.filename
+                  );
+            logmsg(LOG_ERR, "No data can be retrieved from modem.");
+            return (errno = EACCES, EXIT_FAILURE);
+        }
+        // Update scrubber.filename with real path.
+        // Use duplicated buffer because both arguments
+        // cannot be the same string.
+        tmp = strdup(config->modem.scrubber.filename);
+        if (!realpath(tmp, config->modem.scrubber.filename))
+        {
+            // NULL returned, error occured
+            int savederrno = errno;
+            logmsg(
+                  LOG_ERR,
+                  "Could not resolve real path to \"%s\".",
+                  config->modem.scrubber.filename
+                  );
+            free(tmp);
+            return (errno = savederrno, EXIT_FAILURE);
+        }
+        free(tmp);
     }
-    // Update scrubber.filename with real path.
-    // Use duplicated buffer because both arguments
-    // cannot be the same string.
-    tmp = strdup(config->modem.scrubber.filename);
-    if (!realpath(tmp, config->modem.scrubber.filename))
+
+    /*
+     * Separate ping and line data jobs
+     *
+     *      Both jobs are aligned to multiples of their interval (from epoch)
+     *      and rows are joined by their timestamp. Only if line data interval
+     *      is a multiple of the ping interval, every line data row will have
+     *      ping row to join with. A ping that cannot complete before the next
+     *      one is due will cause ticks to be skipped.
+     */
+    if (config->execute.pinginterval)
     {
-        // NULL returned, error occured
-        int savederrno = errno;
-        logmsg(
-              LOG_ERR,
-              "Could not resolve real path to \"%s\".",
-              config->modem.scrubber.filename
-              );
-        free(tmp);
-        return (errno = savederrno, EXIT_FAILURE);
+        if (config->execute.interval % config->execute.pinginterval)
+            logmsg(
+                  LOG_INFO,
+                  "interval (%d) is not a multiple of pinginterval (%d). Not all line data rows will have matching ping rows.",
+                  config->execute.interval,
+                  config->execute.pinginterval
+                  );
+        if ((config->modem.pingtimeout > config->inet.pingtimeout ?
+             config->modem.pingtimeout : config->inet.pingtimeout) + DAEMON_JOB_GRACETIME >
+            config->execute.pinginterval * 1000)
+            logmsg(
+                  LOG_INFO,
+                  "ping timeouts exceed pinginterval (%d s). Some ping ticks may be skipped.",
+                  config->execute.pinginterval
+                  );
     }
-    free(tmp);
 
     //
     // CHECK SCHEDULED EVENTS
@@ -1432,6 +2206,15 @@ int cfg_writefile(const char *cfgfilename)
     fprintf(cfgfile, "interval = %d\n", cfg.execute.interval);
     fprintf(cfgfile, "\n");
 
+    fprintf(cfgfile, "# [pinginterval] ICMP probing interval, when pings are a separate job\n");
+    fprintf(cfgfile, "# NOTE: 0 pings once per [interval] along with the line data.\n");
+    fprintf(cfgfile, "#       Otherwise pings and line data are scheduled as independent jobs\n");
+    fprintf(cfgfile, "#       and [interval] is the line data collection interval.\n");
+    fprintf(cfgfile, "# VALUES  : 0, %d - %d\n", CFG_MIN_EXE_PINGINTERVAL, CFG_MAX_EXE_INTERVAL);
+    fprintf(cfgfile, "# DEFAULT : %d\n", CFG_DEFAULT_EXE_PINGINTERVAL);
+    fprintf(cfgfile, "pinginterval = %d\n", cfg.execute.pinginterval);
+    fprintf(cfgfile, "\n");
+
     fprintf(cfgfile, "# [loglevel] Defines the priority for a message to get logged\n");
     fprintf(cfgfile, "# NOTE: Does NOT affect monitoring data, only the messages from monitoring software itself.\n");
     fprintf(cfgfile, "# VALUES  : LOG_ERR , LOG_INFO or LOG_DEBUG\n");
@@ -1446,6 +2229,134 @@ int cfg_writefile(const char *cfgfilename)
     fprintf(cfgfile, "database = %s\n", cfg.database.filename);
     fprintf(cfgfile, "\n");
 
+    fprintf(cfgfile, "# [commitrows] rows written into the database in one transaction\n");
+    fprintf(cfgfile, "# NOTE: Each transaction costs a journal sync. 1 commits every row.\n");
+    fprintf(cfgfile, "# VALUES  : %d - %d\n", CFG_MIN_DB_COMMITROWS, CFG_MAX_DB_COMMITROWS);
+    fprintf(cfgfile, "# DEFAULT : %d\n", CFG_DEFAULT_DB_COMMITROWS);
+    fprintf(cfgfile, "commitrows = %d\n", cfg.database.commitrows);
+    fprintf(cfgfile, "\n");
+
+    fprintf(cfgfile, "# [commitinterval] seconds before uncommitted rows are committed anyway\n");
+    fprintf(cfgfile, "# NOTE: This is the maximum data loss on power failure.\n");
+    fprintf(cfgfile, "# VALUES  : %d - %d\n", CFG_MIN_DB_COMMITINTERVAL, CFG_MAX_DB_COMMITINTERVAL);
+    fprintf(cfgfile, "# DEFAULT : %d\n", CFG_DEFAULT_DB_COMMITINTERVAL);
+    fprintf(cfgfile, "commitinterval = %d\n", cfg.database.commitinterval);
+    fprintf(cfgfile, "\n");
+
+    fprintf(cfgfile, "# [backend] storage engine of the rows (storage.h)\n");
+    fprintf(cfgfile, "# NOTE: MEMORY keeps nothing. It measures the collection without storage\n");
+    fprintf(cfgfile, "#       and is compared against SQLITE by -testdbwriteperf.\n");
+    fprintf(cfgfile, "# VALUES  : SQLITE or MEMORY\n");
+    fprintf(cfgfile, "# DEFAULT : %s\n", CFG_BACKEND_NAME(CFG_DEFAULT_DB_BACKEND));
+    fprintf(cfgfile, "backend = %s\n", CFG_BACKEND_NAME(cfg.database.backend));
+    fprintf(cfgfile, "\n");
+
+    fprintf(cfgfile, "# [journal] SQLite3 journal mode\n");
+    fprintf(cfgfile, "# NOTE: WAL lets reports read the database without blocking the writer.\n");
+    fprintf(cfgfile, "# VALUES  : DELETE or WAL\n");
+    fprintf(cfgfile, "# DEFAULT : %s\n", CFG_JOURNAL_NAME(CFG_DEFAULT_DB_JOURNAL));
+    fprintf(cfgfile, "journal = %s\n", CFG_JOURNAL_NAME(cfg.database.journal));
+    fprintf(cfgfile, "\n");
+
+    fprintf(cfgfile, "# [synchronous] SQLite3 sync policy\n");
+    fprintf(cfgfile, "# NOTE: AUTO is NORMAL with WAL journal and FULL otherwise.\n");
+    fprintf(cfgfile, "# VALUES  : AUTO, OFF, NORMAL or FULL\n");
+    fprintf(cfgfile, "# DEFAULT : %s\n", CFG_SYNCHRONOUS_NAME(CFG_DEFAULT_DB_SYNCHRONOUS));
+    fprintf(cfgfile, "synchronous = %s\n", CFG_SYNCHRONOUS_NAME(cfg.database.synchronous));
+    fprintf(cfgfile, "\n");
+
+    fprintf(cfgfile, "# [checkpointinterval] seconds between scheduled WAL checkpoints\n");
+    fprintf(cfgfile, "# NOTE: Only with WAL journal. 0 leaves checkpoints to SQLite3.\n");
+    fprintf(cfgfile, "# VALUES  : 0, %d - %d\n", CFG_MIN_DB_CHECKPOINTINTERVAL, CFG_MAX_DB_CHECKPOINTINTERVAL);
+    fprintf(cfgfile, "# DEFAULT : %d\n", CFG_DEFAULT_DB_CHECKPOINTINTERVAL);
+    fprintf(cfgfile, "checkpointinterval = %d\n", cfg.database.checkpointinterval);
+    fprintf(cfgfile, "\n");
+
+    fprintf(cfgfile, "# [walmaxsize] kilobytes the WAL file may grow before it is checkpointed\n");
+    fprintf(cfgfile, "# NOTE: Checked after each commit, regardless of the checkpoint schedule.\n");
+    fprintf(cfgfile, "# VALUES  : %d - %d\n", CFG_MIN_DB_WALMAXSIZE, CFG_MAX_DB_WALMAXSIZE);
+    fprintf(cfgfile, "# DEFAULT : %d\n", CFG_DEFAULT_DB_WALMAXSIZE);
+    fprintf(cfgfile, "walmaxsize = %d\n", cfg.database.walmaxsize);
+    fprintf(cfgfile, "\n");
+
+    fprintf(cfgfile, "# [retention] days of raw data kept, older rows are deleted (rollups are kept)\n");
+    fprintf(cfgfile, "# NOTE: Deleted in small chunks every %d seconds, freed pages are returned\n", DAEMON_RETENTION_INTERVAL);
+    fprintf(cfgfile, "#       with incremental_vacuum. Requires the compact schema (-migratedb).\n");
+    fprintf(cfgfile, "# VALUES  : 0 (keep all), 1 - %d\n", CFG_MAX_DB_RETENTION);
+    fprintf(cfgfile, "# DEFAULT : %d\n", CFG_DEFAULT_DB_RETENTION);
+    fprintf(cfgfile, "retention = %d\n", cfg.database.retention);
+    fprintf(cfgfile, "\n");
+
+    fprintf(cfgfile, "# [retentionlock] milliseconds a retention chunk may hold the write lock\n");
+    fprintf(cfgfile, "# VALUES  : %d - %d\n", CFG_MIN_DB_RETENTIONLOCK, CFG_MAX_DB_RETENTIONLOCK);
+    fprintf(cfgfile, "# DEFAULT : %d\n", CFG_DEFAULT_DB_RETENTIONLOCK);
+    fprintf(cfgfile, "retentionlock = %d\n", cfg.database.retentionlock);
+    fprintf(cfgfile, "\n");
+
+    fprintf(cfgfile, "# [samplelog] append-only columnar log for the samples, instead of [database]\n");
+    fprintf(cfgfile, "# NOTE: Sequential appends only, compressed to a few bytes per row. Meant for\n");
+    fprintf(cfgfile, "#       SD cards. Counters and reboots are still written into [database].\n");
+    fprintf(cfgfile, "#       Command -export-sqlite writes the samples into [database].\n");
+    fprintf(cfgfile, "# VALUES  : absolute path, or empty (samples into [database])\n");
+    fprintf(cfgfile, "# DEFAULT : %s\n", CFG_DEFAULT_DB_SAMPLELOG);
+    fprintf(cfgfile, "samplelog = %s\n", cfg.database.samplelog);
+    fprintf(cfgfile, "\n");
+
+    fprintf(cfgfile, "# [spool] crash-safe append spool for the rows of the workers\n");
+    fprintf(cfgfile, "# NOTE: Workers append checksummed records, daemon syncs the spool every\n");
+    fprintf(cfgfile, "#       [commitinterval] and loads it into [database] in large transactions.\n");
+    fprintf(cfgfile, "#       Records left by a crash are loaded on the next start. Replaces the\n");
+    fprintf(cfgfile, "#       [ramdisk] (AUTO creates the spool next to [database] instead).\n");
+    fprintf(cfgfile, "# VALUES  : absolute path, or empty (rows are sent to the daemon)\n");
+    fprintf(cfgfile, "# DEFAULT : %s\n", CFG_DEFAULT_DB_SPOOL);
+    fprintf(cfgfile, "spool = %s\n", cfg.database.spool);
+    fprintf(cfgfile, "\n");
+
+    fprintf(cfgfile, "# [replica] read-only copy of [database] for reports\n");
+    fprintf(cfgfile, "# NOTE: Refreshed every [replicainterval] with the SQLite3 online backup, a\n");
+    fprintf(cfgfile, "#       few pages at a time. New copy is renamed over the previous one.\n");
+    fprintf(cfgfile, "#       With partitions, the current partition is replicated.\n");
+    fprintf(cfgfile, "# VALUES  : absolute path, or empty (no replica)\n");
+    fprintf(cfgfile, "# DEFAULT : %s\n", CFG_DEFAULT_DB_REPLICA);
+    fprintf(cfgfile, "replica = %s\n", cfg.database.replica);
+    fprintf(cfgfile, "\n");
+
+    fprintf(cfgfile, "# [replicainterval] seconds between replica refreshes\n");
+    fprintf(cfgfile, "# VALUES  : %d - %d\n", CFG_MIN_DB_REPLICAINTERVAL, CFG_MAX_DB_REPLICAINTERVAL);
+    fprintf(cfgfile, "# DEFAULT : %d\n", CFG_DEFAULT_DB_REPLICAINTERVAL);
+    fprintf(cfgfile, "replicainterval = %d\n", cfg.database.replicainterval);
+    fprintf(cfgfile, "\n");
+
+    fprintf(cfgfile, "# [keyframeinterval] seconds between rows that store every line value\n");
+    fprintf(cfgfile, "# NOTE: Change-only storage. In between, a channel power or SNR within\n");
+    fprintf(cfgfile, "#       [changeepsilon] of its stored value is not stored again; the data\n");
+    fprintf(cfgfile, "#       view carries the stored value forward. Pings are stored every row.\n");
+    fprintf(cfgfile, "#       Requires the compact schema (-migratedb).\n");
+    fprintf(cfgfile, "# VALUES  : 0 (store every value), %d - %d\n", CFG_MIN_DB_KEYFRAMEINTERVAL, CFG_MAX_DB_KEYFRAMEINTERVAL);
+    fprintf(cfgfile, "# DEFAULT : %d\n", CFG_DEFAULT_DB_KEYFRAMEINTERVAL);
+    fprintf(cfgfile, "keyframeinterval = %d\n", cfg.database.keyframeinterval);
+    fprintf(cfgfile, "\n");
+
+    fprintf(cfgfile, "# [changeepsilon] tenths of dB(mV) a line value may drift before it is stored\n");
+    fprintf(cfgfile, "# VALUES  : 0 (any change), 1 - %d\n", CFG_MAX_DB_CHANGEEPSILON);
+    fprintf(cfgfile, "# DEFAULT : %d\n", CFG_DEFAULT_DB_CHANGEEPSILON);
+    fprintf(cfgfile, "changeepsilon = %d\n", cfg.database.changeepsilon);
+    fprintf(cfgfile, "\n");
+
+    fprintf(cfgfile, "# [partition] one datafile per day, month or year\n");
+    fprintf(cfgfile, "# NOTE: Partitions are named after [database], eg. \"icmond.2016-09.sqlite3\",\n");
+    fprintf(cfgfile, "#       and created into the same directory. [database] keeps older data.\n");
+    fprintf(cfgfile, "# VALUES  : NONE, DAY, MONTH or YEAR\n");
+    fprintf(cfgfile, "# DEFAULT : %s\n", CFG_PARTITION_NAME(CFG_DEFAULT_DB_PARTITION));
+    fprintf(cfgfile, "partition = %s\n", CFG_PARTITION_NAME(cfg.database.partition));
+    fprintf(cfgfile, "\n");
+
+    fprintf(cfgfile, "# [keeppartitions] number of newest partition datafiles kept, older are removed\n");
+    fprintf(cfgfile, "# VALUES  : 0 (keep all), 1 - %d\n", CFG_MAX_DB_KEEPPARTITIONS);
+    fprintf(cfgfile, "# DEFAULT : %d\n", CFG_DEFAULT_DB_KEEPPARTITIONS);
+    fprintf(cfgfile, "keeppartitions = %d\n", cfg.database.keeppartitions);
+    fprintf(cfgfile, "\n");
+
     fprintf(cfgfile, "# [inet pinghosts] host or address of the ping target\n");
     fprintf(cfgfile, "# VALUES  : single host \"www.host.com\" or list \"www.host1.com,www.host2.com,www.host3.com\"\n");
     fprintf(cfgfile, "# DEFAULT : %s\n", CFG_DEFAULT_INET_PINGHOSTS);
@@ -1495,6 +2406,28 @@ int cfg_writefile(const char *cfgfilename)
     fprintf(cfgfile, "modem scrubbertimeout = %d\n", cfg.modem.scrubber.timeout);
     fprintf(cfgfile, "\n");
 
+    fprintf(cfgfile, "# [modem collector] how line data is retrieved from the modem\n");
+    fprintf(cfgfile, "# SCRUBBER executes the 'modem scrubber' script, SNMP uses built-in SNMPv2c client,\n");
+    fprintf(cfgfile, "# HTTP reads 'modem httppath' over a persistent (keep-alive) connection and parses\n");
+    fprintf(cfgfile, "# the channel tables only when they have changed.\n");
+    fprintf(cfgfile, "# NOTE: SNMP and HTTP collectors use 'modem scrubbertimeout' as their timeout.\n");
+    fprintf(cfgfile, "# VALUES  : SCRUBBER, SNMP or HTTP\n");
+    fprintf(cfgfile, "# DEFAULT : %s\n", CFG_COLLECTOR_NAME(CFG_DEFAULT_MODEM_COLLECTOR));
+    fprintf(cfgfile, "modem collector = %s\n", CFG_COLLECTOR_NAME(cfg.modem.collector));
+    fprintf(cfgfile, "\n");
+
+    fprintf(cfgfile, "# [modem snmpcommunity] SNMPv2c read community\n");
+    fprintf(cfgfile, "# VALUES  : (string, 1 - %d characters)\n", CFG_MAX_SNMPCOMMUNITY_LEN);
+    fprintf(cfgfile, "# DEFAULT : %s\n", CFG_DEFAULT_MODEM_SNMPCOMMUNITY);
+    fprintf(cfgfile, "modem snmpcommunity = %s\n", cfg.modem.snmp.community);
+    fprintf(cfgfile, "\n");
+
+    fprintf(cfgfile, "# [modem httppath] WebUI page containing the channel tables (HTTP collector)\n");
+    fprintf(cfgfile, "# VALUES  : (absolute path, max %d characters)\n", CFG_MAX_HTTPPATH_LEN);
+    fprintf(cfgfile, "# DEFAULT : %s\n", CFG_DEFAULT_MODEM_HTTPPATH);
+    fprintf(cfgfile, "modem httppath = %s\n", cfg.modem.http.path);
+    fprintf(cfgfile, "\n");
+
     fprintf(cfgfile, "# [schedule dst] is daylight savings observed\n");
     fprintf(cfgfile, "# VALUES  : TRUE or FALSE\n");
     fprintf(cfgfile, "# DEFAULT : %s\n", (CFG_DEFAULT_EVENT_APPLYDST == 1 ? "TRUE" : "FALSE"));
@@ -1528,8 +2461,26 @@ void cfg_print(config_t *config, int logpriority, const char *fmtstr, ...)
     logmsg(logpriority, "  .execute.as_daemon       = %s", config->execute.as_daemon ? "TRUE" : "FALSE");
     logmsg(logpriority, "  .execute.tmpfs           = %s", cfg.execute.tmpfs  == 2 ? "AUTO" : (CFG_DEFAULT_EXE_TMPFS ? "TRUE" : "FALSE"));
     logmsg(logpriority, "  .execute.interval        = %d (seconds)", config->execute.interval);
+    logmsg(logpriority, "  .execute.pinginterval    = %d (seconds)", config->execute.pinginterval);
     logmsg(logpriority, "  .execute.loglevel        = (%d) \"%s\"", config->execute.loglevel, cfg_loglevel_val2str(config->execute.loglevel));
     logmsg(logpriority, "  .database.filename       = \"%s\"", config->database.filename);
+    logmsg(logpriority, "  .database.commitrows     = %d (rows)", config->database.commitrows);
+    logmsg(logpriority, "  .database.commitinterval = %d (seconds)", config->database.commitinterval);
+    logmsg(logpriority, "  .database.backend        = %s", CFG_BACKEND_NAME(config->database.backend));
+    logmsg(logpriority, "  .database.journal        = %s", CFG_JOURNAL_NAME(config->database.journal));
+    logmsg(logpriority, "  .database.synchronous    = %s", CFG_SYNCHRONOUS_NAME(config->database.synchronous));
+    logmsg(logpriority, "  .database.checkpointinterval = %d (seconds)", config->database.checkpointinterval);
+    logmsg(logpriority, "  .database.walmaxsize     = %d (kB)", config->database.walmaxsize);
+    logmsg(logpriority, "  .database.partition      = %s", CFG_PARTITION_NAME(config->database.partition));
+    logmsg(logpriority, "  .database.keeppartitions = %d", config->database.keeppartitions);
+    logmsg(logpriority, "  .database.retention      = %d (days)", config->database.retention);
+    logmsg(logpriority, "  .database.retentionlock  = %d (ms)", config->database.retentionlock);
+    logmsg(logpriority, "  .database.samplelog      = \"%s\"", config->database.samplelog);
+    logmsg(logpriority, "  .database.spool          = \"%s\"", config->database.spool);
+    logmsg(logpriority, "  .database.replica        = \"%s\"", config->database.replica);
+    logmsg(logpriority, "  .database.replicainterval = %d (seconds)", config->database.replicainterval);
+    logmsg(logpriority, "  .database.keyframeinterval = %d (seconds)", config->database.keyframeinterval);
+    logmsg(logpriority, "  .database.changeepsilon  = %d (tenths of dB)", config->database.changeepsilon);
     logmsg(logpriority, "  .inet.pinghosts          = (0x%08x) {%s}", config->inet.pinghosts, config->inet.pinghosts);
     logmsg(logpriority, "  .inet.pingtimeout        = %d (milliseconds)", config->inet.pingtimeout);
     logmsg(logpriority, "  .modem.powercontrol      = %s", config->modem.powercontrol ? "TRUE" : "FALSE");
@@ -1538,8 +2489,19 @@ void cfg_print(config_t *config, int logpriority, const char *fmtstr, ...)
     logmsg(logpriority, "  .modem.pingtimeout       = %d (milliseconds)", config->modem.pingtimeout);
     logmsg(logpriority, "  .modem.scrubber.filename = \"%s\"", config->modem.scrubber.filename);
     logmsg(logpriority, "  .modem.scrubber.timeout  = %d (milliseconds)", config->modem.scrubber.timeout);
+    logmsg(logpriority, "  .modem.collector         = %s", CFG_COLLECTOR_NAME(config->modem.collector));
+    logmsg(logpriority, "  .modem.snmp.community    = \"%s\"", config->modem.snmp.community);
+    logmsg(logpriority, "  .modem.http.path         = \"%s\"", config->modem.http.path);
     logmsg(logpriority, "  .cmd.createdatabase      = %s", config->cmd.createdatabase ? "TRUE" : "FALSE");
     logmsg(logpriority, "  .cmd.createconfigfile    = %s", config->cmd.createconfigfile ? "TRUE" : "FALSE");
+    logmsg(logpriority, "  .cmd.migratedatabase     = %s", config->cmd.migratedatabase ? "TRUE" : "FALSE");
+    logmsg(logpriority, "  .cmd.rebuildrollups      = %s", config->cmd.rebuildrollups ? "TRUE" : "FALSE");
+    logmsg(logpriority, "  .cmd.exportsqlite        = %s", config->cmd.exportsqlite ? "TRUE" : "FALSE");
+    logmsg(logpriority, "  .cmd.export              = %s (%lld - %lld)", config->cmd.export ? "TRUE" : "FALSE",
+           (long long)config->cmd.exportfrom, (long long)config->cmd.exportto);
+    logmsg(logpriority, "  .cmd.exportformat        = %s", CFG_EXPORT_NAME(config->cmd.exportformat));
+    logmsg(logpriority, "  .cmd.exportstep          = %d (seconds)", config->cmd.exportstep);
+    logmsg(logpriority, "  .cmd.importcsv           = \"%s\"", config->cmd.importcsv);
     logmsg(logpriority, "  .event.apply_dst         = %d (%s)", config->event.apply_dst,
            config->event.apply_dst == 0 ? "DST not applied" : (config->event.apply_dst > 0 ? "DST applied" : "auto"));
     logmsg(logpriority, "  .event.liststring        = (0x%08x) {%s}", config->event.liststring, config->event.liststring);
@@ -14,6 +14,7 @@
  */
 #include <syslog.h>         // LOG_ERR, LOG_INFO, LOG_DEBUG
 #include <limits.h>         // PATH_MAX
+#include <time.h>           // time_t
 #include <netinet/in.h>     // INET_ADDRSTRLEN (although with IPv4, always 16...)
 
 #ifndef __CONFIG_H__
@@ -25,6 +26,46 @@
 #define TRUE                                1
 #define AUTO                                2
 
+// Line data collectors (cfg.modem.collector)
+#define CFG_COLLECTOR_SCRUBBER              0       // external scrubber script
+#define CFG_COLLECTOR_SNMP                  1       // built-in SNMPv2c GetBulk (snmp.c)
+#define CFG_COLLECTOR_HTTP                  2       // built-in keep-alive WebUI scraper (webui.c)
+#define CFG_COLLECTOR_NAME(c) \
+    ((c) == CFG_COLLECTOR_SNMP ? "SNMP" : (c) == CFG_COLLECTOR_HTTP ? "HTTP" : "SCRUBBER")
+
+// SQLite3 journal mode (cfg.database.journal)
+#define CFG_JOURNAL_DELETE                  0       // rollback journal (SQLite3 default)
+#define CFG_JOURNAL_WAL                     1       // write-ahead log
+#define CFG_JOURNAL_NAME(j) \
+    ((j) == CFG_JOURNAL_WAL ? "WAL" : "DELETE")
+// Storage backend (cfg.database.backend, storage.h)
+#define CFG_BACKEND_SQLITE                  0       // datafile (database.c)
+#define CFG_BACKEND_MEMORY                  1       // process memory, benchmarks and tests
+#define CFG_BACKEND_NAME(b) \
+    ((b) == CFG_BACKEND_MEMORY ? "MEMORY" : "SQLITE")
+// Range export format (cfg.cmd.exportformat, export.h)
+#define CFG_EXPORT_CSV                      0
+#define CFG_EXPORT_JSON                     1
+#define CFG_EXPORT_BINARY                   2
+#define CFG_EXPORT_NAME(f) \
+    ((f) == CFG_EXPORT_JSON ? "JSON" : (f) == CFG_EXPORT_BINARY ? "BINARY" : "CSV")
+// SQLite3 PRAGMA synchronous (cfg.database.synchronous), values as in SQLite3
+#define CFG_SYNCHRONOUS_OFF                 0
+#define CFG_SYNCHRONOUS_NORMAL              1
+#define CFG_SYNCHRONOUS_FULL                2
+#define CFG_SYNCHRONOUS_AUTO                3       // NORMAL with WAL, FULL otherwise
+// Datafile partitioning (cfg.database.partition)
+#define CFG_PARTITION_NONE                  0       // single datafile
+#define CFG_PARTITION_DAY                   1       // one datafile per day
+#define CFG_PARTITION_MONTH                 2
+#define CFG_PARTITION_YEAR                  3
+#define CFG_PARTITION_NAME(p) \
+    ((p) == CFG_PARTITION_DAY ? "DAY" : (p) == CFG_PARTITION_MONTH ? "MONTH" : \
+     (p) == CFG_PARTITION_YEAR ? "YEAR" : "NONE")
+#define CFG_SYNCHRONOUS_NAME(s) \
+    ((s) == CFG_SYNCHRONOUS_OFF ? "OFF" : (s) == CFG_SYNCHRONOUS_NORMAL ? "NORMAL" : \
+     (s) == CFG_SYNCHRONOUS_FULL ? "FULL" : "AUTO")
+
 /*
  * TMPFS SIZE
  *      Size will be 4 MB, based on 08.10.2016 calculations on daily data
@@ -38,18 +79,41 @@
 #define DAEMON_TMPFS_MOUNTPOINT             "/tmp/"DAEMON_NAME".tmpfs"              // used by tmpfsdb.c
 #define DAEMON_TMPFS_SIZEMB                 4                                       // MB
 #define DAEMON_TMPFS_DATABASEFILE           DAEMON_TMPFS_MOUNTPOINT"/"DAEMON_NAME".sqlite3"
+#define DAEMON_SPOOL_SUFFIX                 ".spool"                                // spool next to the datafile, instead of tmpfs
+#define DAEMON_PROFILE_SUFFIX               ".profile"                              // insert latency profile next to the datafile (dbwriter.h)
 #define DAEMON_RUN_AS_USER                  "daemon"
 #define DAEMON_DATALOGGER_TIMEOUT           4800    // (milliseconds) grace time before datalogger process is terminated
 #define DAEMON_IMPORTTMPFS_TIMEOUT          60      // (seconds) 1 minute before data moval from tmpfs to actual datafile is considered failed
 #define DAEMON_IMPORTTMPFS_INTERVAL         600     // (seconds) 10 minutes
+#define DAEMON_RETENTION_INTERVAL           3600    // (seconds) retention pass (if cfg.database.retention)
+#define DAEMON_IMPORTTMPFS_MARGIN           60      // (seconds) younger rows stay in tmpfs (workers may still be writing them)
+#define DAEMON_JOB_GRACETIME                800     // (milliseconds) added to ping / line data job timeouts (INSERT)
 
 // These define compiled-in default configuration
 #define CFG_DEFAULT_FILECONFIG              "/etc/"DAEMON_NAME".conf"               // USE ABSOLUTE PATH!
 #define CFG_DEFAULT_FILEDATABASE            "/srv/"DAEMON_NAME".sqlite3"            // SQLite3 database file (and path)
 #define CFG_DEFAULT_EXE_LOGLEVEL            LOG_INFO                                // see logwrite.h for details
 #define CFG_DEFAULT_EXE_INTERVAL            10                                      // 10 sec data logging interval
+#define CFG_DEFAULT_EXE_PINGINTERVAL        0                                       // 0 == pings done with line data
 #define CFG_DEFAULT_EXE_ASDAEMON            TRUE                                    // true or false
 #define CFG_DEFAULT_EXE_TMPFS               AUTO
+#define CFG_DEFAULT_DB_COMMITROWS           30                                      // rows per transaction
+#define CFG_DEFAULT_DB_COMMITINTERVAL       60                                      // seconds, maximum data-loss window
+#define CFG_DEFAULT_DB_BACKEND              CFG_BACKEND_SQLITE
+#define CFG_DEFAULT_DB_JOURNAL              CFG_JOURNAL_DELETE
+#define CFG_DEFAULT_DB_SYNCHRONOUS          CFG_SYNCHRONOUS_AUTO
+#define CFG_DEFAULT_DB_CHECKPOINTINTERVAL   300                                     // seconds, 0 == SQLite3 automatic checkpoints
+#define CFG_DEFAULT_DB_WALMAXSIZE           4096                                    // kB, checkpoint (TRUNCATE) when exceeded
+#define CFG_DEFAULT_DB_PARTITION            CFG_PARTITION_NONE
+#define CFG_DEFAULT_DB_KEEPPARTITIONS       0                                       // 0 == keep all
+#define CFG_DEFAULT_DB_RETENTION            0                                       // days, 0 == keep all
+#define CFG_DEFAULT_DB_RETENTIONLOCK        100                                     // ms, write lock held by a chunk
+#define CFG_DEFAULT_DB_SAMPLELOG            ""                                      // "" == samples into the datafile
+#define CFG_DEFAULT_DB_SPOOL                ""                                      // "" == workers send rows to the daemon
+#define CFG_DEFAULT_DB_REPLICA              ""                                      // "" == no read-only replica
+#define CFG_DEFAULT_DB_REPLICAINTERVAL      3600                                    // seconds between replica refreshes
+#define CFG_DEFAULT_DB_KEYFRAMEINTERVAL     0                                       // seconds, 0 == every row stores all line values
+#define CFG_DEFAULT_DB_CHANGEEPSILON        0                                       // tenths of dB(mV), change-only storage
 #define CFG_DEFAULT_INET_PINGHOSTS          "www.google.com"                        // Host(s) to ping to evaluate internet connection
 #define CFG_DEFAULT_INET_PINGTIMEOUT        1000                                    // ms before ICMP Echo Request is considered failed
 #define CFG_DEFAULT_MODEM_POWERCONTROL      FALSE                                   // placeholder - true/false for now
@@ -58,12 +122,42 @@
 #define CFG_DEFAULT_MODEM_SCRUBBERTIMEOUT   4000                                    // before scrubber is considered tardy
 #define CFG_DEFAULT_MODEM_SCRUBBER          "/usr/local/bin/"DAEMON_NAME".scrubber" // external scrubber script filepath
 #define CFG_DEFAULT_MODEM_IP                "192.168.1.1"                           // Manufacturer's default CHANGE TO 192.168.0.1 !!!!
+#define CFG_DEFAULT_MODEM_COLLECTOR         CFG_COLLECTOR_SCRUBBER                  // line data source
+#define CFG_DEFAULT_MODEM_SNMPCOMMUNITY     "public"                                // SNMPv2c read community
+#define CFG_DEFAULT_MODEM_HTTPPATH          "/Docsis_system.asp"                    // WebUI page with channel tables
 #define CFG_DEFAULT_EVENT_APPLYDST          0                                       // 0 == no DST, >0 == yes DST, -1 == "auto" (do NOT use)
 #define CFG_DEFAULT_EVENT_STRING            ""                                      // See event.c for details
 
 // Interval period range for logging (in seconds)
 #define CFG_MIN_EXE_INTERVAL                5                                       // 5 seconds
 #define CFG_MAX_EXE_INTERVAL                3600                                    // 1 hour
+// Separate ping job interval (in seconds, 0 == disabled)
+#define CFG_MIN_EXE_PINGINTERVAL            1                                       // 1 second
+// Group commit (rows per transaction, seconds before commit)
+#define CFG_MIN_DB_COMMITROWS               1                                       // 1 == every row is committed
+#define CFG_MAX_DB_COMMITROWS               1000
+#define CFG_MIN_DB_COMMITINTERVAL           1
+#define CFG_MAX_DB_COMMITINTERVAL           3600                                    // 1 hour
+// WAL checkpoint interval (seconds, 0 == automatic) and size limit (kB)
+#define CFG_MIN_DB_CHECKPOINTINTERVAL       10
+#define CFG_MAX_DB_CHECKPOINTINTERVAL       86400                                   // 1 day
+#define CFG_MIN_DB_WALMAXSIZE               64
+#define CFG_MAX_DB_WALMAXSIZE               1048576                                 // 1 GB
+// Partition datafiles kept (0 == all)
+#define CFG_MAX_DB_KEEPPARTITIONS           3660                                    // 10 years of days
+// Raw data retention (days, 0 == keep all) and chunk write lock limit (ms)
+#define CFG_MAX_DB_RETENTION                36500                                   // 100 years
+#define CFG_MIN_DB_RETENTIONLOCK            10
+#define CFG_MAX_DB_RETENTIONLOCK            5000
+// Read-only replica refresh interval (seconds)
+#define CFG_MIN_DB_REPLICAINTERVAL          60
+#define CFG_MAX_DB_REPLICAINTERVAL          86400                                   // 1 day
+// Change-only storage keyframe interval (seconds, 0 == disabled) and epsilon (tenths of dB)
+#define CFG_MIN_DB_KEYFRAMEINTERVAL         10
+#define CFG_MAX_DB_KEYFRAMEINTERVAL         3600                                    // 1 hour
+#define CFG_MAX_DB_CHANGEEPSILON            50                                      // 5 dB
+// Export downsampling bucket (seconds, 0 == every row)
+#define CFG_MAX_EXPORT_STEP                 86400                                   // 1 day
 // Valid ping timeout range (in milliseconds)
 #define CFG_MIN_PING_TIMEOUT                100                                     // 100 ms (0.1 sec)
 #define CFG_MAX_PING_TIMEOUT                3000                                    // 3'000 ms (3 sec)
@@ -73,6 +167,10 @@
 // Scrubber timeout (in milliseconds)
 #define CFG_MIN_MODEM_SCRUBBERTIMEOUT       200
 #define CFG_MAX_MODEM_SCRUBBERTIMEOUT       5000
+// SNMP community string length (snmp.h:SNMP_MAXCOMMUNITYLEN)
+#define CFG_MAX_SNMPCOMMUNITY_LEN           32
+// WebUI page path length
+#define CFG_MAX_HTTPPATH_LEN                128
 // Maximum allowed SQLite3 INSERT times SET LOW TO TEST!! RESET AFTER TESTING
 #define CFG_MAX_INSERT_DELAY_MEAN           200.0L                                  // 200.0L ms mean
 #define CFG_MAX_INSERT_DELAY_MAX            800.0L                                  // 800.0L ms 
@@ -129,11 +227,29 @@ typedef struct {
         unsigned int as_daemon : 1;                     // 0 = std execution, 1 = daemon
         unsigned int tmpfs     : 2;                     // false/true and 2 == auto
         int         interval;                           // probing interval in seconds
+        int         pinginterval;                       // seconds, >0 == pings and line data are separate jobs
         int         loglevel;                           // priority as used by syslog
     } execute;
     struct {
         char        filename[CFG_MAX_FILENAME_LEN + 1]; // SQLite3 logging datafile
         char *      tmpfsfilename;                      // If not NULL, writes go here!
+        int         commitrows;                         // rows buffered into one transaction
+        int         commitinterval;                     // seconds, max age of an uncommitted row
+        int         backend;                            // CFG_BACKEND_*
+        int         journal;                            // CFG_JOURNAL_*
+        int         synchronous;                        // CFG_SYNCHRONOUS_*
+        int         checkpointinterval;                 // seconds, WAL checkpoint event (0 == automatic)
+        int         walmaxsize;                         // kB
+        int         partition;                          // CFG_PARTITION_*
+        int         keeppartitions;                     // 0 == all
+        int         retention;                          // days, 0 == keep all
+        int         retentionlock;                      // ms
+        char        samplelog[CFG_MAX_FILENAME_LEN + 1];// samplelog.h, "" == not in use
+        char        spool[CFG_MAX_FILENAME_LEN + 1];    // spool.h, "" == not in use
+        char        replica[CFG_MAX_FILENAME_LEN + 1];  // read-only copy for reports, "" == not in use
+        int         replicainterval;                    // seconds
+        int         keyframeinterval;                   // seconds, change-only storage (0 == not in use)
+        int         changeepsilon;                      // tenths of dB(mV)
     } database;
     struct {
         int         pingtimeout;                        // ms
@@ -144,15 +260,31 @@ typedef struct {
         int         powerupdelay;                       // seconds
         char        ip[INET_ADDRSTRLEN + 1];            // modem IP (as string)
         int         pingtimeout;                        // ms, maximum allowed before killed
+        int         collector;                          // CFG_COLLECTOR_*
         struct {
             char    filename[CFG_MAX_FILENAME_LEN + 1];
-            int     timeout;                            // ms
+            int     timeout;                            // ms (also SNMP and HTTP collector timeout)
         } scrubber;
+        struct {
+            char    community[CFG_MAX_SNMPCOMMUNITY_LEN + 1];
+        } snmp;
+        struct {
+            char    path[CFG_MAX_HTTPPATH_LEN + 1];
+        } http;
     } modem;
     struct {
         int         createdatabase;
         int         createconfigfile;
         int         testdbwriteperf;
+        int         migratedatabase;
+        int         rebuildrollups;
+        int         exportsqlite;
+        int         export;                             // -export=<from>,<to>
+        time_t      exportfrom;
+        time_t      exportto;                           // inclusive
+        int         exportformat;                       // CFG_EXPORT_*
+        int         exportstep;                         // seconds, 0 == every row
+        char        importcsv[CFG_MAX_FILENAME_LEN + 1];// cisco_docsis_logger CSV, "" == no import
     } cmd;
     struct {
         int         apply_dst;                          // 0 == no DST, >0 = yes, <0 = auto (do NOT use "auto")
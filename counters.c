@@ -0,0 +1,177 @@
+/*
+ * counters.c - 2016 Jani Tammi <janitammi@gmail.com>
+ *
+ *      Delta engine for cumulative modem counters. See counters.h.
+ */
+#include <stdlib.h>             // EXIT_SUCCESS, EXIT_FAILURE
+#include <string.h>             // memset()
+#include <stdbool.h>            // true, false
+#include <errno.h>
+
+#include "counters.h"
+#include "logwrite.h"
+#include "util.h"               // shmalloc()
+
+static counters_store_t *store = NULL;
+
+int counters_attach()
+{
+    if (!store && !(store = shmalloc(sizeof(counters_store_t))))
+        return EXIT_FAILURE;
+    return (errno = 0, EXIT_SUCCESS);
+}
+
+void counters_close()
+{
+    if (!store)
+        return;
+    shfree(store, sizeof(counters_store_t));
+    store = NULL;
+}
+
+void counters_logstats()
+{
+    if (!store || !store->total.n_samples)
+        return;
+    logmsg(
+          LOG_INFO,
+          "Counters: %u samples, %u modem reboots, %u wraps, %u resets",
+          store->total.n_samples,
+          store->total.n_reboots,
+          store->total.n_wraps,
+          store->total.n_resets
+          );
+}
+
+counters_store_t *counters_getstore()
+{
+    return store;
+}
+
+/*
+ * Delta of one Counter32. After reboot, counter has started from zero.
+ */
+static int64_t counter_delta(uint32_t previous, uint32_t current, int rebooted)
+{
+    if (rebooted)
+        return current;
+    if (current < previous)
+    {
+        if (!store->has_sysuptime && previous < COUNTERS_RESET_THRESHOLD)
+        {
+            // Cannot have wrapped - modem was restarted
+            store->total.n_resets++;
+            return current;
+        }
+        store->total.n_wraps++;
+    }
+    // Modulo 2^32 takes care of a (single) wrap
+    return (uint32_t)(current - previous);
+}
+
+int counters_update(
+                   const snmp_docsis_t *d,
+                   time_t now,
+                   databasecounters_t *rec,
+                   databasereboot_t *reboot
+                   )
+{
+    int rc = COUNTERS_BASELINE;
+    int rebooted = false;
+    int i;
+
+    if (!store)
+        return COUNTERS_BASELINE;
+
+    rec->timestamp  = now;
+    rec->seconds    = now - store->timestamp;
+    rec->t3timeouts = DATABASE_COUNTER_NULL_VALUE;
+    rec->t4timeouts = DATABASE_COUNTER_NULL_VALUE;
+    for (i = 0; i < DATABASE_MAXDOWNCHANNELS; i++)
+    {
+        rec->down[i].unerroreds     = DATABASE_COUNTER_NULL_VALUE;
+        rec->down[i].correcteds     = DATABASE_COUNTER_NULL_VALUE;
+        rec->down[i].uncorrectables = DATABASE_COUNTER_NULL_VALUE;
+    }
+
+    // Previous worker was killed in the middle of an update
+    if (store->updating)
+    {
+        logdev("Counter store update was interrupted, starting over");
+        store->valid = false;
+    }
+    store->updating = true;
+    store->total.n_samples++;
+
+    if (store->valid && rec->seconds > 0)
+    {
+        rc = COUNTERS_DELTA;
+        /*
+         * Reboot detection
+         */
+        if (d->has_sysuptime && store->has_sysuptime)
+        {
+            uint32_t uptime   = d->sysuptime / 100;
+            uint64_t expected = (uint64_t)store->sysuptime + (uint64_t)rec->seconds * 100;
+            if (d->sysuptime < store->sysuptime && expected > UINT32_MAX)
+                store->total.n_wraps++;     // TimeTicks wrapped (497 days)
+            else if (d->sysuptime < store->sysuptime ||
+                     uptime + COUNTERS_UPTIME_SLACK < rec->seconds)
+            {
+                rebooted              = true;
+                rc                    = COUNTERS_REBOOT;
+                reboot->timestamp     = now;
+                reboot->boottime      = now - uptime;
+                reboot->lastuptime    = store->sysuptime / 100;
+                rec->seconds          = uptime;
+                store->total.n_reboots++;
+                store->total.lastboot = reboot->boottime;
+                logdev(
+                      "Modem has rebooted (uptime %u s, previously %u s)",
+                      uptime,
+                      reboot->lastuptime
+                      );
+            }
+        }
+
+        /*
+         * Deltas
+         */
+        if (d->has_timeouts && store->has_timeouts)
+        {
+            rec->t3timeouts = counter_delta(store->t3timeouts, d->t3timeouts, rebooted);
+            rec->t4timeouts = counter_delta(store->t4timeouts, d->t4timeouts, rebooted);
+        }
+        for (i = 0; i < d->ndown && i < DATABASE_MAXDOWNCHANNELS; i++)
+        {
+            // Channel may have just appeared
+            if (!d->down[i].has_counters || !store->down[i].valid)
+                continue;
+            rec->down[i].unerroreds     = counter_delta(store->down[i].unerroreds,     d->down[i].unerroreds,     rebooted);
+            rec->down[i].correcteds     = counter_delta(store->down[i].correcteds,     d->down[i].correcteds,     rebooted);
+            rec->down[i].uncorrectables = counter_delta(store->down[i].uncorrectables, d->down[i].uncorrectables, rebooted);
+        }
+    }
+
+    /*
+     * Current sample becomes the previous
+     */
+    store->timestamp     = now;
+    store->sysuptime     = d->sysuptime;
+    store->has_sysuptime = d->has_sysuptime;
+    store->t3timeouts    = d->t3timeouts;
+    store->t4timeouts    = d->t4timeouts;
+    store->has_timeouts  = d->has_timeouts;
+    for (i = 0; i < SNMP_MAXDOWNCHANNELS; i++)
+    {
+        store->down[i].unerroreds     = d->down[i].unerroreds;
+        store->down[i].correcteds     = d->down[i].correcteds;
+        store->down[i].uncorrectables = d->down[i].uncorrectables;
+        store->down[i].valid          = i < d->ndown && d->down[i].has_counters;
+    }
+    store->valid    = true;
+    store->updating = false;
+    return rc;
+}
+
+/* EOF counters.c */
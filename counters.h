@@ -0,0 +1,115 @@
+/*
+ * counters.h - 2016 Jani Tammi <janitammi@gmail.com>
+ *
+ *      Delta engine for cumulative modem counters (SNMP collector).
+ *
+ *      Codeword counters (unerrored, corrected, uncorrectable, per
+ *      downstream channel) and T3/T4 timeouts are cumulative since the
+ *      modem booted. Raw values tell nothing; what matters is how much they
+ *      grew during the interval. A worker process is forked for each tick
+ *      and cannot remember the previous values, so the previous sample is
+ *      kept in a store owned by the daemon:
+ *
+ *      1.  Daemon allocates the store from shared memory (util.c:shmalloc())
+ *          with counters_attach() before line data worker is fork()'ed,
+ *          exactly like the WebUI session (webui.h).
+ *      2.  Worker calls counters_update() with the decoded SNMP response.
+ *          It computes the deltas against the previous sample and replaces
+ *          the previous sample with the new one.
+ *      3.  Worker stores the deltas (counters table) and, if the modem has
+ *          rebooted since the previous sample, a reboot event (reboots
+ *          table). Raw counter values are not stored.
+ *
+ *      Reboot detection is based on sysUpTime. Modem has rebooted if its
+ *      uptime went backwards, or if it is shorter than the time elapsed
+ *      since the previous sample (rebooted AND ran past the previous
+ *      uptime while we were not looking). TimeTicks wrap (497 days) is not
+ *      mistaken for a reboot. After a reboot the counters start from zero
+ *      and the delta is the current value, over the uptime (not the whole
+ *      interval).
+ *
+ *      Counter32 wraparound is handled with modulo 2^32 arithmetic. Modems
+ *      that do not report sysUpTime cannot be checked for reboots; for them
+ *      a counter that goes backwards from below 2^31 is taken to be a reset
+ *      rather than a wrap.
+ *
+ *      Rates are delta / seconds (see the counter_rates view, database.h).
+ */
+#include <stdint.h>             /* uint32_t                                 */
+#include <time.h>               /* time_t                                   */
+
+#include "snmp.h"               /* snmp_docsis_t                            */
+#include "database.h"           /* databasecounters_t, databasereboot_t     */
+
+#ifndef __COUNTERS_H__
+#define __COUNTERS_H__
+
+#define COUNTERS_UPTIME_SLACK       10          // (seconds) modem vs. our clock
+#define COUNTERS_RESET_THRESHOLD    0x80000000  // see above (no sysUpTime)
+
+/*
+ * counters_update() return values
+ */
+#define COUNTERS_BASELINE           0           // first sample, nothing to store
+#define COUNTERS_DELTA              1           // deltas stored into record
+#define COUNTERS_REBOOT             2           // deltas + reboot event
+
+typedef struct
+{
+    uint32_t        unerroreds;
+    uint32_t        correcteds;
+    uint32_t        uncorrectables;
+    int             valid;
+} counters_channel_t;
+
+typedef struct
+{
+    int             valid;                  // previous sample exists
+    int             updating;               // worker killed during update?
+    time_t          timestamp;              // previous sample
+    uint32_t        sysuptime;              // 1/100 s
+    int             has_sysuptime;
+    uint32_t        t3timeouts;
+    uint32_t        t4timeouts;
+    int             has_timeouts;
+    counters_channel_t down[SNMP_MAXDOWNCHANNELS];
+    struct
+    {
+        uint32_t    n_samples;
+        uint32_t    n_reboots;
+        uint32_t    n_wraps;                // counters / TimeTicks wrapped
+        uint32_t    n_resets;               // counters reset (no sysUpTime)
+        time_t      lastboot;
+    } total;
+} counters_store_t;
+
+/*
+ * Daemon side
+ *
+ *  counters_attach()   Allocate the shared store on first call.
+ *  counters_close()    Release shared store.
+ *  counters_logstats() Log store totals.
+ *
+ * Worker side
+ *
+ *  counters_update()   Compute deltas of the decoded response against the
+ *                      previous sample and make it the new previous sample.
+ *                      Fills rec (and reboot, on COUNTERS_REBOOT).
+ *                      Returns COUNTERS_* value. Without store (daemon did
+ *                      not attach), always COUNTERS_BASELINE.
+ *  counters_getstore() Shared store, NULL before counters_attach().
+ */
+int                 counters_attach(void);
+void                counters_close(void);
+void                counters_logstats(void);
+int                 counters_update(
+                                   const snmp_docsis_t *d,
+                                   time_t now,
+                                   databasecounters_t *rec,
+                                   databasereboot_t *reboot
+                                   );
+counters_store_t *  counters_getstore(void);
+
+#endif /* __COUNTERS_H__ */
+
+/* EOF counters.h */
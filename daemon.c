@@ -38,6 +38,10 @@
 #include "logwrite.h"
 #include "capability.h"
 #include "util.h"
+#include "webui.h"
+#include "breaker.h"
+#include "counters.h"
+#include "dbwriter.h"
 
 /*
  * Execution statistics
@@ -52,6 +56,10 @@
  *                       timer fires, regadless of worker succss.
  * n_datalog_actions     Incremented once for each worker process spawned.
  * n_datalog_success     Incremented once for each successful worker process.
+ * n_linedata_unchanged  Successful workers that reused previous line values
+ *                       (HTTP collector, DATALOGGER_FLAG_LINEDATA_UNCHANGED).
+ * n_ping_*              Like n_datalog_*, but for separately scheduled
+ * n_linedata_*          ping and line data jobs (cfg.execute.pinginterval).
  * suspended_by_command  When true, daemon will not spawn worker process
  *                       when interval timer fires, but will keep on
  *                       rotating. Suspended daemon can thus capture
@@ -75,6 +83,11 @@ static struct execstats_t
     int     n_interval_ticks;
     int     n_datalog_actions;
     int     n_datalog_success;
+    int     n_linedata_unchanged;
+    int     n_ping_actions;
+    int     n_ping_success;
+    int     n_linedata_actions;
+    int     n_linedata_success;
     int     n_schduled_events;
     time_t  start_time;
     time_t  end_time;
@@ -83,6 +96,11 @@ static struct execstats_t
     .n_interval_ticks       = 0,
     .n_datalog_actions      = 0,
     .n_datalog_success      = 0,
+    .n_linedata_unchanged   = 0,
+    .n_ping_actions         = 0,
+    .n_ping_success         = 0,
+    .n_linedata_actions     = 0,
+    .n_linedata_success     = 0,
     .n_schduled_events      = 0,
     .start_time             = 0,
     .end_time               = 0
@@ -100,6 +118,7 @@ typedef struct
     int                 pid;
     int                 fd;
     struct itimerspec   tspec;
+    breaker_t          *breaker;        // line data collector of the running job
 } pidtimer_t;
 static struct daemon_t
 {
@@ -108,6 +127,10 @@ static struct daemon_t
     fdtimer_t               interval;
     pidtimer_t              collecttmpfs;
     pidtimer_t              worker;
+    pidtimer_t              ping;           // cfg.execute.pinginterval > 0
+    pidtimer_t              linedata;       // cfg.execute.pinginterval > 0
+    pidtimer_t              replica;        // cfg.database.replica, no timer
+    breaker_t               breaker[CFG_COLLECTOR_HTTP + 1];    // per collector
     struct {
         int                 running;
         time_t              suspended_by_command;
@@ -143,6 +166,21 @@ static struct daemon_t
         .pid                        = 0,
         .fd                         = 0
     },
+    .ping =
+    {
+        .pid                        = 0,
+        .fd                         = 0
+    },
+    .linedata =
+    {
+        .pid                        = 0,
+        .fd                         = 0
+    },
+    .replica =
+    {
+        .pid                        = 0,
+        .fd                         = 0
+    },
     .state =
     {
         .running                    = true, // Set to FALSE and main loop will exit
@@ -266,6 +304,35 @@ static void logexecstats()
           execstats.n_datalog_actions,
           execstats.n_interval_ticks
           );
+    if (execstats.n_ping_actions || execstats.n_linedata_actions)
+        logmsg(
+              LOG_INFO,
+              "Processed %d/%d ping and %d/%d line data jobs.",
+              execstats.n_ping_success,
+              execstats.n_ping_actions,
+              execstats.n_linedata_success,
+              execstats.n_linedata_actions
+              );
+    int c;
+    for (c = 0; c <= CFG_COLLECTOR_HTTP; c++)
+        if (this.breaker[c].n_trips)
+            logmsg(
+                  LOG_INFO,
+                  "%s collector backed off %d times (%d attempts skipped), currently %s.",
+                  this.breaker[c].name,
+                  this.breaker[c].n_trips,
+                  this.breaker[c].n_skipped,
+                  breaker_statestr(&this.breaker[c])
+                  );
+    if (execstats.n_linedata_unchanged)
+        logmsg(
+              LOG_INFO,
+              "Line data was unchanged in %d datalogging actions.",
+              execstats.n_linedata_unchanged
+              );
+    webui_logstats();
+    counters_logstats();
+    dbwriter_logstats();
 }
 
 /*****************************************************************************/
@@ -300,43 +367,223 @@ int daemon_watchdog()
 
 /*
  * API for scheduled events called by event.c:event_execute()
- * Child process function for retrieving tmpfs datafile records.
+ * Retrieve tmpfs datafile records.
+ *
+ *      Watermark is set DAEMON_IMPORTTMPFS_MARGIN seconds back, so that
+ *      rows of running workers (timestamped when they were scheduled)
+ *      cannot arrive below it after the import.
+ *
+ *      Import is run by the database writer process, between its own
+ *      transactions. Without the writer, import is a child process of its
+ *      own; rows buffered in the writer transaction are committed before
+ *      fork(), otherwise the import would not see them. Import process is
+ *      killed if it does not finish within DAEMON_IMPORTTMPFS_TIMEOUT
+ *      (collecttmpfs timer).
  */
 int daemon_importtmpfs()
 {
-//  time_t now = time(NULL);
-    // set timeout timer for collecttmpfs
-    // if(fork() == child) {
-    //      check that the tmpfs / datafile exists
-    //      database.c:database_savetmpds(time_t before);
-    //      report success / failure
-    //      _exit();
-    // }
-    //      logdev("tmpfs data collection launched");
-
-    // Schedule timeout event for the import process
-    if (event_create(
-                    EVENT_ACTION_IMPORTTMPFSTIMEOUT,
-                    DAEMON_IMPORTTMPFS_TIMEOUT            // config.h
-                    ) < 0)
+    time_t watermark = time(NULL) - DAEMON_IMPORTTMPFS_MARGIN;
+
+    if (this.collecttmpfs.pid)
     {
-        logerr(
-              "event_scheduled_create() rejected values: "
-              "action (%d), schedulingtype (%d), seconds (%d)",
-              EVENT_ACTION_IMPORTTMPFSTIMEOUT,
-              EVENT_TYPE_ONCE,
-              DAEMON_IMPORTTMPFS_TIMEOUT
-              );
-        exit(EXIT_FAILURE); // non-recoverable and cannot be ignored
+        logerr("Previous tmpfs import (PID: %d) still running!", this.collecttmpfs.pid);
+        return EXIT_FAILURE;
+    }
+    if (dbwriter_getpid())                  // dbwriter.c
+        return dbwriter_importtmpfs(watermark) ? EXIT_FAILURE : EXIT_SUCCESS;
+    dbwriter_flush();                       // dbwriter.c
+    if ((this.collecttmpfs.pid = fork()) < 0)
+    {
+        logerr("Unable to fork tmpfs import process");
+        this.collecttmpfs.pid = 0;
+        return EXIT_FAILURE;
     }
+    else if (this.collecttmpfs.pid > 0)
+    {
+        timerfd_start_rel(this.collecttmpfs.fd, &this.collecttmpfs.tspec);
+        logdev("Created tmpfs import process (PID: %d)", this.collecttmpfs.pid);
+        return EXIT_SUCCESS;
+    }
+    // Child - must _exit()
+    _exit(database_collecttmpfs(watermark));    // database.c
+}
 
-    return EXIT_SUCCESS;
+/*
+ * API for scheduled events called by event.c:event_execute()
+ * Checkpoint over the database writer connection. PASSIVE never waits
+ * for readers, whatever is left is copied on the next event (or
+ * truncated by the writer, if WAL grows past cfg.database.walmaxsize).
+ */
+int daemon_checkpoint()
+{
+    return dbwriter_checkpoint(false) ? EXIT_FAILURE : EXIT_SUCCESS;   // dbwriter.c
+}
+
+/*
+ * API for scheduled events called by event.c:event_execute()
+ * Partition rollover. Creates the datafile of the period that has just
+ * begun, moves the database writer into it and removes the partitions
+ * beyond cfg.database.keeppartitions. With tmpfs, writer stays in the
+ * tmpfs datafile and the imports pick the partition. Rollover is a ONCE
+ * event and schedules the next one (periods are not of equal length).
+ */
+int daemon_rollover()
+{
+    time_t now  = time(NULL);
+    time_t next = database_nextpartition(now);     // database.c
+    char  *datafile = database_partition(now);
+    int    rc = EXIT_SUCCESS;
+
+    if (cfg.database.partition == CFG_PARTITION_NONE)
+        return EXIT_SUCCESS;
+    if (database_preparepartition(datafile))
+        rc = EXIT_FAILURE;
+    else if (!cfg.execute.tmpfs && dbwriter_rollover(now))   // dbwriter.c
+        rc = EXIT_FAILURE;
+    database_removepartitions(cfg.database.keeppartitions);
+    if (event_create(EVENT_ACTION_ROLLOVER, next - now) < 0)
+    {
+        logerr("Failed to schedule next partition rollover");
+        return EXIT_FAILURE;
+    }
+    logdev("Partition \"%s\", next rollover at %lld", datafile, (long long)next);
+    return rc;
+}
+
+/*
+ * API for scheduled events called by event.c:event_execute()
+ * Start a retention pass. Pass is run by the database writer, one time
+ * bounded chunk at a time (retention timer of the writer). With tmpfs,
+ * writer holds only the recent rows and there is nothing to delete.
+ */
+int daemon_retention()
+{
+    if (cfg.execute.tmpfs)
+    {
+        logdev("Retention skipped, database writer uses the tmpfs datafile");
+        return EXIT_SUCCESS;
+    }
+    return dbwriter_retention() ? EXIT_FAILURE : EXIT_SUCCESS;   // dbwriter.c
+}
+
+/*
+ * API for scheduled events called by event.c:event_execute()
+ * Refresh the read-only replica. Copy is made by a child process, which
+ * sleeps between the small backup steps and may take a while, without
+ * blocking the main loop. Copy of the current partition (or the base
+ * datafile). With tmpfs, rows not yet imported are not in the replica.
+ */
+int daemon_replica()
+{
+    if (this.replica.pid)
+    {
+        logerr("Previous replica refresh (PID: %d) still running!", this.replica.pid);
+        return EXIT_FAILURE;
+    }
+    if ((this.replica.pid = fork()) < 0)
+    {
+        logerr("Unable to fork replica process");
+        this.replica.pid = 0;
+        return EXIT_FAILURE;
+    }
+    else if (this.replica.pid > 0)
+    {
+        logdev("Created replica process (PID: %d)", this.replica.pid);
+        return EXIT_SUCCESS;
+    }
+    // Child - must _exit()
+    _exit(database_replicate(database_partition(time(NULL)), cfg.database.replica));  // database.c
 }
 
+/*
+ * Import timeout is handled by the collecttmpfs timer. Event is kept for
+ * schedules that list it; it kills an import that is still running.
+ */
 int daemon_importtmpfstimeout()
 {
-    logerr("UNIMPLEMENTED!");
-    return EXIT_FAILURE;
+    if (!this.collecttmpfs.pid)
+        return EXIT_SUCCESS;
+    logmsg(LOG_ERR, "tmpfs import (PID: %d) timed out, killing it", this.collecttmpfs.pid);
+    return kill(this.collecttmpfs.pid, SIGKILL) ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+/*
+ * Fork a worker (interval timer) or a separately scheduled job
+ *
+ *      Row timestamp is the scheduled (aligned) time so that ping rows and
+ *      line data rows of separate jobs can be joined. If the collector
+ *      breaker is open, line data is dropped from the job and pings are
+ *      done as scheduled.
+ */
+static int daemon_forkjob(pidtimer_t *job, const char *name, time_t scheduled, int jobs)
+{
+    if (this.state.suspended_by_command || this.state.suspended_by_schedule)
+        return EXIT_SUCCESS;
+    if (job->pid)
+    {
+        logerr("Previous %s job still running, skipping this tick...", name);
+        return EXIT_FAILURE;
+    }
+    // Collector breaker may be open (modem has been failing)
+    job->breaker = NULL;
+    if (jobs & DATALOGGER_JOB_LINEDATA)
+    {
+        if (breaker_allow(&this.breaker[cfg.modem.collector], scheduled))
+            job->breaker = &this.breaker[cfg.modem.collector];
+        else
+        {
+            logdev("%s collector backing off, no line data this tick", CFG_COLLECTOR_NAME(cfg.modem.collector));
+            // Pings keep their cadence
+            if (!(jobs &= ~DATALOGGER_JOB_LINEDATA))
+                return EXIT_SUCCESS;
+        }
+    }
+    // Keep-alive WebUI session is owned by the daemon (see interval timer)
+    if ((jobs & DATALOGGER_JOB_LINEDATA) && cfg.modem.collector == CFG_COLLECTOR_HTTP)
+        webui_connect(cfg.modem.ip, WEBUI_PORT);  // webui.c
+    // Previous counter values must outlive the worker
+    if ((jobs & DATALOGGER_JOB_LINEDATA) && cfg.modem.collector == CFG_COLLECTOR_SNMP)
+        counters_attach();                        // counters.c
+
+    job->pid = fork();
+    if (job->pid < 0)
+    {
+        logerr("Unable to fork %s job process", name);
+        job->pid = 0;
+        if (job->breaker)
+            breaker_report(job->breaker, BREAKER_NORESULT, scheduled);
+        return EXIT_FAILURE;
+    }
+    else if (job->pid > 0)
+    {
+        timerfd_start_rel(job->fd, &job->tspec);
+        logdev("Created %s job process (PID: %d)", name, job->pid);
+        return EXIT_SUCCESS;
+    }
+    // Child - must _exit() (see interval timer)
+    _exit(datalogger(scheduled, jobs));
+}
+
+/*
+ * API for scheduled events called by event.c:event_execute()
+ */
+int daemon_ping(time_t scheduled)
+{
+    int rc = daemon_forkjob(&this.ping, "ping", scheduled, DATALOGGER_JOB_PING);
+    if (this.ping.pid && !rc)
+        execstats.n_ping_actions++;
+    return rc;
+}
+
+/*
+ * API for scheduled events called by event.c:event_execute()
+ */
+int daemon_linedata(time_t scheduled)
+{
+    int rc = daemon_forkjob(&this.linedata, "line data", scheduled, DATALOGGER_JOB_LINEDATA);
+    if (this.linedata.pid && !rc)
+        execstats.n_linedata_actions++;
+    return rc;
 }
 /*****************************************************************************/
 
@@ -408,6 +655,8 @@ static void build_fdset()
     FD_ADD_IF_EXISTS(this.interval.fd);
     FD_ADD_IF_EXISTS(this.collecttmpfs.fd);
     FD_ADD_IF_EXISTS(this.worker.fd);
+    FD_ADD_IF_EXISTS(this.ping.fd);
+    FD_ADD_IF_EXISTS(this.linedata.fd);
 #undef FD_ADD_IF_EXISTS
 }
 
@@ -473,9 +722,23 @@ static void daemon_initialize()
      *      Each wakeup happens in cfg.datalog_interval seconds, following real
      *      clock (not relative to last tick) and thus ensuring long term
      *      accuracy. (no skew due to long term execution and relative timer)
+     *
+     *      Not used when pings and line data are separately scheduled jobs
+     *      (cfg.execute.pinginterval > 0). See "Ping and Line Data Jobs".
      */
     // ONLY if this value has changed (NOTE: interval is 0 at first run...)
-    if (cfg.execute.interval != this.interval.tspec.it_interval.tv_sec)
+    if (cfg.execute.pinginterval)
+    {
+        if (this.interval.fd)
+        {
+            timerfd_disarm(this.interval.fd);   // util.c
+            close(this.interval.fd);
+            this.interval.fd                        = 0;
+            this.interval.tspec.it_interval.tv_sec  = 0;
+            logdev("interval timer destroyed");
+        }
+    }
+    else if (cfg.execute.interval != this.interval.tspec.it_interval.tv_sec)
     {
         if (this.interval.fd)
         {
@@ -506,6 +769,135 @@ static void daemon_initialize()
     }
 
 
+    /*
+     * Commit parsed (tested) schedule to production schedule
+     *
+     *      Always remove all .source = PARSED events before moving
+     *      the content of the parsed before adding new PARSED.
+     *      This initialization function is called by either the start-up
+     *      or handle_SIGHUP() and both are responsible for parsing the
+     *      event schedule string before entering this function.
+     *
+     *  Parsing done by
+     *      config.c:cfg_check()
+     *      daemon.c:handle_SIGHUP() (by calling cfg_check())
+     */
+    event_schedule_clear(EVENT_SOURCE_PARSED);
+    // We expect the test schdule to contain event string content
+    event_commit_test_schedule();
+
+    /*
+     * Ping and Line Data Jobs
+     *
+     *      With cfg.execute.pinginterval > 0, pings and line data are
+     *      collected by separate workers, fork()'ed by PING and LINEDATA
+     *      interval events. Both are aligned to multiples of their interval
+     *      (from epoch) and the scheduled time is stored as the timestamp,
+     *      so a line data row has the same timestamp as the ping row of the
+     *      same second. Each job has its own timeout timer:
+     *
+     *          ping        slower of the two ping timeouts + grace time
+     *          line data   scrubber (collector) timeout + grace time
+     *
+     *      Events are (re)created each time, since intervals may have changed.
+     *      Must be done before the schedule timer is set.
+     */
+    event_remove(EVENT_ACTION_PING);
+    event_remove(EVENT_ACTION_LINEDATA);
+    event_remove(EVENT_ACTION_CHECKPOINT);
+    event_remove(EVENT_ACTION_ROLLOVER);
+    event_remove(EVENT_ACTION_RETENTION);
+    event_remove(EVENT_ACTION_REPLICA);
+    if (cfg.execute.pinginterval)
+    {
+        int timeout;
+        timeout = (cfg.modem.pingtimeout > cfg.inet.pingtimeout ?
+                   cfg.modem.pingtimeout : cfg.inet.pingtimeout) + DAEMON_JOB_GRACETIME;
+        this.ping.tspec.it_value.tv_sec         = timeout / 1000;
+        this.ping.tspec.it_value.tv_nsec        = (timeout % 1000) * 1000000;
+        timeout = cfg.modem.scrubber.timeout + DAEMON_JOB_GRACETIME;
+        this.linedata.tspec.it_value.tv_sec     = timeout / 1000;
+        this.linedata.tspec.it_value.tv_nsec    = (timeout % 1000) * 1000000;
+        if ((!this.ping.fd     && (this.ping.fd     = timerfd_create(CLOCK_REALTIME, 0)) == -1) ||
+            (!this.linedata.fd && (this.linedata.fd = timerfd_create(CLOCK_REALTIME, 0)) == -1))
+        {
+            logerr("timerfd_create()");
+            exit(EXIT_FAILURE);
+        }
+        if (event_create_aligned(EVENT_ACTION_PING, cfg.execute.pinginterval) < 0 ||
+            event_create_aligned(EVENT_ACTION_LINEDATA, cfg.execute.interval) < 0)
+        {
+            logerr("Failed to create ping and line data events");
+            exit(EXIT_FAILURE);
+        }
+        logdev(
+              "Ping job every %d s, line data job every %d s",
+              cfg.execute.pinginterval,
+              cfg.execute.interval
+              );
+    }
+
+    /*
+     * WAL checkpoints
+     *
+     *      Writer connection has automatic checkpoints disabled
+     *      (database.c:database_pragmas()), checkpoints are run by this
+     *      event instead of by whichever commit happens to cross the limit.
+     */
+    if (cfg.database.journal == CFG_JOURNAL_WAL && cfg.database.checkpointinterval)
+    {
+        if (event_create_aligned(EVENT_ACTION_CHECKPOINT, cfg.database.checkpointinterval) < 0)
+        {
+            logerr("Failed to create checkpoint event");
+            exit(EXIT_FAILURE);
+        }
+        logdev("WAL checkpoint every %d s", cfg.database.checkpointinterval);
+    }
+
+    /*
+     * Datafile partitions
+     *
+     *      Rollover right away takes care of a partition setting that was
+     *      just changed (SIGHUP) and of the periods that passed while the
+     *      daemon was not running. It schedules the following rollovers.
+     */
+    if (cfg.database.partition != CFG_PARTITION_NONE && daemon_rollover())
+        logerr("Partition rollover failed");
+
+    /*
+     * Retention
+     *
+     *      Rows older than cfg.database.retention days are deleted in
+     *      chunks by the database writer (dbwriter.c:dbwriter_retentionstep()).
+     *      With partitions, expired partitions are removed whole and this
+     *      only trims the current one.
+     */
+    if (cfg.database.retention)
+    {
+        if (event_create_aligned(EVENT_ACTION_RETENTION, DAEMON_RETENTION_INTERVAL) < 0)
+        {
+            logerr("Failed to create retention event");
+            exit(EXIT_FAILURE);
+        }
+        logdev("Retention %d days, checked every %d s", cfg.database.retention, DAEMON_RETENTION_INTERVAL);
+    }
+
+    /*
+     * Read-only replica
+     *
+     *      Reports read the replica (cfg.database.replica) instead of the
+     *      datafile, the copy is refreshed by daemon_replica().
+     */
+    if (cfg.database.replica[0])
+    {
+        if (event_create_aligned(EVENT_ACTION_REPLICA, cfg.database.replicainterval) < 0)
+        {
+            logerr("Failed to create replica event");
+            exit(EXIT_FAILURE);
+        }
+        logdev("Replica \"%s\" refreshed every %d s", cfg.database.replica, cfg.database.replicainterval);
+    }
+
     /*
      * Event Schedule Timer
      *
@@ -605,23 +997,6 @@ static void daemon_initialize()
         // Do not activate. It's done when the worker process is actually created.
     }
 
-    /*
-     * Commit parsed (tested) schedule to production schedule
-     *
-     *      Always remove all .source = PARSED events before moving
-     *      the content of the parsed before adding new PARSED.
-     *      This initialization function is called by either the start-up
-     *      or handle_SIGHUP() and both are responsible for parsing the
-     *      event schedule string before entering this function.
-     *
-     *  Parsing done by
-     *      config.c:cfg_check()
-     *      daemon.c:handle_SIGHUP() (by calling cfg_check())
-     */
-    event_schedule_clear(EVENT_SOURCE_PARSED);
-    // We expect the test schdule to contain event string content
-    event_commit_test_schedule();
-
     logdev("Initialization completed");
 }
 
@@ -684,6 +1059,8 @@ static void handle_SIGTERM()
 {
     this.state.running = false;
     logmsg(LOG_INFO, "Received SIGTERM, shutting down....");
+    // Do not wait for the commit interval
+    dbwriter_flush();
 }
 
 /*
@@ -704,6 +1081,9 @@ static void handle_SIGHUP()
     // one in main.c:main().
     // This is why this implementation follows closely the
     //
+    // Buffered rows are committed before anything changes
+    dbwriter_flush();
+
     // Create shallow duplicate for re-read attempt
     config_t *newcfg = cfg_dup(&cfg);
     cfg_init(newcfg);
@@ -739,6 +1119,8 @@ static void handle_SIGHUP()
 
     // Apply new configuration values
     daemon_initialize(); // replaces .source = PARSED events
+    // Database writer is restarted with them
+    dbwriter_restart();     // dbwriter.c
 }
 
 /*
@@ -772,29 +1154,23 @@ static void handle_SIGUSR2()
 }
 
 /*
- * Child (datalogger) has exited
+ * Collect exited child process
  */
-static void handle_SIGCHLD()
+static void collect_child(pid_t pid, int status)
 {
-
-    int   status;
-    pid_t pid;
-    if (!(pid = waitpid(-1, &status, WNOHANG)))
-    {
-        logerr(
-              "SIGCHLD received but waitpid() returned %d (expected %d)",
-              pid,
-              this.worker.pid
-              );
-        return;
-    }
-
     // Make sure it's the PID we expect
+    pidtimer_t *job = NULL;
     if (pid == this.worker.pid)
+        job = &this.worker;
+    else if (pid == this.ping.pid)
+        job = &this.ping;
+    else if (pid == this.linedata.pid)
+        job = &this.linedata;
+    if (job)
     {
-        timerfd_disarm(this.worker.fd);    // util.c
+        timerfd_disarm(job->fd);    // util.c
         //
-        // Datalogger / Worker PID...
+        // Datalogger / Worker PID (or ping / line data job)...
         //
         logdev("Datalogger PID received");
 
@@ -804,7 +1180,8 @@ static void handle_SIGCHLD()
         {
             // Voluntary exit
             logdev("worker pid: %d exited with code: %d", pid, WEXITSTATUS(status));
-            if (WEXITSTATUS(status))
+            // Unchanged line data is not an error condition
+            if (WEXITSTATUS(status) & ~DATALOGGER_FLAG_LINEDATA_UNCHANGED)
             {
                 ;
                 // Here we would look at the flags and codes...
@@ -812,7 +1189,14 @@ static void handle_SIGCHLD()
             else
             {
                 // clock in one more success
-                execstats.n_datalog_success++;
+                if (job == &this.ping)
+                    execstats.n_ping_success++;
+                else if (job == &this.linedata)
+                    execstats.n_linedata_success++;
+                else
+                    execstats.n_datalog_success++;
+                if (DATALOGGER_LINEDATA_UNCHANGED(WEXITSTATUS(status)))
+                    execstats.n_linedata_unchanged++;
             }
         }
         else if (WIFSIGNALED(status))
@@ -829,6 +1213,23 @@ static void handle_SIGCHLD()
         {
             logerr("Worker child neither exited nor was terminated by signal - this is considered impossible!");
             logerr("waitpid() returned status 0x%.8X", status);
+        }
+        // Collector result for the breaker. Killed job counts as failure,
+        // skipped collector (modem did not answer ping) as no result.
+        if (job->breaker)
+        {
+            int result = BREAKER_FAILURE;
+            if (WIFEXITED(status))
+            {
+                if (WEXITSTATUS(status) & (DATALOGGER_FLAG_SCRUBBER_TIMEOUT | DATALOGGER_FLAG_SCRUBBER_FAILURE))
+                    result = BREAKER_FAILURE;
+                else if (DATALOGGER_ICMPMODEMTOUT(WEXITSTATUS(status)))
+                    result = BREAKER_NORESULT;
+                else
+                    result = BREAKER_SUCCESS;
+            }
+            breaker_report(job->breaker, result, time(NULL));
+            job->breaker = NULL;
         }
                         /*
                          * Development info about child exit
@@ -849,7 +1250,7 @@ static void handle_SIGCHLD()
                         }
                         *//********* END development info */
         // We collected our PID - null it so we know not to wait anymore
-        this.worker.pid = 0;
+        job->pid = 0;
     }
     else if (pid == this.collecttmpfs.pid)
     {
@@ -861,7 +1262,7 @@ static void handle_SIGCHLD()
         if (WIFEXITED(status))
         {
             if (WEXITSTATUS(status))
-                logerr("CollectTMPFS process exited with code (%d)", WIFEXITED(status));
+                logerr("CollectTMPFS process exited with code (%d)", WEXITSTATUS(status));
         }
         else if (WIFSIGNALED(status))
         {
@@ -879,6 +1280,21 @@ static void handle_SIGCHLD()
         }
         this.collecttmpfs.pid = 0;
     }
+    else if (pid == this.replica.pid)
+    {
+        if (WIFEXITED(status) && WEXITSTATUS(status))
+            logerr("Replica process exited with code (%d)", WEXITSTATUS(status));
+        else if (WIFSIGNALED(status))
+            logmsg(
+                  LOG_INFO,
+                  "Replica process (pid: %d) died to %s signal",
+                  pid,
+                  getsignalname(WTERMSIG(status))
+                  );
+        this.replica.pid = 0;
+    }
+    else if (dbwriter_exited(pid, status))  // dbwriter.c
+        ;
     else
     {
         logerr(
@@ -889,6 +1305,31 @@ static void handle_SIGCHLD()
               );
         return;
     }
+}
+
+/*
+ * Child (datalogger) has exited
+ *
+ *      Signals are not queued. Ping and line data jobs can exit at the
+ *      same time and deliver only one SIGCHLD - collect all exited.
+ */
+static void handle_SIGCHLD()
+{
+    int   status;
+    int   n_collected = 0;
+    pid_t pid;
+    while ((pid = waitpid(-1, &status, WNOHANG)) > 0)
+    {
+        collect_child(pid, status);
+        n_collected++;
+    }
+    if (!n_collected)
+        logerr(
+              "SIGCHLD received but waitpid() returned %d (expected %d)",
+              pid,
+              this.worker.pid
+              );
+    errno = 0;  // last waitpid() leaves ECHILD
     logdev("handle_SIGCHLD() completed.");
 }
 
@@ -995,6 +1436,21 @@ void daemon_main(void)
 
 
 
+    /*
+     * Collector breakers (state is kept over SIGHUP)
+     */
+    int c;
+    for (c = 0; c <= CFG_COLLECTOR_HTTP; c++)
+        breaker_init(&this.breaker[c], CFG_COLLECTOR_NAME(c));
+
+    /*
+     * Database writer process (persistent connection, workers send their rows)
+     */
+    if (cfg.database.backend != CFG_BACKEND_SQLITE)
+        logmsg(LOG_INFO, "%s storage backend, workers write through it", CFG_BACKEND_NAME(cfg.database.backend));
+    else if (dbwriter_start(cfg.execute.tmpfs ? cfg.database.tmpfsfilename : database_partition(time(NULL))))
+        logerr("Unable to open database writer, workers will insert directly");
+
     /*
      * Initialize values that depend on config_t cfg
      */
@@ -1133,44 +1589,10 @@ void daemon_main(void)
             execstats.n_interval_ticks++;
 
             // launch worker process unless suspended
-            if (!(this.state.suspended_by_command || this.state.suspended_by_schedule))
-            {
-                if (this.worker.pid)
-                {
-                    logerr("Previous worker still running, skipping this tick...");
-                    // at least until multiple workers are supported...
-                }
-                else
-                {
-                    // create worker process 
-                    this.worker.pid = fork();
-                    if (this.worker.pid < 0)
-                    {
-                        logerr("Unable to fork worker process");
-                        // No exit, acceptable to lose a tick (see design notes)
-                        this.worker.pid = 0;
-                    }
-                    else if (this.worker.pid > 0)
-                    {
-                        // Start worker/datalogger child timer (relative)
-                        timerfd_start_rel(this.worker.fd, &this.worker.tspec);
-                        execstats.n_datalog_actions++;
-                        logdev("Created worker process (PID: %d)", this.worker.pid);
-                        // ...and that's all we need to do here
-                    }
-                    else
-                    {
-                        // fork() returned zero, this is child code
-                        int rc = datalogger(time(NULL));
-// Maybe some logging about datalogger return codes?
-                        logmsg(LOG_DEBUG, "datalogger() function returned %d.", rc);
-                        // Now the child needs to _exit(), or it will run daemon_main code...
-                        // NOTE: It will need to be _exit() -function or child will call atexit()
-                        // registered fucntion
-                        _exit(rc);
-                    }
-                } // if (this.workerpid)
-            } // if not suspended
+            // (no exit on failure, acceptable to lose a tick - see design notes)
+            if (!daemon_forkjob(&this.worker, "worker", time(NULL), DATALOGGER_JOB_ALL) &&
+                this.worker.pid)
+                execstats.n_datalog_actions++;
         } // FD_ISSET(this.intervaltimer)
 
         /*
@@ -1191,6 +1613,27 @@ void daemon_main(void)
             // It may take a little time for the child to actually die
         }
 
+        /*
+********** Ping / Line data job timeout
+         */
+        pidtimer_t *jobs[] = { &this.ping, &this.linedata };
+        int         j;
+        for (j = 0; j < 2; j++)
+        {
+            if (jobs[j]->fd && FD_ISSET(jobs[j]->fd, &this.readfds))
+            {
+                timerfd_acknowledge(jobs[j]->fd);   // util.c
+                timerfd_disarm(jobs[j]->fd);        // util.c
+                logdev("Job timed out! Killing PID: %d", jobs[j]->pid);
+                if (jobs[j]->pid && kill(jobs[j]->pid, SIGKILL))
+                {
+                    logerr("kill(%d, SIGKILL) failed", jobs[j]->pid);
+                    exit(EXIT_FAILURE);
+                }
+                // Collected by the SIGCHLD handler
+            }
+        }
+
         /*
 ********** CollectTMPFS timeout
          */
@@ -1264,8 +1707,15 @@ void daemon_main(void)
     /*
      * Daemon termination procedures
      */
+    // Write whatever workers left behind
+    dbwriter_close();
+    // tmpfs does not survive a reboot - move everything out
+    if (cfg.execute.tmpfs && !this.collecttmpfs.pid)
+        database_collecttmpfs(time(NULL));  // database.c
     // Report execution statistics
     logexecstats();
+    webui_close();
+    counters_close();
     // Close syslog
     closelog();
     // Release pidfile
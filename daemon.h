@@ -1,6 +1,7 @@
 /*
  * daemon.h - 2016 Jani Tammi <janitammi@gmail.com>
  */
+#include <time.h>       // time_t
 
  #ifndef __DAEMON_H__
  #define __DAEMON_H__
@@ -26,6 +27,21 @@ int daemon_watchdog();
 int daemon_importtmpfs();
 int daemon_importtmpfstimeout();
 
+/*
+ * Separately scheduled worker jobs (cfg.execute.pinginterval > 0)
+ * Argument is the scheduled time, stored as the row timestamp.
+ */
+int daemon_ping(time_t scheduled);
+int daemon_linedata(time_t scheduled);
+
+/*
+ * WAL checkpoint (cfg.database.journal == WAL)
+ */
+int daemon_checkpoint();
+int daemon_rollover();
+int daemon_retention();
+int daemon_replica();
+
 #endif /* __DAEMON_H__ */
 
 /* EOF daemon.h */
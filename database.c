@@ -6,7 +6,12 @@
 #include <time.h>               // time_t
 #include <math.h>
 #include <stdlib.h>             // exit()
+#include <string.h>             // strdup()
 #include <errno.h>              // errno
+#include <fcntl.h>              // open()
+#include <sys/stat.h>           // stat()
+#include <glob.h>               // glob()
+#include <stdbool.h>            // true, false
 #include <sqlite3.h>
 
 #include "database.h"
@@ -14,6 +19,73 @@
 #include "logwrite.h"
 #include "util.h"
 
+#define DATABASE_ROLLUP_LEVELS      3     // rollup_1m, rollup_1h, rollup_1d
+#define DATABASE_SPAN_COLUMNS       32    // span_table[] columns (counters has 28)
+
+// database_scan() and database_violations() index the values as an array
+_Static_assert(
+              sizeof(databaserecord_t) == sizeof(time_t) + DATABASE_SAMPLE_COLUMNS * sizeof(double),
+              "databaserecord_t values are not consecutive doubles"
+              );
+
+static int database_rollupsql(void);
+static int database_densesql(void);
+static int database_materialize(sqlite3 *db, const char *schema, int64_t from, int64_t until, char **errmsg);
+static int database_userversion(sqlite3 *db);
+static int database_globpartitions(glob_t *g);
+static int database_rollupexec(sqlite3 *db, sqlite3_stmt **stmt, int64_t first, int64_t last);
+static char *rollup_create;
+static char *dense_create;
+
+/*
+ * Latest tmpfs import watermark of datafile, 0 if none
+ */
+static int64_t database_watermark(char *filename)
+{
+    sqlite3      *db;
+    sqlite3_stmt *stmt;
+    int64_t       watermark = 0;
+
+    if (sqlite3_open_v2(filename, &db, SQLITE_OPEN_READONLY, NULL) == SQLITE_OK)
+    {
+        sqlite3_busy_timeout(db, DATABASE_SQLITE3_BUSY_TIMEOUT);
+        // No tmpfsimport table, no imports
+        if (sqlite3_prepare_v2(db, SQL_SELECT_TMPFSIMPORT_WATERMARK, -1, &stmt, NULL) == SQLITE_OK)
+        {
+            if (sqlite3_step(stmt) == SQLITE_ROW)
+                watermark = sqlite3_column_int64(stmt, 0);
+            sqlite3_finalize(stmt);
+        }
+    }
+    sqlite3_close(db);
+    return watermark;
+}
+
+/*
+ * Latest watermark before datafile (a partition) had one
+ */
+static int64_t database_lastwatermark(char *datafile)
+{
+    glob_t  g;
+    int64_t watermark = 0;
+    size_t  i;
+
+    if (!strcmp(datafile, cfg.database.filename))
+        return 0;
+    if (!database_globpartitions(&g))
+    {
+        // Names sort chronologically, newest older partition first
+        for (i = g.gl_pathc; i > 0 && !watermark; i--)
+            if (strcmp(g.gl_pathv[i - 1], datafile) < 0)
+                watermark = database_watermark(g.gl_pathv[i - 1]);
+        globfree(&g);
+    }
+    if (!watermark)
+        watermark = database_watermark(cfg.database.filename);
+    errno = 0;
+    return watermark;
+}
+
 /*
  * Event command handler for EVENT_CMD_COLLECTTMPFS
  *
@@ -22,26 +94,306 @@
  *      file and finally, when successful, deletes the records that
  *      were moved.
  *
+ *      tmpfs datafile is ATTACH'ed and everything is done with bulk
+ *      INSERT ... SELECT and DELETE statements in one transaction, so
+ *      the time taken depends very little on the backlog.
+ *
+ *      Watermark (olderthan) of each import is stored into the actual
+ *      datafile (tmpfsimport table), in the same transaction as the
+ *      rows. Only rows newer than the previous watermark are copied.
+ *      New partition has no watermark of its own, it carries over from
+ *      the newest older partition that has one, or the base datafile
+ *      (database_lastwatermark()). Rows are copied with INSERT OR IGNORE,
+ *      a timestamp the datafile already has does not fail the import.
+ *      Transaction over attached databases is not atomic across the
+ *      files in WAL mode; if the rows were committed into the actual
+ *      datafile, but not deleted from tmpfs, the next import deletes
+ *      them without copying them again.
+ *
+ *      Caller must make sure that no rows older than the watermark are
+ *      still on their way into the tmpfs datafile (see daemon.c).
+ *
+ *      If both datafiles use the compact schema, samples table is copied
+ *      as is. Otherwise data views (and their triggers) do the conversion.
+ *
+ *      Rollups of the actual datafile are updated in the same transaction.
+ *
+ *      With partitioned datafiles, rows are moved into the partition of
+ *      the watermark (rows of the previous period, imported after the
+ *      rollover, land in the new partition).
  */
 int database_collecttmpfs(time_t olderthan)
 {
-    if (!cfg.execute.tmpfs)
+    const char *table[] = { "data", "counters", "reboots", NULL };
+    sqlite3    *db;
+    char       *sql;
+    char       *errmsg = NULL;
+    xtmr_t     *t;
+    int64_t     previous = 0, first = -1;
+    int         n_rows = 0, n_changes;
+    int         rc, i, rollups, compact;
+    // Rows go into the partition of the watermark
+    char       *datafile = database_partition(olderthan);
+
+    if (!cfg.execute.tmpfs || !cfg.database.tmpfsfilename)
     {
         logerr("tmpfs not in use! This should not have been called!");
         return EXIT_FAILURE;
     }
-    logerr("NOT IMPLEMENTED!");
-    return EXIT_FAILURE;
+    if (database_preparepartition(datafile))
+        return EXIT_FAILURE;
+    t = xtmr();
+    rollups = database_schema(datafile) == DATABASE_SCHEMA_COMPACT;
+    compact = database_schema(cfg.database.tmpfsfilename) == DATABASE_SCHEMA_COMPACT;
+    if (rollups && compact)
+        table[0] = "samples";
+    if ((rc = sqlite3_open(datafile, &db)) != SQLITE_OK)
+    {
+        logerr("Can't open database \"%s\": %s", datafile, sqlite3_errmsg(db));
+        sqlite3_close(db);
+        free(t);
+        return EXIT_FAILURE;
+    }
+    sqlite3_busy_timeout(db, DATABASE_SQLITE3_BUSY_TIMEOUT);
+    sql = sqlite3_mprintf("ATTACH DATABASE %Q AS tmpfs", cfg.database.tmpfsfilename);
+    rc  = sqlite3_exec(db, sql, NULL, NULL, &errmsg);
+    sqlite3_free(sql);
+    // IMMEDIATE: database writer waits until we are done, not the other way around
+    if (rc == SQLITE_OK)
+        rc = sqlite3_exec(db, SQL_CREATE_TABLE_TMPFSIMPORT "BEGIN IMMEDIATE", NULL, NULL, &errmsg);
+    if (rc == SQLITE_OK)
+    {
+        sqlite3_stmt *stmt;
+        if ((rc = sqlite3_prepare_v2(db, SQL_SELECT_TMPFSIMPORT_WATERMARK, -1, &stmt, NULL)) == SQLITE_OK)
+        {
+            if (sqlite3_step(stmt) == SQLITE_ROW)
+                previous = sqlite3_column_int64(stmt, 0);
+            sqlite3_finalize(stmt);
+        }
+        if (!previous)
+            previous = database_lastwatermark(datafile);
+        // Oldest row imported, rollups are recomputed from there on
+        sql = sqlite3_mprintf(
+                             "SELECT MIN(Timestamp) FROM tmpfs.%s WHERE Timestamp > %lld AND Timestamp <= %lld",
+                             table[0], (long long)previous, (long long)olderthan
+                             );
+        if (rollups && sqlite3_prepare_v2(db, sql, -1, &stmt, NULL) == SQLITE_OK)
+        {
+            if (sqlite3_step(stmt) == SQLITE_ROW && sqlite3_column_type(stmt, 0) != SQLITE_NULL)
+                first = sqlite3_column_int64(stmt, 0);
+            sqlite3_finalize(stmt);
+        }
+        sqlite3_free(sql);
+    }
+    for (i = 0; table[i] && rc == SQLITE_OK; i++)
+    {
+        // Rows of the range, and the one after it, could carry from the moved rows
+        if (i == 0 && rollups &&
+            (rc = database_materialize(db, "main", previous, olderthan, &errmsg)) != SQLITE_OK)
+            break;
+        sql = sqlite3_mprintf(
+                             "INSERT OR IGNORE INTO main.%s SELECT * FROM tmpfs.%s "
+                             "WHERE Timestamp > %lld AND Timestamp <= %lld",
+                             table[i], table[i],
+                             (long long)previous, (long long)olderthan
+                             );
+        // sqlite3_changes() would not count rows inserted by triggers
+        n_changes = sqlite3_total_changes(db);
+        if ((rc = sqlite3_exec(db, sql, NULL, NULL, &errmsg)) == SQLITE_OK)
+            n_rows += sqlite3_total_changes(db) - n_changes;
+        sqlite3_free(sql);
+        if (rc != SQLITE_OK)
+            break;
+        // First remaining row may carry from the moved rows, like after retention
+        if (i == 0 && compact &&
+            (rc = database_materialize(db, "tmpfs", olderthan, olderthan, &errmsg)) != SQLITE_OK)
+            break;
+        sql = sqlite3_mprintf(
+                             "DELETE FROM tmpfs.%s WHERE Timestamp <= %lld",
+                             table[i], (long long)olderthan
+                             );
+        rc = sqlite3_exec(db, sql, NULL, NULL, &errmsg);
+        sqlite3_free(sql);
+    }
+    if (rc == SQLITE_OK && first >= 0)
+    {
+        sqlite3_stmt *stmt[DATABASE_ROLLUP_LEVELS * 2];
+        memset(stmt, 0, sizeof(stmt));
+        rc = database_rollupexec(db, stmt, first, olderthan);
+        for (i = 0; i < DATABASE_ROLLUP_LEVELS * 2; i++)
+            sqlite3_finalize(stmt[i]);
+    }
+    if (rc == SQLITE_OK)
+    {
+        sql = sqlite3_mprintf(
+                             "INSERT INTO main.tmpfsimport VALUES (%lld, %lld, %d); COMMIT;",
+                             (long long)time(NULL), (long long)olderthan, n_rows
+                             );
+        rc = sqlite3_exec(db, sql, NULL, NULL, &errmsg);
+        sqlite3_free(sql);
+    }
+    if (rc != SQLITE_OK)
+    {
+        logerr("tmpfs import failed: %s", errmsg ? errmsg : sqlite3_errmsg(db));
+        sqlite3_free(errmsg);
+        sqlite3_exec(db, "ROLLBACK", NULL, NULL, NULL);
+        sqlite3_close(db);
+        free(t);
+        return EXIT_FAILURE;
+    }
+    sqlite3_close(db);
+    logmsg(
+          LOG_INFO,
+          "tmpfs import: %d rows older than %lld moved in %.2f ms",
+          n_rows,
+          (long long)olderthan,
+          xtmrlap(t)
+          );
+    free(t);
+    errno = 0;
+    return EXIT_SUCCESS;
+}
+
+/*
+ * Read-only replica for reports
+ *
+ *      Online backup API copies the datafile DATABASE_REPLICA_PAGES pages
+ *      per sqlite3_backup_step(), sleeping DATABASE_REPLICA_SLEEP ms in
+ *      between. Source is locked only for the duration of a step:
+ *
+ *          WAL         A read transaction is held over the whole copy, the
+ *                      copy is one consistent snapshot. Readers do not
+ *                      block the writer (a TRUNCATE checkpoint may have to
+ *                      wait for the next attempt).
+ *          DELETE      Shared lock of one step at a time, which a commit
+ *                      has to wait out: DATABASE_REPLICA_PAGES_DELETE pages
+ *                      per step, and the writer connection retries in short
+ *                      sleeps (database_busytimeout()). A commit between
+ *                      the steps restarts the copy from the first page,
+ *                      at most DATABASE_REPLICA_MAXRESTARTS times.
+ *
+ *      Busy source is not waited for in the step (busy timeout 0), the
+ *      step is retried after the sleep instead, so that a pending commit
+ *      gets the lock first.
+ *
+ *      Copy is written without a journal and syncs (it is not in use until
+ *      the rename), so that it does not add to the I/O a commit waits for.
+ *      Replica is in rollback journal mode (readers need no -shm file),
+ *      fsync()'ed, made read-only and renamed over the previous replica.
+ *      Run as a child process of the daemon (daemon.c:daemon_replica()).
+ */
+int database_replicate(char *filename, char *replica)
+{
+    sqlite3        *src, *dst = NULL;
+    sqlite3_backup *backup = NULL;
+    sqlite3_stmt   *stmt;
+    char            tmpname[strlen(replica) + sizeof(DATABASE_REPLICA_SUFFIX)];
+    xtmr_t         *t;
+    int             rc, fd, remaining, previous = -1;
+    int             n_steps = 0, n_restarts = 0, n_pages;
+    bool            wal = false;
+
+    sprintf(tmpname, "%s" DATABASE_REPLICA_SUFFIX, replica);
+    unlink(tmpname);
+    t = xtmr();
+    if ((rc = sqlite3_open_v2(filename, &src, SQLITE_OPEN_READONLY, NULL)) != SQLITE_OK)
+    {
+        logerr("Unable to open datafile \"%s\": %s", filename, sqlite3_errmsg(src));
+        sqlite3_close(src);
+        free(t);
+        return EXIT_FAILURE;
+    }
+    sqlite3_busy_timeout(src, 0);
+    if (sqlite3_prepare_v2(src, "PRAGMA journal_mode", -1, &stmt, NULL) == SQLITE_OK)
+    {
+        if (sqlite3_step(stmt) == SQLITE_ROW)
+            wal = !sqlite3_stricmp((const char *)sqlite3_column_text(stmt, 0), "wal");
+        sqlite3_finalize(stmt);
+    }
+    // Snapshot: read transaction is started by the first read
+    if (wal)
+        rc = sqlite3_exec(src, "BEGIN; SELECT COUNT(*) FROM sqlite_master;", NULL, NULL, NULL);
+    n_pages = wal ? DATABASE_REPLICA_PAGES : DATABASE_REPLICA_PAGES_DELETE;
+    if (rc == SQLITE_OK &&
+        (rc = sqlite3_open(tmpname, &dst)) == SQLITE_OK &&
+        (rc = sqlite3_exec(dst, "PRAGMA journal_mode = OFF; PRAGMA synchronous = OFF", NULL, NULL, NULL)) == SQLITE_OK &&
+        !(backup = sqlite3_backup_init(dst, "main", src, "main")))
+        rc = sqlite3_errcode(dst);
+    while (backup)
+    {
+        rc = sqlite3_backup_step(backup, n_pages);
+        if (rc == SQLITE_DONE || (rc != SQLITE_OK && rc != SQLITE_BUSY && rc != SQLITE_LOCKED))
+            break;
+        n_steps++;
+        // Copied step that did not bring remaining down restarted the copy
+        // (source changed), busy step copied nothing
+        remaining = sqlite3_backup_remaining(backup);
+        if (rc == SQLITE_OK && previous >= 0 && remaining >= previous &&
+            ++n_restarts > DATABASE_REPLICA_MAXRESTARTS)
+        {
+            rc = SQLITE_BUSY;
+            break;
+        }
+        previous = remaining;
+        usleep(DATABASE_REPLICA_SLEEP * 1000);
+    }
+    if (backup && sqlite3_backup_finish(backup) != SQLITE_OK && rc == SQLITE_DONE)
+        rc = sqlite3_errcode(dst);
+    if (wal)
+        sqlite3_exec(src, "COMMIT", NULL, NULL, NULL);
+    sqlite3_close(src);
+    if (rc == SQLITE_DONE)
+        rc = sqlite3_exec(dst, "PRAGMA journal_mode = DELETE", NULL, NULL, NULL);
+    if (rc != SQLITE_OK)
+    {
+        logerr(
+              "Replica of \"%s\" failed: %s",
+              filename,
+              rc == SQLITE_BUSY && n_restarts > DATABASE_REPLICA_MAXRESTARTS ?
+              "datafile changed during every copy" : (dst ? sqlite3_errmsg(dst) : sqlite3_errstr(rc))
+              );
+        sqlite3_close(dst);
+        unlink(tmpname);
+        free(t);
+        return EXIT_FAILURE;
+    }
+    sqlite3_close(dst);
+
+    // Content on disk before the rename, so that a crash leaves either copy
+    if ((fd = open(tmpname, O_RDONLY)) < 0 || fsync(fd) ||
+        chmod(tmpname, S_IRUSR | S_IRGRP | S_IROTH) ||
+        rename(tmpname, replica))
+    {
+        logerr("Unable to replace replica \"%s\"", replica);
+        if (fd >= 0)
+            close(fd);
+        unlink(tmpname);
+        free(t);
+        return EXIT_FAILURE;
+    }
+    close(fd);
+    logmsg(
+          LOG_INFO,
+          "Replica \"%s\" written in %.2f ms (%d steps, %d restarts)",
+          replica,
+          xtmrlap(t),
+          n_steps,
+          n_restarts
+          );
+    free(t);
+    errno = 0;
+    return EXIT_SUCCESS;
 }
 
 /*
  * test SQLite3 write performance
  *
  *      Test is made against "standard" datafile (cfg.database.filename).
- *      Function returns dbwriteperf_t pointer which is allocated from heap.
- *      Caller is responsible for releasing it when no longer needed.
+ *      If persistent is true, all rows are written over one handle (as the
+ *      daemon does), otherwise each row opens and closes the database.
+ *      Function returns pointer to static dbperf_t (do not free).
  */
-dbperf_t *database_testwriteperf(int nsamples)
+dbperf_t *database_testwriteperf(int nsamples, int persistent)
 {
     databaserecord_t dbrec;
     static dbperf_t  dbperf;
@@ -58,14 +410,19 @@ dbperf_t *database_testwriteperf(int nsamples)
     double M2       = 0.0L;
     double delta;
     
+    dbhandle_t *h = NULL;
+    if (persistent && !(h = database_open(cfg.database.filename)))
+        return NULL;
     xtmr_t *t = xtmr();             // Timer
     int rc;                         // return value
     do
     {
         xtmrlap(t);
-        if ((rc = database_insert(cfg.database.filename, &dbrec)))
+        if ((rc = h ? database_write(h, &dbrec) : database_insert(cfg.database.filename, &dbrec)))
         {
             logerr("\ndatabase_insert() failed!");
+            database_close(h);
+            free(t);
             return NULL;
         }
         else
@@ -82,12 +439,41 @@ dbperf_t *database_testwriteperf(int nsamples)
         }
     } while (--nsamples);
     free(t);
+    database_close(h);
 
     // Remove test rows
     database_delete(dbrec.timestamp);
     return &dbperf;
 }
 
+static int database_cmpdouble(const void *a, const void *b)
+{
+    return *(const double *)a < *(const double *)b ? -1 : *(const double *)a > *(const double *)b;
+}
+
+dbperf_t *database_perfstats(dbperf_t *perf, double *ms, int n)
+{
+    double sum = 0.0, sq = 0.0;
+    int    i;
+
+    memset(perf, 0, sizeof(dbperf_t));
+    if (n < 1)
+        return perf;
+    qsort(ms, n, sizeof(double), database_cmpdouble);
+    for (i = 0; i < n; i++)
+        sum += ms[i];
+    perf->mean = sum / n;
+    for (i = 0; i < n; i++)
+        sq += (ms[i] - perf->mean) * (ms[i] - perf->mean);
+    perf->n      = n;
+    perf->min    = ms[0];
+    perf->max    = ms[n - 1];
+    perf->stddev = n > 1 ? sqrt(sq / (n - 1)) : 0.0;
+    perf->p50    = ms[(n - 1) / 2];
+    perf->p99    = ms[(99 * n + 99) / 100 - 1];
+    return perf;
+}
+
 
 /*
  * Create database file
@@ -120,11 +506,17 @@ int database_initialize(char *filename)
     }
 
     /*
-     * Create data table
+     * Create data table (compact schema, "data" is a view)
+     * auto_vacuum must be set before the first table (retention)
      */
     if ((rc = sqlite3_exec(
                           db,
-                          SQL_CREATE_TABLE_DATA,
+                          "PRAGMA auto_vacuum = INCREMENTAL; "
+                          SQL_CREATE_TABLE_SAMPLES
+                          SQL_CREATE_VIEW_DATA
+                          SQL_CREATE_TRIGGER_DATA_INSERT
+                          SQL_CREATE_TRIGGER_DATA_DELETE
+                          SQL_SET_SCHEMA_COMPACT,
                           (void *)0,
                           0,
                           &errMsg
@@ -151,6 +543,8 @@ int database_initialize(char *filename)
     }
 
     sqlite3_close(db);
+    if ((rc = database_upgrade(filename)))
+        return rc;
     // SQLite3 functions persistently set errno values even without errors.
     // They are then automatically picked up by my logwrite routines.
     // This disturbs my little happy world, and thus I simply zero errno now.
@@ -158,227 +552,1948 @@ int database_initialize(char *filename)
     return EXIT_SUCCESS;
 }
 
-int database_delete(int timestamp)
+/*
+ * Does table have the column
+ */
+static int database_hascolumn(sqlite3 *db, const char *table, const char *column)
 {
-    int           rc;
-    sqlite3      *db;
     sqlite3_stmt *stmt;
-    char         *sqlstr;
+    char         *sql = sqlite3_mprintf("SELECT %s FROM %s", column, table);
+    int           exists;
 
-    if ((rc = sqlite3_open(cfg.database.filename, &db)) != SQLITE_OK)
+    exists = sqlite3_prepare_v2(db, sql, -1, &stmt, NULL) == SQLITE_OK;
+    sqlite3_finalize(stmt);
+    sqlite3_free(sql);
+    return exists;
+}
+
+/*
+ * Violations column (bounds), with a partial index over the rows that
+ * have violations, and the Carried column (change-only storage) of the
+ * compact schema. Compact schema: samples_dense, the data view and its
+ * triggers are recreated to include the columns. No data table, nothing
+ * to upgrade.
+ */
+static int database_upgradecolumns(sqlite3 *db, char **errmsg)
+{
+    int         compact = database_userversion(db) == DATABASE_SCHEMA_COMPACT;
+    const char *table   = compact ? "samples" : "data";
+    int         violations, carried, rc;
+    char       *sql;
+
+    if (!database_hascolumn(db, table, "Timestamp"))
+        return SQLITE_OK;
+    violations = database_hascolumn(db, table, "Violations");
+    carried    = !compact || database_hascolumn(db, table, "Carried");
+    if (compact && (rc = database_densesql()) != SQLITE_OK)
+        return rc;
+    if (!violations || !carried)
     {
-        logerr("Can't open database: %s", sqlite3_errmsg(db));
+        if (compact)
+        {
+            sql = sqlite3_mprintf(
+                                 "BEGIN IMMEDIATE; %s%s"
+                                 "DROP VIEW IF EXISTS data; "
+                                 "DROP VIEW IF EXISTS samples_dense; "
+                                 "%s"
+                                 SQL_CREATE_VIEW_DATA
+                                 SQL_CREATE_TRIGGER_DATA_INSERT
+                                 SQL_CREATE_TRIGGER_DATA_DELETE
+                                 "COMMIT; ",
+                                 violations ? "" : "ALTER TABLE samples ADD COLUMN Violations INTEGER; ",
+                                 carried ? "" : "ALTER TABLE samples ADD COLUMN Carried INTEGER; ",
+                                 dense_create
+                                 );
+            rc = sqlite3_exec(db, sql, NULL, NULL, errmsg);
+            sqlite3_free(sql);
+        }
+        else
+            rc = sqlite3_exec(db, "ALTER TABLE data ADD COLUMN Violations INTEGER", NULL, NULL, errmsg);
+        if (rc != SQLITE_OK)
+        {
+            if (!sqlite3_get_autocommit(db))
+                sqlite3_exec(db, "ROLLBACK", NULL, NULL, NULL);
+            return rc;
+        }
+        logmsg(
+              LOG_INFO,
+              "%s%s%s column added into %s table",
+              violations ? "" : "Violations",
+              !violations && !carried ? " and " : "",
+              carried ? "" : "Carried",
+              table
+              );
+    }
+    if (compact && (rc = sqlite3_exec(db, dense_create, NULL, NULL, errmsg)) != SQLITE_OK)
+        return rc;
+    return sqlite3_exec(
+                       db,
+                       compact ? SQL_CREATE_INDEX_SAMPLES_VIOLATIONS : SQL_CREATE_INDEX_DATA_VIOLATIONS,
+                       NULL, NULL, errmsg
+                       );
+}
+
+/*
+ * Create tables and views added after the original data table
+ *
+ *      Statements use "IF NOT EXISTS" and this is safe to call for any
+ *      existing database file.
+ */
+int database_upgrade(char *filename)
+{
+    int      rc;
+    sqlite3 *db;
+    char    *errMsg = 0;
+    int      i;
+    const char *sql[] =
+    {
+        SQL_CREATE_VIEW_JOINED,
+        SQL_CREATE_TABLE_COUNTERS,
+        SQL_CREATE_TABLE_REBOOTS,
+        SQL_CREATE_VIEW_COUNTER_RATES,
+        SQL_CREATE_TABLE_TMPFSIMPORT,
+        SQL_CREATE_TABLE_BOUNDS,
+        NULL
+    };
+
+    if ((rc = sqlite3_open(filename, &db)) != SQLITE_OK)
+    {
+        logerr("Can't open database (\"%s\"): %s", filename, sqlite3_errmsg(db));
         sqlite3_close(db);
         return rc;
     }
-
     if ((rc = sqlite3_busy_timeout(db, DATABASE_SQLITE3_BUSY_TIMEOUT)) != SQLITE_OK)
     {
         logerr("Unable to set timeout: %s", sqlite3_errmsg(db));
         sqlite3_close(db);
         return rc;
     }
-
-    if (timestamp < 0)
-        sqlstr = SQL_DELETE_ALL;
-    else
-        sqlstr = SQL_DELETE_BY_TIMESTAMP;
-
-    if ((rc = sqlite3_prepare_v2(
-                                db,            // Database handle
-                                sqlstr,        // SQL statement, UTF-8 encoded
-                                -1,            // Maximum length of zSql in bytes. (-1 = read until null termination)
-                                &stmt,         // OUT: Statement handle
-                                NULL           // OUT: Pointer to unused portion of zSql
-                                )) != SQLITE_OK)
+    for (i = 0; sql[i]; i++)
     {
-        logerr("Unable to prepare DELETE SQL: %s", sqlite3_errmsg(db));
+        if ((rc = sqlite3_exec(db, sql[i], (void *)0, 0, &errMsg)) != SQLITE_OK)
+        {
+            logerr("SQL error: %s", errMsg ? errMsg : sqlite3_errmsg(db));
+            sqlite3_free(errMsg);
+            sqlite3_close(db);
+            return rc;
+        }
+    }
+    if ((rc = database_upgradecolumns(db, &errMsg)) != SQLITE_OK ||
+        (rc = database_rollupsql()) != SQLITE_OK ||
+        (rc = sqlite3_exec(db, rollup_create, (void *)0, 0, &errMsg)) != SQLITE_OK)
+    {
+        logerr("SQL error: %s", errMsg ? errMsg : sqlite3_errmsg(db));
+        sqlite3_free(errMsg);
         sqlite3_close(db);
         return rc;
     }
+    sqlite3_close(db);
+    errno = 0;
+    return EXIT_SUCCESS;
+}
 
-    if (timestamp >= 0)
+/*
+ * Schema version of the datafile (DATABASE_SCHEMA_*), -1 on error
+ */
+static int database_userversion(sqlite3 *db)
+{
+    sqlite3_stmt *stmt;
+    int           version = -1;
+
+    if (sqlite3_prepare_v2(db, "PRAGMA user_version", -1, &stmt, NULL) == SQLITE_OK)
     {
-        sqlite3_bind_int(stmt, sqlite3_bind_parameter_index(stmt, "@Timestamp"), timestamp);
+        if (sqlite3_step(stmt) == SQLITE_ROW)
+            version = sqlite3_column_int(stmt, 0);
+        sqlite3_finalize(stmt);
     }
+    return version;
+}
 
-    // Execute statement
-	if ((rc = sqlite3_step(stmt)) != SQLITE_DONE)
+int database_schema(char *filename)
+{
+    sqlite3      *db;
+    int           version;
+
+    if (sqlite3_open_v2(filename, &db, SQLITE_OPEN_READONLY, NULL) != SQLITE_OK)
     {
-		logerr("Delete statement dod not return with SQLITE_DONE: %s", sqlite3_errmsg(db));
+        logerr("Can't open database (\"%s\"): %s", filename, sqlite3_errmsg(db));
         sqlite3_close(db);
-        return rc;
-	}
-
-    sqlite3_finalize(stmt);
+        return -1;
+    }
+    version = database_userversion(db);
     sqlite3_close(db);
+    errno = 0;
+    return version;
+}
+
+/*
+ * Switch datafile to incremental auto_vacuum (retention). Takes effect
+ * with VACUUM, which rewrites the whole file and also returns all free
+ * pages. VACUUM is run even if auto_vacuum is already set.
+ */
+static int database_setautovacuum(char *filename)
+{
+    sqlite3 *db;
 
+    if (sqlite3_open(filename, &db) != SQLITE_OK)
+    {
+        logerr("Can't open database (\"%s\"): %s", filename, sqlite3_errmsg(db));
+        sqlite3_close(db);
+        return EXIT_FAILURE;
+    }
+    sqlite3_busy_timeout(db, DATABASE_SQLITE3_BUSY_TIMEOUT);
+    if (sqlite3_exec(db, "PRAGMA auto_vacuum = INCREMENTAL; VACUUM", NULL, NULL, NULL) != SQLITE_OK)
+    {
+        logmsg(LOG_ERR, "VACUUM failed: %s", sqlite3_errmsg(db));
+        sqlite3_close(db);
+        return EXIT_FAILURE;
+    }
+    sqlite3_close(db);
+    errno = 0;
     return EXIT_SUCCESS;
 }
 
 /*
- * Insert record
+ * Convert legacy data table into the compact schema
  *
- * 1. bind variables to statement
- * 2. open cfg->db_filename
- * 3. execute statement
- * 4. close database
- *
- * RETURN
- *      SQLITE_OK       Success
- *      *               Return code received from failed sqlite3_ -function
+ *      Everything is done in one transaction: legacy table is renamed,
+ *      copied into samples (rows of the same timestamp merged) and
+ *      dropped, and data is recreated as a view. data_joined view refers
+ *      to data and is recreated around the change. VACUUM afterwards
+ *      returns the freed pages to the file system and switches the file
+ *      to incremental auto_vacuum. Datafiles already in the compact
+ *      schema are only switched.
  */
-int database_insert(char *filename, databaserecord_t *rec)
+int database_migrate(char *filename)
 {
-    int           rc;   // return code from the sqlite3_* functions
-    sqlite3      *db;
-    sqlite3_stmt *stmt;
-//    xtmr_t *t = xtmr();
+    sqlite3 *db;
+    char    *errmsg = NULL;
+    int      rc, n_rows = 0;
 
-    /*
-     * "Whether or not an error occurs when it is opened, resources associated with
-     *  the database connection handle should be released."
-     */
+    if ((rc = database_schema(filename)) < 0)
+        return EXIT_FAILURE;
+    if (rc == DATABASE_SCHEMA_COMPACT)
+    {
+        logmsg(LOG_INFO, "Database \"%s\" already uses the compact schema", filename);
+        return database_setautovacuum(filename);
+    }
     if ((rc = sqlite3_open(filename, &db)) != SQLITE_OK)
     {
-        logerr("Can't open database \"%s\": %s", filename, sqlite3_errmsg(db));
+        logerr("Can't open database (\"%s\"): %s", filename, sqlite3_errmsg(db));
         sqlite3_close(db);
-        return rc;
+        return EXIT_FAILURE;
     }
-//    logdev("sqlite3_open() : %5.2f ms", xtmrlap(t));
-
-    /*
-     * Set busy timeout
-     *
-     * sqlite3_busy_timeout() sets a busy handler that sleeps for a specified
-     * amount of time when a table is locked. The handler will sleep multiple
-     * times until at least "ms" milliseconds of sleeping have accumulated.
-     *
-     * After at least "ms" milliseconds of sleeping, the handler returns 0
-     * which causes sqlite3_step() to return SQLITE_BUSY.
-     */
-    if ((rc = sqlite3_busy_timeout(db, DATABASE_SQLITE3_BUSY_TIMEOUT)) != SQLITE_OK)
+    sqlite3_busy_timeout(db, DATABASE_SQLITE3_BUSY_TIMEOUT);
+    rc = sqlite3_exec(
+                     db,
+                     "BEGIN EXCLUSIVE; "
+                     "DROP VIEW IF EXISTS data_joined; "
+                     "ALTER TABLE data RENAME TO data_legacy; "
+                     SQL_CREATE_TABLE_SAMPLES
+                     SQL_MIGRATE_COMPACT_COPY,
+                     NULL, NULL, &errmsg
+                     );
+    if (rc == SQLITE_OK)
+        n_rows = sqlite3_changes(db);
+    if (rc == SQLITE_OK && (rc = database_densesql()) == SQLITE_OK)
+        rc = sqlite3_exec(db, dense_create, NULL, NULL, &errmsg);
+    if (rc == SQLITE_OK)
     {
-        logerr("Unable to set timeout: %s", sqlite3_errmsg(db));
-        sqlite3_close(db);
-        return rc;
+        rc = sqlite3_exec(
+                         db,
+                         "DROP TABLE data_legacy; "
+                         SQL_CREATE_VIEW_DATA
+                         SQL_CREATE_TRIGGER_DATA_INSERT
+                         SQL_CREATE_TRIGGER_DATA_DELETE
+                         SQL_CREATE_VIEW_JOINED
+                         SQL_SET_SCHEMA_COMPACT
+                         "COMMIT; ",
+                         NULL, NULL, &errmsg
+                         );
     }
-//    logdev("sqlite3_busy_timeout() : %5.2f ms", xtmrlap(t));
-
-    // Something in this generates errno(2) "No such file or directory"
-    if ((rc = sqlite3_prepare_v2(
-                                db,            // Database handle
-                                SQL_INSERT,    // SQL statement, UTF-8 encoded
-                                -1,            // Maximum length of zSql in bytes. (-1 = read until null termination)
-                                &stmt,         // OUT: Statement handle
-                                NULL           // OUT: Pointer to unused portion of zSql
-                                )) != SQLITE_OK)
+    if (rc != SQLITE_OK)
     {
-        logerr("Unable to prepare INSERT SQL: %s", sqlite3_errmsg(db));
-        logerr("Statement: %s", SQL_INSERT);
+        logerr("Database migration failed: %s", errmsg ? errmsg : sqlite3_errmsg(db));
+        sqlite3_free(errmsg);
+        if (!sqlite3_get_autocommit(db))
+            sqlite3_exec(db, "ROLLBACK", NULL, NULL, NULL);
         sqlite3_close(db);
-        return rc;
+        return EXIT_FAILURE;
     }
-    // clear errno
-//    errno = 0;
-//    logdev("sqlite3_prepare_v2() : %5.2f ms", xtmrlap(t));
-
-#define BINDDOUBLE(s, v) \
-    ({ \
-    if ((v) == DATABASE_DOUBLE_NULL_VALUE) \
-        sqlite3_bind_null(stmt, sqlite3_bind_parameter_index(stmt, (s))); \
-    else \
-        sqlite3_bind_double(stmt, sqlite3_bind_parameter_index(stmt, (s)), (v)); \
-    }) 
-
-    // I don't expect trouble with these...
-    sqlite3_bind_int(stmt, sqlite3_bind_parameter_index(stmt, "@Timestamp"), rec->timestamp);
-    BINDDOUBLE("@ModemPing", rec->modemping_ms);
-    BINDDOUBLE("@InetPing",  rec->inetping_ms);
-    BINDDOUBLE("@dCh1dBbmV", rec->down_ch1_dbmv);
-    BINDDOUBLE("@dCh1dB",    rec->down_ch1_db);
-    BINDDOUBLE("@dCh2dBbmV", rec->down_ch2_dbmv);
-    BINDDOUBLE("@dCh2dB",    rec->down_ch2_db);
-    BINDDOUBLE("@dCh3dBbmV", rec->down_ch3_dbmv);
-    BINDDOUBLE("@dCh3dB",    rec->down_ch3_db);
-    BINDDOUBLE("@dCh4dBbmV", rec->down_ch4_dbmv);
-    BINDDOUBLE("@dCh4dB",    rec->down_ch4_db);
-    BINDDOUBLE("@dCh5dBbmV", rec->down_ch5_dbmv);
-    BINDDOUBLE("@dCh5dB",    rec->down_ch5_db);
-    BINDDOUBLE("@dCh6dBbmV", rec->down_ch6_dbmv);
-    BINDDOUBLE("@dCh6dB",    rec->down_ch6_db);
-    BINDDOUBLE("@dCh7dBbmV", rec->down_ch7_dbmv);
-    BINDDOUBLE("@dCh7dB",    rec->down_ch7_db);
-    BINDDOUBLE("@dCh8dBbmV", rec->down_ch8_dbmv);
-    BINDDOUBLE("@dCh8dB",    rec->down_ch8_db);
-    BINDDOUBLE("@uCh1dBmV",  rec->up_ch1_dbmv);
-    BINDDOUBLE("@uCh2dBmV",  rec->up_ch2_dbmv);
-    BINDDOUBLE("@uCh3dBmV",  rec->up_ch3_dbmv);
-    BINDDOUBLE("@uCh4dBmV",  rec->up_ch4_dbmv);
-//    logdev("sqlite3_bind_*() : %5.2f ms", xtmrlap(t));
+    logmsg(LOG_INFO, "Database \"%s\" migrated to compact schema (%d rows)", filename, n_rows);
+    sqlite3_close(db);
+    database_setautovacuum(filename);
+    // Rollups are computed from samples
+    return database_rebuildrollups(filename);
+}
 
-    // Execute statement
-    // This also generates errno(2) "No such file or directory"
-	if ((rc = sqlite3_step(stmt)) != SQLITE_DONE)
+/*
+ * Datafile partitions (cfg.database.partition)
+ *
+ *      Partition datafiles are named after cfg.database.filename, with the
+ *      period inserted before the extension:
+ *
+ *          /srv/icmond.sqlite3  ->  /srv/icmond.2016-09.sqlite3  (MONTH)
+ *                                   /srv/icmond.2016-09-14.sqlite3 (DAY)
+ *                                   /srv/icmond.2016.sqlite3     (YEAR)
+ *
+ *      Periods are in local time. Names sort in chronological order, which
+ *      is what retention and the read span rely on. The base datafile is
+ *      left as it is (data written before partitioning was enabled) and is
+ *      never removed.
+ */
+static const char *database_partitionformat(int glob)
+{
+    switch (cfg.database.partition)
     {
-		logerr("Insert statement did not return with SQLITE_DONE: %s", sqlite3_errmsg(db));
-        sqlite3_close(db);
-        return rc;
-	}
-    // Clear errno
-//    errno = 0;
-//    logdev("sqlite3_step() : %5.2f ms", xtmrlap(t));
+        case CFG_PARTITION_DAY:
+            return glob ? "[0-9][0-9][0-9][0-9]-[0-9][0-9]-[0-9][0-9]" : "%Y-%m-%d";
+        case CFG_PARTITION_MONTH:
+            return glob ? "[0-9][0-9][0-9][0-9]-[0-9][0-9]" : "%Y-%m";
+        case CFG_PARTITION_YEAR:
+            return glob ? "[0-9][0-9][0-9][0-9]" : "%Y";
+    }
+    return NULL;
+}
 
-    /*
-     * Destroy a prepared statement object,
-     * close database connection and
-     * return with appropriate code
-     */
-    sqlite3_finalize(stmt);
-    sqlite3_close(db);
-//    logdev("sqlite3_finalize() and sqlite3_close() : %5.2f ms", xtmrlap(t));
-//    free(t);
+/*
+ * Base filename with the period (or glob pattern) inserted before the
+ * extension. Extension is the last '.' of the filename part, if any.
+ */
+static char *database_partitionname(char *buffer, const char *period)
+{
+    char *base = cfg.database.filename;
+    char *slash = strrchr(base, '/');
+    char *dot   = strrchr(slash ? slash : base, '.');
+    int   stem  = dot && dot != (slash ? slash + 1 : base) ? (int)(dot - base) : (int)strlen(base);
 
-    return EXIT_SUCCESS;
+    snprintf(buffer, CFG_MAX_FILENAME_LEN + 1, "%.*s.%s%s", stem, base, period, base + stem);
+    return buffer;
 }
 
-void database_logdev(databaserecord_t *rec)
+char *database_partition(time_t t)
 {
-    if (!rec)
-        logdev("Received NULL pointer!");
+    static char filename[CFG_MAX_FILENAME_LEN + 1];
+    char        period[16];
+    struct tm   tm;
 
-#define LOGDEV(n, v) \
-    ({ \
-    if ((v) == DATABASE_DOUBLE_NULL_VALUE) \
-        logdev("%-30s : NULL\n", (n)); \
-    else \
-        logdev("%-30s : %4.1f\n", (n), (v)); \
-    }) 
-
-    logdev("databaserecord_t.timestamp     : %d\n",    (int)rec->timestamp);
-    LOGDEV("databaserecord_t.modemping_ms",  rec->modemping_ms);
-    LOGDEV("databaserecord_t.inetping_ms",   rec->inetping_ms);
-    LOGDEV("databaserecord_t.down_ch1_dbmv", rec->down_ch1_dbmv);
-    LOGDEV("databaserecord_t.down_ch1_db",   rec->down_ch1_db);
-    LOGDEV("databaserecord_t.down_ch2_dbmv", rec->down_ch2_dbmv);
-    LOGDEV("databaserecord_t.down_ch2_db",   rec->down_ch2_db);
-    LOGDEV("databaserecord_t.down_ch3_dbmv", rec->down_ch3_dbmv);
-    LOGDEV("databaserecord_t.down_ch3_db",   rec->down_ch3_db);
-    LOGDEV("databaserecord_t.down_ch4_dbmv", rec->down_ch4_dbmv);
-    LOGDEV("databaserecord_t.down_ch4_db",   rec->down_ch4_db);
-    LOGDEV("databaserecord_t.down_ch5_dbmv", rec->down_ch5_dbmv);
-    LOGDEV("databaserecord_t.down_ch5_db",   rec->down_ch5_db);
-    LOGDEV("databaserecord_t.down_ch6_dbmv", rec->down_ch6_dbmv);
-    LOGDEV("databaserecord_t.down_ch6_db",   rec->down_ch6_db);
-    LOGDEV("databaserecord_t.down_ch7_dbmv", rec->down_ch7_dbmv);
-    LOGDEV("databaserecord_t.down_ch7_db",   rec->down_ch7_db);
-    LOGDEV("databaserecord_t.down_ch8_dbmv", rec->down_ch8_dbmv);
-    LOGDEV("databaserecord_t.down_ch8_db",   rec->down_ch8_db);
-    LOGDEV("databaserecord_t.up_ch1_dbmv",   rec->up_ch1_dbmv);
-    LOGDEV("databaserecord_t.up_ch2_dbmv",   rec->up_ch2_dbmv);
-    LOGDEV("databaserecord_t.up_ch3_dbmv",   rec->up_ch3_dbmv);
-    LOGDEV("databaserecord_t.up_ch4_dbmv",   rec->up_ch4_dbmv);
+    if (cfg.database.partition == CFG_PARTITION_NONE)
+        return cfg.database.filename;
+    localtime_r(&t, &tm);
+    strftime(period, sizeof(period), database_partitionformat(false), &tm);
+    return database_partitionname(filename, period);
+}
 
+/*
+ * Start of the partition period following the one t belongs to
+ */
+time_t database_nextpartition(time_t t)
+{
+    struct tm tm;
+
+    if (cfg.database.partition == CFG_PARTITION_NONE)
+        return 0;
+    localtime_r(&t, &tm);
+    tm.tm_sec  = 0;
+    tm.tm_min  = 0;
+    tm.tm_hour = 0;
+    switch (cfg.database.partition)
+    {
+        case CFG_PARTITION_DAY:
+            tm.tm_mday++;
+            break;
+        case CFG_PARTITION_MONTH:
+            tm.tm_mday = 1;
+            tm.tm_mon++;
+            break;
+        case CFG_PARTITION_YEAR:
+            tm.tm_mday = 1;
+            tm.tm_mon  = 0;
+            tm.tm_year++;
+            break;
+    }
+    // mktime() normalizes overflowing fields, DST is resolved for the new date
+    tm.tm_isdst = -1;
+    return mktime(&tm);
+}
+
+/*
+ * Create partition datafile, unless it exists
+ */
+int database_preparepartition(char *filename)
+{
+    if (!access(filename, F_OK))
+        return (errno = 0, EXIT_SUCCESS);
+    logmsg(LOG_INFO, "Creating partition datafile \"%s\"", filename);
+    return database_initialize(filename) ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+/*
+ * Existing partition datafiles, oldest first. Caller must globfree().
+ */
+static int database_globpartitions(glob_t *g)
+{
+    char pattern[CFG_MAX_FILENAME_LEN + 1];
+    int  rc;
+
+    memset(g, 0, sizeof(glob_t));
+    database_partitionname(pattern, database_partitionformat(true));
+    // glob() sorts the names, which is chronological order
+    if ((rc = glob(pattern, 0, NULL, g)) && rc != GLOB_NOMATCH)
+    {
+        logerr("glob(\"%s\") failed (%d)", pattern, rc);
+        return EXIT_FAILURE;
+    }
+    return (errno = 0, EXIT_SUCCESS);
+}
+
+/*
+ * Retention: remove all but the newest keep partition datafiles (with
+ * their WAL and shared memory files). Takes constant time regardless of
+ * how many rows the partitions hold. Returns the number of files removed.
+ */
+int database_removepartitions(int keep)
+{
+    glob_t g;
+    char   aux[CFG_MAX_FILENAME_LEN + 8];
+    int    n_removed = 0;
+    size_t i;
+
+    if (cfg.database.partition == CFG_PARTITION_NONE || keep < 1)
+        return 0;
+    if (database_globpartitions(&g))
+        return 0;
+    for (i = 0; i + keep < g.gl_pathc; i++)
+    {
+        if (unlink(g.gl_pathv[i]))
+        {
+            logerr("Unable to remove partition datafile \"%s\"", g.gl_pathv[i]);
+            continue;
+        }
+        snprintf(aux, sizeof(aux), "%s-wal", g.gl_pathv[i]);
+        unlink(aux);
+        snprintf(aux, sizeof(aux), "%s-shm", g.gl_pathv[i]);
+        unlink(aux);
+        logmsg(LOG_INFO, "Removed partition datafile \"%s\"", g.gl_pathv[i]);
+        n_removed++;
+    }
+    globfree(&g);
+    errno = 0;
+    return n_removed;
+}
+
+/*
+ * Call fn() for each partition datafile, oldest first. Returns the number
+ * of calls that failed.
+ */
+int database_foreachpartition(int (*fn)(char *datafile))
+{
+    glob_t g;
+    int    n_failed = 0;
+    size_t i;
+
+    if (cfg.database.partition == CFG_PARTITION_NONE)
+        return 0;
+    if (database_globpartitions(&g))
+        return 1;
+    for (i = 0; i < g.gl_pathc; i++)
+        if (fn(g.gl_pathv[i]))
+            n_failed++;
+    globfree(&g);
+    return n_failed;
+}
+
+/*
+ * Span view columns. Datafiles differ by version and schema (legacy data
+ * table has no Carried column, files of earlier versions no Violations),
+ * so span views select by explicit column list rather than SELECT *.
+ */
+#define SPAN_X_COLUMN(f, c, s, k)   #c,
+#define SPAN_CHANNEL(n) \
+    "dCh" #n "Unerrored", "dCh" #n "Corrected", "dCh" #n "Uncorrectable"
+static const struct
+{
+    const char *table;
+    const char *column[DATABASE_SPAN_COLUMNS + 1];
+} span_table[] =
+{
+    {
+        "data",
+        {
+            "Timestamp", DATABASE_VALUES(SPAN_X_COLUMN) "Violations", "Carried", NULL
+        }
+    },
+    {
+        "counters",
+        {
+            "Timestamp", "Seconds", "T3Timeouts", "T4Timeouts",
+            SPAN_CHANNEL(1), SPAN_CHANNEL(2), SPAN_CHANNEL(3), SPAN_CHANNEL(4),
+            SPAN_CHANNEL(5), SPAN_CHANNEL(6), SPAN_CHANNEL(7), SPAN_CHANNEL(8), NULL
+        }
+    },
+    {
+        "reboots",
+        {
+            "Timestamp", "BootTime", "LastUptime", NULL
+        }
+    },
+    {
+        NULL, { NULL }
+    }
+};
+#undef SPAN_CHANNEL
+#undef SPAN_X_COLUMN
+
+/*
+ * SELECT of span_table[t] in schema. Columns the datafile does not have
+ * are NULL.
+ */
+static char *database_spanselect(sqlite3 *db, const char *schema, int t)
+{
+    char *name = sqlite3_mprintf("%s.%s", schema, span_table[t].table);
+    char *sql  = sqlite3_mprintf("SELECT");
+    int   i;
+
+    for (i = 0; span_table[t].column[i]; i++)
+        sql = sqlite3_mprintf(
+                             database_hascolumn(db, name, span_table[t].column[i]) ?
+                             "%z%s %s" : "%z%s NULL AS %s",
+                             sql, i ? "," : "", span_table[t].column[i]
+                             );
+    return sqlite3_mprintf("%z FROM %z", sql, name);
+}
+
+/*
+ * Read connection over all partitions, for SQL reads (reports, ad hoc
+ * queries) that span the partitions
+ *
+ *      Base datafile is opened (read only) and the partitions are attached
+ *      to it, newest first, as many as SQLite allows (SQLITE_LIMIT_ATTACHED,
+ *      10 by default). TEMP views data, counters and reboots are UNION ALL
+ *      over the base datafile and the attached partitions, and take
+ *      precedence over the base datafile tables of the same name. Without
+ *      partitioning, this is the base datafile as is.
+ *
+ *      Base datafile may still have the legacy data table, partitions are
+ *      created with the compact schema (span_table[] columns).
+ *
+ *      Rows are in the partition of the time they were written, which can
+ *      be later than their timestamp (spooled rows, tmpfs import after the
+ *      rollover), and older partitions may not fit into the attach limit.
+ *      Export (export.c) scans every datafile in turn instead.
+ *
+ *      Returns NULL on failure. Caller must sqlite3_close().
+ */
+sqlite3 *database_openspan()
+{
+    sqlite3    *db;
+    glob_t      g;
+    char       *sql, schema[16];
+    int         n_attached = 0, n_max, i, t;
+
+    if (sqlite3_open_v2(cfg.database.filename, &db, SQLITE_OPEN_READONLY, NULL) != SQLITE_OK)
+    {
+        logerr("Can't open database (\"%s\"): %s", cfg.database.filename, sqlite3_errmsg(db));
+        sqlite3_close(db);
+        return NULL;
+    }
+    sqlite3_busy_timeout(db, DATABASE_SQLITE3_BUSY_TIMEOUT);
+    if (cfg.database.partition == CFG_PARTITION_NONE)
+        return (errno = 0, db);
+    if (database_globpartitions(&g))
+    {
+        sqlite3_close(db);
+        return NULL;
+    }
+    n_max = sqlite3_limit(db, SQLITE_LIMIT_ATTACHED, -1);
+    if ((int)g.gl_pathc > n_max)
+        logmsg(
+              LOG_ERR,
+              "%d partitions, only the newest %d can be attached",
+              (int)g.gl_pathc,
+              n_max
+              );
+    for (i = (int)g.gl_pathc - 1; i >= 0 && n_attached < n_max; i--)
+    {
+        sql = sqlite3_mprintf("ATTACH DATABASE %Q AS p%d", g.gl_pathv[i], n_attached);
+        if (sqlite3_exec(db, sql, NULL, NULL, NULL) == SQLITE_OK)
+            n_attached++;
+        else
+            logerr("Unable to attach \"%s\": %s", g.gl_pathv[i], sqlite3_errmsg(db));
+        sqlite3_free(sql);
+    }
+    globfree(&g);
+    for (t = 0; span_table[t].table; t++)
+    {
+        sql = sqlite3_mprintf(
+                             "CREATE TEMP VIEW %s AS %z",
+                             span_table[t].table, database_spanselect(db, "main", t)
+                             );
+        for (i = n_attached - 1; i >= 0; i--)
+        {
+            snprintf(schema, sizeof(schema), "p%d", i);
+            sql = sqlite3_mprintf("%z UNION ALL %z", sql, database_spanselect(db, schema, t));
+        }
+        if (sqlite3_exec(db, sql, NULL, NULL, NULL) != SQLITE_OK)
+        {
+            logerr("Unable to create span view \"%s\": %s", span_table[t].table, sqlite3_errmsg(db));
+            sqlite3_free(sql);
+            sqlite3_close(db);
+            return NULL;
+        }
+        sqlite3_free(sql);
+    }
+    errno = 0;
+    logdev("Database span: base datafile and %d partitions", n_attached);
+    return db;
+}
+
+/*
+ * Rollup tables (rollup_1m, rollup_1h, rollup_1d)
+ *
+ *      One row per bucket (Bucket is the start of the minute, hour or UTC
+ *      day). For each samples column: count of non-NULL values, minimum,
+ *      maximum, sum and sum of squares (in samples units; mean is Sum / N,
+ *      variance SumSq / N - mean^2). Rows is the number of samples rows,
+ *      ModemLost and InetLost the rows without a ping time (ping timed
+ *      out). T3Timeouts and T4Timeouts are the counter deltas stored within
+ *      the bucket.
+ *
+ *      Buckets touched by new rows are recomputed: minutes from samples,
+ *      hours from minutes and days from hours. Recomputation (rather than
+ *      adding the new row into the bucket) is what keeps ping and line
+ *      data rows of the same timestamp, merged by the data view triggers,
+ *      from being counted twice, and makes the result identical to a full
+ *      rebuild (database_rebuildrollups()). All values are integers, so
+ *      the comparison is exact. Minutes are computed from samples_dense,
+ *      change-only rows count as if every value was stored.
+ */
+static const struct
+{
+    const char *table;
+    int         seconds;
+} rollup_level[DATABASE_ROLLUP_LEVELS] =
+{
+    { "rollup_1m",      60 },
+    { "rollup_1h",    3600 },
+    { "rollup_1d",   86400 }
+};
+
+static const char *rollup_column[] =
+{
+    DATABASE_VALUES(DATABASE_X_COMPACT)
+    NULL
+};
+
+/*
+ * CREATE statements and, for each level, DELETE and INSERT ... SELECT of
+ * a bucket range (?1 <= Bucket < ?2). Generated on first use.
+ */
+static char *rollup_create = NULL;
+static char *rollup_sql[DATABASE_ROLLUP_LEVELS * 2];
+
+static int database_rollupsql()
+{
+    char *sql;
+    int   level, c, w;
+
+    if (rollup_create)
+        return SQLITE_OK;
+    sql = sqlite3_mprintf("CREATE INDEX IF NOT EXISTS counters_timestamp ON counters (Timestamp); ");
+    for (level = 0; level < DATABASE_ROLLUP_LEVELS; level++)
+    {
+        sql = sqlite3_mprintf(
+                             "%zCREATE TABLE IF NOT EXISTS %s (Bucket INTEGER PRIMARY KEY, "
+                             "Rows INTEGER, ModemLost INTEGER, InetLost INTEGER, "
+                             "T3Timeouts INTEGER, T4Timeouts INTEGER",
+                             sql, rollup_level[level].table
+                             );
+        for (c = 0; rollup_column[c]; c++)
+            sql = sqlite3_mprintf(
+                                 "%z, %sN INTEGER, %sMin INTEGER, %sMax INTEGER, "
+                                 "%sSum INTEGER, %sSumSq INTEGER",
+                                 sql, rollup_column[c], rollup_column[c], rollup_column[c],
+                                 rollup_column[c], rollup_column[c]
+                                 );
+        sql = sqlite3_mprintf("%z); ", sql);
+    }
+    for (level = 0; level < DATABASE_ROLLUP_LEVELS; level++)
+    {
+        w = rollup_level[level].seconds;
+        rollup_sql[level * 2] = sqlite3_mprintf(
+                                               "DELETE FROM %s WHERE Bucket >= ?1 AND Bucket < ?2",
+                                               rollup_level[level].table
+                                               );
+        if (level == 0)
+        {
+            char *r = sqlite3_mprintf(
+                                     "INSERT INTO %s SELECT Timestamp / %d * %d, "
+                                     "COUNT(*), COUNT(*) - COUNT(ModemRtt), COUNT(*) - COUNT(InetRtt), "
+                                     "(SELECT SUM(T3Timeouts) FROM counters WHERE counters.Timestamp >= "
+                                     "samples.Timestamp / %d * %d AND counters.Timestamp < samples.Timestamp / %d * %d + %d), "
+                                     "(SELECT SUM(T4Timeouts) FROM counters WHERE counters.Timestamp >= "
+                                     "samples.Timestamp / %d * %d AND counters.Timestamp < samples.Timestamp / %d * %d + %d)",
+                                     rollup_level[level].table, w, w,
+                                     w, w, w, w, w,
+                                     w, w, w, w, w
+                                     );
+            for (c = 0; rollup_column[c]; c++)
+                r = sqlite3_mprintf(
+                                   "%z, COUNT(%s), MIN(%s), MAX(%s), SUM(%s), SUM(%s * %s)",
+                                   r, rollup_column[c], rollup_column[c], rollup_column[c],
+                                   rollup_column[c], rollup_column[c], rollup_column[c]
+                                   );
+            rollup_sql[1] = sqlite3_mprintf(
+                                           "%z FROM samples_dense AS samples "
+                                           "WHERE Timestamp >= ?1 AND Timestamp < ?2 GROUP BY 1",
+                                           r
+                                           );
+        }
+        else
+        {
+            char *r = sqlite3_mprintf(
+                                     "INSERT INTO %s SELECT Bucket / %d * %d, SUM(Rows), "
+                                     "SUM(ModemLost), SUM(InetLost), SUM(T3Timeouts), SUM(T4Timeouts)",
+                                     rollup_level[level].table, w, w
+                                     );
+            for (c = 0; rollup_column[c]; c++)
+                r = sqlite3_mprintf(
+                                   "%z, SUM(%sN), MIN(%sMin), MAX(%sMax), SUM(%sSum), SUM(%sSumSq)",
+                                   r, rollup_column[c], rollup_column[c], rollup_column[c],
+                                   rollup_column[c], rollup_column[c]
+                                   );
+            rollup_sql[level * 2 + 1] = sqlite3_mprintf(
+                                                       "%z FROM %s WHERE Bucket >= ?1 AND Bucket < ?2 GROUP BY 1",
+                                                       r, rollup_level[level - 1].table
+                                                       );
+        }
+    }
+    for (level = 0; level < DATABASE_ROLLUP_LEVELS * 2; level++)
+        if (!rollup_sql[level])
+            sql = NULL;
+    if (!sql)
+    {
+        logerr("Unable to generate rollup SQL");
+        return SQLITE_NOMEM;
+    }
+    rollup_create = sql;
+    return SQLITE_OK;
+}
+
+/*
+ * Change-only storage (DATABASE_CARRIED())
+ *
+ *      samples_dense has the columns of samples. Carried value (NULL, bit
+ *      set) is the latest stored value before the row: a descending rowid
+ *      scan to the previous non-NULL value. That is within one keyframe
+ *      interval (a keyframe stores every value), but the view is stored in
+ *      the datafile and has to hold for rows written with any
+ *      keyframeinterval, so the scan is bounded by
+ *      CFG_MAX_DB_KEYFRAMEINTERVAL instead. A row whose value is not found
+ *      there (NULL) costs at most the rows of that hour, 720 at a 5 second
+ *      interval. Rows without Carried cost nothing extra.
+ *
+ *      Later rows carry from a stored value, so a late row in between, or
+ *      retention deleting it, would change them. Before either, the next
+ *      remaining row is materialized: its carried values are stored and
+ *      Carried is cleared. So are the rows around an imported range
+ *      (tmpfs import, CSV import). View is generated on first use, like
+ *      the rollup SQL.
+ */
+static char *dense_create = NULL;
+
+static int database_densesql()
+{
+    char *create;
+    int   c;
+
+    if (dense_create)
+        return SQLITE_OK;
+    create = sqlite3_mprintf("CREATE VIEW IF NOT EXISTS samples_dense AS SELECT Timestamp");
+    for (c = 0; rollup_column[c]; c++)
+    {
+        if (c < DATABASE_PING_COLUMNS)
+        {
+            create = sqlite3_mprintf("%z, %s", create, rollup_column[c]);
+            continue;
+        }
+        create = sqlite3_mprintf(
+                                "%z, CASE WHEN %s IS NULL AND Carried & %u THEN "
+                                "(SELECT p.%s FROM samples AS p WHERE p.Timestamp < samples.Timestamp "
+                                "AND p.Timestamp >= samples.Timestamp - %d "
+                                "AND p.%s IS NOT NULL ORDER BY p.Timestamp DESC LIMIT 1) ELSE %s END AS %s",
+                                create, rollup_column[c], DATABASE_CARRIED(c),
+                                rollup_column[c], CFG_MAX_DB_KEYFRAMEINTERVAL,
+                                rollup_column[c], rollup_column[c], rollup_column[c]
+                                );
+    }
+    if (!(create = sqlite3_mprintf("%z, Violations, Carried FROM samples; ", create)))
+    {
+        logerr("Unable to generate samples_dense SQL");
+        return SQLITE_NOMEM;
+    }
+    dense_create = create;
+    return SQLITE_OK;
+}
+
+char *database_materializesql(const char *schema, const char *where)
+{
+    char *sql;
+    int   c;
+
+    sql = sqlite3_mprintf("UPDATE %s.samples SET Carried = NULL", schema);
+    for (c = DATABASE_PING_COLUMNS; rollup_column[c]; c++)
+        sql = sqlite3_mprintf(
+                             "%z, %s = (SELECT d.%s FROM %s.samples_dense AS d WHERE d.Timestamp = samples.Timestamp)",
+                             sql, rollup_column[c], rollup_column[c], schema
+                             );
+    return sqlite3_mprintf("%z WHERE Carried AND %s; ", sql, where);
+}
+
+/*
+ * Materialize the rows of schema.samples after 'from', up to and
+ * including the first row after 'until'
+ */
+static int database_materialize(sqlite3 *db, const char *schema, int64_t from, int64_t until, char **errmsg)
+{
+    char *where, *sql = NULL;
+    int   rc = SQLITE_NOMEM;
+
+    where = sqlite3_mprintf(
+                           "Timestamp > %lld AND Timestamp <= "
+                           "IFNULL((SELECT MIN(Timestamp) FROM %s.samples WHERE Timestamp > %lld), %lld)",
+                           (long long)from, schema, (long long)until, (long long)until
+                           );
+    if (where && (sql = database_materializesql(schema, where)))
+        rc = sqlite3_exec(db, sql, NULL, NULL, errmsg);
+    sqlite3_free(where);
+    sqlite3_free(sql);
+    return rc;
+}
+
+/*
+ * Recompute the buckets of all levels that cover timestamps first ... last.
+ * Statements are prepared into stmt[] (DATABASE_ROLLUP_LEVELS * 2) if not
+ * already prepared; caller finalizes them.
+ */
+static int database_rollupexec(sqlite3 *db, sqlite3_stmt **stmt, int64_t first, int64_t last)
+{
+    int64_t from, to;
+    int     level, i, rc;
+
+    if ((rc = database_rollupsql()) != SQLITE_OK)
+        return rc;
+    for (level = 0; level < DATABASE_ROLLUP_LEVELS; level++)
+    {
+        from = first / rollup_level[level].seconds * rollup_level[level].seconds;
+        to   = last  / rollup_level[level].seconds * rollup_level[level].seconds + rollup_level[level].seconds;
+        for (i = level * 2; i < level * 2 + 2; i++)
+        {
+            if (!stmt[i] && (rc = sqlite3_prepare_v2(db, rollup_sql[i], -1, &stmt[i], NULL)) != SQLITE_OK)
+            {
+                logerr("Unable to prepare rollup statement: %s", sqlite3_errmsg(db));
+                return rc;
+            }
+            sqlite3_bind_int64(stmt[i], 1, from);
+            sqlite3_bind_int64(stmt[i], 2, to);
+            rc = sqlite3_step(stmt[i]);
+            sqlite3_reset(stmt[i]);
+            if (rc != SQLITE_DONE)
+            {
+                logerr("Updating %s failed: %s", rollup_level[level].table, sqlite3_errmsg(db));
+                return rc;
+            }
+        }
+    }
+    return SQLITE_OK;
+}
+
+/*
+ * Full recomputation of the rollup tables
+ *
+ *      Existing rollups (maintained by the database writer) are copied
+ *      aside, all buckets are recomputed from samples and the two are
+ *      compared. Differences are logged; the recomputed rollups are kept.
+ *      Done in one transaction.
+ */
+int database_rebuildrollups(char *filename)
+{
+    sqlite3_stmt *stmt[DATABASE_ROLLUP_LEVELS * 2];
+    sqlite3_stmt *count;
+    sqlite3      *db;
+    char         *sql;
+    int           n_buckets[DATABASE_ROLLUP_LEVELS], n_differ[DATABASE_ROLLUP_LEVELS];
+    int           level, rc;
+
+    if ((rc = database_schema(filename)) != DATABASE_SCHEMA_COMPACT)
+    {
+        if (rc >= 0)
+            logmsg(LOG_ERR, "Database \"%s\" has no rollups (legacy schema, see -migratedb)", filename);
+        return EXIT_FAILURE;
+    }
+    if ((rc = database_upgrade(filename)))      // creates the rollup tables
+        return EXIT_FAILURE;
+    if (sqlite3_open(filename, &db) != SQLITE_OK)
+    {
+        logerr("Can't open database (\"%s\"): %s", filename, sqlite3_errmsg(db));
+        sqlite3_close(db);
+        return EXIT_FAILURE;
+    }
+    sqlite3_busy_timeout(db, DATABASE_SQLITE3_BUSY_TIMEOUT);
+    memset(stmt, 0, sizeof(stmt));
+    rc = sqlite3_exec(db, "BEGIN IMMEDIATE", NULL, NULL, NULL);
+    for (level = 0; level < DATABASE_ROLLUP_LEVELS && rc == SQLITE_OK; level++)
+    {
+        sql = sqlite3_mprintf(
+                             "CREATE TEMP TABLE previous_%s AS SELECT * FROM %s",
+                             rollup_level[level].table, rollup_level[level].table
+                             );
+        rc  = sqlite3_exec(db, sql, NULL, NULL, NULL);
+        sqlite3_free(sql);
+    }
+    // Timestamps are 32 bit (database_write())
+    if (rc == SQLITE_OK)
+        rc = database_rollupexec(db, stmt, 0, INT32_MAX);
+    for (level = 0; level < DATABASE_ROLLUP_LEVELS && rc == SQLITE_OK; level++)
+    {
+        sql = sqlite3_mprintf(
+                             "SELECT (SELECT COUNT(*) FROM main.%s), (SELECT COUNT(DISTINCT Bucket) FROM ("
+                             "SELECT * FROM (SELECT * FROM main.%s EXCEPT SELECT * FROM previous_%s) UNION ALL "
+                             "SELECT * FROM (SELECT * FROM previous_%s EXCEPT SELECT * FROM main.%s)))",
+                             rollup_level[level].table, rollup_level[level].table, rollup_level[level].table,
+                             rollup_level[level].table, rollup_level[level].table
+                             );
+        if ((rc = sqlite3_prepare_v2(db, sql, -1, &count, NULL)) == SQLITE_OK)
+        {
+            if ((rc = sqlite3_step(count)) == SQLITE_ROW)
+            {
+                n_buckets[level] = sqlite3_column_int(count, 0);
+                n_differ[level]  = sqlite3_column_int(count, 1);
+                rc = SQLITE_OK;
+            }
+            sqlite3_finalize(count);
+        }
+        sqlite3_free(sql);
+    }
+    for (level = 0; level < DATABASE_ROLLUP_LEVELS * 2; level++)
+        sqlite3_finalize(stmt[level]);
+    if (rc == SQLITE_OK)
+        rc = sqlite3_exec(db, "COMMIT", NULL, NULL, NULL);
+    if (rc != SQLITE_OK)
+    {
+        logerr("Rollup rebuild failed: %s", sqlite3_errmsg(db));
+        sqlite3_exec(db, "ROLLBACK", NULL, NULL, NULL);
+        sqlite3_close(db);
+        return EXIT_FAILURE;
+    }
+    sqlite3_close(db);
+    for (level = 0; level < DATABASE_ROLLUP_LEVELS; level++)
+        logmsg(
+              n_differ[level] ? LOG_ERR : LOG_INFO,
+              "%s: %s %d buckets, %d differed from the maintained rollup",
+              filename,
+              rollup_level[level].table,
+              n_buckets[level],
+              n_differ[level]
+              );
+    errno = 0;
+    return EXIT_SUCCESS;
+}
+
+int database_delete(int timestamp)
+{
+    int           rc;
+    sqlite3      *db;
+    sqlite3_stmt *stmt;
+    char         *sqlstr;
+
+    if ((rc = sqlite3_open(cfg.database.filename, &db)) != SQLITE_OK)
+    {
+        logerr("Can't open database: %s", sqlite3_errmsg(db));
+        sqlite3_close(db);
+        return rc;
+    }
+
+    if ((rc = sqlite3_busy_timeout(db, DATABASE_SQLITE3_BUSY_TIMEOUT)) != SQLITE_OK)
+    {
+        logerr("Unable to set timeout: %s", sqlite3_errmsg(db));
+        sqlite3_close(db);
+        return rc;
+    }
+
+    if (timestamp < 0)
+        sqlstr = SQL_DELETE_ALL;
+    else
+        sqlstr = SQL_DELETE_BY_TIMESTAMP;
+
+    if ((rc = sqlite3_prepare_v2(
+                                db,            // Database handle
+                                sqlstr,        // SQL statement, UTF-8 encoded
+                                -1,            // Maximum length of zSql in bytes. (-1 = read until null termination)
+                                &stmt,         // OUT: Statement handle
+                                NULL           // OUT: Pointer to unused portion of zSql
+                                )) != SQLITE_OK)
+    {
+        logerr("Unable to prepare DELETE SQL: %s", sqlite3_errmsg(db));
+        sqlite3_close(db);
+        return rc;
+    }
+
+    if (timestamp >= 0)
+    {
+        sqlite3_bind_int(stmt, sqlite3_bind_parameter_index(stmt, "@Timestamp"), timestamp);
+    }
+
+    // Execute statement
+	if ((rc = sqlite3_step(stmt)) != SQLITE_DONE)
+    {
+		logerr("Delete statement dod not return with SQLITE_DONE: %s", sqlite3_errmsg(db));
+        sqlite3_close(db);
+        return rc;
+	}
+
+    sqlite3_finalize(stmt);
+    sqlite3_close(db);
+
+    return EXIT_SUCCESS;
+}
+
+/*
+ * Persistent connection
+ *
+ *      Opening the database, setting the busy timeout, preparing the
+ *      statement (2 ms alone on Raspberry Pi) and resolving parameter
+ *      names for every single row is wasted work. Handle keeps the
+ *      connection open, prepares each statement on its first use and
+ *      caches the parameter indices. Each write only binds, steps and
+ *      resets.
+ *
+ *      Sample INSERT is generated from DATABASE_VALUES() (database.h) and
+ *      has positional parameters: Timestamp, the values in databaserecord_t
+ *      order, Violations. It has no names to resolve.
+ */
+#define DBSTMT_DATA             0
+#define DBSTMT_COUNTERS         1
+#define DBSTMT_REBOOT           2
+#define DBSTMT_LEGACY           3       // DBSTMT_DATA without Carried
+#define DBSTMT_COUNT            4
+#define DBSTMT_MAXPARAMS        32
+
+#define DBCHANNEL_PARAMS(n) \
+    "@dCh" #n "Unerrored", "@dCh" #n "Corrected", "@dCh" #n "Uncorrectable"
+static const struct
+{
+    const char *sql;
+    int         nparams;
+    const char *param[DBSTMT_MAXPARAMS];
+} dbstmt[DBSTMT_COUNT] =
+{
+    {
+        SQL_INSERT, 0, { NULL }
+    },
+    {
+        SQL_INSERT_COUNTERS, 28,
+        {
+            "@Timestamp", "@Seconds", "@T3Timeouts", "@T4Timeouts",
+            DBCHANNEL_PARAMS(1), DBCHANNEL_PARAMS(2), DBCHANNEL_PARAMS(3), DBCHANNEL_PARAMS(4),
+            DBCHANNEL_PARAMS(5), DBCHANNEL_PARAMS(6), DBCHANNEL_PARAMS(7), DBCHANNEL_PARAMS(8)
+        }
+    },
+    {
+        SQL_INSERT_REBOOT, 3,
+        {
+            "@Timestamp", "@BootTime", "@LastUptime"
+        }
+    },
+    {
+        SQL_INSERT_LEGACY, 0, { NULL }
+    }
+};
+#undef DBCHANNEL_PARAMS
+
+/*
+ * Change-only state, of the rows in the datafile (or in the open
+ * transaction)
+ */
+typedef struct
+{
+    time_t        keyframe;         // of the latest keyframe, 0 == none yet
+    time_t        latest;           // latest row with line values
+    int64_t       stored[DATABASE_LINE_COLUMNS];    // samples units
+    int           valid[DATABASE_LINE_COLUMNS];     // stored[] is not NULL
+} dbchangeonly_t;
+
+struct dbhandle_t
+{
+    sqlite3        *db;
+    char           *filename;
+    int             rollups;            // compact schema, rollups maintained
+    int             retentionchunk;     // rows, adapted to cfg.database.retentionlock
+    int             vacuumchunk;        // pages
+    sqlite3_stmt   *rollup[DATABASE_ROLLUP_LEVELS * 2];
+    databasebounds_t bounds;
+    struct
+    {
+        sqlite3_stmt *stmt;
+        int           index[DBSTMT_MAXPARAMS];
+    } stmt[DBSTMT_COUNT];
+    dbchangeonly_t  changeonly;
+};
+
+/*
+ * Busy handler of the writer connection (database.h)
+ */
+static int database_busy(void *timeout, int n)
+{
+    if ((intptr_t)timeout <= n * DATABASE_SQLITE3_BUSY_SLEEP)
+        return 0;
+    usleep(DATABASE_SQLITE3_BUSY_SLEEP * 1000);
+    return 1;
+}
+
+int database_busytimeout(sqlite3 *db, int ms)
+{
+    return sqlite3_busy_handler(db, ms > 0 ? database_busy : NULL, (void *)(intptr_t)ms);
+}
+
+/*
+ * Journal mode and sync policy (cfg.database.*)
+ *
+ *      journal_mode is stored in the database file, but is set on every
+ *      open so that a configuration change takes effect. Leaving WAL needs
+ *      exclusive access and may fail while others are reading; that is
+ *      logged and the connection keeps going in WAL mode.
+ *
+ *      With scheduled checkpoints (daemon CHECKPOINT event), automatic
+ *      checkpoints are disabled so that no commit pays for one.
+ */
+static void database_pragmas(dbhandle_t *h)
+{
+    char sql[64];
+    int  synchronous = cfg.database.synchronous;
+
+    if (synchronous == CFG_SYNCHRONOUS_AUTO)
+        synchronous = cfg.database.journal == CFG_JOURNAL_WAL ?
+                      CFG_SYNCHRONOUS_NORMAL : CFG_SYNCHRONOUS_FULL;
+    snprintf(sql, sizeof(sql), "PRAGMA journal_mode=%s", CFG_JOURNAL_NAME(cfg.database.journal));
+    if (sqlite3_exec(h->db, sql, NULL, NULL, NULL) != SQLITE_OK)
+        logmsg(LOG_ERR, "\"%s\" failed: %s", sql, sqlite3_errmsg(h->db));
+    snprintf(sql, sizeof(sql), "PRAGMA synchronous=%d", synchronous);
+    sqlite3_exec(h->db, sql, NULL, NULL, NULL);
+    if (cfg.database.journal == CFG_JOURNAL_WAL && cfg.database.checkpointinterval)
+        sqlite3_wal_autocheckpoint(h->db, 0);
+}
+
+dbhandle_t *database_open(char *filename)
+{
+    dbhandle_t *h;
+    int         rc;
+
+    if (!(h = calloc(1, sizeof(dbhandle_t))))
+    {
+        logerr("calloc()");
+        return NULL;
+    }
+    /*
+     * "Whether or not an error occurs when it is opened, resources associated with
+     *  the database connection handle should be released."
+     */
+    if ((rc = sqlite3_open(filename, &h->db)) != SQLITE_OK)
+    {
+        logerr("Can't open database \"%s\": %s", filename, sqlite3_errmsg(h->db));
+        sqlite3_close(h->db);
+        free(h);
+        return NULL;
+    }
+    /*
+     * Busy handler sleeps DATABASE_SQLITE3_BUSY_SLEEP ms at a time when the
+     * datafile is locked, until at least "ms" milliseconds of sleeping have
+     * accumulated (database_busytimeout()).
+     */
+    if ((rc = database_busytimeout(h->db, DATABASE_SQLITE3_BUSY_TIMEOUT)) != SQLITE_OK)
+    {
+        logerr("Unable to set timeout: %s", sqlite3_errmsg(h->db));
+        sqlite3_close(h->db);
+        free(h);
+        return NULL;
+    }
+    h->filename = strdup(filename);
+    h->rollups  = database_userversion(h->db) == DATABASE_SCHEMA_COMPACT;
+    database_pragmas(h);
+    // Samples are written without violations, if the bounds cannot be read
+    database_loadbounds(cfg.database.filename[0] ? cfg.database.filename : filename, &h->bounds);
+    errno = 0;
+    return h;
+}
+
+void database_close(dbhandle_t *h)
+{
+    int i;
+    if (!h)
+        return;
+    // sqlite3_close() would roll back
+    database_commit(h);
+    for (i = 0; i < DBSTMT_COUNT; i++)
+        sqlite3_finalize(h->stmt[i].stmt);  // NULL is harmless
+    for (i = 0; i < DATABASE_ROLLUP_LEVELS * 2; i++)
+        sqlite3_finalize(h->rollup[i]);
+    sqlite3_close(h->db);
+    free(h->filename);
+    free(h);
+}
+
+char *database_filename(dbhandle_t *h)
+{
+    return h->filename;
+}
+
+/*
+ * Group commit
+ *
+ *      Without an explicit transaction, every INSERT is a transaction of
+ *      its own and pays a full journal sync. Rows written between
+ *      database_begin() and database_commit() share one.
+ */
+static int database_exec(dbhandle_t *h, const char *sql)
+{
+    char *errmsg = NULL;
+    int   rc;
+    if ((rc = sqlite3_exec(h->db, sql, NULL, NULL, &errmsg)) != SQLITE_OK)
+    {
+        logerr("\"%s\" failed: %s", sql, errmsg);
+        sqlite3_free(errmsg);
+        return rc;
+    }
+    errno = 0;
+    return SQLITE_OK;
+}
+
+int database_begin(dbhandle_t *h)
+{
+    if (database_intransaction(h))
+        return SQLITE_OK;
+    return database_exec(h, "BEGIN");
+}
+
+int database_commit(dbhandle_t *h)
+{
+    int rc;
+
+    if (!database_intransaction(h))
+        return SQLITE_OK;
+    // Rolled back: change-only state is of rows that are not there
+    if ((rc = database_exec(h, "COMMIT")) != SQLITE_OK && !database_intransaction(h))
+        memset(&h->changeonly, 0, sizeof(h->changeonly));
+    return rc;
+}
+
+int database_intransaction(dbhandle_t *h)
+{
+    return !sqlite3_get_autocommit(h->db);
+}
+
+/*
+ * WAL checkpoint
+ *
+ *      PASSIVE copies what it can without waiting for readers. TRUNCATE
+ *      also copies everything and truncates the WAL file to zero bytes,
+ *      but only if no reader is using the WAL. It does not wait for them
+ *      (busy timeout is lifted for the duration), because the caller is
+ *      the daemon main loop. A long read transaction only delays the
+ *      truncation to a later attempt.
+ *
+ * RETURN
+ *      SQLITE_OK       Success (also when database is not in WAL mode)
+ *      SQLITE_BUSY     Readers prevented full checkpoint (TRUNCATE)
+ *      *               Return code received from sqlite3_wal_checkpoint_v2()
+ */
+int database_checkpoint(dbhandle_t *h, int truncate)
+{
+    int rc, n_log, n_ckpt;
+
+    if (truncate)
+        database_busytimeout(h->db, 0);
+    rc = sqlite3_wal_checkpoint_v2(
+                                  h->db,
+                                  NULL,
+                                  truncate ? SQLITE_CHECKPOINT_TRUNCATE : SQLITE_CHECKPOINT_PASSIVE,
+                                  &n_log,
+                                  &n_ckpt
+                                  );
+    if (truncate)
+        database_busytimeout(h->db, DATABASE_SQLITE3_BUSY_TIMEOUT);
+    if (rc != SQLITE_OK && rc != SQLITE_BUSY)
+    {
+        logerr("sqlite3_wal_checkpoint_v2() failed: %s", sqlite3_errmsg(h->db));
+        return rc;
+    }
+    logdev(
+          "%s checkpoint: %d of %d WAL frames checkpointed",
+          truncate ? "TRUNCATE" : "PASSIVE",
+          n_ckpt,
+          n_log
+          );
+    errno = 0;
+    return rc;
+}
+
+/*
+ * Size of the WAL file in kB (0 if there is none)
+ */
+int database_walsize(dbhandle_t *h)
+{
+    char        walname[strlen(h->filename) + sizeof("-wal")];
+    struct stat st;
+
+    sprintf(walname, "%s-wal", h->filename);
+    if (stat(walname, &st))
+        return (errno = 0, 0);
+    return st.st_size / 1024;
+}
+
+/*
+ * Prepare statement (first use) and cache its parameter indices
+ */
+static sqlite3_stmt *database_stmt(dbhandle_t *h, int s)
+{
+    int i;
+    if (h->stmt[s].stmt)
+        return h->stmt[s].stmt;
+    if (sqlite3_prepare_v2(h->db, dbstmt[s].sql, -1, &h->stmt[s].stmt, NULL) != SQLITE_OK)
+    {
+        logerr("Unable to prepare INSERT SQL: %s", sqlite3_errmsg(h->db));
+        logerr("Statement: %s", dbstmt[s].sql);
+        h->stmt[s].stmt = NULL;
+        return NULL;
+    }
+    for (i = 0; i < dbstmt[s].nparams; i++)
+        h->stmt[s].index[i] = sqlite3_bind_parameter_index(h->stmt[s].stmt, dbstmt[s].param[i]);
+    return h->stmt[s].stmt;
+}
+
+/*
+ * Execute bound statement and make it ready for the next use
+ */
+static int database_step(dbhandle_t *h, sqlite3_stmt *stmt)
+{
+    int rc = sqlite3_step(stmt);
+    sqlite3_reset(stmt);
+    sqlite3_clear_bindings(stmt);
+    if (rc != SQLITE_DONE)
+    {
+        logerr("Insert statement did not return with SQLITE_DONE: %s", sqlite3_errmsg(h->db));
+        return rc;
+    }
+    // SQLite3 sets errno even on success (see database_initialize())
+    errno = 0;
+    return EXIT_SUCCESS;
+}
+
+#define BINDDOUBLE(i, v) \
+    ({ \
+    if ((v) == DATABASE_DOUBLE_NULL_VALUE) \
+        sqlite3_bind_null(stmt, (i)); \
+    else \
+        sqlite3_bind_double(stmt, (i), (v)); \
+    })
+#define BINDCOUNTER(i, v) \
+    ({ \
+    if ((v) == DATABASE_COUNTER_NULL_VALUE) \
+        sqlite3_bind_null(stmt, (i)); \
+    else \
+        sqlite3_bind_int64(stmt, (i), (v)); \
+    })
+
+/*
+ * Change-only storage (cfg.database.keyframeinterval)
+ *
+ *      Line values within cfg.database.changeepsilon (samples units) of
+ *      the value last stored are replaced with NULL; returns their Carried
+ *      bits. Records without line values (ping job, failed poll) leave
+ *      the state alone. NULL value is stored, and the next value after it
+ *      too. Late row, and the first row of the connection, is stored in
+ *      full after the row following it is materialized.
+ *
+ *      Updates a copy of the state (*s), which database_write() keeps
+ *      only when the row was inserted. Rows of a failed commit are gone,
+ *      so is the state: next row is a keyframe.
+ */
+static uint32_t database_changeonly(dbhandle_t *h, dbchangeonly_t *s, time_t timestamp, double *value)
+{
+    static const double scale[DATABASE_SAMPLE_COLUMNS] = { DATABASE_VALUES(DATABASE_X_SCALE) };
+    double   *line = value + DATABASE_PING_COLUMNS;
+    uint32_t  carried = 0;
+    int64_t   v;
+    int       i, n = 0, keyframe;
+
+    for (i = 0; i < DATABASE_LINE_COLUMNS; i++)
+        n += line[i] != DATABASE_DOUBLE_NULL_VALUE;
+    if (!n)
+        return 0;
+    if (timestamp <= s->latest || !s->latest)
+    {
+        if (database_materialize(h->db, "main", timestamp, timestamp, NULL) != SQLITE_OK)
+            logerr("Unable to materialize carried values: %s", sqlite3_errmsg(h->db));
+        if (timestamp <= s->latest)
+            return 0;
+    }
+    keyframe = timestamp - s->keyframe >= cfg.database.keyframeinterval;
+    if (keyframe)
+        s->keyframe = timestamp;
+    s->latest = timestamp;
+    for (i = 0; i < DATABASE_LINE_COLUMNS; i++)
+    {
+        if (line[i] == DATABASE_DOUBLE_NULL_VALUE)
+        {
+            s->valid[i] = false;
+            continue;
+        }
+        v = llround(line[i] * scale[DATABASE_PING_COLUMNS + i]);
+        if (!keyframe && s->valid[i] &&
+            llabs(v - s->stored[i]) <= cfg.database.changeepsilon)
+        {
+            line[i]  = DATABASE_DOUBLE_NULL_VALUE;
+            carried |= DATABASE_CARRIED(DATABASE_PING_COLUMNS + i);
+        }
+        else
+        {
+            s->stored[i] = v;
+            s->valid[i]  = true;
+        }
+    }
+    return carried;
+}
+
+/*
+ * RETURN
+ *      SQLITE_OK       Success
+ *      *               Return code received from failed sqlite3_ -function
+ */
+#define DATABASE_X_VALUE(f, c, s, k)    rec->f,
+int database_write(dbhandle_t *h, databaserecord_t *rec)
+{
+    sqlite3_stmt  *stmt;
+    dbchangeonly_t changeonly;
+    uint32_t       carried = 0;
+    int            i, rc, compact = h->rollups && cfg.database.keyframeinterval;
+    double         value[DATABASE_SAMPLE_COLUMNS] = { DATABASE_VALUES(DATABASE_X_VALUE) };
+
+    if (!(stmt = database_stmt(h, h->rollups ? DBSTMT_DATA : DBSTMT_LEGACY)))
+        return SQLITE_ERROR;
+    if (compact)
+    {
+        changeonly = h->changeonly;
+        carried    = database_changeonly(h, &changeonly, rec->timestamp, value);
+    }
+    // Positional parameters (SQL_INSERT), violations of the actual values
+    sqlite3_bind_int(stmt, 1, rec->timestamp);
+    for (i = 0; i < DATABASE_SAMPLE_COLUMNS; i++)
+        BINDDOUBLE(i + 2, value[i]);
+    if (h->bounds.valid)
+        sqlite3_bind_int(stmt, DATABASE_SAMPLE_COLUMNS + 2, database_violations(&h->bounds, rec));
+    if (carried)
+        sqlite3_bind_int(stmt, DATABASE_SAMPLE_COLUMNS + 3, carried);
+    if ((rc = database_step(h, stmt)) != SQLITE_OK)
+    {
+        // May have rolled back the rows before it, too
+        memset(&h->changeonly, 0, sizeof(h->changeonly));
+        return rc;
+    }
+    if (compact)
+        h->changeonly = changeonly;
+    return SQLITE_OK;
+}
+#undef DATABASE_X_VALUE
+
+int database_writecounters(dbhandle_t *h, databasecounters_t *rec)
+{
+    sqlite3_stmt *stmt;
+    int          *index = h->stmt[DBSTMT_COUNTERS].index;
+    int           i;
+
+    if (!(stmt = database_stmt(h, DBSTMT_COUNTERS)))
+        return SQLITE_ERROR;
+    sqlite3_bind_int(stmt, index[0], rec->timestamp);
+    sqlite3_bind_int(stmt, index[1], rec->seconds);
+    BINDCOUNTER(index[2], rec->t3timeouts);
+    BINDCOUNTER(index[3], rec->t4timeouts);
+    for (i = 0; i < DATABASE_MAXDOWNCHANNELS; i++)
+    {
+        BINDCOUNTER(index[4 + i * 3],     rec->down[i].unerroreds);
+        BINDCOUNTER(index[4 + i * 3 + 1], rec->down[i].correcteds);
+        BINDCOUNTER(index[4 + i * 3 + 2], rec->down[i].uncorrectables);
+    }
+    return database_step(h, stmt);
+}
+
+int database_writereboot(dbhandle_t *h, databasereboot_t *rec)
+{
+    sqlite3_stmt *stmt;
+    int          *index = h->stmt[DBSTMT_REBOOT].index;
+
+    if (!(stmt = database_stmt(h, DBSTMT_REBOOT)))
+        return SQLITE_ERROR;
+    sqlite3_bind_int(stmt, index[0], rec->timestamp);
+    sqlite3_bind_int(stmt, index[1], rec->boottime);
+    sqlite3_bind_int(stmt, index[2], rec->lastuptime);
+    return database_step(h, stmt);
+}
+
+/*
+ * Bounds
+ *
+ *      Latest row of the bounds table into per value limits, in
+ *      databaserecord_t order (pings have only a maximum). Checking a
+ *      sample is then one branch-free loop of fixed length over the
+ *      values, which the compiler can vectorize.
+ */
+#define SQL_X_PINGBOUNDS(f, c, s, k)    ", NULL, max" #c
+#define SQL_X_LINEBOUNDS(f, c, s, k)    ", min" #c ", max" #c
+#define SQL_SELECT_BOUNDS \
+    "SELECT Timestamp" DATABASE_PING_VALUES(SQL_X_PINGBOUNDS) DATABASE_LINE_VALUES(SQL_X_LINEBOUNDS) " " \
+    "FROM bounds ORDER BY Timestamp DESC LIMIT 1"
+
+int database_loadbounds(char *filename, databasebounds_t *bounds)
+{
+    sqlite3      *db;
+    sqlite3_stmt *stmt;
+    int           i, rc;
+
+    memset(bounds, 0, sizeof(databasebounds_t));
+    if (sqlite3_open_v2(filename, &db, SQLITE_OPEN_READONLY, NULL) != SQLITE_OK)
+    {
+        logerr("Can't open database (\"%s\"): %s", filename, sqlite3_errmsg(db));
+        sqlite3_close(db);
+        return EXIT_FAILURE;
+    }
+    sqlite3_busy_timeout(db, DATABASE_SQLITE3_BUSY_TIMEOUT);
+    if (sqlite3_prepare_v2(db, SQL_SELECT_BOUNDS, -1, &stmt, NULL) != SQLITE_OK)
+    {
+        logmsg(LOG_ERR, "Unable to read bounds of \"%s\": %s", filename, sqlite3_errmsg(db));
+        sqlite3_close(db);
+        return (errno = 0, EXIT_FAILURE);
+    }
+    if ((rc = sqlite3_step(stmt)) == SQLITE_ROW)
+    {
+        bounds->valid     = true;
+        bounds->timestamp = sqlite3_column_int64(stmt, 0);
+        for (i = 0; i < DATABASE_SAMPLE_COLUMNS; i++)
+        {
+            bounds->min[i] = sqlite3_column_type(stmt, i * 2 + 1) == SQLITE_NULL ?
+                             -INFINITY : sqlite3_column_double(stmt, i * 2 + 1);
+            bounds->max[i] = sqlite3_column_type(stmt, i * 2 + 2) == SQLITE_NULL ?
+                             INFINITY : sqlite3_column_double(stmt, i * 2 + 2);
+        }
+        errno = 0;
+        logdev("Bounds of %lld loaded from \"%s\"", (long long)bounds->timestamp, filename);
+    }
+    sqlite3_finalize(stmt);
+    sqlite3_close(db);
+    if (rc != SQLITE_ROW && rc != SQLITE_DONE)
+    {
+        logmsg(LOG_ERR, "Unable to read bounds of \"%s\"", filename);
+        return (errno = 0, EXIT_FAILURE);
+    }
+    return (errno = 0, EXIT_SUCCESS);
+}
+
+uint32_t database_violations(databasebounds_t *bounds, databaserecord_t *rec)
+{
+    const double *value = &rec->modemping_ms;
+    uint32_t      mask  = 0;
+    int           i;
+
+    for (i = 0; i < DATABASE_SAMPLE_COLUMNS; i++)
+        mask |= (uint32_t)((value[i] != DATABASE_DOUBLE_NULL_VALUE) &
+                           ((value[i] < bounds->min[i]) | (value[i] > bounds->max[i]))) << i;
+    return mask;
+}
+
+/*
+ * Sample rows from ... to, in timestamp order. Data view (or the legacy
+ * data table) has the columns in databaserecord_t order, NULLs are
+ * returned as DATABASE_DOUBLE_NULL_VALUE. Rows of the open transaction
+ * are included.
+ */
+static int database_scandb(
+                          sqlite3 *db,
+                          time_t from,
+                          time_t to,
+                          int (*fn)(databaserecord_t *record, void *arg),
+                          void *arg
+                          )
+{
+    sqlite3_stmt     *stmt;
+    databaserecord_t  rec;
+    double           *value = &rec.modemping_ms;
+    int               i, rc, n = 0;
+
+    if ((rc = sqlite3_prepare_v2(
+                                db,
+                                "SELECT * FROM data WHERE Timestamp BETWEEN ? AND ? ORDER BY Timestamp",
+                                -1,
+                                &stmt,
+                                NULL
+                                )) != SQLITE_OK)
+    {
+        logerr("sqlite3_prepare_v2() failed: %s", sqlite3_errmsg(db));
+        return -1;
+    }
+    sqlite3_bind_int64(stmt, 1, from);
+    sqlite3_bind_int64(stmt, 2, to);
+    while ((rc = sqlite3_step(stmt)) == SQLITE_ROW)
+    {
+        rec.timestamp = sqlite3_column_int64(stmt, 0);
+        for (i = 0; i < DATABASE_SAMPLE_COLUMNS; i++)
+            value[i] = sqlite3_column_type(stmt, i + 1) == SQLITE_NULL ?
+                       DATABASE_DOUBLE_NULL_VALUE : sqlite3_column_double(stmt, i + 1);
+        n++;
+        if (fn(&rec, arg))
+        {
+            rc = SQLITE_DONE;
+            break;
+        }
+    }
+    if (rc != SQLITE_DONE)
+    {
+        logerr("Sample scan failed: %s", sqlite3_errmsg(db));
+        n = -1;
+    }
+    sqlite3_finalize(stmt);
+    errno = 0;
+    return n;
+}
+
+int database_scan(
+                 dbhandle_t *h,
+                 time_t from,
+                 time_t to,
+                 int (*fn)(databaserecord_t *record, void *arg),
+                 void *arg
+                 )
+{
+    return database_scandb(h->db, from, to, fn, arg);
+}
+
+/*
+ * Scan over a read only connection of its own. Rows are stepped out of
+ * the Timestamp range of the index (rowid of the compact schema), memory
+ * use does not depend on the range.
+ */
+int database_scanfile(
+                     char *filename,
+                     time_t from,
+                     time_t to,
+                     int (*fn)(databaserecord_t *record, void *arg),
+                     void *arg
+                     )
+{
+    sqlite3 *db;
+    int      n;
+
+    if (sqlite3_open_v2(filename, &db, SQLITE_OPEN_READONLY, NULL) != SQLITE_OK)
+    {
+        logerr("Can't open database (\"%s\"): %s", filename, sqlite3_errmsg(db));
+        sqlite3_close(db);
+        return -1;
+    }
+    sqlite3_busy_timeout(db, DATABASE_SQLITE3_BUSY_TIMEOUT);
+    n = database_scandb(db, from, to, fn, arg);
+    sqlite3_close(db);
+    return n;
+}
+
+/*
+ * Recompute rollup buckets of rows first ... last (written since the
+ * previous call). Called by the writer before it commits, so that rows and
+ * rollups are committed together; outside a transaction, one is opened.
+ */
+int database_rollup(dbhandle_t *h, time_t first, time_t last)
+{
+    int rc, own = !database_intransaction(h);
+
+    if (!h->rollups)
+        return SQLITE_OK;
+    if (own && (rc = database_begin(h)))
+        return rc;
+    rc = database_rollupexec(h->db, h->rollup, first, last);
+    if (own)
+    {
+        if (rc == SQLITE_OK)
+            rc = database_commit(h);
+        else
+            sqlite3_exec(h->db, "ROLLBACK", NULL, NULL, NULL);
+    }
+    // SQLite3 sets errno even on success (see database_initialize())
+    errno = 0;
+    return rc;
+}
+
+/*
+ * Retention (cfg.database.retention)
+ *
+ *      Rows older than cutoff are deleted from samples, counters and
+ *      reboots (rollups are kept), oldest first, one chunk per call. Each
+ *      chunk is its own IMMEDIATE transaction. A progress handler
+ *      interrupts a statement that runs past maxlock_ms; the chunk is
+ *      rolled back and the next one is half the size. Chunk size adapts so
+ *      that a chunk takes between a quarter and half of maxlock_ms. Commit
+ *      (journal sync) cannot be interrupted and is included in the
+ *      adaptation, but not enforced.
+ *
+ *      Only the compact schema is supported: samples are deleted by rowid
+ *      (Timestamp) and counters over the counters_timestamp index. Legacy
+ *      data table has no index and every chunk would scan it.
+ */
+static double database_monotonicms()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000.0 + now.tv_nsec / 1000000.0;
+}
+
+static int database_deadline(void *deadline)
+{
+    return database_monotonicms() > *(double *)deadline;
+}
+
+/*
+ * Execute sql (one chunk) in an IMMEDIATE transaction within maxlock_ms.
+ * Returns SQLITE_OK, SQLITE_INTERRUPT (rolled back) or an error. Sets *ms
+ * to the time the write lock was held and *n_changes.
+ */
+static int database_chunk(dbhandle_t *h, const char *sql, int maxlock_ms, double *ms, int *n_changes)
+{
+    double start, deadline;
+    int    rc;
+
+    *ms        = 0.0;
+    *n_changes = 0;
+    // Do not wait on busy longer than we would hold the lock
+    database_busytimeout(h->db, maxlock_ms);
+    rc = sqlite3_exec(h->db, "BEGIN IMMEDIATE", NULL, NULL, NULL);
+    database_busytimeout(h->db, DATABASE_SQLITE3_BUSY_TIMEOUT);
+    if (rc != SQLITE_OK)
+        return rc;
+    start    = database_monotonicms();
+    deadline = start + maxlock_ms;
+    sqlite3_progress_handler(h->db, DATABASE_RETENTION_PROGRESSOPS, database_deadline, &deadline);
+    rc = sqlite3_exec(h->db, sql, NULL, NULL, NULL);
+    sqlite3_progress_handler(h->db, 0, NULL, NULL);
+    *n_changes = sqlite3_changes(h->db);
+    if (rc == SQLITE_OK)
+        rc = sqlite3_exec(h->db, "COMMIT", NULL, NULL, NULL);
+    if (rc != SQLITE_OK && !sqlite3_get_autocommit(h->db))
+        sqlite3_exec(h->db, "ROLLBACK", NULL, NULL, NULL);
+    *ms = database_monotonicms() - start;
+    return rc;
+}
+
+/*
+ * Adapt chunk size to the time the previous chunk took
+ */
+static int database_chunksize(int size, int rc, double ms, int maxlock_ms, int max)
+{
+    if (rc == SQLITE_INTERRUPT || ms > maxlock_ms / 2.0)
+        size /= 2;
+    else if (ms < maxlock_ms / 4.0)
+        size *= 2;
+    return size < 1 ? 1 : (size > max ? max : size);
+}
+
+int database_retention(dbhandle_t *h, time_t cutoff, int maxlock_ms, int *n_deleted, time_t *oldest)
+{
+    const char   *table[] = { "samples", "counters", "reboots", NULL };
+    sqlite3_stmt *stmt;
+    char         *sql;
+    double        ms;
+    int           rc, i;
+
+    *n_deleted = 0;
+    *oldest    = 0;
+    if (!h->rollups)
+        return (errno = ENOTSUP, -1);
+    if (!h->retentionchunk)
+        h->retentionchunk = DATABASE_RETENTION_CHUNK;
+    for (i = 0; table[i]; i++)
+    {
+        // Anything left in this table?
+        sql = sqlite3_mprintf("SELECT MIN(Timestamp) FROM %s WHERE Timestamp < %lld", table[i], (long long)cutoff);
+        rc  = sqlite3_prepare_v2(h->db, sql, -1, &stmt, NULL);
+        sqlite3_free(sql);
+        if (rc != SQLITE_OK)
+        {
+            logerr("Retention: %s", sqlite3_errmsg(h->db));
+            return -1;
+        }
+        if (sqlite3_step(stmt) == SQLITE_ROW && sqlite3_column_type(stmt, 0) != SQLITE_NULL)
+            *oldest = sqlite3_column_int64(stmt, 0);
+        sqlite3_finalize(stmt);
+        if (*oldest)
+            break;
+    }
+    if (!table[i])
+        return (errno = 0, DATABASE_RETENTION_DONE);
+    sql = sqlite3_mprintf(
+                         "DELETE FROM %s WHERE rowid IN "
+                         "(SELECT rowid FROM %s WHERE Timestamp < %lld ORDER BY Timestamp LIMIT %d)",
+                         table[i], table[i], (long long)cutoff, h->retentionchunk
+                         );
+    // First remaining row may carry values from the deleted ones
+    if (sql && i == 0)
+    {
+        char *where = sqlite3_mprintf(
+                                     "Timestamp = (SELECT MIN(Timestamp) FROM samples WHERE Timestamp > "
+                                     "(SELECT MAX(Timestamp) FROM (SELECT Timestamp FROM samples "
+                                     "WHERE Timestamp < %lld ORDER BY Timestamp LIMIT %d)))",
+                                     (long long)cutoff, h->retentionchunk
+                                     );
+        char *materialize = where ? database_materializesql("main", where) : NULL;
+        sqlite3_free(where);
+        if (materialize)
+            sql = sqlite3_mprintf("%z%z", materialize, sql);
+        else
+        {
+            sqlite3_free(sql);
+            sql = NULL;
+        }
+    }
+    if (!sql)
+    {
+        logerr("Retention: unable to generate SQL");
+        return -1;
+    }
+    rc = database_chunk(h, sql, maxlock_ms, &ms, n_deleted);
+    sqlite3_free(sql);
+    h->retentionchunk = database_chunksize(h->retentionchunk, rc, ms, maxlock_ms, DATABASE_RETENTION_MAXCHUNK);
+    if (rc == SQLITE_INTERRUPT || rc == SQLITE_BUSY)
+    {
+        logdev("Retention chunk %s after %.1f ms, next chunk %d rows",
+               rc == SQLITE_BUSY ? "busy" : "interrupted", ms, h->retentionchunk);
+        *n_deleted = 0;
+        return (errno = 0, DATABASE_RETENTION_MORE);
+    }
+    if (rc != SQLITE_OK)
+    {
+        logerr("Retention delete from %s failed: %s", table[i], sqlite3_errmsg(h->db));
+        return -1;
+    }
+    errno = 0;
+    logdev("Retention deleted %d rows from %s in %.1f ms", *n_deleted, table[i], ms);
+    return DATABASE_RETENTION_MORE;
+}
+
+/*
+ * Return free pages to the file system, chunk at a time, like retention.
+ * Requires auto_vacuum = INCREMENTAL (new datafiles, -migratedb).
+ */
+int database_incrementalvacuum(dbhandle_t *h, int maxlock_ms, int *n_pages)
+{
+    sqlite3_stmt *stmt;
+    char          sql[64];
+    double        ms;
+    int           rc, n_free = 0, autovacuum = 0, chunk;
+
+    *n_pages = 0;
+    if (sqlite3_prepare_v2(h->db, "PRAGMA auto_vacuum", -1, &stmt, NULL) == SQLITE_OK)
+    {
+        if (sqlite3_step(stmt) == SQLITE_ROW)
+            autovacuum = sqlite3_column_int(stmt, 0);
+        sqlite3_finalize(stmt);
+    }
+    if (autovacuum != DATABASE_AUTOVACUUM_INCREMENTAL)
+        return (errno = ENOTSUP, -1);
+    if (sqlite3_prepare_v2(h->db, "PRAGMA freelist_count", -1, &stmt, NULL) == SQLITE_OK)
+    {
+        if (sqlite3_step(stmt) == SQLITE_ROW)
+            n_free = sqlite3_column_int(stmt, 0);
+        sqlite3_finalize(stmt);
+    }
+    if (!n_free)
+        return (errno = 0, DATABASE_RETENTION_DONE);
+    if (!h->vacuumchunk)
+        h->vacuumchunk = DATABASE_VACUUM_CHUNK;
+    chunk = h->vacuumchunk;
+    snprintf(sql, sizeof(sql), "PRAGMA incremental_vacuum(%d)", chunk);
+    rc = database_chunk(h, sql, maxlock_ms, &ms, n_pages);
+    h->vacuumchunk = database_chunksize(h->vacuumchunk, rc, ms, maxlock_ms, DATABASE_VACUUM_MAXCHUNK);
+    if (rc == SQLITE_INTERRUPT || rc == SQLITE_BUSY)
+        return (errno = 0, DATABASE_RETENTION_MORE);
+    if (rc != SQLITE_OK)
+    {
+        logerr("incremental_vacuum failed: %s", sqlite3_errmsg(h->db));
+        return -1;
+    }
+    // sqlite3_changes() does not count pages
+    *n_pages = n_free < chunk ? n_free : chunk;
+    errno = 0;
+    logdev("incremental_vacuum freed up to %d pages in %.1f ms", *n_pages, ms);
+    return DATABASE_RETENTION_MORE;
+}
+
+/*
+ * Single row inserts (open, write, close)
+ *
+ *      For callers that do not keep a handle. Every call pays the full
+ *      open + prepare cost (see database_testwriteperf()).
+ */
+int database_insert(char *filename, databaserecord_t *rec)
+{
+    dbhandle_t *h;
+    int         rc;
+    if (!(h = database_open(filename)))
+        return SQLITE_CANTOPEN;
+    rc = database_write(h, rec);
+    if (rc == SQLITE_OK)
+        rc = database_rollup(h, rec->timestamp, rec->timestamp);
+    database_close(h);
+    return rc;
+}
+
+int database_insertcounters(char *filename, databasecounters_t *rec)
+{
+    dbhandle_t *h;
+    int         rc;
+    if (!(h = database_open(filename)))
+        return SQLITE_CANTOPEN;
+    rc = database_writecounters(h, rec);
+    if (rc == SQLITE_OK)
+        rc = database_rollup(h, rec->timestamp, rec->timestamp);
+    database_close(h);
+    return rc;
+}
+
+int database_insertreboot(char *filename, databasereboot_t *rec)
+{
+    dbhandle_t *h;
+    int         rc;
+    if (!(h = database_open(filename)))
+        return SQLITE_CANTOPEN;
+    rc = database_writereboot(h, rec);
+    database_close(h);
+    return rc;
+}
+
+void database_logdev(databaserecord_t *rec)
+{
+    static const char *name[DATABASE_SAMPLE_COLUMNS] = { DATABASE_VALUES(DATABASE_X_NAME) };
+    double            *value;
+    int                i;
+
+    if (!rec)
+    {
+        logdev("Received NULL pointer!");
+        return;
+    }
+    value = &rec->modemping_ms;
+    logdev("databaserecord_t.timestamp     : %d\n", (int)rec->timestamp);
+    for (i = 0; i < DATABASE_SAMPLE_COLUMNS; i++)
+    {
+        if (value[i] == DATABASE_DOUBLE_NULL_VALUE)
+            logdev("databaserecord_t.%-13s : NULL\n", name[i]);
+        else
+            logdev("databaserecord_t.%-13s : %4.1f\n", name[i], value[i]);
+    }
 }
 
 /* EOF */
@@ -30,6 +30,7 @@
  */
 #include <float.h>     // DBL_MAX
 #include <time.h>
+#include <stdint.h>    // int64_t
 
 #ifndef __DATABASE_H__
 #define __DATABASE_H__
@@ -52,37 +53,160 @@
  *			is 5 seconds...
  */
 #define DATABASE_SQLITE3_BUSY_TIMEOUT	4000
+#define DATABASE_SQLITE3_BUSY_SLEEP     2       // ms, writer connection (database_busytimeout())
 #define DATABASE_DOUBLE_NULL_VALUE      DBL_MAX
+#define DATABASE_COUNTER_NULL_VALUE     (-1)
+#define DATABASE_MAXDOWNCHANNELS        8
+
+/*
+ * Sample values
+ *
+ *      One line per value, in databaserecord_t order. Record fields, the
+ *      SQL of the data table, samples table, data view and its triggers,
+ *      the INSERT, binding, rollup columns and logging are all generated
+ *      from these lists:
+ *
+ *          X(field, column, compact, scale)
+ *
+ *          field       databaserecord_t member (double)
+ *          column      data view (and legacy data table) column, REAL
+ *          compact     samples table column, INTEGER (value * scale)
+ *          scale       units of compact per unit of column
+ *
+ *      Pings are in milliseconds (microseconds in samples). Line values,
+ *      in the order scrubber and WebUI report them, are in dBmV / dB
+ *      (tenths in samples). Bounds have only a maximum for pings.
+ *
+ *      Existing datafiles need an upgrade (database_upgrade()) for a new
+ *      column, as do the bounds table and samplelog.c streams.
+ */
+#define DATABASE_PING_VALUES(X) \
+    X(modemping_ms,     ModemPing,  ModemRtt,   1000) \
+    X(inetping_ms,      InetPing,   InetRtt,    1000)
+#define DATABASE_LINE_VALUES(X) \
+    X(down_ch1_dbmv,    dCh1dBbmV,  dCh1Power,  10) \
+    X(down_ch1_db,      dCh1dB,     dCh1Snr,    10) \
+    X(down_ch2_dbmv,    dCh2dBbmV,  dCh2Power,  10) \
+    X(down_ch2_db,      dCh2dB,     dCh2Snr,    10) \
+    X(down_ch3_dbmv,    dCh3dBbmV,  dCh3Power,  10) \
+    X(down_ch3_db,      dCh3dB,     dCh3Snr,    10) \
+    X(down_ch4_dbmv,    dCh4dBbmV,  dCh4Power,  10) \
+    X(down_ch4_db,      dCh4dB,     dCh4Snr,    10) \
+    X(down_ch5_dbmv,    dCh5dBbmV,  dCh5Power,  10) \
+    X(down_ch5_db,      dCh5dB,     dCh5Snr,    10) \
+    X(down_ch6_dbmv,    dCh6dBbmV,  dCh6Power,  10) \
+    X(down_ch6_db,      dCh6dB,     dCh6Snr,    10) \
+    X(down_ch7_dbmv,    dCh7dBbmV,  dCh7Power,  10) \
+    X(down_ch7_db,      dCh7dB,     dCh7Snr,    10) \
+    X(down_ch8_dbmv,    dCh8dBbmV,  dCh8Power,  10) \
+    X(down_ch8_db,      dCh8dB,     dCh8Snr,    10) \
+    X(up_ch1_dbmv,      uCh1dBmV,   uCh1Power,  10) \
+    X(up_ch2_dbmv,      uCh2dBmV,   uCh2Power,  10) \
+    X(up_ch3_dbmv,      uCh3dBmV,   uCh3Power,  10) \
+    X(up_ch4_dbmv,      uCh4dBmV,   uCh4Power,  10)
+#define DATABASE_VALUES(X)              DATABASE_PING_VALUES(X) DATABASE_LINE_VALUES(X)
+
+#define DATABASE_X_COUNT(f, c, s, k)    + 1
+#define DATABASE_X_FIELD(f, c, s, k)    double f;
+#define DATABASE_X_NAME(f, c, s, k)     #f,
+#define DATABASE_X_SCALE(f, c, s, k)    k##.0,
+#define DATABASE_X_COMPACT(f, c, s, k)  #s,
+#define DATABASE_PING_COLUMNS           (0 DATABASE_PING_VALUES(DATABASE_X_COUNT))
+#define DATABASE_LINE_COLUMNS           (0 DATABASE_LINE_VALUES(DATABASE_X_COUNT))
+#define DATABASE_SAMPLE_COLUMNS         (DATABASE_PING_COLUMNS + DATABASE_LINE_COLUMNS)
+/*
+ * Schema version (PRAGMA user_version)
+ */
+#define DATABASE_SCHEMA_LEGACY          0       // data table of REAL columns
+#define DATABASE_SCHEMA_COMPACT         1       // samples table + data view
+
+/*
+ * Retention (database_retention(), database_incrementalvacuum())
+ */
+#define DATABASE_RETENTION_DONE         0
+#define DATABASE_RETENTION_MORE         1
+#define DATABASE_RETENTION_CHUNK        256     // rows, initial
+#define DATABASE_RETENTION_MAXCHUNK     65536
+#define DATABASE_VACUUM_CHUNK           64      // pages, initial
+#define DATABASE_VACUUM_MAXCHUNK        16384
+#define DATABASE_RETENTION_PROGRESSOPS  1000    // VM instructions between deadline checks
+#define DATABASE_AUTOVACUUM_INCREMENTAL 2       // PRAGMA auto_vacuum
+
+/*
+ * Read-only replica (database_replicate())
+ */
+#define DATABASE_REPLICA_PAGES          64      // pages per sqlite3_backup_step()
+#define DATABASE_REPLICA_PAGES_DELETE   8       // rollback journal datafile (shared lock per step)
+#define DATABASE_REPLICA_SLEEP          20      // ms between steps
+#define DATABASE_REPLICA_MAXRESTARTS    8       // source changed under the copy
+#define DATABASE_REPLICA_SUFFIX         ".tmp"  // copy is renamed over the replica
+
+/*
+ * Bounds violations (Violations column, database_violations())
+ *
+ *      Bit n is value n of databaserecord_t (0 == modemping_ms). Groups
+ *      for queries, for example every sample with a downstream SNR out of
+ *      range (partial index samples_violations covers Violations > 0):
+ *
+ *          SELECT * FROM data WHERE Violations > 0 AND Violations & 174760;
+ */
+#define DATABASE_VIOLATION(n)           (1u << (n))
+#define DATABASE_VIOLATIONS_PING        0x000003    // ModemPing, InetPing
+#define DATABASE_VIOLATIONS_DOWN_POWER  0x015554    // dCh1dBbmV ... dCh8dBbmV
+#define DATABASE_VIOLATIONS_DOWN_SNR    0x02AAA8    // dCh1dB ... dCh8dB
+#define DATABASE_VIOLATIONS_UP_POWER    0x3C0000    // uCh1dBmV ... uCh4dBmV
+
+/*
+ * Change-only storage (Carried column, cfg.database.keyframeinterval)
+ *
+ *      Line value within cfg.database.changeepsilon of the value last
+ *      stored is written as NULL, with bit n (as in Violations) set in
+ *      Carried. samples_dense view, and the data view over it, carry the
+ *      stored value forward. Every keyframeinterval seconds, and as the
+ *      first row of a connection, all values are stored.
+ *
+ *      A row inserted before carried rows, or deleted from under them,
+ *      would change what they carry. database_materializesql() returns an
+ *      UPDATE that stores the carried values of the rows of schema.samples
+ *      selected by 'where' (e.g. "Timestamp = ..."), to run before that.
+ *      Free with sqlite3_free(), NULL on error.
+ */
+#define DATABASE_CARRIED(n)             (1u << (n))
+
+char *  database_materializesql(const char *schema, const char *where);
 
 /*
  * public configuration values structure
  */
 typedef struct {
     time_t timestamp;           /* measurement datetime in Unix timestamp   */
-    double modemping_ms;        /* ping response in mS                      */
-    double inetping_ms;         /* ping response in mS                      */
-    double down_ch1_dbmv;
-    double down_ch1_db;
-    double down_ch2_dbmv;
-    double down_ch2_db;
-    double down_ch3_dbmv;
-    double down_ch3_db;
-    double down_ch4_dbmv;
-    double down_ch4_db;
-    double down_ch5_dbmv;
-    double down_ch5_db;
-    double down_ch6_dbmv;
-    double down_ch6_db;
-    double down_ch7_dbmv;
-    double down_ch7_db;
-    double down_ch8_dbmv;
-    double down_ch8_db;
-    double up_ch1_dbmv;
-    double up_ch2_dbmv;
-    double up_ch3_dbmv;
-    double up_ch4_dbmv;
+    DATABASE_VALUES(DATABASE_X_FIELD)
 } databaserecord_t;
 
+/*
+ * Counter deltas over .seconds (counters.c). Raw values are not stored.
+ */
+typedef struct {
+    time_t  timestamp;
+    int     seconds;            /* delta period (uptime, if rebooted)       */
+    int64_t t3timeouts;
+    int64_t t4timeouts;
+    struct {
+        int64_t unerroreds;
+        int64_t correcteds;
+        int64_t uncorrectables;
+    } down[DATABASE_MAXDOWNCHANNELS];
+} databasecounters_t;
+
+/*
+ * Modem reboot event (counters.c)
+ */
+typedef struct {
+    time_t  timestamp;          /* when detected                            */
+    time_t  boottime;           /* timestamp - sysUpTime                    */
+    int     lastuptime;         /* (seconds) uptime in the previous sample  */
+} databasereboot_t;
+
 typedef struct
 {
     int    n;       // Number of samples
@@ -90,15 +214,125 @@ typedef struct
     double mean;    // Average
     double max;     // Slowest insert
     double stddev;  // Standard Deviation
+    double p50;     // Median
+    double p99;     // 99th percentile (nearest rank)
 } dbperf_t;
 
+/*
+ * Latest bounds row, as limits per databaserecord_t value. NULL limit is
+ * -INFINITY / INFINITY (no limit), pings have no minimum.
+ */
+typedef struct
+{
+    int    valid;                               // bounds row was found
+    time_t timestamp;                           // of the bounds row
+    double min[DATABASE_SAMPLE_COLUMNS];
+    double max[DATABASE_SAMPLE_COLUMNS];
+} databasebounds_t;
+
 #endif /* __DATABASE_H__ */
 
 /*
  * Function prototypes
  */
 int     database_initialize(char *datafile);
+/*
+ * Create tables and views added after the original data table (if they do
+ * not exist). Called by database_initialize() and at start-up, for database
+ * files created by earlier versions.
+ */
+int     database_upgrade(char *datafile);
+/*
+ * Persistent connection
+ *
+ *  database_open()     Open datafile. Statements are prepared on first use
+ *                      and kept (with their parameter indices) until
+ *                      database_close().
+ *  database_write*()   Bind, step and reset. Returns SQLITE_OK or the
+ *                      failed sqlite3_* function return code.
+ *  database_begin()    Open a transaction (no-op if one is open). Rows
+ *                      written until database_commit() share one journal
+ *                      sync. database_close() commits an open transaction.
+ *  database_checkpoint() WAL checkpoint, PASSIVE or TRUNCATE.
+ *  database_walsize()  WAL file size in kB.
+ *  database_busytimeout() Busy handler of the writer connection: fixed
+ *                      DATABASE_SQLITE3_BUSY_SLEEP ms sleeps up to ms in
+ *                      total. sqlite3_busy_timeout() backs off up to 100
+ *                      ms per sleep, much longer than a reader (replica
+ *                      step) holds the shared lock the commit waits for.
+ *  database_rollup()   Recompute rollup buckets covering first ... last
+ *                      (compact schema only).
+ *  database_scan()     Call fn() for each sample row from ... to (inclusive),
+ *                      fn() returning non-zero stops. Returns number of
+ *                      rows, -1 on error.
+ *
+ *  Journal mode and synchronous are set on open (cfg.database.journal,
+ *  cfg.database.synchronous).
+ *
+ *  Bounds are loaded on open, from the base datafile (cfg.database.filename;
+ *  partitions and the tmpfs datafile have empty bounds tables). The daemon
+ *  opens at start and when the writer restarts on SIGHUP. database_write()
+ *  stores the violations of each sample into Violations, NULL if there is
+ *  no bounds row.
+ */
+typedef struct dbhandle_t dbhandle_t;
+struct sqlite3;
+dbhandle_t *database_open(char *datafile);
+void    database_close(dbhandle_t *handle);
+char *  database_filename(dbhandle_t *handle);
+int     database_begin(dbhandle_t *handle);
+int     database_commit(dbhandle_t *handle);
+int     database_intransaction(dbhandle_t *handle);
+int     database_checkpoint(dbhandle_t *handle, int truncate);
+int     database_walsize(dbhandle_t *handle);
+int     database_busytimeout(struct sqlite3 *db, int ms);
+int     database_write(dbhandle_t *handle, databaserecord_t *record);
+int     database_writecounters(dbhandle_t *handle, databasecounters_t *record);
+int     database_writereboot(dbhandle_t *handle, databasereboot_t *record);
+int     database_rollup(dbhandle_t *handle, time_t first, time_t last);
+int     database_scan(
+                     dbhandle_t *handle,
+                     time_t from,
+                     time_t to,
+                     int (*fn)(databaserecord_t *record, void *arg),
+                     void *arg
+                     );
+/*
+ * database_scan() over a read only connection of its own (no handle)
+ */
+int     database_scanfile(
+                         char *datafile,
+                         time_t from,
+                         time_t to,
+                         int (*fn)(databaserecord_t *record, void *arg),
+                         void *arg
+                         );
+/*
+ * Bounds
+ *
+ *  database_loadbounds()   Latest bounds row (by Timestamp) of datafile.
+ *                          No row is not an error (bounds->valid is 0).
+ *  database_violations()   DATABASE_VIOLATION() bits of the values outside
+ *                          bounds. Missing values (DATABASE_DOUBLE_NULL_VALUE)
+ *                          are not violations.
+ */
+int      database_loadbounds(char *datafile, databasebounds_t *bounds);
+uint32_t database_violations(databasebounds_t *bounds, databaserecord_t *record);
+/*
+ * Retention chunk: delete rows older than cutoff, holding the write lock
+ * for at most maxlock_ms. Returns DATABASE_RETENTION_MORE (call again),
+ * DATABASE_RETENTION_DONE or -1 (errno ENOTSUP: legacy schema). Oldest
+ * remaining timestamp before the chunk is returned for progress.
+ * Incremental vacuum likewise (ENOTSUP: auto_vacuum is not INCREMENTAL).
+ */
+int     database_retention(dbhandle_t *handle, time_t cutoff, int maxlock_ms, int *n_deleted, time_t *oldest);
+int     database_incrementalvacuum(dbhandle_t *handle, int maxlock_ms, int *n_pages);
+/*
+ * Single row inserts (open, write and close for each row)
+ */
 int     database_insert(char *datafile, databaserecord_t *record);
+int     database_insertcounters(char *datafile, databasecounters_t *record);
+int     database_insertreboot(char *datafile, databasereboot_t *record);
 void	database_logdev(databaserecord_t *record);
 /*
  * Delete row(s) matching to defined timestamp value.
@@ -110,45 +344,245 @@ int     database_delete(int timestamp);
  * EVENT_CMD_COLLECTTMPFS handler
  * Read all data older than argument (olderthan) from tmpfs datafile and insert
  * them into the actual datafile. (deletes the records that were moved).
+ * Moves data, counters and reboots rows, in one transaction.
  */
 int     database_collecttmpfs(time_t olderthan);
 
 /*
- * Test SQLite3 write performance
+ * Copy datafile into a read-only replica for reports, with the online
+ * backup API, DATABASE_REPLICA_PAGES at a time. Copy is written next to
+ * the replica and renamed over it when complete, readers of the replica
+ * see either the previous or the new copy.
+ */
+int     database_replicate(char *datafile, char *replica);
+
+/*
+ * Convert legacy data table into the compact schema (see below). Rows of
+ * the same timestamp (separate ping and line data jobs) are merged.
+ */
+int     database_migrate(char *datafile);
+int     database_schema(char *datafile);
+
+/*
+ * Rollup tables rollup_1m, rollup_1h and rollup_1d (compact schema). Kept
+ * up to date by the database writer, per bucket: samples rows, lost pings,
+ * T3/T4 timeouts and, for each samples column, N, Min, Max, Sum and SumSq.
+ * Rebuild recomputes all buckets from samples and logs how many differed.
  */
-dbperf_t *database_testwriteperf(int nsamples);
+int     database_rebuildrollups(char *datafile);
+
+/*
+ * Datafile partitions (cfg.database.partition)
+ *
+ *  database_partition()    Datafile for time t. Static buffer. Base
+ *                          datafile if partitioning is not in use.
+ *  database_nextpartition() Start of the next partition period (0 if
+ *                          partitioning is not in use).
+ *  database_preparepartition() Create datafile if it does not exist.
+ *  database_removepartitions() Remove all but the newest keep partitions.
+ *                          Returns number of datafiles removed.
+ *  database_foreachpartition() Call fn() for each partition datafile.
+ *                          Returns number of failed calls.
+ *  database_openspan()     Read only connection where data, counters and
+ *                          reboots span the base datafile and partitions,
+ *                          for SQL reads. Newest partitions only, up to the
+ *                          attach limit (export scans every datafile).
+ */
+char *  database_partition(time_t t);
+time_t  database_nextpartition(time_t t);
+int     database_preparepartition(char *datafile);
+int     database_removepartitions(int keep);
+int     database_foreachpartition(int (*fn)(char *datafile));
+struct sqlite3 *database_openspan(void);
+
+/*
+ * Test SQLite3 write performance (open per row or persistent connection)
+ */
+dbperf_t *database_testwriteperf(int nsamples, int persistent);
+
+/*
+ * Fill perf from n timings (ms). Sorts the array. Returns perf.
+ */
+dbperf_t *database_perfstats(dbperf_t *perf, double *ms, int n);
 
 /*
  * SQL statements used internally
  */
-#define SQL_CREATE_TABLE_DATA " \
-CREATE TABLE data ( \
-    Timestamp       INTEGER, \
-    ModemPing       REAL, \
-    InetPing        REAL, \
-    dCh1dBbmV       REAL, \
-    dCh1dB          REAL, \
-    dCh2dBbmV       REAL, \
-    dCh2dB          REAL, \
-    dCh3dBbmV       REAL, \
-    dCh3dB          REAL, \
-    dCh4dBbmV       REAL, \
-    dCh4dB          REAL, \
-    dCh5dBbmV       REAL, \
-    dCh5dB          REAL, \
-    dCh6dBbmV       REAL, \
-    dCh6dB          REAL, \
-    dCh7dBbmV       REAL, \
-    dCh7dB          REAL, \
-    dCh8dBbmV       REAL, \
-    dCh8dB          REAL, \
-    uCh1dBmV        REAL, \
-    uCh2dBmV        REAL, \
-    uCh3dBmV        REAL, \
-    uCh4dBmV        REAL \
+/*
+ * Legacy data table (DATABASE_SCHEMA_LEGACY). New datafiles are created
+ * with the compact schema, -migratedb converts old ones.
+ */
+#define SQL_X_DATA(f, c, s, k)      ", " #c " REAL"
+#define SQL_CREATE_TABLE_DATA \
+    "CREATE TABLE data (Timestamp INTEGER" DATABASE_VALUES(SQL_X_DATA) "); "
+/*
+ * Compact schema (DATABASE_SCHEMA_COMPACT)
+ *
+ *      REAL value takes 8 bytes, but the readings have one decimal. They
+ *      are stored as scaled integers, which SQLite3 stores in 1 or 2 bytes:
+ *
+ *          *Power, *Snr    tenths of dBmV / dB
+ *          *Rtt            microseconds
+ *
+ *      Timestamp is the INTEGER PRIMARY KEY, ie. the rowid. It costs no
+ *      extra space and time range queries are rowid range scans.
+ *
+ *      "data" is a view that presents the legacy column names and units,
+ *      so queries written for the old table keep working. INSTEAD OF
+ *      triggers make it writable: an INSERT of a timestamp that already
+ *      has a row fills in the NULL columns (separate ping and line data
+ *      jobs produce one row), DELETE deletes from samples. The merge is
+ *      INSERT OR IGNORE and an UPDATE when nothing was inserted, rather
+ *      than an upsert, which would need SQLite 3.24.
+ *
+ *      Violations is the bounds violation bitmask (DATABASE_VIOLATION()),
+ *      merged rows have the bits of both. database_upgrade() adds it to
+ *      datafiles of earlier versions (legacy data table too).
+ *
+ *      Carried is the change-only bitmask (DATABASE_CARRIED()), NULL in
+ *      rows that store every value. The data view reads samples_dense,
+ *      which database.c generates; it has the samples columns, with the
+ *      carried values filled in from the latest stored value.
+ */
+#define SQL_X_SAMPLES(f, c, s, k)   #s " INTEGER, "
+#define SQL_CREATE_TABLE_SAMPLES \
+    "CREATE TABLE IF NOT EXISTS samples (Timestamp INTEGER PRIMARY KEY, " \
+    DATABASE_VALUES(SQL_X_SAMPLES) "Violations INTEGER, Carried INTEGER); "
+#define SQL_CREATE_INDEX_SAMPLES_VIOLATIONS " \
+CREATE INDEX IF NOT EXISTS samples_violations \
+ON samples (Violations) WHERE Violations > 0; "
+#define SQL_CREATE_INDEX_DATA_VIOLATIONS " \
+CREATE INDEX IF NOT EXISTS data_violations \
+ON data (Violations) WHERE Violations > 0; "
+#define SQL_X_VIEW(f, c, s, k)      #s " / " #k ".0 AS " #c ", "
+#define SQL_CREATE_VIEW_DATA \
+    "CREATE VIEW IF NOT EXISTS data AS SELECT Timestamp, " \
+    DATABASE_VALUES(SQL_X_VIEW) "Violations, Carried FROM samples_dense; "
+#define SQL_X_ROUND(f, c, s, k)     "ROUND(NEW." #c " * " #k "), "
+#define SQL_X_MERGE(f, c, s, k)     #s " = IFNULL(ROUND(NEW." #c " * " #k "), " #s "), "
+#define SQL_CREATE_TRIGGER_DATA_INSERT \
+    "CREATE TRIGGER IF NOT EXISTS data_insert INSTEAD OF INSERT ON data BEGIN " \
+    "INSERT OR IGNORE INTO samples VALUES (NEW.Timestamp, " DATABASE_VALUES(SQL_X_ROUND) "NEW.Violations, NEW.Carried); " \
+    "UPDATE samples SET " DATABASE_VALUES(SQL_X_MERGE) \
+    "Violations = IFNULL(NEW.Violations | Violations, IFNULL(NEW.Violations, Violations)), " \
+    "Carried = IFNULL(NEW.Carried | Carried, IFNULL(NEW.Carried, Carried)) " \
+    "WHERE Timestamp = NEW.Timestamp AND changes() = 0; " \
+    "END; "
+#define SQL_CREATE_TRIGGER_DATA_DELETE " \
+CREATE TRIGGER IF NOT EXISTS data_delete \
+INSTEAD OF DELETE ON data \
+BEGIN \
+    DELETE FROM samples WHERE Timestamp = OLD.Timestamp; \
+END; "
+#define SQL_SET_SCHEMA_COMPACT " \
+PRAGMA user_version = 1; "
+/*
+ * Migration (database_migrate()), legacy table is renamed to data_legacy
+ * and dropped after copying.
+ */
+#define SQL_X_MIGRATE(f, c, s, k)   "ROUND(MAX(" #c ") * " #k "), "
+#define SQL_MIGRATE_COMPACT_COPY \
+    "INSERT INTO samples SELECT Timestamp, " DATABASE_VALUES(SQL_X_MIGRATE) "NULL, NULL " \
+    "FROM data_legacy WHERE Timestamp IS NOT NULL GROUP BY Timestamp; "
+/*
+ * Separately scheduled ping and line data jobs (cfg.execute.pinginterval)
+ * store their values into separate rows, with NULLs in place of the values
+ * collected by the other job. Jobs are aligned to their intervals, so both
+ * rows of the same second have the same timestamp. This view merges them.
+ * (aggregate MAX() ignores NULLs) With the compact schema, the rows are
+ * merged on insert and the view is kept for existing queries.
+ */
+#define SQL_X_JOINED(f, c, s, k)    ", MAX(" #c ") AS " #c
+#define SQL_CREATE_VIEW_JOINED \
+    "CREATE VIEW IF NOT EXISTS data_joined AS SELECT Timestamp" DATABASE_VALUES(SQL_X_JOINED) " " \
+    "FROM data GROUP BY Timestamp; "
+/*
+ * Counter deltas and modem reboots (counters.h). NULL when the modem does
+ * not provide the counter or there was no previous value to compare to.
+ */
+#define SQL_CREATE_TABLE_COUNTERS " \
+CREATE TABLE IF NOT EXISTS counters ( \
+    Timestamp           INTEGER, \
+    Seconds             INTEGER, \
+    T3Timeouts          INTEGER, \
+    T4Timeouts          INTEGER, \
+    dCh1Unerrored       INTEGER, \
+    dCh1Corrected       INTEGER, \
+    dCh1Uncorrectable   INTEGER, \
+    dCh2Unerrored       INTEGER, \
+    dCh2Corrected       INTEGER, \
+    dCh2Uncorrectable   INTEGER, \
+    dCh3Unerrored       INTEGER, \
+    dCh3Corrected       INTEGER, \
+    dCh3Uncorrectable   INTEGER, \
+    dCh4Unerrored       INTEGER, \
+    dCh4Corrected       INTEGER, \
+    dCh4Uncorrectable   INTEGER, \
+    dCh5Unerrored       INTEGER, \
+    dCh5Corrected       INTEGER, \
+    dCh5Uncorrectable   INTEGER, \
+    dCh6Unerrored       INTEGER, \
+    dCh6Corrected       INTEGER, \
+    dCh6Uncorrectable   INTEGER, \
+    dCh7Unerrored       INTEGER, \
+    dCh7Corrected       INTEGER, \
+    dCh7Uncorrectable   INTEGER, \
+    dCh8Unerrored       INTEGER, \
+    dCh8Corrected       INTEGER, \
+    dCh8Uncorrectable   INTEGER \
+); "
+#define SQL_CREATE_TABLE_REBOOTS " \
+CREATE TABLE IF NOT EXISTS reboots ( \
+    Timestamp           INTEGER, \
+    BootTime            INTEGER, \
+    LastUptime          INTEGER \
+); "
+/*
+ * tmpfs import log (database_collecttmpfs()). Rows with Timestamp up to
+ * the latest Watermark have been moved from tmpfs into this datafile.
+ */
+#define SQL_CREATE_TABLE_TMPFSIMPORT " \
+CREATE TABLE IF NOT EXISTS tmpfsimport ( \
+    Timestamp           INTEGER, \
+    Watermark           INTEGER, \
+    Rows                INTEGER \
 ); "
+#define SQL_SELECT_TMPFSIMPORT_WATERMARK " \
+SELECT IFNULL(MAX(Watermark), 0) FROM main.tmpfsimport; "
+/*
+ * Per minute rates, all downstream channels summed
+ */
+#define SQL_CREATE_VIEW_COUNTER_RATES " \
+CREATE VIEW IF NOT EXISTS counter_rates AS \
+SELECT \
+    Timestamp, \
+    Seconds, \
+    60.0 * T3Timeouts / Seconds AS T3PerMinute, \
+    60.0 * T4Timeouts / Seconds AS T4PerMinute, \
+    60.0 * ( \
+        IFNULL(dCh1Corrected, 0) + \
+        IFNULL(dCh2Corrected, 0) + \
+        IFNULL(dCh3Corrected, 0) + \
+        IFNULL(dCh4Corrected, 0) + \
+        IFNULL(dCh5Corrected, 0) + \
+        IFNULL(dCh6Corrected, 0) + \
+        IFNULL(dCh7Corrected, 0) + \
+        IFNULL(dCh8Corrected, 0) \
+    ) / Seconds AS CorrectedPerMinute, \
+    60.0 * ( \
+        IFNULL(dCh1Uncorrectable, 0) + \
+        IFNULL(dCh2Uncorrectable, 0) + \
+        IFNULL(dCh3Uncorrectable, 0) + \
+        IFNULL(dCh4Uncorrectable, 0) + \
+        IFNULL(dCh5Uncorrectable, 0) + \
+        IFNULL(dCh6Uncorrectable, 0) + \
+        IFNULL(dCh7Uncorrectable, 0) + \
+        IFNULL(dCh8Uncorrectable, 0) \
+    ) / Seconds AS UncorrectablePerMinute \
+FROM counters \
+WHERE Seconds > 0; "
 #define SQL_CREATE_TABLE_BOUNDS " \
-CREATE TABLE bounds ( \
+CREATE TABLE IF NOT EXISTS bounds ( \
     Timestamp       INTEGER, \
     maxModemPing    REAL, \
     maxInetPing     REAL, \
@@ -212,58 +646,81 @@ DELETE FROM data WHERE Timestamp = @Timestamp"
 #define SQL_DELETE_ALL " \
 DELETE FROM data"
 
-#define SQL_INSERT " \
-INSERT INTO data ( \
+#define SQL_X_COLUMN(f, c, s, k)    #c ", "
+#define SQL_X_PARAM(f, c, s, k)     "?, "
+#define SQL_INSERT \
+    "INSERT INTO data (Timestamp, " DATABASE_VALUES(SQL_X_COLUMN) "Violations, Carried) " \
+    "VALUES (?, " DATABASE_VALUES(SQL_X_PARAM) "?, ?)"
+#define SQL_INSERT_LEGACY \
+    "INSERT INTO data (Timestamp, " DATABASE_VALUES(SQL_X_COLUMN) "Violations) " \
+    "VALUES (?, " DATABASE_VALUES(SQL_X_PARAM) "?)"
+
+#define SQL_INSERT_COUNTERS " \
+INSERT INTO counters ( \
                  Timestamp, \
-                 ModemPing, \
-                 InetPing, \
-                 dCh1dBbmV, \
-                 dCh1dB, \
-                 dCh2dBbmV, \
-                 dCh2dB, \
-                 dCh3dBbmV, \
-                 dCh3dB, \
-                 dCh4dBbmV, \
-                 dCh4dB, \
-                 dCh5dBbmV, \
-                 dCh5dB, \
-                 dCh6dBbmV, \
-                 dCh6dB, \
-                 dCh7dBbmV, \
-                 dCh7dB, \
-                 dCh8dBbmV, \
-                 dCh8dB, \
-                 uCh1dBmV, \
-                 uCh2dBmV, \
-                 uCh3dBmV, \
-                 uCh4dBmV \
+                 Seconds, \
+                 T3Timeouts, \
+                 T4Timeouts, \
+                 dCh1Unerrored, \
+                 dCh1Corrected, \
+                 dCh1Uncorrectable, \
+                 dCh2Unerrored, \
+                 dCh2Corrected, \
+                 dCh2Uncorrectable, \
+                 dCh3Unerrored, \
+                 dCh3Corrected, \
+                 dCh3Uncorrectable, \
+                 dCh4Unerrored, \
+                 dCh4Corrected, \
+                 dCh4Uncorrectable, \
+                 dCh5Unerrored, \
+                 dCh5Corrected, \
+                 dCh5Uncorrectable, \
+                 dCh6Unerrored, \
+                 dCh6Corrected, \
+                 dCh6Uncorrectable, \
+                 dCh7Unerrored, \
+                 dCh7Corrected, \
+                 dCh7Uncorrectable, \
+                 dCh8Unerrored, \
+                 dCh8Corrected, \
+                 dCh8Uncorrectable \
                  ) \
 VALUES           ( \
                  @Timestamp, \
-                 @ModemPing, \
-                 @InetPing, \
-                 @dCh1dBbmV, \
-                 @dCh1dB, \
-                 @dCh2dBbmV, \
-                 @dCh2dB, \
-                 @dCh3dBbmV, \
-                 @dCh3dB, \
-                 @dCh4dBbmV, \
-                 @dCh4dB, \
-                 @dCh5dBbmV, \
-                 @dCh5dB, \
-                 @dCh6dBbmV, \
-                 @dCh6dB, \
-                 @dCh7dBbmV, \
-                 @dCh7dB, \
-                 @dCh8dBbmV, \
-                 @dCh8dB, \
-                 @uCh1dBmV, \
-                 @uCh2dBmV, \
-                 @uCh3dBmV, \
-                 @uCh4dBmV \
+                 @Seconds, \
+                 @T3Timeouts, \
+                 @T4Timeouts, \
+                 @dCh1Unerrored, \
+                 @dCh1Corrected, \
+                 @dCh1Uncorrectable, \
+                 @dCh2Unerrored, \
+                 @dCh2Corrected, \
+                 @dCh2Uncorrectable, \
+                 @dCh3Unerrored, \
+                 @dCh3Corrected, \
+                 @dCh3Uncorrectable, \
+                 @dCh4Unerrored, \
+                 @dCh4Corrected, \
+                 @dCh4Uncorrectable, \
+                 @dCh5Unerrored, \
+                 @dCh5Corrected, \
+                 @dCh5Uncorrectable, \
+                 @dCh6Unerrored, \
+                 @dCh6Corrected, \
+                 @dCh6Uncorrectable, \
+                 @dCh7Unerrored, \
+                 @dCh7Corrected, \
+                 @dCh7Uncorrectable, \
+                 @dCh8Unerrored, \
+                 @dCh8Corrected, \
+                 @dCh8Uncorrectable \
                  )"
 
+#define SQL_INSERT_REBOOT " \
+INSERT INTO reboots (Timestamp, BootTime, LastUptime) \
+VALUES (@Timestamp, @BootTime, @LastUptime)"
+
 #define SQL_INSERT_BOUNDS " \
 CREATE TABLE bounds ( \
                     Timestamp, \
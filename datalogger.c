@@ -12,6 +12,9 @@
  *      Parent process fork()'s one child on each tick of the interval
  *      timer and directs the child's execution to datalogger() function
  *      along with time_t value and access to config.c:cfg structure.
+ *      If pings have their own interval (cfg.execute.pinginterval), the
+ *      children are fork()'ed by scheduled PING and LINEDATA events instead
+ *      and each does only its part of the work (DATALOGGER_JOB_*).
  *
  *      Parent (the daemon proper) is uninterested in the specifics and
  *      only cares about the eventual exit code (and that the datalogger
@@ -24,6 +27,25 @@
  *      Datalogger is responsible for executing the scrubber script (the
  *      code that actually retrieves and parses data from the modem's
  *      WebUI) and writing it into the database specified in the cfg struct.
+ *      Under the daemon, rows are handed over to the daemon's database
+ *      writer (dbwriter.c), which keeps the database connection open.
+ *      Alternatively (cfg.modem.collector == CFG_COLLECTOR_SNMP), line data
+ *      is requested with a single SNMP GetBulk (snmp.c) and no script is
+ *      executed. SNMP failures are reported with the same scrubber flags.
+ *      Cumulative SNMP counters (codewords, T3/T4) are stored as deltas
+ *      against the previous sample kept by the daemon (counters.c).
+ *      HTTP collector (cfg.modem.collector == CFG_COLLECTOR_HTTP) takes the
+ *      place of the scrubber script in the child process; it uses the
+ *      daemon's keep-alive WebUI session (webui.c) and reports reused line
+ *      values with DATALOGGER_FLAG_LINEDATA_UNCHANGED.
+ *
+ *      Line data collection depends on the modem being reachable. The
+ *      collector (whichever it is) is started only after the modem has
+ *      answered the ICMP Echo Request. If the modem ping times out, the
+ *      collector is not started at all (line data is stored as NULLs and
+ *      DATALOGGER_FLAG_ICMPMODEM_TIMEOUT is set) instead of waiting for the
+ *      full collector timeout. Repeatedly failing collectors are further
+ *      throttled by the daemon (breaker.c).
  *
  *      EXIT CODES TO BE REDESIGNED
  *      Following return codes are used:
@@ -54,6 +76,11 @@
 #include "config.h"
 #include "database.h"
 #include "icmpecho.h"
+#include "snmp.h"
+#include "counters.h"
+#include "dbwriter.h"
+#include "storage.h"
+#include "webui.h"
 #include "capability.h"
 #include "logwrite.h"
 #include "keyval.h"
@@ -239,7 +266,10 @@ int process_child(pid_t pid, int status)
                       scrubber.stdoutbuffer
                       );
                 // Set the flag to indicate scrubber failure
-                instance.returnvalue |= DATALOGGER_FLAG_SCRUBBER_FAILURE;
+                if (cfg.modem.collector == CFG_COLLECTOR_HTTP && WEXITSTATUS(status) == WEBUI_ERROR_DATA)
+                    instance.returnvalue |= DATALOGGER_FLAG_SCRUBBER_DATAERROR;
+                else
+                    instance.returnvalue |= DATALOGGER_FLAG_SCRUBBER_FAILURE;
             }
         }
         else if (WIFSIGNALED(status) && scrubber.killed_for_timeout)
@@ -285,12 +315,104 @@ int process_child(pid_t pid, int status)
 }
 
 
+/*
+ * Start line data collector
+ *
+ *      Either sends the SNMP request (returned, response is read in the
+ *      main loop) or fork()'s the scrubber child (script or HTTP collector).
+ */
+static struct snmp_t *collector_start(int use_scrubber)
+{
+    /*
+     * SNMP collector (instead of scrubber)
+     *
+     *      One GetBulkRequest, response is read in the main loop.
+     *      Uses the scrubber timeout value.
+     */
+    struct snmp_t *snmp = NULL;
+    if (!use_scrubber)
+    {
+        if (!(snmp = snmp_prepare(cfg.modem.ip, SNMP_PORT, cfg.modem.snmp.community, cfg.modem.scrubber.timeout)))
+        {
+            instance.returnvalue |= DATALOGGER_FLAG_SCRUBBER_FAILURE;
+        }
+        else if (snmp_send(snmp))
+        {
+            instance.returnvalue |= DATALOGGER_FLAG_SCRUBBER_FAILURE;
+            snmp_close(snmp);
+            snmp = NULL;
+        }
+        else
+        {
+            timerfd_start_rel(snmp->timeoutfd, &snmp->timeoutspec);
+        }
+    }
+
+    /*
+     * Scrubber timeout (relative timer)
+     *
+     *      Sets a timer to expire at maximum allowed wait time.
+     *      This is not configurable atm...
+     */
+    if (use_scrubber)
+        timerfd_start_rel(scrubber.timeoutfd, &scrubber.tspec);
+
+    /*
+     * execv scrubber is likely to deliver data in stdout
+     * read and parse. Report parsing errors
+     *
+     * Read and parse pings
+     */
+    int status = 0;
+    switch (use_scrubber ? (scrubber.pid = fork()) : -2)
+    {
+        case -2: // SNMP collector, no scrubber
+            break;
+        case -1:
+            perror("fork()");
+            _exit(EXIT_FAILURE);
+        case 0: // in the child
+            if (cfg.modem.collector == CFG_COLLECTOR_HTTP)
+            {
+                close(scrubber.pipe[PIPE_READ]);
+                close(scrubber.pipe[PIPE_WRITE]);
+                _exit(webui_scrape(cfg.modem.http.path, cfg.modem.scrubber.timeout));
+            }
+#ifdef _DEBUG
+            syslog(
+                  LOG_DEBUG,
+                  "calling execve(\"%s\", {\"%s\"}, envp)",
+                  scrubber.script,
+                  scrubber.argv[1]
+                  );
+#endif
+            close(scrubber.pipe[PIPE_READ]);
+            dup2(scrubber.pipe[PIPE_WRITE], STDOUT_FILENO);
+            status = execve(scrubber.script, scrubber.argv, scrubber.envp);
+            // syslog() because lowrite.c does not recognize our parent pid.
+            // This is the ONLY place in this whole solution where we need to do this.
+            syslog(
+                  LOG_ERR,
+                  "execve(\"%s\", {\"%s\"}, envp) failed! (status 0x%.8X)",
+                  scrubber.script,
+                  scrubber.argv[1],
+                  status
+                  );
+            _exit(status); // only happens if execve(2) fails
+        default: // in parent
+            close(scrubber.pipe[PIPE_WRITE]);
+            break;
+    }
+//    devlog("Scrubber child (PID: %d) started", scrubber.pid);
+    return snmp;
+}
+
 /******************************************************************************
  * datalogger() - worker process'es main function
  *
  *
  */
-int datalogger(time_t logtime)
+int datalogger(time_t logtime, int jobs)
 {
     // Have a different name in syslog messages for datalogger
     openlog(DAEMON_NAME".datalogger", LOG_PID, LOG_DAEMON);
@@ -323,7 +445,13 @@ int datalogger(time_t logtime)
     }
 
     /* args: Scrubber Script, Modem IP, timeout */
-    init_scrubber_struct(cfg.modem.scrubber.filename, cfg.modem.ip, cfg.modem.scrubber.timeout);
+    // HTTP collector runs in the scrubber child "slot" (same timeout handling)
+    int do_linedata  = (jobs & DATALOGGER_JOB_LINEDATA);
+    int use_scrubber = do_linedata &&
+                       (cfg.modem.collector == CFG_COLLECTOR_SCRUBBER ||
+                        cfg.modem.collector == CFG_COLLECTOR_HTTP);
+    if (use_scrubber)
+        init_scrubber_struct(cfg.modem.scrubber.filename, cfg.modem.ip, cfg.modem.scrubber.timeout);
 
     /* set up signalfd's for:
      *
@@ -401,67 +529,50 @@ int datalogger(time_t logtime)
      * Prepare ICMP Echo Request packet sending
      * NOTE; timeout in MILLISECONS!
      */
-    struct icmpecho_t *icmpmodem = icmp_prepare(cfg.modem.ip, cfg.modem.pingtimeout);
+    struct icmpecho_t *icmpmodem = NULL;
+    struct icmpecho_t *icmpinet  = NULL;
+    // Modem ping is also needed to gate the line data collector
+    if (jobs & (DATALOGGER_JOB_PING | DATALOGGER_JOB_LINEDATA))
+        icmpmodem = icmp_prepare(cfg.modem.ip, cfg.modem.pingtimeout);
 //#pragma message "NO SUPPORT FOR MULTIPLE INET PING HOSTS - JUST TAKES THE FIRST..."
-    struct icmpecho_t *icmpinet  = icmp_prepare(cfg.inet.pinghosts, cfg.inet.pingtimeout);
+    if (jobs & DATALOGGER_JOB_PING)
+        icmpinet  = icmp_prepare(cfg.inet.pinghosts, cfg.inet.pingtimeout);
 //icmp_dump(icmpmodem);
 
     /*
-     * Scrubber timeout (relative timer)
+     * Line data collector
      *
-     *      Sets a timer to expire at maximum allowed wait time.
-     *      This is not configurable atm...
+     *      Modem ping gates the collector: it is started only when (and if)
+     *      the modem answers the echo request (see ICMP Echo in main loop).
+     *      A modem that does not answer ping will not answer the scrubber or
+     *      SNMP requests either, and trying would only burn the full
+     *      collector timeout.
      */
-/* MOVE TO BEFORE LOOP */
-    timerfd_start_rel(scrubber.timeoutfd, &scrubber.tspec);
+    struct snmp_t *snmp              = NULL;
+    int            snmp_ok           = false;
+    int            collector_pending = do_linedata;
+    int            collector_started = false;
 
     /*
-     * execv scrubber is likely to deliver data in stdout
-     * read and parse. Report parsing errors
-     *
-     * Read and parse pings
+     * Launch ICMP Echo Request (relative timers)
      */
-    int status = 0;
-    switch (scrubber.pid = fork())
+    if (icmpinet)
     {
-        case -1:
-            perror("fork()");
-            _exit(EXIT_FAILURE);
-        case 0: // in the child
-#ifdef _DEBUG
-            syslog(
-                  LOG_DEBUG,
-                  "calling execve(\"%s\", {\"%s\"}, envp)",
-                  scrubber.script,
-                  scrubber.argv[1]
-                  );
-#endif
-            close(scrubber.pipe[PIPE_READ]);
-            dup2(scrubber.pipe[PIPE_WRITE], STDOUT_FILENO);
-            status = execve(scrubber.script, scrubber.argv, scrubber.envp);
-            // syslog() because lowrite.c does not recognize our parent pid.
-            // This is the ONLY place in this whole solution where we need to do this.
-            syslog(
-                  LOG_ERR,
-                  "execve(\"%s\", {\"%s\"}, envp) failed! (status 0x%.8X)",
-                  scrubber.script,
-                  scrubber.argv[1],
-                  status
-                  );
-            _exit(status); // only happens if execve(2) fails
-        default: // in parent
-            close(scrubber.pipe[PIPE_WRITE]);
-            break;
+        icmp_send(icmpinet);
+        timerfd_start_rel(icmpinet->timeoutfd, &icmpinet->timeoutspec);
+    }
+    if (icmpmodem)
+    {
+        icmp_send(icmpmodem);
+        timerfd_start_rel(icmpmodem->timeoutfd, &icmpmodem->timeoutspec);
+    }
+    else if (collector_pending)
+    {
+        // Could not ping the modem (socket failure?) - collect ungated
+        collector_pending = false;
+        collector_started = true;
+        snmp = collector_start(use_scrubber);
     }
-//    devlog("Scrubber child (PID: %d) started", scrubber.pid);
-
-    /*
-     * Launch ICMP Echo Request (relative timers)
-     */
-    icmp_send(icmpinet);
-    timerfd_start_rel(icmpinet->timeoutfd, &icmpinet->timeoutspec);
-    icmp_send(icmpmodem);
-    timerfd_start_rel(icmpmodem->timeoutfd, &icmpmodem->timeoutspec);
 
     /*
 ****** MAIN LOOP
@@ -483,25 +594,35 @@ int datalogger(time_t logtime)
          */
         nfds = 0;
         FD_ZERO(&readfds);
-        FD_SET(scrubber.timeoutfd, &readfds);
-        nfds = (nfds > scrubber.timeoutfd ? nfds : scrubber.timeoutfd);   // max(nfds, fd)
+        if (use_scrubber)
+        {
+            FD_SET(scrubber.timeoutfd, &readfds);
+            nfds = (nfds > scrubber.timeoutfd ? nfds : scrubber.timeoutfd);   // max(nfds, fd)
+        }
         FD_SET(instance.signalfd, &readfds);
         nfds = (nfds > instance.signalfd ? nfds : instance.signalfd);     // max(nfds, fd)
         // Add ICMP Echo Request fds
-        if (icmpinet->sent_and_listening)
+        if (icmpinet && icmpinet->sent_and_listening)
         {
             FD_SET(icmpinet->recvfd, &readfds);
             nfds = (nfds > icmpinet->recvfd ? nfds : icmpinet->recvfd);
             FD_SET(icmpinet->timeoutfd, &readfds);
             nfds = (nfds > icmpinet->timeoutfd ? nfds : icmpinet->timeoutfd);
         }
-        if (icmpmodem->sent_and_listening)
+        if (icmpmodem && icmpmodem->sent_and_listening)
         {
             FD_SET(icmpmodem->recvfd, &readfds);
             nfds = (nfds > icmpmodem->recvfd ? nfds : icmpmodem->recvfd);
             FD_SET(icmpmodem->timeoutfd, &readfds);
             nfds = (nfds > icmpmodem->timeoutfd ? nfds : icmpmodem->timeoutfd);
         }
+        if (snmp && snmp->sent_and_listening)
+        {
+            FD_SET(snmp->sockfd, &readfds);
+            nfds = (nfds > snmp->sockfd ? nfds : snmp->sockfd);
+            FD_SET(snmp->timeoutfd, &readfds);
+            nfds = (nfds > snmp->timeoutfd ? nfds : snmp->timeoutfd);
+        }
 //devlog("Entering pselect()");
         prc = pselect(
                      nfds + 1,        // Calculated by setup above
@@ -580,7 +701,7 @@ int datalogger(time_t logtime)
         /*
 ********** Scrubber timeout
          */
-        if (FD_ISSET(scrubber.timeoutfd, &readfds))
+        if (use_scrubber && FD_ISSET(scrubber.timeoutfd, &readfds))
         {
             /*
              * Read file descriptor to reset state
@@ -594,39 +715,83 @@ int datalogger(time_t logtime)
         /*
 ********** ICMP Echo
          */
-        if (FD_ISSET(icmpmodem->recvfd, &readfds))
+        if (icmpmodem && FD_ISSET(icmpmodem->recvfd, &readfds))
         {
             timerfd_disarm(icmpmodem->timeoutfd);
             icmp_receive(icmpmodem);
             devlog("Modem ICMP echo reply received in %.2f ms", icmp_getelapsed(icmpmodem));
+            // Modem is up, start line data collector
+            if (collector_pending)
+            {
+                collector_pending = false;
+                collector_started = true;
+                snmp = collector_start(use_scrubber);
+            }
         }
-        if (FD_ISSET(icmpmodem->timeoutfd, &readfds))
+        if (icmpmodem && FD_ISSET(icmpmodem->timeoutfd, &readfds))
         {
             // Read file descriptor to reset state
             timerfd_acknowledge(icmpmodem->timeoutfd);  // util.c
             devlog("Modem ICMP echo timeout");
             icmp_cancel(icmpmodem);
+            instance.returnvalue |= DATALOGGER_FLAG_ICMPMODEM_TIMEOUT;
+            if (collector_pending)
+            {
+                // Modem is down, line data is left NULL
+                collector_pending = false;
+                devlog("Line data collector skipped (modem did not answer ping)");
+            }
         }
         // Inet ICMP Echo Reply
-        if (FD_ISSET(icmpinet->recvfd, &readfds))
+        if (icmpinet && FD_ISSET(icmpinet->recvfd, &readfds))
         {
             timerfd_disarm(icmpinet->timeoutfd);
             icmp_receive(icmpinet);
             devlog("Inet ICMP echo reply received in %.2f ms", icmp_getelapsed(icmpinet));
         }
-        if (FD_ISSET(icmpinet->timeoutfd, &readfds))
+        if (icmpinet && FD_ISSET(icmpinet->timeoutfd, &readfds))
         {
             // Read file descriptor to reset state
             timerfd_acknowledge(icmpinet->timeoutfd);  // util.c
             devlog("Inet ICMP echo timeout");
             icmp_cancel(icmpinet);
+            instance.returnvalue |= DATALOGGER_FLAG_ICMPINET_TIMEOUT;
+        }
+
+        /*
+********** SNMP response
+         */
+        if (snmp && FD_ISSET(snmp->sockfd, &readfds))
+        {
+            int rc = snmp_receive(snmp);
+            if (rc == EXIT_SUCCESS)
+            {
+                timerfd_disarm(snmp->timeoutfd);
+                snmp_ok = true;
+                snmp_logdev(snmp);
+            }
+            else if (rc == EXIT_FAILURE)
+            {
+                timerfd_disarm(snmp->timeoutfd);
+                instance.returnvalue |= DATALOGGER_FLAG_SCRUBBER_FAILURE;
+            }
+            // else (-1) not our response, keep listening
+        }
+        if (snmp && FD_ISSET(snmp->timeoutfd, &readfds))
+        {
+            timerfd_acknowledge(snmp->timeoutfd);   // util.c
+            logmsg(LOG_ERR, "SNMP agent at %s did not respond in time", cfg.modem.ip);
+            snmp_cancel(snmp);
+            instance.returnvalue |= DATALOGGER_FLAG_SCRUBBER_TIMEOUT;
         }
 
     /*
      * Time to exit loop?
      */
     } while (inetping.pid || modemping.pid || scrubber.pid ||
-             icmpmodem->sent_and_listening || icmpinet->sent_and_listening);
+             (icmpmodem && icmpmodem->sent_and_listening) ||
+             (icmpinet && icmpinet->sent_and_listening) ||
+             (snmp && snmp->sent_and_listening));
 //    devlog("All tasks completed. Exiting pselect() loop...");
 
     /*
@@ -634,10 +799,23 @@ int datalogger(time_t logtime)
      *
      *      ICMP Echo Reply times, rounded to 2 decimals
      */
-//    if ()
+    if (icmpmodem && icmpinet)
     {
-        instance.dbrec.modemping_ms = round(icmp_getelapsed(icmpmodem) * 100) / 100;
-        instance.dbrec.inetping_ms  = round(icmp_getelapsed(icmpinet)  * 100) / 100;
+        // Unanswered pings are NULLs (not zero milliseconds)
+        if (DATALOGGER_ICMPMODEMTOUT(instance.returnvalue))
+            instance.dbrec.modemping_ms = DATABASE_DOUBLE_NULL_VALUE;
+        else
+            instance.dbrec.modemping_ms = round(icmp_getelapsed(icmpmodem) * 100) / 100;
+        if (DATALOGGER_ICMPINETTOUT(instance.returnvalue))
+            instance.dbrec.inetping_ms  = DATABASE_DOUBLE_NULL_VALUE;
+        else
+            instance.dbrec.inetping_ms  = round(icmp_getelapsed(icmpinet)  * 100) / 100;
+    }
+    else
+    {
+        // Line data job, pings are stored by the ping job
+        instance.dbrec.modemping_ms = DATABASE_DOUBLE_NULL_VALUE;
+        instance.dbrec.inetping_ms  = DATABASE_DOUBLE_NULL_VALUE;
     }
     // ICMP's not needed anymore
     free(icmpinet);
@@ -645,33 +823,53 @@ int datalogger(time_t logtime)
 
     // First set all values to symbolic null values
     // They will be replaced with proper values, if all goes well
-    instance.dbrec.down_ch1_dbmv = DATABASE_DOUBLE_NULL_VALUE;
-    instance.dbrec.down_ch1_db   = DATABASE_DOUBLE_NULL_VALUE;
-    instance.dbrec.down_ch2_dbmv = DATABASE_DOUBLE_NULL_VALUE;
-    instance.dbrec.down_ch2_db   = DATABASE_DOUBLE_NULL_VALUE;
-    instance.dbrec.down_ch3_dbmv = DATABASE_DOUBLE_NULL_VALUE;
-    instance.dbrec.down_ch3_db   = DATABASE_DOUBLE_NULL_VALUE;
-    instance.dbrec.down_ch4_dbmv = DATABASE_DOUBLE_NULL_VALUE;
-    instance.dbrec.down_ch4_db   = DATABASE_DOUBLE_NULL_VALUE;
-    instance.dbrec.down_ch5_dbmv = DATABASE_DOUBLE_NULL_VALUE;
-    instance.dbrec.down_ch5_db   = DATABASE_DOUBLE_NULL_VALUE;
-    instance.dbrec.down_ch6_dbmv = DATABASE_DOUBLE_NULL_VALUE;
-    instance.dbrec.down_ch6_db   = DATABASE_DOUBLE_NULL_VALUE;
-    instance.dbrec.down_ch7_dbmv = DATABASE_DOUBLE_NULL_VALUE;
-    instance.dbrec.down_ch7_db   = DATABASE_DOUBLE_NULL_VALUE;
-    instance.dbrec.down_ch8_dbmv = DATABASE_DOUBLE_NULL_VALUE;
-    instance.dbrec.down_ch8_db   = DATABASE_DOUBLE_NULL_VALUE;
-    instance.dbrec.up_ch1_dbmv   = DATABASE_DOUBLE_NULL_VALUE;
-    instance.dbrec.up_ch2_dbmv   = DATABASE_DOUBLE_NULL_VALUE;
-    instance.dbrec.up_ch3_dbmv   = DATABASE_DOUBLE_NULL_VALUE;
-    instance.dbrec.up_ch4_dbmv   = DATABASE_DOUBLE_NULL_VALUE;
-
-    if (!scrubber.killed_for_timeout)
+#define LINEVALUE(f, c, s, k) &instance.dbrec.f,
+    double *line[DATABASE_LINE_COLUMNS] = { DATABASE_LINE_VALUES(LINEVALUE) };   // database.h
+#undef LINEVALUE
+    int     i;
+    for (i = 0; i < DATABASE_LINE_COLUMNS; i++)
+        *line[i] = DATABASE_DOUBLE_NULL_VALUE;
+
+    // Cumulative counters are stored as deltas (counters.c)
+    databasecounters_t counters;
+    databasereboot_t   reboot;
+    int                counters_rc = COUNTERS_BASELINE;
+    if (snmp)
+    {
+        if (snmp_ok)
+        {
+            snmp_fill_record(snmp, &instance.dbrec);
+            counters_rc = counters_update(&snmp->docsis, instance.dbrec.timestamp, &counters, &reboot);
+        }
+        snmp_close(snmp);
+    }
+    else if (collector_started && cfg.modem.collector == CFG_COLLECTOR_HTTP)
+    {
+        webui_session_t *webui = webui_getsession();
+        if (!scrubber.killed_for_timeout &&
+            !(instance.returnvalue & (DATALOGGER_FLAG_SCRUBBER_FAILURE | DATALOGGER_FLAG_SCRUBBER_DATAERROR)))
+        {
+            if (!webui_fill_record(&instance.dbrec))
+                instance.returnvalue |= DATALOGGER_FLAG_SCRUBBER_DATAERROR;
+            else if (webui->tick.unchanged)
+                instance.returnvalue |= DATALOGGER_FLAG_LINEDATA_UNCHANGED;
+        }
+        if (webui)
+            devlog(
+                  "WebUI: %d bytes in %.2f ms (%s connection), parse %.2f ms%s",
+                  webui->tick.bytes,
+                  webui->tick.fetch_ms,
+                  webui->tick.reused ? "kept-alive" : "new",
+                  webui->tick.parse_ms,
+                  webui->tick.unchanged ? " (unchanged)" : ""
+                  );
+    }
+    else if (collector_started && use_scrubber && !scrubber.killed_for_timeout)
     {
         // Line data
         keyval_t kv = keyval_create(scrubber.stdoutbuffer);
         // There must be exactly 21 values (key + 20 values; 16 down stream and 4 upstream)
-        if (keyval_nvalues(kv) != 20)
+        if (keyval_nvalues(kv) != DATABASE_LINE_COLUMNS)
         {
             logerr("Malformed scrubber data! %d values in kv", keyval_nvalues(kv));
             free(kv);
@@ -684,26 +882,8 @@ int datalogger(time_t logtime)
             // quaranteed that we have all pointers, even if they point to null.
             // (emptry string)
             // strtod() would be more advances, but I don't need any of it's features
-            instance.dbrec.down_ch1_dbmv = atof(kv[1]);
-            instance.dbrec.down_ch1_db   = atof(kv[2]);
-            instance.dbrec.down_ch2_dbmv = atof(kv[3]);
-            instance.dbrec.down_ch2_db   = atof(kv[4]);
-            instance.dbrec.down_ch3_dbmv = atof(kv[5]);
-            instance.dbrec.down_ch3_db   = atof(kv[6]);
-            instance.dbrec.down_ch4_dbmv = atof(kv[7]);
-            instance.dbrec.down_ch4_db   = atof(kv[8]);
-            instance.dbrec.down_ch5_dbmv = atof(kv[9]);
-            instance.dbrec.down_ch5_db   = atof(kv[10]);
-            instance.dbrec.down_ch6_dbmv = atof(kv[11]);
-            instance.dbrec.down_ch6_db   = atof(kv[12]);
-            instance.dbrec.down_ch7_dbmv = atof(kv[13]);
-            instance.dbrec.down_ch7_db   = atof(kv[14]);
-            instance.dbrec.down_ch8_dbmv = atof(kv[15]);
-            instance.dbrec.down_ch8_db   = atof(kv[16]);
-            instance.dbrec.up_ch1_dbmv   = atof(kv[17]);
-            instance.dbrec.up_ch2_dbmv   = atof(kv[18]);
-            instance.dbrec.up_ch3_dbmv   = atof(kv[19]);
-            instance.dbrec.up_ch4_dbmv   = atof(kv[20]);
+            for (i = 0; i < DATABASE_LINE_COLUMNS; i++)
+                *line[i] = atof(kv[i + 1]);
         }
         free(kv);
     }
@@ -713,21 +893,37 @@ int datalogger(time_t logtime)
     /*
 ****** INSERT
      */
-    // Determine insert target
-    char *datafile;
-    if (cfg.execute.tmpfs)
-        datafile = cfg.database.tmpfsfilename;
-    else
-        datafile = cfg.database.filename;
+    // Daemon writes the rows over its persistent connection (dbwriter.c)
+    if (!dbwriter_send(DBWRITER_MSG_RECORD, &instance.dbrec))
+    {
+        if ((counters_rc != COUNTERS_BASELINE && dbwriter_send(DBWRITER_MSG_COUNTERS, &counters)) ||
+            (counters_rc == COUNTERS_REBOOT   && dbwriter_send(DBWRITER_MSG_REBOOT,   &reboot)))
+            return(DATALOGGER_SQLITE3_ERROR | instance.returnvalue);
+        return (errno = 0, EXIT_SUCCESS | instance.returnvalue);
+    }
+
+    // No writer (not executed by the daemon) - write through the backend
+    char      *datafile;
+    storage_t *storage;
+    if (!(datafile = storage_datafile(instance.dbrec.timestamp)) ||
+        !(storage = storage_open(storage_backend(cfg.database.backend), datafile)))
+        return(DATALOGGER_SQLITE3_ERROR | instance.returnvalue);
     xtmr_t *t = xtmr();   // util.c
     int rc;
-    if ((rc = database_insert(datafile, &instance.dbrec)))
+    // Row, counters and reboot are stored together
+    if ((rc = storage_append(storage, &instance.dbrec, 1)) ||
+        (counters_rc != COUNTERS_BASELINE && (rc = storage_appendcounters(storage, &counters))) ||
+        (counters_rc == COUNTERS_REBOOT   && (rc = storage_appendreboot(storage, &reboot))) ||
+        (rc = storage_flush(storage)))
     {
-        logerr("Database insert failed! Return code %d", rc);
+        logerr("%s storage write failed! Return code %d", storage_name(storage), rc);
+        storage_close(storage);
+        free(t);
         return(DATALOGGER_SQLITE3_ERROR | instance.returnvalue);
     }
-    devlog("SQLite3 INSERT took %5.2f milliseconds", xtmrlap(t));
+    devlog("%s storage write took %5.2f milliseconds", storage_name(storage), xtmrlap(t));
     free(t);
+    storage_close(storage);
 
     // All done, returns to fork() code which will take care of
     // the actual _exit()
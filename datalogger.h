@@ -35,7 +35,7 @@
 // These affect stored data, but process will still complete
 #define DATALOGGER_FLAG_ICMPINET_TIMEOUT    (1 << 2)    // inet ping was killed
 #define DATALOGGER_FLAG_ICMPMODEM_TIMEOUT   (1 << 3)    // modem ping was killed
-#define DATALOGGER_FLAG_RESERVED            (1 << 4)    //
+#define DATALOGGER_FLAG_LINEDATA_UNCHANGED  (1 << 4)    // HTTP collector reused previous line values (not an error)
 // Scrubber flags CANNOT exist at the same time -> collapse into 0 == no err, 1, 2 and 3 (2-bits)
 #define DATALOGGER_FLAG_SCRUBBER_TIMEOUT    (1 << 5)    // scrubber was killed
 #define DATALOGGER_FLAG_SCRUBBER_FAILURE    (1 << 6)    // normal exit, but non-zero exit code
@@ -48,13 +48,26 @@
 #define DATALOGGER_SCUBBER_TIMEOUT(c)       ((c) & DATALOGGER_FLAG_SCRUBBER_TIMEOUT)
 #define DATALOGGER_SCRUBBER_FAILURE(c)      ((c) & DATALOGGER_FLAG_SCRUBBER_FAILURE)
 #define DATALOGGER_SCRUBBER_DATAERROR(c)    ((c) & DATALOGGER_FLAG_SCRUBBER_DATAERROR)
+#define DATALOGGER_LINEDATA_UNCHANGED(c)    ((c) & DATALOGGER_FLAG_LINEDATA_UNCHANGED)
+
+/*
+ * Datalogger jobs
+ *
+ *      By default (cfg.execute.pinginterval == 0) each worker does it all.
+ *      With separate ping and line data cadences, the daemon creates workers
+ *      that do only one. Values that the job does not collect are stored
+ *      as NULLs and rows are joined by their (aligned) timestamp.
+ */
+#define DATALOGGER_JOB_PING                 (1 << 0)    // ICMP Echo to modem and internet host
+#define DATALOGGER_JOB_LINEDATA             (1 << 1)    // modem line data (cfg.modem.collector)
+#define DATALOGGER_JOB_ALL                  (DATALOGGER_JOB_PING | DATALOGGER_JOB_LINEDATA)
 
 typedef struct
 {
     unsigned int code                   : 2;
     unsigned int f_icmpinet_timeout     : 1;
     unsigned int f_icmpmodem_timeout    : 1;
-    unsigned int f_reserved             : 1;
+    unsigned int f_linedata_unchanged   : 1;
     unsigned int f_scrubber_timeout     : 1;
     unsigned int f_scrubber_failure     : 1;
     unsigned int f_scrubber_dataerror   : 1;
@@ -65,13 +78,14 @@ typedef struct
 /*
  * Function prototypes
  *
- *  datalogger(time_t)
+ *  datalogger(time_t, int)
  *
  *      The "worker" routine which will send the ICMP Echo Request packets and
  *      execute external script that will retrieve DOCSIS modem line dB values.
  *
  *      time_t is the Unix timestamp (since epoch) and it is inserted into the
  *      database to mark the date and time when the data record was collected.
+ *      int is a mask of DATALOGGER_JOB_* values to perform.
  *
  *      Return value is a 8-bit byte value that is a combination of a code and
  *      four possible flags. Please see above for explanations and defines.
@@ -87,7 +101,7 @@ typedef struct
  *      Caller is responsible for free()'ing up the buffer when no longer
  *      needed.
  */
-int   datalogger(time_t);
+int   datalogger(time_t, int);
 char *datalogger_errorstring(int);
 
 /* EOF datalogger.h */
@@ -0,0 +1,1351 @@
+/*
+ * dbwriter.c - 2016 Jani Tammi <janitammi@gmail.com>
+ *
+ *      Database writer process. See dbwriter.h.
+ */
+#include <stdio.h>              // fopen(), rename()
+#include <stdlib.h>             // EXIT_SUCCESS, EXIT_FAILURE
+#include <unistd.h>             // pipe2(), read(), write()
+#include <fcntl.h>              // O_NONBLOCK, O_CLOEXEC
+#include <limits.h>             // PIPE_BUF
+#include <string.h>             // memset()
+#include <stdbool.h>            // true, false
+#include <signal.h>             // signal()
+#include <sys/timerfd.h>        // timerfd_create()
+#include <sys/select.h>         // select()
+#include <sys/wait.h>           // waitpid()
+#include <errno.h>
+
+#include "dbwriter.h"
+#include "logwrite.h"
+#include "util.h"               // xtmr(), timerfd_*()
+#include "config.h"             // cfg.database.commitrows, .commitinterval
+#include "samplelog.h"          // cfg.database.samplelog
+#include "spool.h"              // cfg.database.spool
+#include "keyval.h"             // profile file
+
+#define PIPE_READ   0
+#define PIPE_WRITE  1
+
+static struct
+{
+    dbhandle_t     *handle;             // NULL == not the writer
+    int             pipe[2];
+    int             control;            // daemon: non-blocking write end
+    struct
+    {
+        int         type;
+        int64_t     value;
+    }               deferred[DBWRITER_MAXDEFERRED];
+    int             n_deferred;         // control messages the full pipe did not take
+    pid_t           pid;                // writer process (daemon side)
+    time_t          started;
+    int             restart;            // daemon closed it, start again
+    int             running;            // writer process main loop
+    char           *datafile;           // for the (re)start
+    int             commitfd;           // timerfd, commitinterval
+    int             n_pending;          // rows in the open transaction
+    double          pending_ms;         // write time of the n_pending rows
+    time_t          first;              // oldest and newest timestamp of
+    time_t          last;               // the rows since the last rollup
+    xtmr_t         *timer;
+    samplelog_t    *samplelog;         // NULL == samples into the datafile
+    int             n_unsynced;         // rows in the sample log since sync
+    spool_t        *spool;              // NULL == workers write into the pipe
+    time_t          drained;            // last spool drain
+    int             backlog;            // last drain stopped at DBWRITER_SPOOL_BATCH
+    int             draining;           // rows come from the spool, no commits
+    int             retentionfd;        // timerfd, next retention chunk
+    struct
+    {
+        int         state;              // DBWRITER_RETENTION_*
+        time_t      cutoff;             // rows older than this are deleted
+        time_t      first;              // oldest row when the pass started
+        int         percent;            // progress, last logged
+        uint32_t    n_deleted;          // this pass
+        uint32_t    n_pages;
+    } retention;
+    struct
+    {
+        char       *profile;            // NULL == commits are not adaptive
+        int         mode;               // DBWRITER_MODE_DIRECT, _BATCHED
+        int         saved;              // mode in the profile (_SPOOL: batched is too slow)
+        double      ms[DBWRITER_LATENCY_WINDOW];
+        int         rows[DBWRITER_LATENCY_WINDOW];
+        int         n;                  // commits in the window
+        int         next;
+        int         n_unsaved;          // commits since the profile was saved
+        uint32_t    n_switches;
+    } adaptive;
+    struct
+    {
+        uint32_t    n_written;
+        uint32_t    n_failed;
+        uint32_t    n_commits;
+        uint32_t    n_lost;             // failed commits
+        double      write_ms;
+        double      max_ms;
+        double      commit_ms;
+        double      maxcommit_ms;
+        uint32_t    n_checkpoints;
+        uint32_t    n_walfull;          // checkpoints forced by walmaxsize
+        double      maxcheckpoint_ms;
+        uint32_t    n_retentionchunks;
+        uint32_t    n_retentiondeleted;
+        uint32_t    n_retentionpages;
+        double      maxretention_ms;    // longest chunk (upper bound of lock time)
+        uint32_t    n_drains;           // spool drain transactions
+        double      maxdrain_ms;
+    } total;
+} writer;
+
+static int dbwriter_drain(int all);
+static int dbwriter_write(dbwriter_msg_t *msg);
+
+/*
+ * Pipe and spool are created before any worker is fork()'ed and kept over
+ * writer process restarts. Workers hold the write end.
+ */
+static int dbwriter_pipe()
+{
+    char path[64];
+
+    // Atomic pipe writes is what makes concurrent workers safe
+    _Static_assert(sizeof(dbwriter_msg_t) <= PIPE_BUF, "dbwriter_msg_t exceeds PIPE_BUF");
+
+    if (writer.pipe[PIPE_READ])
+        return (errno = 0, EXIT_SUCCESS);
+    // Exec'ed scrubber scripts do not need it (O_CLOEXEC)
+    if (pipe2(writer.pipe, O_CLOEXEC))
+    {
+        logerr("pipe2()");
+        writer.pipe[PIPE_READ]  = 0;
+        writer.pipe[PIPE_WRITE] = 0;
+        return EXIT_FAILURE;
+    }
+    fcntl(writer.pipe[PIPE_READ], F_SETFL, O_NONBLOCK);
+    // Own open file description, O_NONBLOCK must not reach the workers
+    snprintf(path, sizeof(path), "/proc/self/fd/%d", writer.pipe[PIPE_WRITE]);
+    if ((writer.control = open(path, O_WRONLY | O_NONBLOCK | O_CLOEXEC)) < 0)
+    {
+        logerr("Unable to open \"%s\", control messages may block", path);
+        writer.control = 0;
+    }
+    writer.n_deferred = 0;
+    if (cfg.database.spool[0] &&
+        !(writer.spool = spool_open(cfg.database.spool, sizeof(dbwriter_msg_t))))
+        logerr("Unable to open spool \"%s\", workers send their rows to the writer", cfg.database.spool);
+    return (errno = 0, EXIT_SUCCESS);
+}
+
+static void dbwriter_release()
+{
+    if (writer.pipe[PIPE_READ])
+        close(writer.pipe[PIPE_READ]);
+    if (writer.pipe[PIPE_WRITE])
+        close(writer.pipe[PIPE_WRITE]);
+    if (writer.control)
+        close(writer.control);
+    writer.pipe[PIPE_READ]  = 0;
+    writer.pipe[PIPE_WRITE] = 0;
+    writer.control          = 0;
+    writer.n_deferred       = 0;
+    spool_close(writer.spool);
+    writer.spool = NULL;
+    free(writer.datafile);
+    writer.datafile = NULL;
+}
+
+/*
+ * Spool is synced (and drained) on a fixed period, commitinterval. Records
+ * left by a crash (or by the previous writer) are drained right away.
+ */
+static void dbwriter_armspool()
+{
+    struct itimerspec tspec;
+
+    if (!writer.spool)
+        return;
+    if (!writer.commitfd)
+    {
+        logerr("No commit timer, spool \"%s\" is drained only when the writer closes", cfg.database.spool);
+        return;
+    }
+    memset(&tspec, 0, sizeof(tspec));
+    tspec.it_value.tv_sec    = cfg.database.commitinterval;
+    tspec.it_interval.tv_sec = cfg.database.commitinterval;
+    timerfd_start_rel(writer.commitfd, &tspec);     // util.c
+    writer.drained = time(NULL);
+    writer.backlog = false;
+    if (spool_getstats(writer.spool)->n_replayed)
+    {
+        logmsg(LOG_INFO, "Replaying %u records from spool \"%s\"",
+               spool_getstats(writer.spool)->n_replayed, cfg.database.spool);
+        dbwriter_drain(true);
+    }
+}
+
+/*
+ * Restarted writer (SIGHUP) continues from the mode the previous one saved
+ */
+static void dbwriter_resumeprofile()
+{
+    dbwriter_profile_t profile;
+
+    if (!writer.adaptive.profile || dbwriter_loadprofile(writer.adaptive.profile, &profile))
+        return;
+    writer.adaptive.mode  = profile.mode == DBWRITER_MODE_DIRECT ? DBWRITER_MODE_DIRECT : DBWRITER_MODE_BATCHED;
+    writer.adaptive.saved = profile.mode;
+    writer.adaptive.n     = 0;
+    writer.adaptive.next  = 0;
+}
+
+/*
+ * Writer side of the open: connection, timers and the sample log
+ */
+static int dbwriter_attach(char *datafile)
+{
+    if (!(writer.handle = database_open(datafile)))
+        return EXIT_FAILURE;
+    // Without the timer, rows are committed as they arrive
+    if ((writer.commitfd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC)) == -1)
+    {
+        logerr("timerfd_create()");
+        writer.commitfd = 0;
+    }
+    if ((writer.retentionfd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC)) == -1)
+    {
+        logerr("timerfd_create()");
+        writer.retentionfd = 0;
+    }
+    writer.timer = xtmr();
+    // Failure is not fatal, samples are then written into the datafile
+    if (cfg.database.samplelog[0] && !(writer.samplelog = samplelog_open(cfg.database.samplelog)))
+        logerr("Unable to open sample log \"%s\", samples are written into \"%s\"",
+               cfg.database.samplelog, datafile);
+    writer.n_unsynced = 0;
+    dbwriter_armspool();
+    dbwriter_resumeprofile();
+    logdev("Database writer opened \"%s\"", datafile);
+    return (errno = 0, EXIT_SUCCESS);
+}
+
+int dbwriter_open(char *datafile)
+{
+    if (writer.handle || writer.pid)
+        return (errno = 0, EXIT_SUCCESS);
+    if (dbwriter_pipe())
+        return EXIT_FAILURE;
+    if (dbwriter_attach(datafile))
+    {
+        dbwriter_release();
+        return EXIT_FAILURE;
+    }
+    return (errno = 0, EXIT_SUCCESS);
+}
+
+/*
+ * Oldest uncommitted row may wait commitinterval seconds
+ */
+static void dbwriter_armtimer()
+{
+    struct itimerspec tspec;
+    // Periodic with the spool (dbwriter_armspool())
+    if (!writer.commitfd || writer.spool)
+        return;
+    memset(&tspec, 0, sizeof(tspec));
+    tspec.it_value.tv_sec = cfg.database.commitinterval;
+    timerfd_start_rel(writer.commitfd, &tspec);     // util.c
+}
+
+/*
+ * Rows per transaction. Adaptive DIRECT mode commits every row.
+ */
+static int dbwriter_commitrows()
+{
+    if (writer.adaptive.profile && writer.adaptive.mode == DBWRITER_MODE_DIRECT)
+        return 1;
+    return cfg.database.commitrows;
+}
+
+/*
+ * Per row mean and max of the commits in the window
+ */
+static void dbwriter_rowlatency(double *mean, double *max)
+{
+    double total = 0.0;
+    int    i, n_rows = 0;
+
+    *max = 0.0;
+    for (i = 0; i < writer.adaptive.n; i++)
+    {
+        total  += writer.adaptive.ms[i];
+        n_rows += writer.adaptive.rows[i];
+        if (writer.adaptive.ms[i] / writer.adaptive.rows[i] > *max)
+            *max = writer.adaptive.ms[i] / writer.adaptive.rows[i];
+    }
+    *mean = n_rows ? total / n_rows : 0.0;
+}
+
+/*
+ * Latest window statistics into the profile, mode is kept. Saved every
+ * DBWRITER_PROFILE_SAVE commits and on close, the daemon is often stopped
+ * by a power cut.
+ */
+static void dbwriter_updateprofile()
+{
+    dbwriter_profile_t profile;
+
+    if (!writer.adaptive.profile || !writer.adaptive.n)
+        return;
+    memset(&profile, 0, sizeof(profile));
+    profile.mode    = writer.adaptive.saved;
+    profile.updated = time(NULL);
+    dbwriter_rowlatency(&profile.mean, &profile.max);
+    writer.adaptive.n_unsaved = 0;
+    dbwriter_saveprofile(writer.adaptive.profile, &profile);
+}
+
+/*
+ * Adaptive commits (see dbwriter.h). Spool drains and the sample log are
+ * not row inserts, their timings are not used. ms is the write and commit
+ * time of a transaction of rows rows.
+ *
+ * Limits are per row, a batch is not compared to the limits of a single
+ * insert. Back to DIRECT by the commit times: a direct commit takes at most
+ * as long as the commit of a batch.
+ */
+static void dbwriter_latency(double ms, int rows)
+{
+    dbwriter_profile_t profile;
+    double             mean = 0.0, max = 0.0;
+    int                i;
+
+    if (!writer.adaptive.profile || writer.spool || writer.samplelog)
+        return;
+    writer.adaptive.ms[writer.adaptive.next]   = ms;
+    writer.adaptive.rows[writer.adaptive.next] = rows;
+    writer.adaptive.next = (writer.adaptive.next + 1) % DBWRITER_LATENCY_WINDOW;
+    if (writer.adaptive.n < DBWRITER_LATENCY_WINDOW)
+        writer.adaptive.n++;
+    if (++writer.adaptive.n_unsaved >= DBWRITER_PROFILE_SAVE)
+        dbwriter_updateprofile();
+    if (writer.adaptive.n < DBWRITER_LATENCY_WINDOW)
+        return;
+    for (i = 0; i < DBWRITER_LATENCY_WINDOW; i++)
+    {
+        mean += writer.adaptive.ms[i] / DBWRITER_LATENCY_WINDOW;
+        max   = writer.adaptive.ms[i] > max ? writer.adaptive.ms[i] : max;
+    }
+    profile.mode    = writer.adaptive.mode;
+    profile.updated = time(NULL);
+    dbwriter_rowlatency(&profile.mean, &profile.max);
+    if (profile.mean > CFG_MAX_INSERT_DELAY_MEAN || profile.max > CFG_MAX_INSERT_DELAY_MAX)
+    {
+        if (writer.adaptive.mode == DBWRITER_MODE_DIRECT)
+            profile.mode = DBWRITER_MODE_BATCHED;
+        else if (writer.adaptive.saved != DBWRITER_MODE_SPOOL)
+        {
+            logmsg(
+                  LOG_INFO,
+                  "Batched commits take mean %.2f ms, max %.2f ms per row, spool will be used from the next start",
+                  profile.mean,
+                  profile.max
+                  );
+            profile.mode = DBWRITER_MODE_SPOOL;
+        }
+    }
+    else if (writer.adaptive.mode == DBWRITER_MODE_BATCHED &&
+             mean < CFG_MAX_INSERT_DELAY_MEAN * DBWRITER_LATENCY_HYSTERESIS &&
+             max  < CFG_MAX_INSERT_DELAY_MAX  * DBWRITER_LATENCY_HYSTERESIS)
+        profile.mode = DBWRITER_MODE_DIRECT;
+    if (profile.mode == writer.adaptive.mode || profile.mode == writer.adaptive.saved)
+        return;
+    if (profile.mode != DBWRITER_MODE_SPOOL)
+    {
+        logmsg(
+              LOG_INFO,
+              "Commit latency mean %.2f ms, max %.2f ms over %d commits, database writer switches to %s commits",
+              mean,
+              max,
+              DBWRITER_LATENCY_WINDOW,
+              DBWRITER_MODE_NAME(profile.mode)
+              );
+        writer.adaptive.mode = profile.mode;
+        writer.adaptive.n_switches++;
+    }
+    writer.adaptive.saved     = profile.mode;
+    writer.adaptive.n         = 0;
+    writer.adaptive.next      = 0;
+    writer.adaptive.n_unsaved = 0;
+    dbwriter_saveprofile(writer.adaptive.profile, &profile);
+}
+
+/*
+ * Sample log rows are durable once the tail is synced
+ */
+static void dbwriter_syncsamplelog()
+{
+    if (writer.samplelog && writer.n_unsynced)
+    {
+        if (samplelog_sync(writer.samplelog))
+            logerr("Sample log sync failed");
+        writer.n_unsynced = 0;
+    }
+}
+
+/*
+ * Commit open transaction. Spool records read so far are in it (or in the
+ * sample log), they are consumed when it commits and read again if it is
+ * lost.
+ */
+static int dbwriter_commit()
+{
+    int    rc;
+    double ms;
+
+    if (!writer.n_pending)
+    {
+        if (writer.spool)
+            spool_consume(writer.spool);
+        return (errno = 0, EXIT_SUCCESS);
+    }
+    if (writer.commitfd && !writer.spool)
+        timerfd_disarm(writer.commitfd);    // util.c
+    xtmrlap(writer.timer);
+    // Rollups are committed with the rows. Failure is not fatal (-rebuildrollups).
+    if (writer.last && database_rollup(writer.handle, writer.first, writer.last))
+        logerr("Rollup update failed, rows are committed without it");
+    rc = database_commit(writer.handle);
+    ms = xtmrlap(writer.timer);
+    if (rc)
+    {
+        if (database_intransaction(writer.handle))
+        {
+            // Most likely SQLITE_BUSY, rows are still in the transaction
+            logerr("Database commit failed (%d), retrying later", rc);
+            dbwriter_armtimer();
+            return rc;
+        }
+        if (writer.spool)
+        {
+            logerr("Database commit failed (%d), %d rows are read from the spool again", rc, writer.n_pending);
+            spool_rewind(writer.spool);
+        }
+        else
+        {
+            logerr("Database commit failed (%d), %d rows lost", rc, writer.n_pending);
+            writer.total.n_lost += writer.n_pending;
+        }
+        writer.n_pending  = 0;
+        writer.pending_ms = 0.0;
+        writer.last       = 0;
+        return rc;
+    }
+    logdev("Database writer committed %d rows (%.2f ms)", writer.n_pending, ms);
+    dbwriter_latency(writer.pending_ms + ms, writer.n_pending);
+    writer.total.n_commits++;
+    writer.total.commit_ms   += ms;
+    writer.total.maxcommit_ms = ms > writer.total.maxcommit_ms ? ms : writer.total.maxcommit_ms;
+    writer.n_pending  = 0;
+    writer.pending_ms = 0.0;
+    writer.last       = 0;
+    if (writer.spool)
+        spool_consume(writer.spool);
+    /*
+     * WAL backpressure. Scheduled checkpoints are PASSIVE and may not keep
+     * up (long running readers). Do not let the WAL grow without bound.
+     */
+    if (cfg.database.journal == CFG_JOURNAL_WAL &&
+        database_walsize(writer.handle) > cfg.database.walmaxsize)
+    {
+        logdev("WAL file exceeds %d kB, checkpointing", cfg.database.walmaxsize);
+        writer.total.n_walfull++;
+        dbwriter_checkpoint(true);
+    }
+    return (errno = 0, EXIT_SUCCESS);
+}
+
+/*
+ * Spool into the datafile, DBWRITER_SPOOL_BATCH records per transaction.
+ * One transaction per call, unless all is set (open, reopen, close).
+ */
+static int dbwriter_drain(int all)
+{
+    dbwriter_msg_t msg[DBWRITER_SPOOL_CHUNK];
+    int            i, n, n_rows, rc;
+    double         ms;
+    xtmr_t        *t = xtmr();      // util.c
+
+    writer.drained = time(NULL);
+    do
+    {
+        xtmrlap(t);
+        writer.draining = true;
+        for (n_rows = 0; n_rows < DBWRITER_SPOOL_BATCH; n_rows += n)
+        {
+            if ((n = spool_read(writer.spool, msg, DBWRITER_SPOOL_CHUNK)) <= 0)
+                break;
+            for (i = 0; i < n; i++)
+                dbwriter_write(&msg[i]);
+        }
+        writer.draining = false;
+        dbwriter_syncsamplelog();
+        rc = dbwriter_commit();
+        ms = xtmrlap(t);
+        if (n_rows)
+        {
+            logdev("Database writer drained %d spool records (%.2f ms)", n_rows, ms);
+            writer.total.n_drains++;
+            writer.total.maxdrain_ms = ms > writer.total.maxdrain_ms ? ms : writer.total.maxdrain_ms;
+        }
+    } while (!rc && all && n_rows >= DBWRITER_SPOOL_BATCH);
+    writer.backlog = !rc && n_rows >= DBWRITER_SPOOL_BATCH;
+    free(t);
+    return rc;
+}
+
+/*
+ * Daemon side of the public calls. Control messages are queued behind the
+ * rows sent before them. EAGAIN when the pipe is full.
+ */
+static int dbwriter_sendcontrol(int type, int64_t value)
+{
+    dbwriter_msg_t msg;
+
+    memset(&msg, 0, sizeof(msg));
+    msg.type                 = type;
+    msg.data.control.value   = value;
+    if (write(writer.control ? writer.control : writer.pipe[PIPE_WRITE], &msg, sizeof(msg)) != sizeof(msg))
+        return (errno = errno ? errno : EIO, EXIT_FAILURE);
+    return (errno = 0, EXIT_SUCCESS);
+}
+
+/*
+ * Deferred messages go first, in order. Recurring ones are dropped while
+ * the pipe is full, the next timer tick sends them again.
+ */
+static int dbwriter_request(int type, int64_t value)
+{
+    int recurring = type == DBWRITER_MSG_FLUSH || type == DBWRITER_MSG_CHECKPOINT ||
+                    type == DBWRITER_MSG_RETENTION || type == DBWRITER_MSG_LOGSTATS;
+    int i, n;
+
+    for (n = 0; n < writer.n_deferred; n++)
+        if (dbwriter_sendcontrol(writer.deferred[n].type, writer.deferred[n].value))
+            break;
+    if (n)
+    {
+        for (i = n; i < writer.n_deferred; i++)
+            writer.deferred[i - n] = writer.deferred[i];
+        writer.n_deferred -= n;
+        logdev("Sent %d deferred control message(s) to the database writer", n);
+    }
+    if (!writer.n_deferred)
+    {
+        if (!dbwriter_sendcontrol(type, value))
+            return (errno = 0, EXIT_SUCCESS);
+        if (errno != EAGAIN)
+        {
+            logerr("Unable to send control message %d to the database writer", type);
+            return EXIT_FAILURE;
+        }
+    }
+    if (recurring)
+    {
+        logdev("Database writer pipe is full, control message %d dropped", type);
+        return (errno = 0, EXIT_SUCCESS);
+    }
+    if (writer.n_deferred >= DBWRITER_MAXDEFERRED)
+    {
+        logmsg(LOG_ERR, "Database writer pipe is full, control message %d lost", type);
+        return (errno = EAGAIN, EXIT_FAILURE);
+    }
+    writer.deferred[writer.n_deferred].type  = type;
+    writer.deferred[writer.n_deferred].value = value;
+    writer.n_deferred++;
+    logdev("Database writer pipe is full, control message %d deferred", type);
+    return (errno = 0, EXIT_SUCCESS);
+}
+
+/*
+ * Commit timer, signals. With the spool, the spool is synced and, every
+ * DBWRITER_SPOOL_INTERVAL seconds, drained.
+ */
+int dbwriter_flush()
+{
+    if (writer.pid)
+        return dbwriter_request(DBWRITER_MSG_FLUSH, 0);
+    if (!writer.handle)
+        return (errno = 0, EXIT_SUCCESS);
+    dbwriter_syncsamplelog();
+    if (writer.spool)
+    {
+        if (spool_sync(writer.spool))
+            logerr("Spool sync failed");
+        if (writer.backlog || time(NULL) - writer.drained >= DBWRITER_SPOOL_INTERVAL)
+            return dbwriter_drain(false);
+    }
+    return dbwriter_commit();
+}
+
+/*
+ * WAL checkpoint (daemon CHECKPOINT event and WAL backpressure)
+ */
+int dbwriter_checkpoint(int truncate)
+{
+    int    rc;
+    double ms;
+
+    if (writer.pid)
+        return dbwriter_request(DBWRITER_MSG_CHECKPOINT, truncate);
+    if (!writer.handle || cfg.database.journal != CFG_JOURNAL_WAL)
+        return (errno = 0, EXIT_SUCCESS);
+    // Checkpoint cannot include rows of the open transaction
+    if (writer.n_pending && (rc = dbwriter_flush()))
+        return rc;
+    xtmrlap(writer.timer);
+    rc = database_checkpoint(writer.handle, truncate);
+    ms = xtmrlap(writer.timer);
+    writer.total.n_checkpoints++;
+    writer.total.maxcheckpoint_ms = ms > writer.total.maxcheckpoint_ms ? ms : writer.total.maxcheckpoint_ms;
+    return rc;
+}
+
+/*
+ * Retention pass (daemon RETENTION event)
+ *
+ *      Pass deletes rows older than cfg.database.retention days and then
+ *      returns the freed pages (incremental_vacuum). Work is done one
+ *      chunk per retention timer expiry, each chunk holding the write lock
+ *      at most cfg.database.retentionlock ms. Between chunks, the writer
+ *      is free for DBWRITER_RETENTION_DUTY times the lock limit, so rows
+ *      from workers are not held up. Rows are written over this same
+ *      connection and never wait for the chunks.
+ */
+static void dbwriter_armretention(int ms)
+{
+    struct itimerspec tspec;
+    if (!writer.retentionfd)
+        return;
+    memset(&tspec, 0, sizeof(tspec));
+    tspec.it_value.tv_sec  = ms / 1000;
+    tspec.it_value.tv_nsec = (ms % 1000) * 1000000 + 1;   // 0 would disarm
+    timerfd_start_rel(writer.retentionfd, &tspec);      // util.c
+}
+
+int dbwriter_retention()
+{
+    if (writer.pid)
+        return dbwriter_request(DBWRITER_MSG_RETENTION, 0);
+    if (!writer.handle || !cfg.database.retention || !writer.retentionfd)
+        return (errno = 0, EXIT_SUCCESS);
+    if (writer.retention.state != DBWRITER_RETENTION_IDLE)
+    {
+        logdev("Retention pass still running (%d%%)", writer.retention.percent);
+        return (errno = 0, EXIT_SUCCESS);
+    }
+    memset(&writer.retention, 0, sizeof(writer.retention));
+    writer.retention.state  = DBWRITER_RETENTION_DELETE;
+    writer.retention.cutoff = time(NULL) - (time_t)cfg.database.retention * 86400;
+    dbwriter_armretention(0);
+    return (errno = 0, EXIT_SUCCESS);
+}
+
+static void dbwriter_retentiondone()
+{
+    if (writer.retention.n_deleted || writer.retention.n_pages)
+        logmsg(
+              LOG_INFO,
+              "Retention: %u rows older than %lld deleted, %u pages freed",
+              writer.retention.n_deleted,
+              (long long)writer.retention.cutoff,
+              writer.retention.n_pages
+              );
+    writer.retention.state = DBWRITER_RETENTION_IDLE;
+}
+
+int dbwriter_retentionstep()
+{
+    time_t oldest;
+    double ms;
+    int    rc, n;
+
+    if (!writer.handle || writer.retention.state == DBWRITER_RETENTION_IDLE)
+        return (errno = 0, EXIT_SUCCESS);
+    // Chunks are transactions of their own
+    if (dbwriter_flush() && database_intransaction(writer.handle))
+    {
+        dbwriter_armretention(cfg.database.retentionlock * DBWRITER_RETENTION_DUTY);
+        return EXIT_FAILURE;
+    }
+    xtmrlap(writer.timer);
+    if (writer.retention.state == DBWRITER_RETENTION_DELETE)
+    {
+        rc = database_retention(writer.handle, writer.retention.cutoff,
+                                cfg.database.retentionlock, &n, &oldest);
+        writer.retention.n_deleted       += n;
+        writer.total.n_retentiondeleted  += n;
+        if (rc == DATABASE_RETENTION_MORE && oldest)
+        {
+            // Progress is the share of the time range deleted so far
+            if (!writer.retention.first)
+                writer.retention.first = oldest;
+            if (writer.retention.cutoff > writer.retention.first &&
+                (oldest - writer.retention.first) * 10 / (writer.retention.cutoff - writer.retention.first) >
+                writer.retention.percent / 10)
+            {
+                writer.retention.percent = (oldest - writer.retention.first) * 100 /
+                                           (writer.retention.cutoff - writer.retention.first);
+                logmsg(
+                      LOG_INFO,
+                      "Retention: %d%% (%u rows deleted)",
+                      writer.retention.percent,
+                      writer.retention.n_deleted
+                      );
+            }
+        }
+        else if (rc == DATABASE_RETENTION_DONE)
+            writer.retention.state = DBWRITER_RETENTION_VACUUM;
+        else
+        {
+            if (errno == ENOTSUP)
+                logmsg(LOG_ERR, "Retention requires the compact schema (see -migratedb)");
+            dbwriter_retentiondone();
+            return EXIT_FAILURE;
+        }
+    }
+    else
+    {
+        rc = database_incrementalvacuum(writer.handle, cfg.database.retentionlock, &n);
+        writer.retention.n_pages       += n;
+        writer.total.n_retentionpages  += n;
+        if (rc != DATABASE_RETENTION_MORE)
+        {
+            if (rc < 0 && errno == ENOTSUP)
+                logmsg(LOG_INFO, "Retention: datafile is not in incremental auto_vacuum mode (see -migratedb), free pages are reused");
+            dbwriter_retentiondone();
+            return (errno = 0, EXIT_SUCCESS);
+        }
+    }
+    ms = xtmrlap(writer.timer);
+    writer.total.n_retentionchunks++;
+    writer.total.maxretention_ms = ms > writer.total.maxretention_ms ? ms : writer.total.maxretention_ms;
+    dbwriter_armretention(cfg.database.retentionlock * DBWRITER_RETENTION_DUTY);
+    return (errno = 0, EXIT_SUCCESS);
+}
+
+/*
+ * Switch to another datafile (partition rollover). Messages queued before
+ * the rollover have been written, they are committed into the current
+ * datafile first. If the new datafile cannot be opened, writer stays with
+ * the current one.
+ */
+static int dbwriter_reopen(char *datafile)
+{
+    dbhandle_t *handle;
+
+    if (!writer.handle)
+        return dbwriter_open(datafile);
+    if (!strcmp(database_filename(writer.handle), datafile))
+        return (errno = 0, EXIT_SUCCESS);
+    dbwriter_flush();
+    if (writer.spool)
+        dbwriter_drain(true);
+    if (!(handle = database_open(datafile)))
+    {
+        logerr("Unable to open \"%s\", database writer keeps \"%s\"",
+               datafile, database_filename(writer.handle));
+        return EXIT_FAILURE;
+    }
+    // Commits whatever a failed flush left in the transaction
+    database_close(writer.handle);
+    writer.handle     = handle;
+    writer.n_pending  = 0;
+    writer.pending_ms = 0.0;
+    writer.last       = 0;
+    if (writer.commitfd && !writer.spool)
+        timerfd_disarm(writer.commitfd);    // util.c
+    logdev("Database writer reopened \"%s\"", datafile);
+    return (errno = 0, EXIT_SUCCESS);
+}
+
+int dbwriter_rollover(time_t now)
+{
+    char *datafile = database_partition(now);   // database.c
+
+    if (writer.pid)
+    {
+        // Restarted writer opens the current partition
+        free(writer.datafile);
+        writer.datafile = strdup(datafile);
+        return dbwriter_request(DBWRITER_MSG_ROLLOVER, now);
+    }
+    dbwriter_process();
+    return dbwriter_reopen(datafile);
+}
+
+/*
+ * tmpfs import. Run by the writer between its own transactions, so that
+ * the import is not a second writer on the tmpfs datafile. Import must see
+ * the rows of the open transaction.
+ */
+int dbwriter_importtmpfs(time_t watermark)
+{
+    if (writer.pid)
+        return dbwriter_request(DBWRITER_MSG_IMPORTTMPFS, watermark);
+    dbwriter_flush();
+    return database_collecttmpfs(watermark);    // database.c
+}
+
+/*
+ * Samples into the sample log. Synced like a commit: commitrows rows or
+ * commitinterval seconds, whichever comes first.
+ */
+static int dbwriter_writesamplelog(databaserecord_t *record)
+{
+    double ms;
+
+    xtmrlap(writer.timer);
+    if (samplelog_append(writer.samplelog, record))
+        return EXIT_FAILURE;
+    ms = xtmrlap(writer.timer);
+    writer.total.n_written++;
+    writer.total.write_ms += ms;
+    writer.total.max_ms    = ms > writer.total.max_ms ? ms : writer.total.max_ms;
+    if (!writer.n_unsynced++ && !writer.n_pending)
+        dbwriter_armtimer();
+    if ((writer.n_unsynced >= dbwriter_commitrows() || !writer.commitfd) && !writer.draining)
+        dbwriter_flush();
+    return (errno = 0, EXIT_SUCCESS);
+}
+
+static int dbwriter_write(dbwriter_msg_t *msg)
+{
+    int    rc;
+    double ms;
+    time_t timestamp = 0;
+
+    // Failed append falls back to the datafile
+    if (msg->type == DBWRITER_MSG_RECORD && writer.samplelog &&
+        !dbwriter_writesamplelog(&msg->data.record))
+        return EXIT_SUCCESS;
+    /*
+     * First row opens the transaction and starts the commitinterval timer.
+     * If that fails, the row is written in its own implicit transaction.
+     * (Timer may already run for the sample log rows.)
+     */
+    if (!writer.n_pending && writer.commitfd && (dbwriter_commitrows() > 1 || writer.draining))
+    {
+        if (!database_begin(writer.handle) && !writer.n_unsynced)
+            dbwriter_armtimer();
+    }
+    xtmrlap(writer.timer);
+    switch (msg->type)
+    {
+        case DBWRITER_MSG_RECORD:
+            rc = database_write(writer.handle, &msg->data.record);
+            timestamp = msg->data.record.timestamp;
+            break;
+        case DBWRITER_MSG_COUNTERS:
+            rc = database_writecounters(writer.handle, &msg->data.counters);
+            timestamp = msg->data.counters.timestamp;
+            break;
+        case DBWRITER_MSG_REBOOT:
+            rc = database_writereboot(writer.handle, &msg->data.reboot);
+            break;
+        default:
+            logerr("Unknown database writer message type %d", msg->type);
+            rc = EXIT_FAILURE;
+            break;
+    }
+    ms = xtmrlap(writer.timer);
+    if (rc)
+    {
+        writer.total.n_failed++;
+        logerr("Database write failed! Return code %d", rc);
+        // Do not leave an empty transaction open
+        if (!writer.n_pending)
+            database_commit(writer.handle);
+        return rc;
+    }
+    writer.total.n_written++;
+    writer.total.write_ms += ms;
+    writer.total.max_ms    = ms > writer.total.max_ms ? ms : writer.total.max_ms;
+    if (!database_intransaction(writer.handle))
+    {
+        // Row was committed on its own, so is its rollup
+        if (timestamp && database_rollup(writer.handle, timestamp, timestamp))
+            logerr("Rollup update failed");
+        dbwriter_latency(ms, 1);
+        return EXIT_SUCCESS;
+    }
+    if (timestamp)
+    {
+        writer.first = !writer.last || timestamp < writer.first ? timestamp : writer.first;
+        writer.last  = timestamp > writer.last ? timestamp : writer.last;
+    }
+    writer.pending_ms += ms;
+    if (++writer.n_pending >= dbwriter_commitrows() && !writer.draining)
+        dbwriter_flush();
+    return EXIT_SUCCESS;
+}
+
+static void dbwriter_control(dbwriter_msg_t *msg)
+{
+    int64_t value = msg->data.control.value;
+
+    switch (msg->type)
+    {
+        case DBWRITER_MSG_FLUSH:
+            dbwriter_flush();
+            break;
+        case DBWRITER_MSG_CHECKPOINT:
+            dbwriter_checkpoint((int)value);
+            break;
+        case DBWRITER_MSG_ROLLOVER:
+            dbwriter_reopen(database_partition((time_t)value));
+            break;
+        case DBWRITER_MSG_RETENTION:
+            dbwriter_retention();
+            break;
+        case DBWRITER_MSG_IMPORTTMPFS:
+            dbwriter_importtmpfs((time_t)value);
+            break;
+        case DBWRITER_MSG_LOGSTATS:
+            dbwriter_logstats();
+            break;
+        case DBWRITER_MSG_CLOSE:
+            writer.running = false;
+            break;
+        default:
+            logerr("Unknown database writer control message %d", msg->type);
+            break;
+    }
+}
+
+int dbwriter_process()
+{
+    dbwriter_msg_t msg;
+    ssize_t        n;
+
+    if (!writer.handle)
+        return EXIT_FAILURE;
+    while ((n = read(writer.pipe[PIPE_READ], &msg, sizeof(msg))) == sizeof(msg))
+    {
+        if (msg.type < DBWRITER_MSG_FLUSH)
+            dbwriter_write(&msg);
+        else
+            dbwriter_control(&msg);
+    }
+    // All write ends closed, daemon is gone
+    if (n == 0)
+        writer.running = false;
+    if (n < 0 && errno != EAGAIN)
+    {
+        logerr("read()");
+        return EXIT_FAILURE;
+    }
+    if (n > 0)
+        logerr("Truncated database writer message (%d bytes)", (int)n);
+    return (errno = 0, EXIT_SUCCESS);
+}
+
+void dbwriter_close()
+{
+    int status;
+
+    if (writer.pid)
+    {
+        // Writer commits, drains the spool and logs its totals before it exits
+        writer.restart = false;
+        // Nothing else to do, wait for room in the pipe
+        if (writer.control)
+            fcntl(writer.control, F_SETFL, 0);
+        if (!dbwriter_request(DBWRITER_MSG_CLOSE, 0) &&
+            waitpid(writer.pid, &status, 0) == writer.pid &&
+            WIFEXITED(status) && !WEXITSTATUS(status))
+            logdev("Database writer (PID: %d) closed", writer.pid);
+        else
+            logerr("Database writer (PID: %d) did not close cleanly", writer.pid);
+        writer.pid = 0;
+    }
+    else if (writer.handle)
+    {
+        dbwriter_process();
+        dbwriter_flush();
+        if (writer.spool)
+            dbwriter_drain(true);
+        dbwriter_updateprofile();
+        if (writer.commitfd)
+            close(writer.commitfd);
+        if (writer.retentionfd)
+            close(writer.retentionfd);
+        samplelog_close(writer.samplelog);
+        database_close(writer.handle);
+        free(writer.timer);
+        writer.handle          = NULL;
+        writer.commitfd        = 0;
+        writer.retentionfd     = 0;
+        writer.samplelog       = NULL;
+        writer.retention.state = DBWRITER_RETENTION_IDLE;
+    }
+    dbwriter_release();
+}
+
+/*
+ * Writer process main loop. Ends on DBWRITER_MSG_CLOSE or when the daemon
+ * (and all the workers) are gone.
+ */
+static int dbwriter_main()
+{
+    fd_set fds;
+    int    maxfd;
+
+    writer.running = true;
+    while (writer.running)
+    {
+        FD_ZERO(&fds);
+        FD_SET(writer.pipe[PIPE_READ], &fds);
+        maxfd = writer.pipe[PIPE_READ];
+        if (writer.commitfd)
+        {
+            FD_SET(writer.commitfd, &fds);
+            maxfd = writer.commitfd > maxfd ? writer.commitfd : maxfd;
+        }
+        if (writer.retentionfd)
+        {
+            FD_SET(writer.retentionfd, &fds);
+            maxfd = writer.retentionfd > maxfd ? writer.retentionfd : maxfd;
+        }
+        if (select(maxfd + 1, &fds, NULL, NULL, NULL) == -1)
+        {
+            if (errno == EINTR)
+                continue;
+            logerr("select()");
+            break;
+        }
+        if (FD_ISSET(writer.pipe[PIPE_READ], &fds))
+            dbwriter_process();
+        if (writer.commitfd && FD_ISSET(writer.commitfd, &fds))
+        {
+            timerfd_acknowledge(writer.commitfd);   // util.c
+            dbwriter_flush();
+        }
+        if (writer.retentionfd && FD_ISSET(writer.retentionfd, &fds))
+        {
+            timerfd_acknowledge(writer.retentionfd);    // util.c
+            dbwriter_retentionstep();
+        }
+    }
+    // Totals include the final commit
+    dbwriter_process();
+    dbwriter_flush();
+    if (writer.spool)
+        dbwriter_drain(true);
+    dbwriter_logstats();
+    dbwriter_close();
+    return EXIT_SUCCESS;
+}
+
+static int dbwriter_fork()
+{
+    pid_t pid;
+
+    writer.restart = false;
+    if ((pid = fork()) < 0)
+    {
+        logerr("Unable to fork database writer process");
+        return EXIT_FAILURE;
+    }
+    else if (pid > 0)
+    {
+        writer.pid     = pid;
+        writer.started = time(NULL);
+        logdev("Created database writer process (PID: %d) for \"%s\"", pid, writer.datafile);
+        return (errno = 0, EXIT_SUCCESS);
+    }
+    // Child - must _exit(). Daemon ends it with DBWRITER_MSG_CLOSE.
+    signal(SIGTERM, SIG_IGN);
+    signal(SIGHUP,  SIG_IGN);
+    signal(SIGINT,  SIG_IGN);
+    // Otherwise the pipe would never reach EOF
+    close(writer.pipe[PIPE_WRITE]);
+    writer.pipe[PIPE_WRITE] = 0;
+    if (writer.control)
+        close(writer.control);
+    writer.control = 0;
+    if (dbwriter_attach(writer.datafile))
+        _exit(DBWRITER_EXIT_NOTOPEN);
+    _exit(dbwriter_main());
+}
+
+int dbwriter_start(char *datafile)
+{
+    if (writer.handle || writer.pid)
+        return (errno = 0, EXIT_SUCCESS);
+    if (dbwriter_pipe())
+        return EXIT_FAILURE;
+    writer.datafile = strdup(datafile);
+    if (dbwriter_fork())
+    {
+        dbwriter_release();
+        return EXIT_FAILURE;
+    }
+    return (errno = 0, EXIT_SUCCESS);
+}
+
+/*
+ * New configuration (SIGHUP). Writer closes and is started again by
+ * dbwriter_exited(). Rows sent in between wait in the pipe.
+ */
+int dbwriter_restart()
+{
+    if (!writer.pid || writer.restart)
+        return (errno = 0, EXIT_SUCCESS);
+    if (dbwriter_request(DBWRITER_MSG_CLOSE, 0))
+        return EXIT_FAILURE;
+    writer.restart = true;
+    return (errno = 0, EXIT_SUCCESS);
+}
+
+/*
+ * Writer process exited (daemon SIGCHLD). Started again with the same
+ * pipe, spool and datafile, unless it could not open the datafile or died
+ * within DBWRITER_RESTART_HOLDOFF seconds of its start. Workers then insert
+ * their rows directly, as without the writer.
+ */
+int dbwriter_exited(pid_t pid, int status)
+{
+    if (!writer.pid || pid != writer.pid)
+        return false;
+    writer.pid = 0;
+    if (writer.restart)
+        logdev("Database writer (PID: %d) closed for restart", pid);
+    else
+    {
+        if (WIFSIGNALED(status))
+            logerr("Database writer (PID: %d) died to %s signal", pid, getsignalname(WTERMSIG(status)));
+        else
+            logerr("Database writer (PID: %d) exited with code (%d)", pid, WEXITSTATUS(status));
+        if ((WIFEXITED(status) && WEXITSTATUS(status) == DBWRITER_EXIT_NOTOPEN) ||
+            time(NULL) - writer.started < DBWRITER_RESTART_HOLDOFF)
+        {
+            logerr("Database writer is not restarted, workers will insert directly");
+            dbwriter_release();
+            return true;
+        }
+    }
+    if (dbwriter_fork())
+        dbwriter_release();
+    return true;
+}
+
+pid_t dbwriter_getpid()
+{
+    return writer.pid;
+}
+
+int dbwriter_adapt(char *profile, int mode)
+{
+    free(writer.adaptive.profile);
+    memset(&writer.adaptive, 0, sizeof(writer.adaptive));
+    if (!profile)
+        return (errno = 0, EXIT_SUCCESS);
+    if (!(writer.adaptive.profile = strdup(profile)))
+    {
+        logerr("strdup()");
+        return EXIT_FAILURE;
+    }
+    writer.adaptive.mode  = mode == DBWRITER_MODE_DIRECT ? DBWRITER_MODE_DIRECT : DBWRITER_MODE_BATCHED;
+    writer.adaptive.saved = mode;
+    return (errno = 0, EXIT_SUCCESS);
+}
+
+/*
+ * Profile file, "key = value" lines like the configuration file
+ */
+int dbwriter_loadprofile(char *filename, dbwriter_profile_t *profile)
+{
+    FILE     *fp;
+    keyval_t  kv;
+    char      line[128];
+    int       n = 0;
+
+    memset(profile, 0, sizeof(dbwriter_profile_t));
+    profile->mode = -1;
+    if (!(fp = fopen(filename, "r")))
+        return EXIT_FAILURE;
+    while (fgets(line, sizeof(line), fp))
+    {
+        if (!(kv = keyval_create(line)))
+            continue;
+        if (keyval_nvalues(kv) == 1)
+        {
+            if (keyval_iskey(kv, "mode"))
+            {
+                for (profile->mode = DBWRITER_MODE_SPOOL; profile->mode >= 0; profile->mode--)
+                    if (eqlstrnocase(kv[1], DBWRITER_MODE_NAME(profile->mode)))
+                        break;
+                n++;
+            }
+            else if (keyval_iskey(kv, "mean"))
+                profile->mean = atof(kv[1]), n++;
+            else if (keyval_iskey(kv, "max"))
+                profile->max = atof(kv[1]), n++;
+            else if (keyval_iskey(kv, "updated"))
+                profile->updated = (time_t)atoll(kv[1]), n++;
+        }
+        free(kv);
+    }
+    fclose(fp);
+    if (n != 4 || profile->mode < 0 || profile->updated > time(NULL) ||
+        time(NULL) - profile->updated > DBWRITER_PROFILE_MAXAGE)
+        return (errno = 0, EXIT_FAILURE);
+    return (errno = 0, EXIT_SUCCESS);
+}
+
+int dbwriter_saveprofile(char *filename, dbwriter_profile_t *profile)
+{
+    FILE *fp;
+    char  tmp[CFG_MAX_FILENAME_LEN + sizeof(DAEMON_PROFILE_SUFFIX) + 8];
+    int   rc;
+
+    snprintf(tmp, sizeof(tmp), "%s.tmp", filename);
+    if (!(fp = fopen(tmp, "w")))
+    {
+        logerr("Unable to write profile \"%s\"", tmp);
+        return EXIT_FAILURE;
+    }
+    fprintf(fp, "# Insert latency profile of the database writer (dbwriter.h)\n");
+    fprintf(fp, "mode = %s\n",    DBWRITER_MODE_NAME(profile->mode));
+    fprintf(fp, "mean = %.3f\n",  profile->mean);
+    fprintf(fp, "max = %.3f\n",   profile->max);
+    fprintf(fp, "updated = %lld\n", (long long)profile->updated);
+    rc = fclose(fp);
+    if (rc || rename(tmp, filename))
+    {
+        logerr("Unable to write profile \"%s\"", filename);
+        unlink(tmp);
+        return EXIT_FAILURE;
+    }
+    return (errno = 0, EXIT_SUCCESS);
+}
+
+void dbwriter_logstats()
+{
+    if (writer.pid)
+    {
+        dbwriter_request(DBWRITER_MSG_LOGSTATS, 0);
+        return;
+    }
+    if (!writer.total.n_written && !writer.total.n_failed)
+        return;
+    if (writer.total.n_commits || writer.total.n_lost)
+        logmsg(
+              LOG_INFO,
+              "Database writer: %u commits (%u rows lost), mean %.2f ms, max %.2f ms",
+              writer.total.n_commits,
+              writer.total.n_lost,
+              writer.total.n_commits ? writer.total.commit_ms / writer.total.n_commits : 0.0,
+              writer.total.maxcommit_ms
+              );
+    if (writer.samplelog)
+    {
+        samplelog_stats_t *stats = samplelog_getstats(writer.samplelog);
+        logmsg(
+              LOG_INFO,
+              "Sample log: %u rows (%u merged, %u late), %u segments sealed (%u rows, %.2f bytes/row), %u syncs",
+              stats->n_rows,
+              stats->n_merged,
+              stats->n_late,
+              stats->n_segments,
+              stats->n_encoded,
+              stats->n_encoded ? (double)stats->n_bytes / stats->n_encoded : 0.0,
+              stats->n_syncs
+              );
+    }
+    if (writer.spool)
+    {
+        spool_stats_t *stats = spool_getstats(writer.spool);
+        logmsg(
+              LOG_INFO,
+              "Database writer: spool drained %u records in %u transactions (%u replayed, %u corrupt), max %.2f ms",
+              stats->n_read,
+              writer.total.n_drains,
+              stats->n_replayed,
+              stats->n_corrupt,
+              writer.total.maxdrain_ms
+              );
+    }
+    if (writer.total.n_retentionchunks)
+        logmsg(
+              LOG_INFO,
+              "Database writer: retention deleted %u rows, freed %u pages in %u chunks, max %.2f ms%s",
+              writer.total.n_retentiondeleted,
+              writer.total.n_retentionpages,
+              writer.total.n_retentionchunks,
+              writer.total.maxretention_ms,
+              writer.retention.state != DBWRITER_RETENTION_IDLE ? " (pass in progress)" : ""
+              );
+    if (writer.adaptive.profile)
+        logmsg(
+              LOG_INFO,
+              "Database writer: %s commits, %u mode switches",
+              DBWRITER_MODE_NAME(writer.adaptive.mode),
+              writer.adaptive.n_switches
+              );
+    if (writer.total.n_checkpoints)
+        logmsg(
+              LOG_INFO,
+              "Database writer: %u WAL checkpoints (%u forced by walmaxsize), max %.2f ms",
+              writer.total.n_checkpoints,
+              writer.total.n_walfull,
+              writer.total.maxcheckpoint_ms
+              );
+    logmsg(
+          LOG_INFO,
+          "Database writer: %u rows written (%u failed), mean %.2f ms, max %.2f ms",
+          writer.total.n_written,
+          writer.total.n_failed,
+          writer.total.n_written ? writer.total.write_ms / writer.total.n_written : 0.0,
+          writer.total.max_ms
+          );
+}
+
+/*
+ * Worker side
+ */
+int dbwriter_send(int type, void *data)
+{
+    dbwriter_msg_t msg;
+
+    if (!writer.handle && !writer.pid)
+        return (errno = ENOTCONN, EXIT_FAILURE);
+    msg.type = type;
+    switch (type)
+    {
+        case DBWRITER_MSG_RECORD:
+            msg.data.record   = *(databaserecord_t *)data;
+            break;
+        case DBWRITER_MSG_COUNTERS:
+            msg.data.counters = *(databasecounters_t *)data;
+            break;
+        case DBWRITER_MSG_REBOOT:
+            msg.data.reboot   = *(databasereboot_t *)data;
+            break;
+        default:
+            return (errno = EINVAL, EXIT_FAILURE);
+    }
+    // Durable at the next spool sync, pipe only while the daemon runs
+    if (writer.spool && !spool_append(writer.spool, &msg))
+        return (errno = 0, EXIT_SUCCESS);
+    if (write(writer.pipe[PIPE_WRITE], &msg, sizeof(msg)) != sizeof(msg))
+    {
+        logerr("write()");
+        return EXIT_FAILURE;
+    }
+    return (errno = 0, EXIT_SUCCESS);
+}
+
+/* EOF dbwriter.c */
@@ -0,0 +1,221 @@
+/*
+ * dbwriter.h - 2016 Jani Tammi <janitammi@gmail.com>
+ *
+ *      Single database writer process.
+ *
+ *      Workers used to open the database, prepare the INSERT statement and
+ *      close the database for every row, and the tmpfs import was another
+ *      process writing into the same datafile. Every one of them could hit
+ *      SQLITE_BUSY. Now one long lived process owns the only read-write
+ *      connection:
+ *
+ *      1.  Daemon creates a pipe and fork()'s the writer with
+ *          dbwriter_start() before any worker is fork()'ed. Workers inherit
+ *          the write end. Writer opens the datafile
+ *          (database.c:database_open()); SQLite3 connections must not be
+ *          carried over fork().
+ *      2.  Worker sends its rows as fixed size messages (dbwriter_send()).
+ *          Messages are smaller than PIPE_BUF, so writes are atomic even
+ *          if several workers write at the same time.
+ *      3.  Writer selects the read end and writes the rows over the
+ *          persistent connection (dbwriter_process()).
+ *
+ *      Daemon drives the writer with control messages through the same
+ *      pipe (flush, checkpoint, partition rollover, retention, tmpfs import,
+ *      statistics, close), queued behind the rows sent before them. Daemon
+ *      side calls of the public functions below send them. Daemon writes
+ *      them through its own non-blocking open of the write end, so a full
+ *      pipe (writer stuck in a long commit) does not stall its event loop:
+ *      recurring messages (flush, checkpoint, retention, statistics) are
+ *      dropped, the others wait in a queue of DBWRITER_MAXDEFERRED messages
+ *      and are sent first with the next request. Writer ignores
+ *      SIGTERM, SIGHUP and SIGINT; it exits on DBWRITER_MSG_CLOSE or when
+ *      the pipe has no writers left. SIGHUP restarts it with the new
+ *      configuration, a writer that dies is restarted (dbwriter_exited()).
+ *      Only readers (web UI, reports) share the datafile with it, and WAL
+ *      readers do not block the writer, so the busy timeout is not on the
+ *      row path anymore.
+ *
+ *      Rows are group committed: first row opens a transaction, which is
+ *      committed when it holds cfg.database.commitrows rows or when
+ *      cfg.database.commitinterval seconds have passed (timerfd, selected
+ *      by the writer). Commit interval is the maximum amount of data lost
+ *      if the power is cut. SIGTERM and SIGHUP commit immediately.
+ *
+ *      Rollup tables (database.h) are recomputed for the buckets of the
+ *      committed rows, in the same transaction.
+ *
+ *      With WAL journal (cfg.database.journal), writer connection also runs
+ *      the checkpoints: PASSIVE on the daemon CHECKPOINT event and TRUNCATE
+ *      whenever a commit leaves the WAL file larger than walmaxsize.
+ *
+ *      With a sample log (cfg.database.samplelog, samplelog.h), samples
+ *      are appended into the log instead of the datafile and synced on the
+ *      same commitrows / commitinterval terms. Counters and reboots are still
+ *      written into the datafile. Rollups of the logged samples are built
+ *      when the log is exported (-export-sqlite).
+ *
+ *      With a spool (cfg.database.spool, spool.h), workers append their
+ *      messages into the spool file instead of the pipe. Commit timer then
+ *      runs periodically: each tick syncs the spool, and every
+ *      DBWRITER_SPOOL_INTERVAL seconds the spool is drained into the
+ *      datafile, DBWRITER_SPOOL_BATCH rows per transaction. Pipe remains
+ *      the fallback if an append fails.
+ *
+ *      Retention (cfg.database.retention) is run by the writer as well, in
+ *      time bounded chunks between the rows (dbwriter_retentionstep()).
+ *
+ *      Adaptive commits (tmpfs = AUTO, see main.c:predaemon_initialize()).
+ *      Writer keeps the latency of the last DBWRITER_LATENCY_WINDOW commits
+ *      it makes (write and commit time of the transaction, rollup included)
+ *      and switches between
+ *
+ *          DIRECT          every row committed as it arrives, and
+ *          BATCHED         group commit (commitrows / commitinterval)
+ *
+ *      when the window mean or max per row crosses CFG_MAX_INSERT_DELAY_MEAN
+ *      or _MAX. Back to DIRECT only when the mean and max of the (batch)
+ *      commits are below DBWRITER_LATENCY_HYSTERESIS of the limits. If
+ *      BATCHED commits miss the limits per row as well, the spool is used
+ *      from the next start. Window starts over whenever the decision
+ *      changes. Mode and the window statistics (per row) are saved in a
+ *      profile file (dbwriter_saveprofile()) on every change, every
+ *      DBWRITER_PROFILE_SAVE commits and on close; daemon reads it on start
+ *      instead of test inserting into the datafile. Profile older than
+ *      DBWRITER_PROFILE_MAXAGE is measured again.
+ *
+ *      dbwriter_open() runs the same writer inside the calling process
+ *      (command line utilities, unit tests); nothing is selected then and
+ *      the caller flushes.
+ *
+ *      If the writer is not running (worker executed outside the daemon,
+ *      or the writer could not open the datafile), dbwriter_send() fails
+ *      and the worker inserts the row itself, as before.
+ */
+#include <stdint.h>             /* uint32_t, int64_t                        */
+#include <sys/types.h>          /* pid_t                                    */
+
+#include "database.h"           /* databaserecord_t ...                     */
+
+#ifndef __DBWRITER_H__
+#define __DBWRITER_H__
+
+#define DBWRITER_MSG_RECORD         1       // databaserecord_t
+#define DBWRITER_MSG_COUNTERS       2       // databasecounters_t
+#define DBWRITER_MSG_REBOOT         3       // databasereboot_t
+#define DBWRITER_MSG_FLUSH          16      // control messages (daemon)
+#define DBWRITER_MSG_CHECKPOINT     17      // value: truncate
+#define DBWRITER_MSG_ROLLOVER       18      // value: time, partition of
+#define DBWRITER_MSG_RETENTION      19
+#define DBWRITER_MSG_IMPORTTMPFS    20      // value: watermark
+#define DBWRITER_MSG_LOGSTATS       21
+#define DBWRITER_MSG_CLOSE          22
+
+#define DBWRITER_EXIT_NOTOPEN       2       // writer could not open the datafile
+#define DBWRITER_RESTART_HOLDOFF    10      // (seconds) died sooner, not restarted
+
+#define DBWRITER_RETENTION_IDLE     0
+#define DBWRITER_RETENTION_DELETE   1
+#define DBWRITER_RETENTION_VACUUM   2
+#define DBWRITER_RETENTION_DUTY     4       // pause between chunks (x retentionlock)
+
+#define DBWRITER_MODE_DIRECT        0       // adaptive commits, see above
+#define DBWRITER_MODE_BATCHED       1
+#define DBWRITER_MODE_SPOOL         2       // workers append into a spool (decided on start)
+#define DBWRITER_MODE_NAME(m) \
+    ((m) == DBWRITER_MODE_DIRECT ? "DIRECT" : (m) == DBWRITER_MODE_BATCHED ? "BATCHED" : "SPOOL")
+
+#define DBWRITER_LATENCY_WINDOW     64      // commits in the rolling latency statistics
+#define DBWRITER_LATENCY_HYSTERESIS 0.5     // share of the limits to return to DIRECT
+#define DBWRITER_PROFILE_MAXAGE     (30 * 86400)    // (seconds) older profile is not used
+#define DBWRITER_PROFILE_SAVE       (4 * DBWRITER_LATENCY_WINDOW)   // commits between profile saves
+
+#define DBWRITER_SPOOL_INTERVAL     300     // (seconds) between spool drains
+#define DBWRITER_SPOOL_BATCH        5000    // rows per drain transaction
+#define DBWRITER_SPOOL_CHUNK        64      // messages read from the spool at a time
+
+#define DBWRITER_MAXDEFERRED        8       // control messages waiting for a full pipe
+
+typedef struct
+{
+    int                     type;           // DBWRITER_MSG_*
+    union
+    {
+        databaserecord_t    record;
+        databasecounters_t  counters;
+        databasereboot_t    reboot;
+        struct
+        {
+            int64_t         value;
+        }                   control;
+    } data;
+} dbwriter_msg_t;
+
+typedef struct
+{
+    int                     mode;           // DBWRITER_MODE_*
+    double                  mean;           // (ms) commit latency window
+    double                  max;
+    time_t                  updated;
+} dbwriter_profile_t;
+
+/*
+ * Daemon side
+ *
+ *  dbwriter_start()    Create the pipe and fork() the writer process.
+ *  dbwriter_restart()  Close the writer, dbwriter_exited() starts it again.
+ *  dbwriter_exited()   SIGCHLD of the writer; restarts it. False if pid is
+ *                      not the writer.
+ *  dbwriter_getpid()   Writer process, 0 if not running.
+ *  dbwriter_adapt()    Adaptive commits, starting in mode, learned profile
+ *                      saved into profile. Call before dbwriter_start().
+ *
+ * Profile
+ *
+ *  dbwriter_loadprofile() EXIT_FAILURE if the file does not exist, cannot
+ *                      be parsed or is older than DBWRITER_PROFILE_MAXAGE.
+ *  dbwriter_saveprofile() Replace the file (rename()).
+ *
+ * Both (daemon side calls are sent to the writer process)
+ *
+ *  dbwriter_open()     Open datafile and create the pipe (no process).
+ *  dbwriter_process()  Write all queued messages into the database.
+ *  dbwriter_flush()    Commit open transaction (commit timer, signals).
+ *                      With the spool, sync it and drain when due.
+ *  dbwriter_checkpoint() WAL checkpoint (commits first). No-op without WAL.
+ *  dbwriter_rollover() Commit and switch to the partition of time now.
+ *  dbwriter_retention() Start a retention pass (no-op if one is running).
+ *  dbwriter_retentionstep() Run one retention chunk (retention timer).
+ *  dbwriter_importtmpfs() Commit and import the tmpfs datafile up to the
+ *                      watermark (database.c:database_collecttmpfs()).
+ *  dbwriter_close()    Process remaining messages, commit and close. Waits
+ *                      for the writer process to exit.
+ *  dbwriter_logstats() Log totals.
+ *
+ * Worker side
+ *
+ *  dbwriter_send()     Queue a row (spool or pipe). EXIT_FAILURE if writer
+ *                      is not running.
+ */
+int     dbwriter_start(char *datafile);
+int     dbwriter_restart(void);
+int     dbwriter_exited(pid_t pid, int status);
+pid_t   dbwriter_getpid(void);
+int     dbwriter_adapt(char *profile, int mode);
+int     dbwriter_loadprofile(char *filename, dbwriter_profile_t *profile);
+int     dbwriter_saveprofile(char *filename, dbwriter_profile_t *profile);
+int     dbwriter_open(char *datafile);
+int     dbwriter_process(void);
+int     dbwriter_flush(void);
+int     dbwriter_checkpoint(int truncate);
+int     dbwriter_rollover(time_t now);
+int     dbwriter_retention(void);
+int     dbwriter_retentionstep(void);
+int     dbwriter_importtmpfs(time_t watermark);
+void    dbwriter_close(void);
+void    dbwriter_logstats(void);
+int     dbwriter_send(int type, void *data);
+
+#endif /* __DBWRITER_H__ */
+
+/* EOF dbwriter.h */
@@ -89,6 +89,12 @@ event_action_t event_action[] =
     { "IMPORTTMPFS",        EVENT_TYPE_INTERVAL },
     { "IMPORTTMPFSTIMEOUT", EVENT_TYPE_ONCE },
     { "WATCHDOG",           EVENT_TYPE_INTERVAL },
+    { "PING",               EVENT_TYPE_INTERVAL },
+    { "LINEDATA",           EVENT_TYPE_INTERVAL },
+    { "CHECKPOINT",         EVENT_TYPE_INTERVAL },
+    { "ROLLOVER",           EVENT_TYPE_ONCE },
+    { "RETENTION",          EVENT_TYPE_INTERVAL },
+    { "REPLICA",            EVENT_TYPE_INTERVAL },
     { NULL }
 };
 
@@ -415,6 +421,23 @@ time_t event_reschedule(event_t *event)
     // calculate new .next_trigger -value
     __schedule_next_trigger(event);
     time_t now = time(NULL);
+    if (event->type == EVENT_TYPE_INTERVAL && event->next_trigger <= now)
+    {
+        // Short intervals can fall behind (or clock was set forward).
+        // Skip to the next future triggering, keeping the alignment.
+        int n_skipped = 0;
+        while (event->next_trigger <= now)
+        {
+            event->next_trigger += event->localoffset;
+            n_skipped++;
+        }
+        logmsg(
+              LOG_INFO,
+              "Event %s was late, %d triggerings skipped",
+              event_getactionstr(event->action),
+              n_skipped
+              );
+    }
     if (event->next_trigger < now)
     {
         logerr("__schedule_next_trigger(event) failed to create .next_trigger correctly!");
@@ -458,6 +481,24 @@ int event_execute(event_t *event)
         case EVENT_ACTION_WATCHDOG:
             return daemon_watchdog();          // daemon.c
             break;
+        case EVENT_ACTION_PING:
+            return daemon_ping(event->next_trigger);     // daemon.c
+            break;
+        case EVENT_ACTION_LINEDATA:
+            return daemon_linedata(event->next_trigger); // daemon.c
+            break;
+        case EVENT_ACTION_CHECKPOINT:
+            return daemon_checkpoint();        // daemon.c
+            break;
+        case EVENT_ACTION_ROLLOVER:
+            return daemon_rollover();          // daemon.c
+            break;
+        case EVENT_ACTION_RETENTION:
+            return daemon_retention();         // daemon.c
+            break;
+        case EVENT_ACTION_REPLICA:
+            return daemon_replica();           // daemon.c
+            break;
         default:
             logerr(
                   "Unrecognized event action code (%d) received!",
@@ -655,6 +696,57 @@ time_t event_create(int action, time_t seconds)
     return (errno = 0, event->next_trigger);
 }
 
+/*
+ * Create new interval event, first triggering aligned to a multiple
+ * of 'seconds' from the epoch.
+ */
+time_t event_create_aligned(int action, time_t seconds)
+{
+    if (
+       action > EVENT_ACTION_MAXVALUE ||
+       action < 1 ||
+       seconds < 1 ||
+       event_action[action].default_type != EVENT_TYPE_INTERVAL
+       )
+    {
+        return (errno = EINVAL, -1);
+    }
+    event_t *event = calloc(1, sizeof(event_t));
+    event->action         = action;
+    event->type           = EVENT_TYPE_INTERVAL;
+    event->source         = EVENT_SOURCE_INTERNAL;
+    event->localoffset    = seconds;
+    // Non-zero .next_trigger is advanced by .localoffset on reschedule
+    event->next_trigger   = (time(NULL) / seconds + 1) * seconds;
+    eventheap_insert(event);
+    return (errno = 0, event->next_trigger);
+}
+
+/*
+ * Remove (and release) events of given action from the production schedule
+ */
+int event_remove(int action)
+{
+    event_t **tmp = calloc(eventheap_size() + 1, sizeof(event_t *));
+    event_t *event;
+    int     index = 0;
+    int     n_removed = 0;
+    while ((event = eventheap_fetch()))
+    {
+        if (event->action == action)
+        {
+            free(event);
+            n_removed++;
+        }
+        else
+            tmp[index++] = event;
+    }
+    for (index = 0; tmp[index]; index++)
+        eventheap_insert(tmp[index]);
+    free(tmp);
+    return n_removed;
+}
+
 /******************************************************************************
  * Parses provided array into 'temporary' schedule buffer.
  * This function will output LOG_ERR messages for problems.
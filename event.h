@@ -179,8 +179,14 @@
 #define EVENT_ACTION_IMPORTTMPFS        5
 #define EVENT_ACTION_IMPORTTMPFSTIMEOUT 6
 #define EVENT_ACTION_WATCHDOG           7
+#define EVENT_ACTION_PING               8   // cfg.execute.pinginterval > 0
+#define EVENT_ACTION_LINEDATA           9   // cfg.execute.pinginterval > 0
+#define EVENT_ACTION_CHECKPOINT         10  // cfg.database.journal == WAL
+#define EVENT_ACTION_ROLLOVER           11  // cfg.database.partition != NONE
+#define EVENT_ACTION_RETENTION          12  // cfg.database.retention > 0
+#define EVENT_ACTION_REPLICA            13  // cfg.database.replica != ""
 
-#define EVENT_ACTION_MAXVALUE           EVENT_ACTION_WATCHDOG
+#define EVENT_ACTION_MAXVALUE           EVENT_ACTION_REPLICA
 #define EVENT_ACTIONSTR_MAXLEN         20
 
 #define EVENT_SOURCE_UNKNOWN            0
@@ -206,7 +212,7 @@ typedef struct event_tag
     time_t          next_trigger;                       // UTC+0 when this event triggers next time
     time_t          localoffset;                        // hours and minutes from midnight, local STANDARD time
     int             type   : 3;                         // [0-3] See EVENT_TYPE_* defines
-    int             action : 5;                         // [0-8] See EVENT_ACTION_* defines (MUST BE SIGNED!)
+    int             action : 5;                         // [0-9] See EVENT_ACTION_* defines (MUST BE SIGNED!)
     unsigned int    source : 2;                         // parsed or created with a function (internal)
 //    char    string[1 + EVENT_ACTIONSTR_MAXLEN + 6 + 1];    // "23:59 OFF" reparsed to meet criteria 6 + code + null
 } event_t;
@@ -287,6 +293,26 @@ char *   event_getactionstr(int action);
  */
 time_t   event_create(int action, time_t seconds);
 
+/*
+ * Create / add new aligned interval event
+ *
+ *      Like event_create(), but the first triggering is the next multiple of
+ *      'seconds' from the epoch (instead of now + seconds). Events with
+ *      intervals that are multiples of each other will then trigger at the
+ *      same second. Only for actions of EVENT_TYPE_INTERVAL.
+ *
+ * RETURN
+ *      time_t  / 0         time_t for the next triggering of the new event
+ *      -1      / EINVAL    Invalid argument(s)
+ */
+time_t   event_create_aligned(int action, time_t seconds);
+
+/*
+ * Remove all events with specified action from the production schedule.
+ * Returns the number of removed events.
+ */
+int      event_remove(int action);
+
 /*
  * Returns a pointer to the next event in the schedule.
  * May or may not be triggered. Schedule is untouched.
@@ -314,7 +340,8 @@ int      event_execute(event_t *event);
  *
  *      New .next_trigger will be calculated and the event will be
  *      reinserted into the eventheap. Function returns the time_t
- *      for .next_trigger.
+ *      for .next_trigger. Interval events skip the triggerings that
+ *      were missed (late execution or clock change).
  */
 time_t   event_reschedule(event_t *event);
 
@@ -0,0 +1,276 @@
+/*
+ * export.c - 2016 Jani Tammi <janitammi@gmail.com>
+ *
+ *      Sample range export. See export.h.
+ */
+#include <stdio.h>
+#include <stdarg.h>             // va_list
+#include <stdlib.h>             // EXIT_SUCCESS, EXIT_FAILURE
+#include <string.h>             // memcpy(), memset()
+#include <math.h>               // lrint()
+#include <unistd.h>             // access()
+#include <errno.h>
+
+#include "export.h"
+#include "database.h"           // database_scanfile(), database_foreachpartition()
+#include "samplelog.h"          // samplelog_scan()
+#include "config.h"             // cfg.database.filename, .samplelog
+#include "logwrite.h"
+#include "util.h"               // xtmr()
+
+#define EXPORT_MAXLINE              2048        // bytes, longest formatted row
+
+#define EXPORT_X_COLUMN(f, c, s, k) #c,
+static const char *column[DATABASE_SAMPLE_COLUMNS] = { DATABASE_VALUES(EXPORT_X_COLUMN) };
+static const double scale[DATABASE_SAMPLE_COLUMNS] = { DATABASE_VALUES(DATABASE_X_SCALE) };
+#undef EXPORT_X_COLUMN
+
+static char buffer[EXPORT_BUFFER];
+
+static struct
+{
+    FILE       *out;
+    int         format;
+    int         step;
+    time_t      from;
+    time_t      to;
+    size_t      used;                           // bytes in buffer
+    long long   n_bytes;
+    long long   n_rows;
+    long long   n_records;
+    int         failed;                         // write error, scan stops
+    // Bucket being averaged (step > 0)
+    time_t      bucket;
+    uint32_t    rows;
+    double      sum[DATABASE_SAMPLE_COLUMNS];
+    uint32_t    n[DATABASE_SAMPLE_COLUMNS];
+} this;
+
+static void export_flush()
+{
+    if (this.used && fwrite(buffer, 1, this.used, this.out) != this.used)
+        this.failed = 1;
+    this.n_bytes += this.used;
+    this.used     = 0;
+}
+
+static void export_printf(const char *format, ...) __attribute__ ((format (printf, 1, 2)));
+static void export_printf(const char *format, ...)
+{
+    va_list args;
+
+    va_start(args, format);
+    this.used += vsnprintf(buffer + this.used, sizeof(buffer) - this.used, format, args);
+    va_end(args);
+}
+
+static void export_header()
+{
+    export_header_t header;
+    int             i;
+
+    switch (this.format)
+    {
+        case CFG_EXPORT_CSV:
+            export_printf("Timestamp");
+            for (i = 0; i < DATABASE_SAMPLE_COLUMNS; i++)
+                export_printf(",%s", column[i]);
+            export_printf("%s\n", this.step ? ",Rows" : "");
+            break;
+        case CFG_EXPORT_BINARY:
+            memset(&header, 0, sizeof(header));
+            memcpy(header.magic, EXPORT_MAGIC, sizeof(header.magic));
+            header.columns = DATABASE_SAMPLE_COLUMNS;
+            header.step    = this.step;
+            memcpy(buffer + this.used, &header, sizeof(header));
+            this.used += sizeof(header);
+            break;
+    }
+}
+
+/*
+ * One record into the buffer, buffer is written out when it is close to
+ * full. NULL values are DATABASE_DOUBLE_NULL_VALUE.
+ */
+static void export_record(time_t timestamp, uint32_t rows, const double *value)
+{
+    export_record_t record;
+    int             i;
+
+    switch (this.format)
+    {
+        case CFG_EXPORT_CSV:
+            export_printf("%lld", (long long)timestamp);
+            for (i = 0; i < DATABASE_SAMPLE_COLUMNS; i++)
+                if (value[i] == DATABASE_DOUBLE_NULL_VALUE)
+                    buffer[this.used++] = ',';
+                else
+                    export_printf(",%.10g", value[i]);
+            if (this.step)
+                export_printf(",%u", rows);
+            buffer[this.used++] = '\n';
+            break;
+        case CFG_EXPORT_JSON:
+            export_printf("{\"Timestamp\": %lld", (long long)timestamp);
+            for (i = 0; i < DATABASE_SAMPLE_COLUMNS; i++)
+                if (value[i] == DATABASE_DOUBLE_NULL_VALUE)
+                    export_printf(", \"%s\": null", column[i]);
+                else
+                    export_printf(", \"%s\": %.10g", column[i], value[i]);
+            if (this.step)
+                export_printf(", \"Rows\": %u", rows);
+            export_printf("}\n");
+            break;
+        case CFG_EXPORT_BINARY:
+            record.timestamp = timestamp;
+            record.rows      = rows;
+            for (i = 0; i < DATABASE_SAMPLE_COLUMNS; i++)
+                record.value[i] = value[i] == DATABASE_DOUBLE_NULL_VALUE ?
+                                  EXPORT_NULL : (int32_t)lrint(value[i] * scale[i]);
+            memcpy(buffer + this.used, &record, sizeof(record));
+            this.used += sizeof(record);
+            break;
+    }
+    this.n_records++;
+    if (this.used > sizeof(buffer) - EXPORT_MAXLINE)
+        export_flush();
+}
+
+static void export_bucket()
+{
+    double value[DATABASE_SAMPLE_COLUMNS];
+    int    i;
+
+    if (!this.rows)
+        return;
+    for (i = 0; i < DATABASE_SAMPLE_COLUMNS; i++)
+        value[i] = this.n[i] ? this.sum[i] / this.n[i] : DATABASE_DOUBLE_NULL_VALUE;
+    export_record(this.bucket, this.rows, value);
+    this.rows = 0;
+    memset(this.sum, 0, sizeof(this.sum));
+    memset(this.n, 0, sizeof(this.n));
+}
+
+/*
+ * Scan callback. Rows arrive in timestamp order (a late row of the sample
+ * log may be older, it is averaged into the current bucket).
+ */
+static int export_row(databaserecord_t *record, void *arg)
+{
+    const double *value = &record->modemping_ms;
+    time_t        bucket;
+    int           i;
+
+    this.n_rows++;
+    if (!this.step)
+        export_record(record->timestamp, 1, value);
+    else
+    {
+        bucket = record->timestamp - record->timestamp % this.step;
+        if (this.rows && bucket > this.bucket)
+            export_bucket();
+        if (!this.rows)
+            this.bucket = bucket;
+        this.rows++;
+        for (i = 0; i < DATABASE_SAMPLE_COLUMNS; i++)
+            if (value[i] != DATABASE_DOUBLE_NULL_VALUE)
+            {
+                this.sum[i] += value[i];
+                this.n[i]++;
+            }
+    }
+    return this.failed;
+}
+
+static int export_datafile(char *datafile)
+{
+    if (database_scanfile(datafile, this.from, this.to, export_row, NULL) < 0 || this.failed)
+        return EXIT_FAILURE;
+    return EXIT_SUCCESS;
+}
+
+/*
+ * Datafile and its partitions, rows from ... to
+ */
+static int export_datafiles(time_t from, time_t to)
+{
+    if (from > to)
+        return EXIT_SUCCESS;
+    this.from = from;
+    this.to   = to;
+    return export_datafile(cfg.database.filename) ||
+           database_foreachpartition(export_datafile);      // database.c
+}
+
+/*
+ * Scan callback, timestamp of the first row
+ */
+static int export_first(databaserecord_t *record, void *arg)
+{
+    *(time_t *)arg = record->timestamp;
+    return 1;
+}
+
+/*
+ * Sample log, preceded by the datafile rows older than its first row of
+ * the range (history from before the sample log was configured)
+ */
+static int export_samplelog(time_t from, time_t to)
+{
+    time_t first = to + 1;
+
+    if (samplelog_scan(cfg.database.samplelog, from, to, export_first, &first) < 0)
+        return EXIT_FAILURE;
+    if (first > from && !access(cfg.database.filename, F_OK))
+    {
+        logdev("Rows older than %lld from the datafile", (long long)first);
+        if (export_datafiles(from, first - 1))
+            return EXIT_FAILURE;
+    }
+    return samplelog_scan(cfg.database.samplelog, from, to, export_row, NULL) < 0 || this.failed;
+}
+
+long long export_run(time_t from, time_t to, int format, int step, FILE *out)
+{
+    xtmr_t *t;
+    double  ms;
+    int     rc;
+
+    if (from > to || step < 0)
+        return (errno = EINVAL, -1);
+    memset(&this, 0, sizeof(this));
+    this.out    = out;
+    this.format = format;
+    this.step   = step;
+    t = xtmr();
+    export_header();
+    if (cfg.database.samplelog[0] && !access(cfg.database.samplelog, F_OK))
+        rc = export_samplelog(from, to);
+    else
+        rc = export_datafiles(from, to);
+    export_bucket();
+    export_flush();
+    if (fflush(out))
+        this.failed = 1;
+    ms = xtmrlap(t);
+    free(t);
+    if (rc || this.failed)
+    {
+        logerr("Export failed after %lld rows", this.n_rows);
+        return -1;
+    }
+    logmsg(
+          LOG_INFO,
+          "Exported %lld rows as %lld %s records (%.1f MB) in %.2f s, %.0f rows/s",
+          this.n_rows,
+          this.n_records,
+          CFG_EXPORT_NAME(format),
+          this.n_bytes / 1048576.0,
+          ms / 1000.0,
+          ms > 0.0 ? this.n_rows * 1000.0 / ms : 0.0
+          );
+    errno = 0;
+    return this.n_records;
+}
+
+/* EOF export.c */
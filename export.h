@@ -0,0 +1,73 @@
+/*
+ * export.h - 2016 Jani Tammi <janitammi@gmail.com>
+ *
+ *      Sample range export (-export=<from>,<to>).
+ *
+ *      Rows are stepped out of the Timestamp index one at a time
+ *      (database_scanfile(), samplelog_scan()) and formatted into a large
+ *      stdio buffer (EXPORT_BUFFER), so memory use does not depend on the
+ *      range. Sources, in timestamp order:
+ *
+ *          datafile        cfg.database.filename, then its partitions,
+ *                          oldest first
+ *          sample log      cfg.database.samplelog, if configured
+ *
+ *      With a sample log, datafile rows are exported up to the first row of
+ *      the range in the log (history from before the log was configured).
+ *      Datafile samples after that are not exported: the writer puts them
+ *      in the log, the datafile only has rows of a failed append and the
+ *      rows copied from the log by -export-sqlite.
+ *
+ *      Formats (cfg.cmd.exportformat):
+ *
+ *          CSV             Header line of data view column names, NULL is
+ *                          an empty field.
+ *          JSON            One object per line, NULL is null.
+ *          BINARY          export_header_t, then one export_record_t per
+ *                          row. Values are scaled integers of the compact
+ *                          schema (database.h), EXPORT_NULL is NULL. Host
+ *                          byte order.
+ *
+ *      Downsampling (cfg.cmd.exportstep > 0): rows are averaged into buckets
+ *      of step seconds, per column over the non-NULL values. Bucket is
+ *      written when the first row of a later bucket arrives, and carries
+ *      the number of rows it averages (Rows).
+ */
+#include <stdio.h>              /* FILE                                     */
+#include <stdint.h>             /* int32_t                                  */
+#include <time.h>               /* time_t                                   */
+
+#include "database.h"           /* DATABASE_SAMPLE_COLUMNS                  */
+
+#ifndef __EXPORT_H__
+#define __EXPORT_H__
+
+#define EXPORT_BUFFER               (1 << 20)   // bytes, output buffer
+#define EXPORT_MAGIC                "ICMONDX1"
+#define EXPORT_NULL                 INT32_MIN
+
+typedef struct
+{
+    char            magic[8];                   // EXPORT_MAGIC
+    uint32_t        columns;                    // DATABASE_SAMPLE_COLUMNS
+    uint32_t        step;                       // seconds, 0 == not downsampled
+} export_header_t;
+
+typedef struct
+{
+    int64_t         timestamp;                  // start of the bucket, if downsampled
+    uint32_t        rows;                       // averaged into this record
+    int32_t         value[DATABASE_SAMPLE_COLUMNS];
+} export_record_t;
+
+/*
+ *  export_run()    Write the rows of from ... to (inclusive) into out, in
+ *                  format (CFG_EXPORT_*), downsampled into step second
+ *                  buckets (0 == every row). Returns number of records
+ *                  written, -1 on error.
+ */
+long long export_run(time_t from, time_t to, int format, int step, FILE *out);
+
+#endif /* __EXPORT_H__ */
+
+/* EOF export.h */
@@ -0,0 +1,389 @@
+/*
+ * import.c - 2016 Jani Tammi <janitammi@gmail.com>
+ *
+ *      cisco_docsis_logger CSV import. See import.h.
+ */
+#include <stdio.h>
+#include <stdlib.h>             // EXIT_SUCCESS, EXIT_FAILURE
+#include <string.h>             // memchr(), memmove()
+#include <unistd.h>             // read()
+#include <fcntl.h>              // open()
+#include <math.h>               // lrint()
+#include <time.h>               // mktime()
+#include <errno.h>
+#include <sqlite3.h>
+
+#include "import.h"
+#include "database.h"
+#include "logwrite.h"
+#include "util.h"               // xtmr()
+
+#define IMPORT_X_COLUMN(f, c, s, k)     ", " #s
+#define IMPORT_X_PARAM(f, c, s, k)      ", ?"
+#define SQL_IMPORT_SAMPLES \
+    "INSERT OR IGNORE INTO samples (Timestamp" DATABASE_LINE_VALUES(IMPORT_X_COLUMN) ", Violations) " \
+    "VALUES (?" DATABASE_LINE_VALUES(IMPORT_X_PARAM) ", ?)"
+#define SQL_IMPORT_CARRIED \
+    "SELECT Timestamp FROM samples WHERE Carried ORDER BY Timestamp DESC LIMIT 1"
+#define SQL_IMPORT_MATERIALIZE \
+    "Timestamp = (SELECT MIN(Timestamp) FROM samples WHERE Timestamp > ?1)"
+
+static const double scale[DATABASE_LINE_COLUMNS] = { DATABASE_LINE_VALUES(DATABASE_X_SCALE) };
+static char buffer[IMPORT_BUFFER];
+
+/*
+ * "YYYY.MM.DD hh:mm:ss" (local time). mktime() is called once per hour of
+ * the log, minutes and seconds are added to the start of the hour.
+ */
+static time_t import_timestamp(const char *p)
+{
+    static const int digit[] = { 0, 1, 2, 3, 5, 6, 8, 9, 11, 12, 14, 15, 17, 18 };
+    static int       hour = -1, mday, mon, year;
+    static time_t    start;
+    int              i, n[14];
+    struct tm        tm;
+
+    for (i = 0; i < 14; i++)
+    {
+        if (p[digit[i]] < '0' || p[digit[i]] > '9')
+            return -1;
+        n[i] = p[digit[i]] - '0';
+    }
+    tm.tm_year = n[0] * 1000 + n[1] * 100 + n[2] * 10 + n[3] - 1900;
+    tm.tm_mon  = n[4] * 10 + n[5] - 1;
+    tm.tm_mday = n[6] * 10 + n[7];
+    tm.tm_hour = n[8] * 10 + n[9];
+    tm.tm_min  = n[10] * 10 + n[11];
+    tm.tm_sec  = n[12] * 10 + n[13];
+    if (tm.tm_mon > 11 || tm.tm_mday < 1 || tm.tm_mday > 31 ||
+        tm.tm_hour > 23 || tm.tm_min > 59 || tm.tm_sec > 60)
+        return -1;
+    if (tm.tm_hour != hour || tm.tm_mday != mday || tm.tm_mon != mon || tm.tm_year != year)
+    {
+        struct tm h = tm;
+        h.tm_min    = 0;
+        h.tm_sec    = 0;
+        h.tm_isdst  = -1;
+        start = mktime(&h);
+        hour  = tm.tm_hour;
+        mday  = tm.tm_mday;
+        mon   = tm.tm_mon;
+        year  = tm.tm_year;
+    }
+    return start + tm.tm_min * 60 + tm.tm_sec;
+}
+
+/*
+ * Value up to ';' or end. Empty field is DATABASE_DOUBLE_NULL_VALUE.
+ * Returns pointer past the value, NULL if malformed.
+ */
+static const char *import_value(const char *p, const char *end, double *value)
+{
+    long long mantissa = 0;
+    double    divisor  = 1.0;
+    int       negative = 0, n_digits = 0;
+
+    while (p < end && *p == ' ')
+        p++;
+    if (p == end || *p == ';')
+    {
+        *value = DATABASE_DOUBLE_NULL_VALUE;
+        return p;
+    }
+    if (*p == '-' || *p == '+')
+        negative = *p++ == '-';
+    for (; p < end && *p >= '0' && *p <= '9'; p++, n_digits++)
+        mantissa = mantissa * 10 + (*p - '0');
+    if (p < end && (*p == ',' || *p == '.'))
+        for (p++; p < end && *p >= '0' && *p <= '9'; p++, n_digits++)
+        {
+            mantissa = mantissa * 10 + (*p - '0');
+            divisor *= 10.0;
+        }
+    while (p < end && *p == ' ')
+        p++;
+    if (!n_digits || n_digits > 15 || (p < end && *p != ';'))
+        return NULL;
+    *value = (negative ? -mantissa : mantissa) / divisor;
+    return p;
+}
+
+/*
+ * One line, without the line terminator. Returns 0 (row), 1 (header) or
+ * -1 (malformed). Zero-filled row gets NULL values and *failure is set.
+ */
+static int import_parse(const char *p, const char *end, databaserecord_t *rec, int *failure)
+{
+    double *value = &rec->down_ch1_dbmv;
+    int     i, n_zero = 0;
+
+    if (end > p && end[-1] == '\r')
+        end--;
+    if (end - p >= 8 && !strncmp(p, "datetime", 8))
+        return 1;
+    if (end - p < 20 || p[19] != ';' || (rec->timestamp = import_timestamp(p)) < 0)
+        return -1;
+    p += 20;
+    for (i = 0; i < DATABASE_LINE_COLUMNS; i++)
+    {
+        if (i && (p == end || *p++ != ';'))
+            return -1;
+        if (!(p = import_value(p, end, &value[i])))
+            return -1;
+        n_zero += value[i] == 0.0;
+    }
+    if (p != end)
+        return -1;
+    if ((*failure = n_zero == DATABASE_LINE_COLUMNS))
+        for (i = 0; i < DATABASE_LINE_COLUMNS; i++)
+            value[i] = DATABASE_DOUBLE_NULL_VALUE;
+    return 0;
+}
+
+static int import_row(sqlite3_stmt *stmt, databaserecord_t *rec, databasebounds_t *bounds)
+{
+    const double *value = &rec->down_ch1_dbmv;
+    int           i, rc;
+
+    sqlite3_bind_int64(stmt, 1, rec->timestamp);
+    for (i = 0; i < DATABASE_LINE_COLUMNS; i++)
+        if (value[i] == DATABASE_DOUBLE_NULL_VALUE)
+            sqlite3_bind_null(stmt, i + 2);
+        else
+            sqlite3_bind_int64(stmt, i + 2, lrint(value[i] * scale[i]));
+    if (bounds->valid)
+        sqlite3_bind_int(stmt, DATABASE_LINE_COLUMNS + 2, database_violations(bounds, rec));
+    else
+        sqlite3_bind_null(stmt, DATABASE_LINE_COLUMNS + 2);
+    rc = sqlite3_step(stmt);
+    sqlite3_reset(stmt);
+    return rc == SQLITE_DONE ? SQLITE_OK : rc;
+}
+
+/*
+ * Newest row with carried values (change-only storage, database.h), 0 if
+ * none. Rows imported before it may land between a stored value and the
+ * rows carrying it.
+ */
+static time_t import_carried(sqlite3 *db)
+{
+    sqlite3_stmt *stmt;
+    time_t        carried = 0;
+
+    if (sqlite3_prepare_v2(db, SQL_IMPORT_CARRIED, -1, &stmt, NULL) == SQLITE_OK)
+    {
+        if (sqlite3_step(stmt) == SQLITE_ROW)
+            carried = sqlite3_column_int64(stmt, 0);
+        sqlite3_finalize(stmt);
+    }
+    return carried;
+}
+
+/*
+ * Store the carried values of the first row after the one to be imported,
+ * so that the rows after it do not carry from the imported row instead.
+ * Statement is prepared on first use.
+ */
+static int import_materialize(sqlite3 *db, sqlite3_stmt **stmt, time_t timestamp)
+{
+    char *sql;
+    int   rc;
+
+    if (!*stmt)
+    {
+        if (!(sql = database_materializesql("main", SQL_IMPORT_MATERIALIZE)))
+            return SQLITE_NOMEM;
+        rc = sqlite3_prepare_v2(db, sql, -1, stmt, NULL);
+        sqlite3_free(sql);
+        if (rc != SQLITE_OK)
+            return rc;
+    }
+    sqlite3_bind_int64(*stmt, 1, timestamp);
+    rc = sqlite3_step(*stmt);
+    sqlite3_reset(*stmt);
+    return rc == SQLITE_DONE ? SQLITE_OK : rc;
+}
+
+/*
+ * Rollups of first ... last, over a connection of the database writer kind
+ */
+static int import_rollups(char *datafile, time_t first, time_t last)
+{
+    dbhandle_t *h;
+    int         rc;
+
+    if (!(h = database_open(datafile)))
+        return SQLITE_ERROR;
+    rc = database_rollup(h, first, last);
+    database_close(h);
+    return rc;
+}
+
+int import_csv(char *csvfile, char *datafile, import_stats_t *stats)
+{
+    import_stats_t    local;
+    databaserecord_t  rec;
+    databasebounds_t  bounds;
+    sqlite3          *db;
+    sqlite3_stmt     *stmt = NULL;
+    sqlite3_stmt     *materialize = NULL;
+    xtmr_t           *t;
+    char             *line, *eol, *end;
+    size_t            used = 0;
+    ssize_t           n;
+    time_t            first = 0, last = 0, carried = 0;
+    int               fd, rc, i, failure, skipping = 0, in_transaction = 0, eof = 0;
+
+    if (!stats)
+        stats = &local;
+    memset(stats, 0, sizeof(import_stats_t));
+    if (database_schema(datafile) != DATABASE_SCHEMA_COMPACT)
+    {
+        logmsg(LOG_ERR, "CSV import requires the compact schema (-migratedb)");
+        return (errno = ENOTSUP, EXIT_FAILURE);
+    }
+    if ((fd = open(csvfile, O_RDONLY)) < 0)
+    {
+        logerr("Unable to open \"%s\"", csvfile);
+        return EXIT_FAILURE;
+    }
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+    database_loadbounds(datafile, &bounds);             // database.c
+    for (i = 0; i < DATABASE_PING_COLUMNS; i++)
+        (&rec.modemping_ms)[i] = DATABASE_DOUBLE_NULL_VALUE;
+    if ((rc = sqlite3_open(datafile, &db)) != SQLITE_OK)
+    {
+        logerr("Can't open database (\"%s\"): %s", datafile, sqlite3_errmsg(db));
+        sqlite3_close(db);
+        close(fd);
+        return EXIT_FAILURE;
+    }
+    sqlite3_busy_timeout(db, DATABASE_SQLITE3_BUSY_TIMEOUT);
+    t  = xtmr();
+    // Index is built once, after the rows
+    rc = sqlite3_exec(db, "DROP INDEX IF EXISTS samples_violations", NULL, NULL, NULL);
+    if (rc == SQLITE_OK)
+        rc = sqlite3_prepare_v2(db, SQL_IMPORT_SAMPLES, -1, &stmt, NULL);
+
+    while (rc == SQLITE_OK && !eof)
+    {
+        if ((n = read(fd, buffer + used, sizeof(buffer) - used)) <= 0)
+        {
+            /*
+             * Last line without a line terminator is parsed as if it had
+             * one, it is torn only if it does not parse. (used is less
+             * than IMPORT_MAXLINE, there is room for the terminator.)
+             */
+            if (n < 0 || !used || skipping)
+                break;
+            buffer[used] = '\n';
+            n   = 1;
+            eof = 1;
+        }
+        used += n;
+        line  = buffer;
+        end   = buffer + used;
+        while (rc == SQLITE_OK && (eol = memchr(line, '\n', end - line)))
+        {
+            if (skipping)
+                skipping = 0;
+            else
+            {
+                stats->n_lines++;
+                switch (import_parse(line, eol, &rec, &failure))
+                {
+                    case 0:
+                        stats->n_rows++;
+                        stats->n_failures += failure;
+                        if (!in_transaction)
+                        {
+                            if ((rc = sqlite3_exec(db, "BEGIN IMMEDIATE", NULL, NULL, NULL)) != SQLITE_OK)
+                                break;
+                            in_transaction = 1;
+                            // Writer may have added rows in between
+                            carried = import_carried(db);
+                        }
+                        if (rec.timestamp < carried &&
+                            (rc = import_materialize(db, &materialize, rec.timestamp)) != SQLITE_OK)
+                            break;
+                        if ((rc = import_row(stmt, &rec, &bounds)) != SQLITE_OK)
+                            break;
+                        if (sqlite3_changes(db))
+                        {
+                            stats->n_imported++;
+                            if (!first || rec.timestamp < first)
+                                first = rec.timestamp;
+                            if (rec.timestamp > last)
+                                last = rec.timestamp;
+                        }
+                        else
+                            stats->n_duplicates++;
+                        if (!(stats->n_rows % IMPORT_TRANSACTION))
+                        {
+                            rc = sqlite3_exec(db, "COMMIT", NULL, NULL, NULL);
+                            in_transaction = 0;
+                        }
+                        break;
+                    case -1:
+                        stats->n_malformed++;
+                        break;
+                }
+            }
+            line = eol + 1;
+        }
+        // Partial line to the front of the buffer, for the next read
+        used = end - line;
+        if (used >= IMPORT_MAXLINE)
+        {
+            // Line without end, skip it up to the next line terminator
+            stats->n_lines     += !skipping;
+            stats->n_malformed += !skipping;
+            skipping = 1;
+            used     = 0;
+        }
+        else if (used)
+            memmove(buffer, line, used);
+    }
+    // Read failed, partial line
+    if (rc == SQLITE_OK && n < 0)
+    {
+        logerr("Unable to read \"%s\"", csvfile);
+        stats->n_lines     += used && !skipping;
+        stats->n_malformed += used && !skipping;
+    }
+    if (in_transaction)
+        sqlite3_exec(db, rc == SQLITE_OK ? "COMMIT" : "ROLLBACK", NULL, NULL, NULL);
+    if (rc != SQLITE_OK)
+        logerr("CSV import into \"%s\" failed: %s", datafile, sqlite3_errmsg(db));
+    sqlite3_finalize(stmt);
+    sqlite3_finalize(materialize);
+    if (sqlite3_exec(db, SQL_CREATE_INDEX_SAMPLES_VIOLATIONS, NULL, NULL, NULL) != SQLITE_OK)
+    {
+        logerr("Unable to create index samples_violations: %s", sqlite3_errmsg(db));
+        rc = SQLITE_ERROR;
+    }
+    sqlite3_close(db);
+    close(fd);
+    if (rc == SQLITE_OK && stats->n_imported && (rc = import_rollups(datafile, first, last)) != SQLITE_OK)
+        logerr("Rollups of the imported rows failed");
+    stats->ms = xtmrlap(t);
+    free(t);
+    logmsg(
+          LOG_INFO,
+          "CSV import: %lld rows (%lld zero-filled), %lld imported, %lld duplicates, "
+          "%lld malformed lines in %.2f s, %.0f rows/s",
+          stats->n_rows,
+          stats->n_failures,
+          stats->n_imported,
+          stats->n_duplicates,
+          stats->n_malformed,
+          stats->ms / 1000.0,
+          stats->ms > 0.0 ? stats->n_rows * 1000.0 / stats->ms : 0.0
+          );
+    if (rc != SQLITE_OK)
+        return EXIT_FAILURE;
+    errno = 0;
+    return EXIT_SUCCESS;
+}
+
+/* EOF import.c */
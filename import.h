@@ -0,0 +1,59 @@
+/*
+ * import.h - 2016 Jani Tammi <janitammi@gmail.com>
+ *
+ *      Import of the history of bin/cisco_docsis_logger (-importcsv=<file>).
+ *
+ *      Before icmond, the logger script appended the line data into
+ *      /var/log/cisco.csv every 10 seconds:
+ *
+ *          datetime;DnCh1 dBmV;DnCh1 dB;...;UpCh4 dBmV\r\n        (header)
+ *          2016.09.04 12:00:00;-3,5;37,6;...;42,0\n
+ *
+ *      Local time, ';' delimiters and comma decimals, the 20 line values in
+ *      databaserecord_t order. When the modem did not answer, every value
+ *      was written as "0,0"; these rows are imported with NULL values, as
+ *      is a field the script did not find (empty). Lines that do not parse
+ *      (a write cut by a power loss) are skipped and counted.
+ *
+ *      File is read in IMPORT_BUFFER blocks and each line is parsed in
+ *      place, in one pass, without allocations. Rows go straight into the
+ *      samples table (compact schema only) in transactions of
+ *      IMPORT_TRANSACTION rows. Timestamps that the datafile already has
+ *      are skipped (INSERT OR IGNORE), so an import can be repeated. Row
+ *      imported before rows with carried values (change-only storage)
+ *      first materializes the row after it. The samples_violations index
+ *      is dropped for the import and created again after it; rollups of
+ *      the imported range are recomputed last.
+ *
+ *      Rows are imported into the base datafile, also when partitions are
+ *      in use. Export (export.c) scans the base datafile, then the
+ *      partitions; partition retention never removes the base datafile.
+ */
+#ifndef __IMPORT_H__
+#define __IMPORT_H__
+
+#define IMPORT_BUFFER               (1 << 20)   // bytes, read block
+#define IMPORT_MAXLINE              1024        // bytes, longer lines are malformed
+#define IMPORT_TRANSACTION          50000       // rows per transaction
+
+typedef struct
+{
+    long long   n_lines;
+    long long   n_rows;                         // parsed
+    long long   n_imported;
+    long long   n_duplicates;                   // timestamp already in the datafile
+    long long   n_failures;                     // zero-filled rows (NULL values)
+    long long   n_malformed;                    // skipped
+    double      ms;
+} import_stats_t;
+
+/*
+ *  import_csv()    Import csvfile into datafile. Statistics (may be NULL)
+ *                  are filled also on failure. Returns EXIT_SUCCESS or
+ *                  EXIT_FAILURE (errno ENOTSUP: legacy schema).
+ */
+int import_csv(char *csvfile, char *datafile, import_stats_t *stats);
+
+#endif /* __IMPORT_H__ */
+
+/* EOF import.h */
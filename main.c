@@ -31,6 +31,11 @@
 #include "version.h"
 #include "util.h"
 #include "tmpfs.h"
+#include "samplelog.h"
+#include "benchmark.h"
+#include "export.h"
+#include "import.h"
+#include "dbwriter.h"
 
 static pid_t daemon_pid;
 
@@ -331,46 +336,52 @@ static void daemonize(int run_as_daemon)
 #define NUM_SQLITE3_INSERT_TESTS    4
 static int predaemon_initialize()
 {
+    // Database files created by earlier versions lack the newer tables and views
+    if (database_upgrade(cfg.database.filename))    // database.c
+    {
+        logerr("Failed to upgrade database!");
+        return EXIT_FAILURE;
+    }
+    if (database_foreachpartition(database_upgrade))  // database.c
+    {
+        logerr("Failed to upgrade partition datafiles!");
+        return EXIT_FAILURE;
+    }
+
+    // Spool replaces the tmpfs, no need to test or mount
+    if (cfg.database.spool[0] && cfg.execute.tmpfs != FALSE)
+    {
+        logmsg(LOG_INFO, "Spool \"%s\" in use, ramdisk (tmpfs) will not be created", cfg.database.spool);
+        cfg.execute.tmpfs = FALSE;
+    }
     // Test if so configured
     if (cfg.execute.tmpfs == AUTO)
     {
-        dbperf_t *dbperf;   // Pointer to static struct in function - do not free!
-        if (!(dbperf = database_testwriteperf(NUM_SQLITE3_INSERT_TESTS)))   // database.c
-        {
-            logerr("SQLite3 write performance test failed!");
-            return EXIT_FAILURE;
-        }
-        // check 
-        if (dbperf->mean > CFG_MAX_INSERT_DELAY_MEAN ||
-            dbperf->max  > CFG_MAX_INSERT_DELAY_MAX)
+        dbwriter_profile_t profile;
+        char               profilefile[CFG_MAX_FILENAME_LEN + sizeof(DAEMON_PROFILE_SUFFIX)];
+
+        sprintf(profilefile, "%s" DAEMON_PROFILE_SUFFIX, cfg.database.filename);
+        // Learned by the database writer, no test inserts into the datafile
+        if (!dbwriter_loadprofile(profilefile, &profile))  // dbwriter.c
         {
             logmsg(
                   LOG_INFO,
-                  "SQLite3 database write performance is below accepted!"
-                  );
-            logmsg(
-                  LOG_INFO,
-                  "Required values: mean < %5.2f ms, max < %5.2f ms",
-                  CFG_MAX_INSERT_DELAY_MEAN,
-                  CFG_MAX_INSERT_DELAY_MAX
-                  );
-            logmsg(
-                  LOG_INFO,
-                  "Results: (n=%d) Min %5.2f ms Mean %5.2f ms Max %5.2f ms StdDev %4.2f",
-                  dbperf->n,
-                  dbperf->min,
-                  dbperf->mean,
-                  dbperf->max,
-                  dbperf->stddev
+                  "Insert latency profile \"%s\": %s, mean %5.2f ms, max %5.2f ms",
+                  profilefile,
+                  DBWRITER_MODE_NAME(profile.mode),
+                  profile.mean,
+                  profile.max
                   );
-            logmsg(
-                  LOG_INFO,
-                  "Ramdisk (tmpfs) will be created"
-                  );
-            cfg.execute.tmpfs = TRUE;
         }
         else
         {
+            dbperf_t *dbperf;   // Pointer to static struct in function - do not free!
+            // Daemon writes over a persistent connection
+            if (!(dbperf = database_testwriteperf(NUM_SQLITE3_INSERT_TESTS, TRUE)))   // database.c
+            {
+                logerr("SQLite3 write performance test failed!");
+                return EXIT_FAILURE;
+            }
             logmsg(
                   LOG_INFO,
                   "Results: (n=%d) Min %5.2f ms Mean %5.2f ms Max %5.2f ms StdDev %4.2f",
@@ -380,8 +391,70 @@ static int predaemon_initialize()
                   dbperf->max,
                   dbperf->stddev
                   );
-            logdev("SQLite3 write performance figures OK");
+            // check
+            if (dbperf->mean > CFG_MAX_INSERT_DELAY_MEAN ||
+                dbperf->max  > CFG_MAX_INSERT_DELAY_MAX)
+            {
+                logmsg(
+                      LOG_INFO,
+                      "SQLite3 database write performance is below accepted!"
+                      );
+                logmsg(
+                      LOG_INFO,
+                      "Required values: mean < %5.2f ms, max < %5.2f ms",
+                      (double)CFG_MAX_INSERT_DELAY_MEAN,
+                      (double)CFG_MAX_INSERT_DELAY_MAX
+                      );
+                profile.mode = DBWRITER_MODE_SPOOL;
+            }
+            else
+            {
+                logdev("SQLite3 write performance figures OK");
+                profile.mode = DBWRITER_MODE_DIRECT;
+            }
+            profile.mean    = dbperf->mean;
+            profile.max     = dbperf->max;
+            profile.updated = time(NULL);
+            // Writer (daemon user) updates it
+            if (user_set_eugid(DAEMON_RUN_AS_USER) == EXIT_SUCCESS)    // user.c
+            {
+                dbwriter_saveprofile(profilefile, &profile);           // dbwriter.c
+                user_restore_eugid();
+            }
+        }
+        if (profile.mode == DBWRITER_MODE_SPOOL)
+        {
+            // Spool next to the datafile. Survives a power cut and needs no mount().
+            if (snprintf(
+                        cfg.database.spool,
+                        sizeof(cfg.database.spool),
+                        "%s" DAEMON_SPOOL_SUFFIX,
+                        cfg.database.filename
+                        ) < (int)sizeof(cfg.database.spool))
+            {
+                logmsg(
+                      LOG_INFO,
+                      "Spool \"%s\" will be used",
+                      cfg.database.spool
+                      );
+                cfg.execute.tmpfs = FALSE;
+            }
+            else
+            {
+                // Truncated, not in use
+                cfg.database.spool[0] = '\0';
+                logmsg(
+                      LOG_INFO,
+                      "Ramdisk (tmpfs) will be created"
+                      );
+                cfg.execute.tmpfs = TRUE;
+            }
+        }
+        else
+        {
+            // Writer switches between direct and batched commits as it goes
             cfg.execute.tmpfs = FALSE;
+            dbwriter_adapt(profilefile, profile.mode);      // dbwriter.c
         }
         errno = 0;
     }
@@ -437,14 +510,17 @@ static int predaemon_initialize()
 /***************************************************************************************
  * SPECIAL COMMAND : Test SQLite3 database write performance
  *
- *  Executes repeated INSERTs and measures time it takes.
+ *  Sweeps the datafile settings (benchmark.h) with nsamples rows each, against
+ *  scratch files next to the datafile (same volume). Table and recommendation
+ *  are logged, JSON is printed to stdout.
  */
 static int cmd_testdbperf(int nsamples)
 {
     double    time_elapsed;
-    dbperf_t *dbperf;
+    char      scratch[CFG_MAX_FILENAME_LEN + 8];
+    char      spoolfile[CFG_MAX_FILENAME_LEN + sizeof(DAEMON_SPOOL_SUFFIX) + 8];
 
-    if (nsamples < 0)
+    if (nsamples < 1)
         return (errno = EINVAL, EXIT_FAILURE);
 
     logmsg(LOG_ERR, "Testing SQLite3 write performance... Please wait.");
@@ -454,27 +530,15 @@ static int cmd_testdbperf(int nsamples)
      */
     xtmr_t *t = xtmr();     // util.c
 
-    /*
-     * Database file does not exist (anymore)
-     * Hand processing over to database.c:db_initialize()
-     */
-    if (!(dbperf = database_testwriteperf(nsamples)))
+    snprintf(scratch, sizeof(scratch), "%s.test", cfg.database.filename);
+    sprintf(spoolfile, "%s" DAEMON_SPOOL_SUFFIX ".test", cfg.database.filename);
+    if (benchmark_run(scratch, spoolfile, nsamples, stdout))   // benchmark.c
+    {
+        free(t);
         return EXIT_FAILURE;
+    }
 
     time_elapsed = xtmrlap(t);
-
-    /*
-     * Report
-     */
-    logmsg(
-          LOG_ERR,
-          "Results: (n=%d) Min %5.2f ms Mean %5.2f ms Max %5.2f ms StdDev %4.2f",
-          dbperf->n,
-          dbperf->min,
-          dbperf->mean,
-          dbperf->max,
-          dbperf->stddev
-          );
     logmsg(
           LOG_INFO,
           "Database write performance executed in %.2f seconds.",
@@ -581,6 +645,188 @@ static int cmd_initdb(char *filename)
     return (errno = 0, EXIT_SUCCESS);
 }
 
+/***************************************************************************************
+ * SPECIAL COMMAND : Migrate database into the compact schema
+ *
+ *  Intended use case: Database was created by an earlier version (REAL columns).
+ *  Superuser stops the daemon and gives the commandline directive. Data is
+ *  converted in one transaction and the file is vacuumed.
+ */
+static int cmd_migratedb(char *filename)
+{
+    struct stat st;
+    off_t       size;
+
+    if (stat(filename, &st))
+    {
+        logmsg(LOG_ERR, "Database file (\"%s\") does not exist!", filename);
+        return EXIT_FAILURE;
+    }
+    size = st.st_size;
+    xtmr_t *t = xtmr();     // util.c
+    if (user_set_eugid(DAEMON_RUN_AS_USER) == EXIT_FAILURE)
+    {
+        int savederrno = errno;
+        logmsg(LOG_ERR, "Unable to assume effective UID of \"%s\"!", DAEMON_RUN_AS_USER);
+        free(t);
+        return (errno = savederrno, EXIT_FAILURE);
+    }
+    if (database_migrate(filename))         // database.c
+    {
+        user_restore_eugid();
+        free(t);
+        return EXIT_FAILURE;
+    }
+    if (user_restore_eugid())               // user.c
+    {
+        free(t);
+        return EXIT_FAILURE;
+    }
+    stat(filename, &st);
+    logmsg(
+          LOG_INFO,
+          "Database migrated in %.2f seconds. Size %lld -> %lld bytes.\n",
+          xtmrlap(t) / 1000,
+          (long long)size,
+          (long long)st.st_size
+          );
+    free(t);
+    return (errno = 0, EXIT_SUCCESS);
+}
+
+/***************************************************************************************
+ * SPECIAL COMMAND : Rebuild rollup tables
+ *
+ *  Rollups are maintained by the daemon. This recomputes them from the
+ *  samples of the datafile and each partition datafile, and reports how
+ *  many buckets differed from the maintained ones (should be none).
+ */
+static int cmd_rebuildrollups()
+{
+    int rc;
+
+    if (access(cfg.database.filename, F_OK))
+    {
+        logmsg(LOG_ERR, "Database file (\"%s\") does not exist!", cfg.database.filename);
+        return EXIT_FAILURE;
+    }
+    xtmr_t *t = xtmr();     // util.c
+    if (user_set_eugid(DAEMON_RUN_AS_USER) == EXIT_FAILURE)
+    {
+        int savederrno = errno;
+        logmsg(LOG_ERR, "Unable to assume effective UID of \"%s\"!", DAEMON_RUN_AS_USER);
+        free(t);
+        return (errno = savederrno, EXIT_FAILURE);
+    }
+    rc = database_rebuildrollups(cfg.database.filename);                // database.c
+    rc = database_foreachpartition(database_rebuildrollups) || rc;     // database.c
+    if (user_restore_eugid())               // user.c
+        rc = EXIT_FAILURE;
+    logmsg(LOG_INFO, "Rollups rebuilt in %.2f seconds.\n", xtmrlap(t) / 1000);
+    free(t);
+    return rc ? EXIT_FAILURE : (errno = 0, EXIT_SUCCESS);
+}
+
+/***************************************************************************************
+ * SPECIAL COMMAND : Export sample log into the database
+ *
+ *  Samples in the sample log (cfg.database.samplelog) are written into the
+ *  datafile, which is created if it does not exist. Rollups are built for the
+ *  exported rows.
+ */
+static int cmd_exportsqlite()
+{
+    int rc;
+
+    if (!cfg.database.samplelog[0])
+    {
+        logmsg(LOG_ERR, "Sample log (\"samplelog\") is not configured!");
+        return (errno = EINVAL, EXIT_FAILURE);
+    }
+    if (access(cfg.database.samplelog, F_OK))
+    {
+        logmsg(LOG_ERR, "Sample log (\"%s\") does not exist!", cfg.database.samplelog);
+        return EXIT_FAILURE;
+    }
+    if (user_set_eugid(DAEMON_RUN_AS_USER) == EXIT_FAILURE)
+    {
+        int savederrno = errno;
+        logmsg(LOG_ERR, "Unable to assume effective UID of \"%s\"!", DAEMON_RUN_AS_USER);
+        return (errno = savederrno, EXIT_FAILURE);
+    }
+    rc = samplelog_export(cfg.database.samplelog, cfg.database.filename);  // samplelog.c
+    if (user_restore_eugid())               // user.c
+        rc = EXIT_FAILURE;
+    return rc ? EXIT_FAILURE : (errno = 0, EXIT_SUCCESS);
+}
+
+/***************************************************************************************
+ * SPECIAL COMMAND : Export a range of samples
+ *
+ *  Samples of cfg.cmd.exportfrom ... exportto are written into stdout, as
+ *  CSV, JSON lines or binary records (export.h). Execution messages go into
+ *  stderr, stdout can be redirected into a file or a pipe.
+ */
+static int cmd_export()
+{
+    long long n;
+
+    if (!cfg.database.samplelog[0] && access(cfg.database.filename, F_OK))
+    {
+        logmsg(LOG_ERR, "Database file (\"%s\") does not exist!", cfg.database.filename);
+        return EXIT_FAILURE;
+    }
+    if (user_set_eugid(DAEMON_RUN_AS_USER) == EXIT_FAILURE)
+    {
+        int savederrno = errno;
+        logmsg(LOG_ERR, "Unable to assume effective UID of \"%s\"!", DAEMON_RUN_AS_USER);
+        return (errno = savederrno, EXIT_FAILURE);
+    }
+    n = export_run(                                         // export.c
+                  cfg.cmd.exportfrom,
+                  cfg.cmd.exportto,
+                  cfg.cmd.exportformat,
+                  cfg.cmd.exportstep,
+                  stdout
+                  );
+    if (user_restore_eugid())               // user.c
+        n = -1;
+    return n < 0 ? EXIT_FAILURE : (errno = 0, EXIT_SUCCESS);
+}
+
+/***************************************************************************************
+ * SPECIAL COMMAND : Import cisco_docsis_logger CSV history
+ *
+ *  Rows of the CSV (cfg.cmd.importcsv) are written into the datafile, which
+ *  must use the compact schema. Timestamps already in the datafile are not
+ *  replaced, so the import can be repeated as the CSV grows.
+ */
+static int cmd_importcsv()
+{
+    int rc;
+
+    if (access(cfg.database.filename, F_OK))
+    {
+        logmsg(LOG_ERR, "Database file (\"%s\") does not exist!", cfg.database.filename);
+        return EXIT_FAILURE;
+    }
+    if (access(cfg.cmd.importcsv, R_OK))
+    {
+        logmsg(LOG_ERR, "CSV file (\"%s\") is not readable!", cfg.cmd.importcsv);
+        return EXIT_FAILURE;
+    }
+    if (user_set_eugid(DAEMON_RUN_AS_USER) == EXIT_FAILURE)
+    {
+        int savederrno = errno;
+        logmsg(LOG_ERR, "Unable to assume effective UID of \"%s\"!", DAEMON_RUN_AS_USER);
+        return (errno = savederrno, EXIT_FAILURE);
+    }
+    rc = import_csv(cfg.cmd.importcsv, cfg.database.filename, NULL);   // import.c
+    if (user_restore_eugid())               // user.c
+        rc = EXIT_FAILURE;
+    return rc ? EXIT_FAILURE : (errno = 0, EXIT_SUCCESS);
+}
+
 /***************************************************************************************
  * SPECIAL COMMAND : Write configuration file
  *
@@ -805,12 +1051,82 @@ int main(int argc, char **argv)
         }
     }
 
+    /*
+****** SPECIAL COMMAND: MIGRATE DATABASE INTO COMPACT SCHEMA
+     *
+     */
+    if (cfg.cmd.migratedatabase)
+    {
+        if (cmd_migratedb(cfg.database.filename))
+        {
+            logmsg(LOG_ERR, "Database migration failed! Existing database left untouched.");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    /*
+****** SPECIAL COMMAND: REBUILD ROLLUP TABLES
+     *
+     */
+    if (cfg.cmd.rebuildrollups)
+    {
+        if (cmd_rebuildrollups())
+        {
+            logmsg(LOG_ERR, "Rollup rebuild failed!");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    /*
+****** SPECIAL COMMAND: EXPORT SAMPLE LOG INTO THE DATABASE
+     *
+     */
+    if (cfg.cmd.exportsqlite)
+    {
+        if (cmd_exportsqlite())
+        {
+            logmsg(LOG_ERR, "Sample log export failed!");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    /*
+****** SPECIAL COMMAND: EXPORT A RANGE OF SAMPLES
+     *
+     */
+    if (cfg.cmd.export)
+    {
+        if (cmd_export())
+        {
+            logmsg(LOG_ERR, "Export failed!");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    /*
+****** SPECIAL COMMAND: IMPORT CISCO_DOCSIS_LOGGER CSV HISTORY
+     *
+     */
+    if (cfg.cmd.importcsv[0])
+    {
+        if (cmd_importcsv())
+        {
+            logmsg(LOG_ERR, "CSV import failed!");
+            exit(EXIT_FAILURE);
+        }
+    }
+
     /*
      * Exit if any special commands were executed
      */
     if (cfg.cmd.createdatabase ||
         cfg.cmd.createconfigfile ||
-        cfg.cmd.testdbwriteperf)
+        cfg.cmd.testdbwriteperf ||
+        cfg.cmd.migratedatabase ||
+        cfg.cmd.rebuildrollups ||
+        cfg.cmd.exportsqlite ||
+        cfg.cmd.export ||
+        cfg.cmd.importcsv[0])
     {
         logdev("Commands executed successfully. Exiting...");
         return EXIT_SUCCESS;
@@ -831,12 +1147,14 @@ int main(int argc, char **argv)
     /*
      * Perform small test on SQLite3 write performance.
      * If the results are bad;
-     *      1. Mount small tmpfs ("ramdisk").
-     *      2. Create an event to periodically move
-     *         the accumulated data to real database.
-     *      3. Reconfigure this daemon so that datalogger
-     *         processes write into the tmpfs instead.
-     *      4. Commit schedule into use.
+     *      1. Use a spool next to the datafile (spool.h),
+     *         which the database writer drains into the
+     *         datafile in large transactions.
+     *      2. Or, if so configured (ramdisk = TRUE), mount
+     *         small tmpfs ("ramdisk"), create an event to
+     *         periodically move the accumulated data to real
+     *         database and reconfigure this daemon so that
+     *         datalogger processes write into the tmpfs.
      */
     if (predaemon_initialize())
     {
@@ -0,0 +1,1206 @@
+/*
+ * samplelog.c - 2016 Jani Tammi <janitammi@gmail.com>
+ *
+ *      Append-only columnar sample log. See samplelog.h.
+ *
+ *      File layout
+ *
+ *          samplelog_header_t
+ *          samplelog_segment_t, streams, samplelog_footer_t
+ *          samplelog_segment_t, streams, samplelog_footer_t
+ *          ...
+ *
+ *      Streams are bitstreams (most significant bit first), one for
+ *      timestamps, one for NULL masks and one per value column. Segment
+ *      header has their lengths in bytes. Each segment is decoded on its
+ *      own; codec state starts from zero.
+ */
+#include <stdio.h>
+#include <stdlib.h>             // EXIT_SUCCESS, EXIT_FAILURE
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>             // pread(), pwrite(), fdatasync(), ftruncate()
+#include <fcntl.h>              // open()
+#include <math.h>               // round()
+#include <errno.h>
+#include <sys/stat.h>           // fstat()
+#include <sys/mman.h>           // mmap(), munmap()
+
+#include "samplelog.h"
+#include "logwrite.h"
+#include "util.h"               // xtmr(), crc32()
+
+#define SAMPLELOG_MAGIC         "ICMONDSL"
+#define SAMPLELOG_VERSION       1
+#define SAMPLELOG_SEGMENTMAGIC  0x47455353      // "SSEG"
+#define SAMPLELOG_FOOTERMAGIC   0x544F4F46      // "FOOT"
+#define SAMPLELOG_TAILMAGIC     0x4C494154      // "TAIL"
+#define SAMPLELOG_TAILSUFFIX    ".tail"
+#define SAMPLELOG_NEWSUFFIX     ".tail.new"
+#define SAMPLELOG_STREAMS       (SAMPLELOG_COLUMNS + 2)
+#define STREAM_TIMESTAMP        0
+#define STREAM_MASK             1
+#define STREAM_VALUE            2               // first value column
+
+_Static_assert(
+              sizeof(databaserecord_t) == sizeof(time_t) + SAMPLELOG_COLUMNS * sizeof(double),
+              "SAMPLELOG_COLUMNS does not match databaserecord_t"
+              );
+
+typedef struct
+{
+    char            magic[8];
+    uint32_t        version;
+    uint32_t        columns;
+} samplelog_header_t;
+
+typedef struct
+{
+    uint32_t        magic;
+    uint32_t        n_rows;
+    int64_t         first;                      // oldest timestamp
+    int64_t         last;                       // newest timestamp
+    uint32_t        length[SAMPLELOG_STREAMS];  // bytes
+} samplelog_segment_t;
+
+typedef struct
+{
+    uint32_t        magic;
+    uint32_t        generation;
+    int64_t         first;
+    int64_t         last;
+    uint64_t        offset;                     // samplelog_segment_t
+    uint32_t        size;                       // segment header + streams
+    uint32_t        crc;                        // CRC-32 of the above
+} samplelog_footer_t;
+
+typedef struct
+{
+    uint32_t        magic;
+    uint32_t        generation;                 // footer generation it follows
+} samplelog_tailheader_t;
+
+typedef struct
+{
+    uint32_t        crc;                        // CRC-32 of record
+    uint32_t        reserved;
+    databaserecord_t record;
+} samplelog_tailrecord_t;
+
+/*
+ * Quantization (resolution of the compact schema, database.h)
+ */
+static const double samplelog_scale[SAMPLELOG_COLUMNS] =
+{
+    DATABASE_VALUES(DATABASE_X_SCALE)
+};
+
+// Values of databaserecord_t are consecutive doubles (see above)
+#define COLUMNS(rec)        (&(rec)->modemping_ms)
+
+/*
+ * Bitstreams
+ */
+typedef struct
+{
+    uint8_t        *buf;
+    size_t          size;                       // allocated bytes
+    uint64_t        nbits;
+} bitwriter_t;
+
+typedef struct
+{
+    const uint8_t  *buf;
+    uint64_t        nbits;
+    uint64_t        pos;
+    int             overrun;
+} bitreader_t;
+
+static int bitwriter_put(bitwriter_t *bw, uint64_t value, int n)
+{
+    int used, take;
+
+    if ((bw->nbits + n + 7) / 8 > bw->size)
+    {
+        size_t   size = bw->size ? bw->size * 2 : 256;
+        uint8_t *buf;
+        if (!(buf = realloc(bw->buf, size)))
+            return (errno = ENOMEM, EXIT_FAILURE);
+        memset(buf + bw->size, 0, size - bw->size);
+        bw->buf  = buf;
+        bw->size = size;
+    }
+    while (n > 0)
+    {
+        used = bw->nbits & 7;
+        take = n < 8 - used ? n : 8 - used;
+        bw->buf[bw->nbits >> 3] |= ((value >> (n - take)) & ((1 << take) - 1)) << (8 - used - take);
+        bw->nbits += take;
+        n         -= take;
+    }
+    return EXIT_SUCCESS;
+}
+
+static uint64_t bitreader_get(bitreader_t *br, int n)
+{
+    uint64_t value = 0;
+    int      used, take;
+
+    if (br->pos + n > br->nbits)
+    {
+        br->overrun = true;
+        return 0;
+    }
+    while (n > 0)
+    {
+        used  = br->pos & 7;
+        take  = n < 8 - used ? n : 8 - used;
+        value = (value << take) | ((br->buf[br->pos >> 3] >> (8 - used - take)) & ((1 << take) - 1));
+        br->pos += take;
+        n       -= take;
+    }
+    return value;
+}
+
+static int64_t signextend(uint64_t value, int n)
+{
+    return (int64_t)(value << (64 - n)) >> (64 - n);
+}
+
+/*
+ * Codec state (shared by encoder and decoder)
+ */
+typedef struct
+{
+    int64_t         timestamp;
+    int64_t         delta;
+    uint32_t        mask;                       // previous two distinct masks
+    uint32_t        mask2;
+    struct
+    {
+        uint64_t    bits;
+        int         lead;                       // -1 == no window yet
+        int         trail;
+        int         n;
+    } value[SAMPLELOG_COLUMNS];
+} codec_t;
+
+static void codec_reset(codec_t *c)
+{
+    int i;
+    memset(c, 0, sizeof(codec_t));
+    for (i = 0; i < SAMPLELOG_COLUMNS; i++)
+        c->value[i].lead = -1;
+}
+
+/*
+ * Delta-of-delta: '0' same delta, '10' 7 bits, '110' 9 bits,
+ * '1110' 12 bits, '1111' 64 bits (two's complement).
+ */
+static int encode_timestamp(codec_t *c, bitwriter_t *bw, int64_t timestamp, int first)
+{
+    int64_t dod;
+    int     rc;
+
+    if (first)
+        rc = bitwriter_put(bw, (uint64_t)timestamp, 64);
+    else
+    {
+        dod = (timestamp - c->timestamp) - c->delta;
+        if (dod == 0)
+            rc = bitwriter_put(bw, 0, 1);
+        else if (dod >= -64 && dod <= 63)
+            rc = bitwriter_put(bw, 0x2, 2) || bitwriter_put(bw, dod & 0x7F, 7);
+        else if (dod >= -256 && dod <= 255)
+            rc = bitwriter_put(bw, 0x6, 3) || bitwriter_put(bw, dod & 0x1FF, 9);
+        else if (dod >= -2048 && dod <= 2047)
+            rc = bitwriter_put(bw, 0xE, 4) || bitwriter_put(bw, dod & 0xFFF, 12);
+        else
+            rc = bitwriter_put(bw, 0xF, 4) || bitwriter_put(bw, (uint64_t)dod, 64);
+        c->delta = timestamp - c->timestamp;
+    }
+    c->timestamp = timestamp;
+    return rc;
+}
+
+static int64_t decode_timestamp(codec_t *c, bitreader_t *br, int first)
+{
+    int64_t dod;
+
+    if (first)
+        c->timestamp = (int64_t)bitreader_get(br, 64);
+    else
+    {
+        if (!bitreader_get(br, 1))
+            dod = 0;
+        else if (!bitreader_get(br, 1))
+            dod = signextend(bitreader_get(br, 7), 7);
+        else if (!bitreader_get(br, 1))
+            dod = signextend(bitreader_get(br, 9), 9);
+        else if (!bitreader_get(br, 1))
+            dod = signextend(bitreader_get(br, 12), 12);
+        else
+            dod = (int64_t)bitreader_get(br, 64);
+        c->delta     += dod;
+        c->timestamp += c->delta;
+    }
+    return c->timestamp;
+}
+
+/*
+ * NULL mask: '0' same as previous, '10' same as the one before it
+ * (alternating ping and line data rows), '11' + mask.
+ */
+static int encode_mask(codec_t *c, bitwriter_t *bw, uint32_t mask)
+{
+    int rc;
+
+    if (mask == c->mask)
+        return bitwriter_put(bw, 0, 1);
+    if (mask == c->mask2)
+        rc = bitwriter_put(bw, 0x2, 2);
+    else
+        rc = bitwriter_put(bw, 0x3, 2) || bitwriter_put(bw, mask, SAMPLELOG_COLUMNS);
+    c->mask2 = c->mask;
+    c->mask  = mask;
+    return rc;
+}
+
+static uint32_t decode_mask(codec_t *c, bitreader_t *br)
+{
+    uint32_t mask;
+
+    if (!bitreader_get(br, 1))
+        return c->mask;
+    if (!bitreader_get(br, 1))
+        mask = c->mask2;
+    else
+        mask = bitreader_get(br, SAMPLELOG_COLUMNS);
+    c->mask2 = c->mask;
+    c->mask  = mask;
+    return mask;
+}
+
+/*
+ * Values: first value as is, then XOR against the previous value.
+ * '0' same value, '10' meaningful bits fit the previous window,
+ * '11' + 5 bits leading zeros + 6 bits length + meaningful bits.
+ */
+static int encode_value(codec_t *c, bitwriter_t *bw, int i, double value)
+{
+    uint64_t bits, xor;
+    int      lead, trail, n, rc;
+
+    memcpy(&bits, &value, sizeof(bits));
+    if (!c->value[i].n++)
+        rc = bitwriter_put(bw, bits, 64);
+    else if (!(xor = bits ^ c->value[i].bits))
+        rc = bitwriter_put(bw, 0, 1);
+    else
+    {
+        lead  = __builtin_clzll(xor);
+        lead  = lead > 31 ? 31 : lead;
+        trail = __builtin_ctzll(xor);
+        if (c->value[i].lead >= 0 && lead >= c->value[i].lead && trail >= c->value[i].trail)
+        {
+            n  = 64 - c->value[i].lead - c->value[i].trail;
+            rc = bitwriter_put(bw, 0x2, 2) || bitwriter_put(bw, xor >> c->value[i].trail, n);
+        }
+        else
+        {
+            n  = 64 - lead - trail;
+            rc = bitwriter_put(bw, 0x3, 2) || bitwriter_put(bw, lead, 5) ||
+                 bitwriter_put(bw, n & 0x3F, 6) || bitwriter_put(bw, xor >> trail, n);
+            c->value[i].lead  = lead;
+            c->value[i].trail = trail;
+        }
+    }
+    c->value[i].bits = bits;
+    return rc;
+}
+
+static double decode_value(codec_t *c, bitreader_t *br, int i)
+{
+    double value;
+    int    n;
+
+    if (!c->value[i].n++)
+        c->value[i].bits = bitreader_get(br, 64);
+    else if (bitreader_get(br, 1))
+    {
+        if (bitreader_get(br, 1))
+        {
+            c->value[i].lead  = bitreader_get(br, 5);
+            n                 = bitreader_get(br, 6);
+            c->value[i].trail = 64 - c->value[i].lead - (n ? n : 64);
+        }
+        if (c->value[i].lead < 0 || c->value[i].trail < 0)
+        {
+            br->overrun = true;
+            return 0.0;
+        }
+        n = 64 - c->value[i].lead - c->value[i].trail;
+        c->value[i].bits ^= bitreader_get(br, n) << c->value[i].trail;
+    }
+    memcpy(&value, &c->value[i].bits, sizeof(value));
+    return value;
+}
+
+/*
+ * Writer
+ */
+struct samplelog_t
+{
+    char           *filename;
+    char           *tailname;
+    char           *newname;                    // next tail, during seal
+    int             fd;
+    int             tailfd;
+    off_t           size;                       // end of the last sealed segment
+    off_t           tailsize;
+    uint32_t        generation;                 // of the last sealed segment
+    int             dirty;                      // tail has unsynced rows
+    time_t          newest;                     // newest timestamp appended
+    time_t          encoded;                    // newest timestamp encoded
+    int             n_pending;                  // reorder buffer, ascending
+    databaserecord_t pending[SAMPLELOG_PENDING];
+    databaserecord_t *replay;                   // tail rows not yet replayed
+    int             n_replay;
+    struct
+    {
+        bitwriter_t stream[SAMPLELOG_STREAMS];
+        codec_t     codec;
+        uint32_t    n_rows;
+        time_t      first;
+        time_t      last;
+        time_t      hour;
+    } segment;
+    samplelog_stats_t stats;
+};
+
+/*
+ * Write a tail file: header and the rows that are not in sealed segments
+ * (reorder buffer, rows still to be replayed). Synced before returning.
+ */
+static int samplelog_writetail(samplelog_t *log, char *name, uint32_t generation)
+{
+    samplelog_tailheader_t header = { SAMPLELOG_TAILMAGIC, generation };
+    samplelog_tailrecord_t tr;
+    int                    fd, i, rc = EXIT_SUCCESS;
+
+    if ((fd = open(name, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644)) == -1)
+    {
+        logerr("open(\"%s\")", name);
+        return EXIT_FAILURE;
+    }
+    if (write(fd, &header, sizeof(header)) != sizeof(header))
+        rc = EXIT_FAILURE;
+    memset(&tr, 0, sizeof(tr));
+    for (i = 0; i < log->n_pending + log->n_replay && !rc; i++)
+    {
+        tr.record = i < log->n_pending ? log->pending[i] : log->replay[i - log->n_pending];
+        tr.crc    = crc32(&tr.record, sizeof(tr.record));
+        if (write(fd, &tr, sizeof(tr)) != sizeof(tr))
+            rc = EXIT_FAILURE;
+    }
+    if (rc || fdatasync(fd))
+    {
+        logerr("Unable to write \"%s\"", name);
+        rc = EXIT_FAILURE;
+    }
+    close(fd);
+    return rc;
+}
+
+/*
+ * Open the tail for appends. Failure leaves tailfd -1, the next append
+ * tries again.
+ */
+static int samplelog_opentail(samplelog_t *log)
+{
+    if ((log->tailfd = open(log->tailname, O_WRONLY | O_APPEND | O_CLOEXEC)) == -1)
+    {
+        logerr("Unable to open sample log tail \"%s\"", log->tailname);
+        return EXIT_FAILURE;
+    }
+    return (errno = 0, EXIT_SUCCESS);
+}
+
+/*
+ * Seal the open segment: next tail, segment + footer, rename next tail
+ * over the tail. See samplelog.h for crash recovery.
+ */
+static int samplelog_seal(samplelog_t *log)
+{
+    samplelog_segment_t seg;
+    samplelog_footer_t  footer;
+    uint8_t            *buf, *p;
+    size_t              size;
+    int                 i;
+
+    memset(&seg, 0, sizeof(seg));
+    seg.magic  = SAMPLELOG_SEGMENTMAGIC;
+    seg.n_rows = log->segment.n_rows;
+    seg.first  = log->segment.first;
+    seg.last   = log->segment.last;
+    size       = sizeof(seg);
+    for (i = 0; i < SAMPLELOG_STREAMS; i++)
+    {
+        seg.length[i] = (log->segment.stream[i].nbits + 7) / 8;
+        size         += seg.length[i];
+    }
+    if (!(buf = malloc(size + sizeof(footer))))
+        return (errno = ENOMEM, EXIT_FAILURE);
+    memcpy(buf, &seg, sizeof(seg));
+    for (p = buf + sizeof(seg), i = 0; i < SAMPLELOG_STREAMS; p += seg.length[i], i++)
+        memcpy(p, log->segment.stream[i].buf, seg.length[i]);
+    memset(&footer, 0, sizeof(footer));
+    footer.magic      = SAMPLELOG_FOOTERMAGIC;
+    footer.generation = log->generation + 1;
+    footer.first      = seg.first;
+    footer.last       = seg.last;
+    footer.offset     = log->size;
+    footer.size       = size;
+    footer.crc        = crc32(buf, size);
+    memcpy(buf + size, &footer, sizeof(footer));
+
+    if (samplelog_writetail(log, log->newname, footer.generation))
+    {
+        unlink(log->newname);
+        free(buf);
+        return EXIT_FAILURE;
+    }
+    if (pwrite(log->fd, buf, size + sizeof(footer), log->size) != size + sizeof(footer) ||
+        fdatasync(log->fd))
+    {
+        logerr("Unable to write segment into \"%s\"", log->filename);
+        if (ftruncate(log->fd, log->size))
+            logerr("ftruncate(\"%s\")", log->filename);
+        unlink(log->newname);
+        free(buf);
+        return EXIT_FAILURE;
+    }
+    free(buf);
+    log->size      += size + sizeof(footer);
+    log->generation = footer.generation;
+    // If this fails, samplelog_open() completes the rename
+    if (rename(log->newname, log->tailname))
+        logerr("rename(\"%s\", \"%s\")", log->newname, log->tailname);
+    else
+    {
+        if (log->tailfd != -1)
+            close(log->tailfd);
+        // New tail was synced with every row that is not sealed
+        log->dirty    = false;
+        log->tailsize = sizeof(samplelog_tailheader_t) +
+                        (log->n_pending + log->n_replay) * sizeof(samplelog_tailrecord_t);
+        samplelog_opentail(log);
+    }
+    logdev(
+          "Sample log segment sealed: %u rows, %d bytes (%.1f bytes/row)",
+          seg.n_rows,
+          (int)size,
+          (double)size / seg.n_rows
+          );
+    log->stats.n_segments++;
+    log->stats.n_encoded += seg.n_rows;
+    log->stats.n_bytes   += size + sizeof(footer);
+    for (i = 0; i < SAMPLELOG_STREAMS; i++)
+    {
+        memset(log->segment.stream[i].buf, 0, seg.length[i]);
+        log->segment.stream[i].nbits = 0;
+    }
+    codec_reset(&log->segment.codec);
+    log->segment.n_rows = 0;
+    return (errno = 0, EXIT_SUCCESS);
+}
+
+/*
+ * Encode the oldest row of the reorder buffer. Segment is sealed first,
+ * if the row belongs to a later hour.
+ */
+static int samplelog_encode(samplelog_t *log)
+{
+    databaserecord_t rec = log->pending[0];
+    double          *column = COLUMNS(&rec);
+    time_t           hour = rec.timestamp - rec.timestamp % SAMPLELOG_SEGMENT;
+    uint32_t         mask = 0;
+    int              i, rc;
+
+    // Failed seal is retried on the next row, segment grows meanwhile
+    if (log->segment.n_rows && hour > log->segment.hour && samplelog_seal(log))
+        logmsg(LOG_ERR, "Sample log segment could not be sealed");
+    memmove(&log->pending[0], &log->pending[1], --log->n_pending * sizeof(databaserecord_t));
+
+    for (i = 0; i < SAMPLELOG_COLUMNS; i++)
+        if (column[i] != DATABASE_DOUBLE_NULL_VALUE && !isnan(column[i]))
+            mask |= 1 << i;
+    rc = encode_timestamp(&log->segment.codec, &log->segment.stream[STREAM_TIMESTAMP],
+                          rec.timestamp, !log->segment.n_rows) ||
+         encode_mask(&log->segment.codec, &log->segment.stream[STREAM_MASK], mask);
+    // + 0.0 turns -0.0 into 0.0
+    for (i = 0; i < SAMPLELOG_COLUMNS && !rc; i++)
+        if (mask & (1 << i))
+            rc = encode_value(&log->segment.codec, &log->segment.stream[STREAM_VALUE + i], i,
+                              round(column[i] * samplelog_scale[i]) + 0.0);
+    if (rc)
+    {
+        logerr("Sample log encoder out of memory");
+        return EXIT_FAILURE;
+    }
+    if (!log->segment.n_rows)
+    {
+        log->segment.hour  = hour;
+        log->segment.first = log->segment.last = rec.timestamp;
+    }
+    log->segment.first = rec.timestamp < log->segment.first ? rec.timestamp : log->segment.first;
+    log->segment.last  = rec.timestamp > log->segment.last  ? rec.timestamp : log->segment.last;
+    log->segment.n_rows++;
+    log->encoded = rec.timestamp > log->encoded ? rec.timestamp : log->encoded;
+    return EXIT_SUCCESS;
+}
+
+/*
+ * Fill in columns of a row of the same timestamp. Like the compact schema
+ * (data_insert trigger), a non-NULL value of the later row wins.
+ */
+static void samplelog_merge(databaserecord_t *dst, databaserecord_t *src)
+{
+    double *to   = COLUMNS(dst);
+    double *from = COLUMNS(src);
+    int     i;
+
+    for (i = 0; i < SAMPLELOG_COLUMNS; i++)
+        if (from[i] != DATABASE_DOUBLE_NULL_VALUE)
+            to[i] = from[i];
+}
+
+/*
+ * Into the reorder buffer. Rows of the same timestamp are merged (NULL
+ * columns are filled in). Rows that left the reorder window are encoded.
+ */
+static int samplelog_queue(samplelog_t *log, databaserecord_t *rec)
+{
+    int n;
+
+    if (log->encoded && rec->timestamp <= log->encoded)
+        log->stats.n_late++;
+    for (n = log->n_pending; n > 0 && log->pending[n - 1].timestamp > rec->timestamp; n--)
+        ;
+    if (n > 0 && log->pending[n - 1].timestamp == rec->timestamp)
+    {
+        samplelog_merge(&log->pending[n - 1], rec);
+        log->stats.n_merged++;
+    }
+    else
+    {
+        memmove(&log->pending[n + 1], &log->pending[n], (log->n_pending - n) * sizeof(databaserecord_t));
+        log->pending[n] = *rec;
+        log->n_pending++;
+    }
+    log->newest = rec->timestamp > log->newest ? rec->timestamp : log->newest;
+    while (log->n_pending &&
+           (log->n_pending == SAMPLELOG_PENDING ||
+            log->pending[0].timestamp <= log->newest - SAMPLELOG_REORDER))
+    {
+        if (samplelog_encode(log))
+            return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
+
+/*
+ * Segment index. Footers are walked backwards from the end of the file.
+ * If that fails (torn end), segments are walked forwards from the start
+ * until one does not check out. Checksum is verified for the last segment
+ * of the backward walk and for every segment of the forward walk.
+ * Returns number of segments (*index in file order, malloc()'ed) and the
+ * end of the last valid segment (*end).
+ */
+static int samplelog_checkfooter(const uint8_t *map, off_t end, samplelog_footer_t *f, int crc)
+{
+    samplelog_segment_t seg;
+
+    if (end < sizeof(samplelog_header_t) + sizeof(seg) + sizeof(*f))
+        return false;
+    memcpy(f, map + end - sizeof(*f), sizeof(*f));
+    if (f->magic != SAMPLELOG_FOOTERMAGIC ||
+        f->offset < sizeof(samplelog_header_t) ||
+        f->size < sizeof(seg) ||
+        f->offset + f->size + sizeof(*f) != end)
+        return false;
+    memcpy(&seg, map + f->offset, sizeof(seg));
+    if (seg.magic != SAMPLELOG_SEGMENTMAGIC)
+        return false;
+    return !crc || crc32(map + f->offset, f->size) == f->crc;
+}
+
+static int samplelog_index(const uint8_t *map, off_t size, samplelog_footer_t **index, off_t *end)
+{
+    samplelog_footer_t  f, *list = NULL, *tmp;
+    samplelog_segment_t seg;
+    off_t               off, segsize;
+    int                 n = 0, i, allocated = 0;
+
+    // Backwards
+    for (off = size; off > sizeof(samplelog_header_t); off = f.offset, n++)
+    {
+        if (!samplelog_checkfooter(map, off, &f, !n))
+            break;
+        if (n == allocated)
+        {
+            allocated = allocated ? allocated * 2 : 64;
+            if (!(tmp = realloc(list, allocated * sizeof(f))))
+                goto nomem;
+            list = tmp;
+        }
+        list[n] = f;
+    }
+    if (off == sizeof(samplelog_header_t))
+    {
+        for (i = 0; i < n / 2; i++)
+        {
+            f               = list[i];
+            list[i]         = list[n - 1 - i];
+            list[n - 1 - i] = f;
+        }
+        *index = list;
+        *end   = size;
+        return n;
+    }
+    // Forwards
+    for (n = 0, off = sizeof(samplelog_header_t); off + sizeof(seg) + sizeof(f) <= size; off += segsize + sizeof(f), n++)
+    {
+        memcpy(&seg, map + off, sizeof(seg));
+        if (seg.magic != SAMPLELOG_SEGMENTMAGIC)
+            break;
+        for (segsize = sizeof(seg), i = 0; i < SAMPLELOG_STREAMS; i++)
+            segsize += seg.length[i];
+        if (off + segsize + sizeof(f) > size ||
+            !samplelog_checkfooter(map, off + segsize + sizeof(f), &f, true))
+            break;
+        if (n == allocated)
+        {
+            allocated = allocated ? allocated * 2 : 64;
+            if (!(tmp = realloc(list, allocated * sizeof(f))))
+                goto nomem;
+            list = tmp;
+        }
+        list[n] = f;
+    }
+    *index = list;
+    *end   = off;
+    return n;
+nomem:
+    free(list);
+    return (errno = ENOMEM, -1);
+}
+
+/*
+ * Read tail. Returns number of rows with a valid checksum (*rows is
+ * malloc()'ed), -1 on error (ENOENT: no tail). *end is the end of the
+ * last valid row, 0 if the header is not valid.
+ */
+static int samplelog_readtail(char *name, databaserecord_t **rows, uint32_t *generation, off_t *end)
+{
+    samplelog_tailheader_t header;
+    samplelog_tailrecord_t tr;
+    struct stat            st;
+    int                    fd, n = 0;
+
+    *rows = NULL;
+    *end  = 0;
+    if ((fd = open(name, O_RDONLY | O_CLOEXEC)) == -1)
+        return -1;
+    if (fstat(fd, &st) ||
+        pread(fd, &header, sizeof(header), 0) != sizeof(header) ||
+        header.magic != SAMPLELOG_TAILMAGIC)
+    {
+        close(fd);
+        return (errno = 0, 0);
+    }
+    *generation = header.generation;
+    *end        = sizeof(header);
+    if (!(*rows = malloc((st.st_size - sizeof(header)) / sizeof(tr) * sizeof(databaserecord_t) + 1)))
+    {
+        close(fd);
+        return (errno = ENOMEM, -1);
+    }
+    while (pread(fd, &tr, sizeof(tr), *end) == sizeof(tr) &&
+           crc32(&tr.record, sizeof(tr.record)) == tr.crc)
+    {
+        (*rows)[n++] = tr.record;
+        *end        += sizeof(tr);
+    }
+    close(fd);
+    return (errno = 0, n);
+}
+
+samplelog_t *samplelog_open(char *filename)
+{
+    samplelog_header_t  header;
+    samplelog_footer_t *index = NULL;
+    samplelog_t        *log;
+    databaserecord_t   *rows;
+    struct stat         st;
+    uint8_t            *map;
+    uint32_t            generation;
+    off_t               end;
+    int                 i, n;
+
+    if (!(log = calloc(1, sizeof(samplelog_t))))
+    {
+        logerr("Out of memory");
+        return NULL;
+    }
+    log->fd = log->tailfd = -1;
+    if (!(log->filename = strdup(filename)) ||
+        !(log->tailname = malloc(strlen(filename) + sizeof(SAMPLELOG_NEWSUFFIX))) ||
+        !(log->newname  = malloc(strlen(filename) + sizeof(SAMPLELOG_NEWSUFFIX))))
+    {
+        logerr("Out of memory");
+        goto fail;
+    }
+    sprintf(log->tailname, "%s" SAMPLELOG_TAILSUFFIX, filename);
+    sprintf(log->newname,  "%s" SAMPLELOG_NEWSUFFIX, filename);
+    codec_reset(&log->segment.codec);
+
+    /*
+     * Sealed segments
+     */
+    if ((log->fd = open(filename, O_RDWR | O_CREAT | O_CLOEXEC, 0644)) == -1 || fstat(log->fd, &st))
+    {
+        logerr("open(\"%s\")", filename);
+        goto fail;
+    }
+    if (!st.st_size)
+    {
+        memset(&header, 0, sizeof(header));
+        memcpy(header.magic, SAMPLELOG_MAGIC, sizeof(header.magic));
+        header.version = SAMPLELOG_VERSION;
+        header.columns = SAMPLELOG_COLUMNS;
+        if (write(log->fd, &header, sizeof(header)) != sizeof(header) || fdatasync(log->fd))
+        {
+            logerr("Unable to write \"%s\"", filename);
+            goto fail;
+        }
+        st.st_size = sizeof(header);
+    }
+    if (st.st_size < sizeof(header) ||
+        pread(log->fd, &header, sizeof(header), 0) != sizeof(header) ||
+        memcmp(header.magic, SAMPLELOG_MAGIC, sizeof(header.magic)) ||
+        header.version != SAMPLELOG_VERSION ||
+        header.columns != SAMPLELOG_COLUMNS)
+    {
+        logmsg(LOG_ERR, "\"%s\" is not a sample log file", filename);
+        errno = EINVAL;
+        goto fail;
+    }
+    if ((map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, log->fd, 0)) == MAP_FAILED)
+    {
+        logerr("mmap(\"%s\")", filename);
+        goto fail;
+    }
+    n = samplelog_index(map, st.st_size, &index, &end);
+    munmap(map, st.st_size);
+    if (n < 0)
+        goto fail;
+    if (end < st.st_size)
+    {
+        logmsg(
+              LOG_ERR,
+              "Sample log \"%s\": torn segment, %lld bytes truncated",
+              filename,
+              (long long)(st.st_size - end)
+              );
+        if (ftruncate(log->fd, end))
+        {
+            logerr("ftruncate(\"%s\")", filename);
+            goto fail;
+        }
+    }
+    log->size       = end;
+    log->generation = n ? index[n - 1].generation : 0;
+    free(index);
+
+    /*
+     * Tail. Seal was interrupted if the next tail exists: it is the tail
+     * if the segment made it into the file.
+     */
+    if ((n = samplelog_readtail(log->newname, &rows, &generation, &end)) >= 0)
+    {
+        free(rows);
+        if (end && generation == log->generation)
+        {
+            if (rename(log->newname, log->tailname))
+                logerr("rename(\"%s\", \"%s\")", log->newname, log->tailname);
+        }
+        else
+            unlink(log->newname);
+    }
+    if ((n = samplelog_readtail(log->tailname, &rows, &generation, &end)) < 0 || !end)
+    {
+        if (n < 0 && errno != ENOENT)
+            goto fail;
+        free(rows);
+        rows = NULL;
+        n    = 0;
+        if (samplelog_writetail(log, log->tailname, log->generation))
+            goto fail;
+        end  = sizeof(samplelog_tailheader_t);
+    }
+    else if (generation != log->generation)
+        logmsg(
+              LOG_ERR,
+              "Sample log \"%s\": tail generation %u, segments %u",
+              filename,
+              generation,
+              log->generation
+              );
+    if (samplelog_opentail(log))
+    {
+        free(rows);
+        goto fail;
+    }
+    if (fstat(log->tailfd, &st) == 0 && st.st_size > end)
+    {
+        logmsg(
+              LOG_ERR,
+              "Sample log \"%s\": torn tail row, %lld bytes truncated",
+              filename,
+              (long long)(st.st_size - end)
+              );
+        if (ftruncate(log->tailfd, end))
+            logerr("ftruncate(\"%s\")", log->tailname);
+    }
+    log->tailsize = end;
+
+    /*
+     * Replay. If an hour is sealed meanwhile, rows not yet replayed go
+     * into the next tail (log->replay).
+     */
+    for (i = 0; i < n; i++)
+    {
+        log->replay   = rows + i + 1;
+        log->n_replay = n - i - 1;
+        samplelog_queue(log, &rows[i]);
+    }
+    log->replay   = NULL;
+    log->n_replay = 0;
+    free(rows);
+    memset(&log->stats, 0, sizeof(log->stats));
+    logdev(
+          "Sample log \"%s\" opened, %lld bytes, %d rows replayed from the tail",
+          filename,
+          (long long)log->size,
+          n
+          );
+    return (errno = 0, log);
+fail:
+    i = errno;
+    samplelog_close(log);
+    errno = i;
+    return NULL;
+}
+
+int samplelog_append(samplelog_t *log, databaserecord_t *record)
+{
+    samplelog_tailrecord_t tr;
+
+    memset(&tr, 0, sizeof(tr));
+    tr.record = *record;
+    tr.crc    = crc32(&tr.record, sizeof(tr.record));
+    // Reopen after the seal failed
+    if (log->tailfd == -1 && samplelog_opentail(log))
+        return EXIT_FAILURE;
+    if (write(log->tailfd, &tr, sizeof(tr)) != sizeof(tr))
+    {
+        logerr("Unable to append into \"%s\"", log->tailname);
+        // Partial row would hide the rows after it
+        if (ftruncate(log->tailfd, log->tailsize))
+            logerr("ftruncate(\"%s\")", log->tailname);
+        return EXIT_FAILURE;
+    }
+    log->tailsize += sizeof(tr);
+    log->dirty     = true;
+    log->stats.n_rows++;
+    return samplelog_queue(log, record);
+}
+
+int samplelog_sync(samplelog_t *log)
+{
+    if (!log->dirty)
+        return (errno = 0, EXIT_SUCCESS);
+    if (fdatasync(log->tailfd))
+    {
+        logerr("fdatasync(\"%s\")", log->tailname);
+        return EXIT_FAILURE;
+    }
+    log->dirty = false;
+    log->stats.n_syncs++;
+    return (errno = 0, EXIT_SUCCESS);
+}
+
+void samplelog_close(samplelog_t *log)
+{
+    int i;
+
+    if (!log)
+        return;
+    if (log->tailfd != -1)
+    {
+        samplelog_sync(log);
+        close(log->tailfd);
+    }
+    if (log->fd != -1)
+        close(log->fd);
+    for (i = 0; i < SAMPLELOG_STREAMS; i++)
+        free(log->segment.stream[i].buf);
+    free(log->filename);
+    free(log->tailname);
+    free(log->newname);
+    free(log);
+}
+
+samplelog_stats_t *samplelog_getstats(samplelog_t *log)
+{
+    return &log->stats;
+}
+
+/*
+ * Reader
+ */
+static int samplelog_decode(
+                           const uint8_t *map,
+                           samplelog_footer_t *f,
+                           time_t from,
+                           time_t to,
+                           int (*fn)(databaserecord_t *, void *),
+                           void *arg,
+                           int *n_rows
+                           )
+{
+    samplelog_segment_t seg;
+    bitreader_t         br[SAMPLELOG_STREAMS];
+    codec_t             codec;
+    databaserecord_t    rec;
+    double             *column = COLUMNS(&rec);
+    const uint8_t      *p = map + f->offset + sizeof(seg);
+    uint32_t            mask;
+    int                 i, row;
+
+    if (crc32(map + f->offset, f->size) != f->crc)
+        return (errno = EILSEQ, -1);
+    memcpy(&seg, map + f->offset, sizeof(seg));
+    for (i = 0; i < SAMPLELOG_STREAMS; p += seg.length[i], i++)
+    {
+        br[i].buf     = p;
+        br[i].nbits   = seg.length[i] * 8ULL;
+        br[i].pos     = 0;
+        br[i].overrun = false;
+    }
+    codec_reset(&codec);
+    for (row = 0; row < seg.n_rows; row++)
+    {
+        rec.timestamp = decode_timestamp(&codec, &br[STREAM_TIMESTAMP], !row);
+        mask          = decode_mask(&codec, &br[STREAM_MASK]);
+        for (i = 0; i < SAMPLELOG_COLUMNS; i++)
+            column[i] = mask & (1 << i) ?
+                         decode_value(&codec, &br[STREAM_VALUE + i], i) / samplelog_scale[i] :
+                         DATABASE_DOUBLE_NULL_VALUE;
+        for (i = 0; i < SAMPLELOG_STREAMS; i++)
+            if (br[i].overrun)
+                return (errno = EILSEQ, -1);
+        if (rec.timestamp < from || rec.timestamp > to)
+            continue;
+        (*n_rows)++;
+        if (fn(&rec, arg))
+            return 1;
+    }
+    return 0;
+}
+
+int samplelog_scan(
+                  char *filename,
+                  time_t from,
+                  time_t to,
+                  int (*fn)(databaserecord_t *record, void *arg),
+                  void *arg
+                  )
+{
+    samplelog_header_t  header;
+    samplelog_footer_t *index = NULL;
+    databaserecord_t   *rows;
+    struct stat         st;
+    uint8_t            *map;
+    uint32_t            generation;
+    off_t               end;
+    char               *tailname;
+    int                 fd, i, k, n, rc = 0, n_rows = 0;
+
+    if ((fd = open(filename, O_RDONLY | O_CLOEXEC)) == -1 || fstat(fd, &st))
+    {
+        logerr("open(\"%s\")", filename);
+        return -1;
+    }
+    if (st.st_size < sizeof(header) ||
+        pread(fd, &header, sizeof(header), 0) != sizeof(header) ||
+        memcmp(header.magic, SAMPLELOG_MAGIC, sizeof(header.magic)))
+    {
+        logmsg(LOG_ERR, "\"%s\" is not a sample log file", filename);
+        close(fd);
+        return (errno = EINVAL, -1);
+    }
+    if ((map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0)) == MAP_FAILED)
+    {
+        logerr("mmap(\"%s\")", filename);
+        close(fd);
+        return -1;
+    }
+    close(fd);
+    if ((n = samplelog_index(map, st.st_size, &index, &end)) < 0)
+    {
+        munmap(map, st.st_size);
+        return -1;
+    }
+    for (i = 0; i < n && rc <= 0; i++)
+    {
+        if (index[i].last < from || index[i].first > to)
+            continue;
+        if ((rc = samplelog_decode(map, &index[i], from, to, fn, arg, &n_rows)) < 0)
+            logmsg(
+                  LOG_ERR,
+                  "Sample log \"%s\": segment at %llu does not decode, skipped",
+                  filename,
+                  (unsigned long long)index[i].offset
+                  );
+    }
+    free(index);
+    munmap(map, st.st_size);
+    if (rc > 0)
+        return (errno = 0, n_rows);
+
+    /*
+     * Rows that are not sealed yet are in the order they arrived, and not
+     * merged. Insertion sort (stable, nearly sorted input) and merge.
+     */
+    if (!(tailname = malloc(strlen(filename) + sizeof(SAMPLELOG_TAILSUFFIX))))
+        return (errno = ENOMEM, -1);
+    sprintf(tailname, "%s" SAMPLELOG_TAILSUFFIX, filename);
+    n = samplelog_readtail(tailname, &rows, &generation, &end);
+    free(tailname);
+    for (i = 1; i < n; i++)
+    {
+        databaserecord_t rec = rows[i];
+        for (k = i; k > 0 && rows[k - 1].timestamp > rec.timestamp; k--)
+            rows[k] = rows[k - 1];
+        rows[k] = rec;
+    }
+    for (i = 0, k = 0; i < n; i++)
+    {
+        if (k && rows[k - 1].timestamp == rows[i].timestamp)
+            samplelog_merge(&rows[k - 1], &rows[i]);
+        else
+            rows[k++] = rows[i];
+    }
+    for (n = k, i = 0; i < n; i++)
+    {
+        if (rows[i].timestamp < from || rows[i].timestamp > to)
+            continue;
+        n_rows++;
+        if (fn(&rows[i], arg))
+            break;
+    }
+    free(rows);
+    return (errno = 0, n_rows);
+}
+
+/*
+ * Export (-export-sqlite)
+ */
+typedef struct
+{
+    dbhandle_t     *handle;
+    int             n_rows;
+    int             n_failed;
+    time_t          first;                      // rows since the last commit
+    time_t          last;
+} samplelog_export_t;
+
+static int samplelog_exportrow(databaserecord_t *rec, void *arg)
+{
+    samplelog_export_t *e = arg;
+
+    if (database_write(e->handle, rec))
+    {
+        e->n_failed++;
+        return 0;
+    }
+    e->first = !e->last || rec->timestamp < e->first ? rec->timestamp : e->first;
+    e->last  = rec->timestamp > e->last ? rec->timestamp : e->last;
+    if (++e->n_rows % SAMPLELOG_EXPORTROWS == 0)
+    {
+        if (database_rollup(e->handle, e->first, e->last) || database_commit(e->handle))
+            return -1;
+        e->last = 0;
+        database_begin(e->handle);
+    }
+    return 0;
+}
+
+int samplelog_export(char *filename, char *datafile)
+{
+    samplelog_export_t e;
+    xtmr_t            *t = xtmr();     // util.c
+    double             ms;
+    int                n, rc;
+
+    memset(&e, 0, sizeof(e));
+    if (access(datafile, F_OK) && database_initialize(datafile))
+    {
+        free(t);
+        return EXIT_FAILURE;
+    }
+    // Legacy data table would get duplicate rows instead of merged ones
+    if (database_schema(datafile) != DATABASE_SCHEMA_COMPACT)
+    {
+        logmsg(LOG_ERR, "\"%s\" is not in the compact schema (see -migratedb)", datafile);
+        free(t);
+        return (errno = ENOTSUP, EXIT_FAILURE);
+    }
+    if (!(e.handle = database_open(datafile)))
+    {
+        free(t);
+        return EXIT_FAILURE;
+    }
+    database_begin(e.handle);
+    n  = samplelog_scan(filename, 0, INT32_MAX, samplelog_exportrow, &e);
+    rc = (e.last && database_rollup(e.handle, e.first, e.last)) || database_commit(e.handle);
+    database_close(e.handle);
+    ms = xtmrlap(t);
+    free(t);
+    if (n < 0 || rc || e.n_failed)
+    {
+        logmsg(
+              LOG_ERR,
+              "Sample log export into \"%s\" failed (%d rows, %d failed)",
+              datafile,
+              e.n_rows,
+              e.n_failed
+              );
+        return EXIT_FAILURE;
+    }
+    logmsg(
+          LOG_INFO,
+          "Exported %d rows from \"%s\" into \"%s\" in %.2f seconds (%.0f rows/s)",
+          e.n_rows,
+          filename,
+          datafile,
+          ms / 1000,
+          ms > 0 ? e.n_rows / (ms / 1000) : 0.0
+          );
+    return (errno = 0, EXIT_SUCCESS);
+}
+
+/* EOF samplelog.c */
@@ -0,0 +1,121 @@
+/*
+ * samplelog.h - 2016 Jani Tammi <janitammi@gmail.com>
+ *
+ *      Append-only columnar sample log (cfg.database.samplelog).
+ *
+ *      SQLite3 writes each row into a B-tree page somewhere in the file,
+ *      plus the journal. On an SD card that is a random page write (or
+ *      three) per row, whatever the group commit does. Sample log stores
+ *      the samples (databaserecord_t) as purely sequential appends into
+ *      two files:
+ *
+ *          <samplelog>         Sealed segments, one per hour. Never
+ *                              rewritten, only appended to.
+ *          <samplelog>.tail    Rows of the open (unsealed) hour, raw, one
+ *                              checksummed record per row. Synced with the
+ *                              database writer commit interval.
+ *
+ *      Segment is columnar: timestamps, NULL masks and each of the 22
+ *      value columns are separate bitstreams, compressed the way Facebook
+ *      Gorilla compresses time series:
+ *
+ *          Timestamp   Delta-of-delta. Fixed interval costs one bit a row.
+ *          NULL mask   Bit per column. Repeated mask (or alternating ping
+ *                      and line data rows) costs one or two bits a row.
+ *          Values      XOR against the previous value of the column, only
+ *                      the meaningful bits are stored. NULLs are not stored.
+ *
+ *      Values are quantized to the resolution of the compact schema
+ *      (database.h) before they are XOR'ed; microseconds for ping times,
+ *      tenths of dB(mV) for the line values. Whole numbers as doubles have
+ *      mostly zero mantissa bits, which is what makes XOR compression work.
+ *      A year of 5 second samples takes some tens of MB.
+ *
+ *      Rows are kept in a small reorder buffer (SAMPLELOG_REORDER seconds)
+ *      before they are encoded, because ping and line data jobs finish in
+ *      any order. Rows of the same timestamp are merged there, like the
+ *      compact schema merges them.
+ *
+ *      Segment is sealed when a row of a later hour is encoded. Sealed
+ *      segment is written, followed by a footer (index entry: time range,
+ *      offset, checksum). Readers walk the footers backwards from the end
+ *      of the file to find segments, and decode only those that overlap
+ *      the requested range. A torn segment (power cut during append) fails
+ *      its checksum and is truncated away by the next samplelog_open().
+ *
+ *      Tail is replaced on each seal by the rows that were not sealed. The
+ *      new tail is written and synced before the segment, and renamed over
+ *      the old one after it; footer and tail both carry a generation number
+ *      so that samplelog_open() can tell which one a crash interrupted.
+ *
+ *      Files are in host byte order. Counters and reboots are not samples
+ *      and are written into the datafile as before.
+ */
+#include <stdint.h>             /* uint32_t                                 */
+#include <time.h>               /* time_t                                   */
+
+#include "database.h"           /* databaserecord_t                         */
+
+#ifndef __SAMPLELOG_H__
+#define __SAMPLELOG_H__
+
+#define SAMPLELOG_COLUMNS           22          // databaserecord_t values
+#define SAMPLELOG_SEGMENT           3600        // (seconds) sealed per hour
+#define SAMPLELOG_REORDER           60          // (seconds) reorder buffer
+#define SAMPLELOG_PENDING           64          // (rows) reorder buffer size
+#define SAMPLELOG_EXPORTROWS        10000       // rows per export transaction
+
+typedef struct samplelog_t samplelog_t;
+
+typedef struct
+{
+    uint32_t        n_rows;                     // appended (before merge)
+    uint32_t        n_merged;                   // merged into another row
+    uint32_t        n_late;                     // older than the reorder window
+    uint32_t        n_segments;                 // sealed
+    uint32_t        n_syncs;
+    uint64_t        n_bytes;                    // sealed segments
+    uint32_t        n_encoded;                  // rows in sealed segments
+} samplelog_stats_t;
+
+/*
+ * Writer (database writer)
+ *
+ *  samplelog_open()    Open or create. Truncates a torn segment and replays
+ *                      the tail. NULL on error.
+ *  samplelog_append()  Add a row. Seals the segment when an hour is full.
+ *  samplelog_sync()    fdatasync() the tail (commit interval).
+ *  samplelog_close()   Sync and close. Open segment stays in the tail.
+ *  samplelog_getstats() Totals since open.
+ */
+samplelog_t *samplelog_open(char *filename);
+int     samplelog_append(samplelog_t *log, databaserecord_t *record);
+int     samplelog_sync(samplelog_t *log);
+void    samplelog_close(samplelog_t *log);
+samplelog_stats_t *samplelog_getstats(samplelog_t *log);
+
+/*
+ * Reader
+ *
+ *  samplelog_scan()    Call fn() for each row from ... to (inclusive), in
+ *                      storage order: sealed segments, then the (sorted and
+ *                      merged) tail. A row that arrived after the reorder
+ *                      window had passed may repeat a timestamp. fn()
+ *                      returning non-zero stops the scan. Returns number of
+ *                      rows, -1 on error.
+ *  samplelog_export()  Write all rows into a compact schema datafile
+ *                      (created if it does not exist), in transactions of
+ *                      SAMPLELOG_EXPORTROWS rows, rollups included.
+ */
+int     samplelog_scan(
+                      char *filename,
+                      time_t from,
+                      time_t to,
+                      int (*fn)(databaserecord_t *record, void *arg),
+                      void *arg
+                      );
+int     samplelog_export(char *filename, char *datafile);
+
+#endif /* __SAMPLELOG_H__ */
+
+/* EOF samplelog.h */
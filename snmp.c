@@ -0,0 +1,741 @@
+/*
+ * snmp.c - 2016 Jani Tammi <janitammi@gmail.com>
+ *
+ *      Minimal SNMPv2c GetBulk client for DOCSIS-MIB line data.
+ *      See snmp.h for details.
+ *
+ *      BER encoding is done BACKWARDS (from the end of the buffer towards
+ *      the start), because that way every length is known when its header
+ *      is written. Completed message is then moved to the buffer start.
+ */
+#include <stdio.h>
+#include <unistd.h>             // close(), getpid()
+#include <stdlib.h>             // malloc()
+#include <stdbool.h>            // true, false
+#include <string.h>             // memset(), memcpy(), memmove()
+#include <errno.h>
+#include <netdb.h>              // gethostbyname()
+#include <sys/socket.h>         // socket(), sendto(), recv()
+#include <sys/timerfd.h>        // timerfd_create()
+#include <arpa/inet.h>          // htons()
+
+#include "snmp.h"
+#include "logwrite.h"
+
+/*
+ * GetBulk request layout
+ *
+ *      Non-repeaters are the scalar(ish) objects that are read with GetNext
+ *      semantics (one varbind each). Repeaters are table columns, each one
+ *      walked SNMP_MAXREPETITIONS rows forward. The order of the repeater
+ *      rows in the response is the channel order.
+ */
+enum
+{
+    ROLE_SYSUPTIME = 0,
+    ROLE_TXPOWER,
+    ROLE_T3TIMEOUTS,
+    ROLE_T4TIMEOUTS,
+    ROLE_DOWNPOWER,             // first repeater
+    ROLE_DOWNSNR,
+    ROLE_UNERROREDS,
+    ROLE_CORRECTEDS,
+    ROLE_UNCORRECTABLES,
+    ROLE_UPTXPOWER,
+    ROLE_COUNT
+};
+#define N_NONREPEATERS      ROLE_DOWNPOWER
+#define N_REPEATERS         (ROLE_COUNT - N_NONREPEATERS)
+
+static const char *request_oidstr[ROLE_COUNT] =
+{
+    SNMP_OID_SYSUPTIME,
+    SNMP_OID_CMSTATUSTXPOWER,
+    SNMP_OID_CMSTATUST3TIMEOUTS,
+    SNMP_OID_CMSTATUST4TIMEOUTS,
+    SNMP_OID_DOWNCHANNELPOWER,
+    SNMP_OID_SIGQSIGNALNOISE,
+    SNMP_OID_SIGQUNERROREDS,
+    SNMP_OID_SIGQCORRECTEDS,
+    SNMP_OID_SIGQUNCORRECTABLES,
+    SNMP_OID_CM3USTXPOWER
+};
+static snmp_oid_t request_oid[ROLE_COUNT];
+static int        request_oid_parsed = false;
+
+
+/*****************************************************************************/
+// BER ENCODE (backwards)
+/*****************************************************************************/
+typedef struct
+{
+    unsigned char *base;
+    unsigned char *pos;         // moves towards base
+} berbuf_t;
+
+static int ber_push(berbuf_t *b, const unsigned char *data, int n)
+{
+    if (b->pos - b->base < n)
+        return -1;
+    b->pos -= n;
+    memcpy(b->pos, data, n);
+    return n;
+}
+
+/*
+ * Type and length octets (definite form)
+ */
+static int ber_push_header(berbuf_t *b, unsigned char type, int len)
+{
+    unsigned char hdr[6];
+    int           n = 0;
+    hdr[n++] = type;
+    if (len < 0x80)
+        hdr[n++] = len;
+    else if (len <= 0xFF)
+    {
+        hdr[n++] = 0x81;
+        hdr[n++] = len;
+    }
+    else if (len <= 0xFFFF)
+    {
+        hdr[n++] = 0x82;
+        hdr[n++] = len >> 8;
+        hdr[n++] = len & 0xFF;
+    }
+    else
+        return -1;
+    return ber_push(b, hdr, n);
+}
+
+/*
+ * Minimal two's complement content. Unsigned application types
+ * (Counter32, Gauge32, TimeTicks) get their leading zero octet
+ * automatically, since they are handled as positive int64_t.
+ */
+static int ber_push_integer(berbuf_t *b, unsigned char type, int64_t value)
+{
+    unsigned char tmp[9];
+    int           n = 0;
+    int64_t       rest;
+    for (;;)
+    {
+        tmp[sizeof(tmp) - 1 - n] = (unsigned char)(value & 0xFF);
+        n++;
+        rest = value >> 8;
+        if ((rest ==  0 && !(tmp[sizeof(tmp) - n] & 0x80)) ||
+            (rest == -1 &&  (tmp[sizeof(tmp) - n] & 0x80)) ||
+            n == sizeof(tmp))
+            break;
+        value = rest;
+    }
+    if (ber_push(b, tmp + sizeof(tmp) - n, n) < 0 || ber_push_header(b, type, n) < 0)
+        return -1;
+    return 0;
+}
+
+static int ber_push_oid(berbuf_t *b, const snmp_oid_t *oid)
+{
+    unsigned char *end = b->pos;
+    unsigned char  c;
+    uint32_t       sub;
+    int            i;
+    if (oid->len < 2)
+        return -1;
+    for (i = oid->len - 1; i >= 1; i--)
+    {
+        // First two sub-identifiers are combined (40 * X + Y)
+        sub = (i == 1) ? oid->sub[0] * 40 + oid->sub[1] : oid->sub[i];
+        c = sub & 0x7F;
+        if (ber_push(b, &c, 1) < 0)
+            return -1;
+        while ((sub >>= 7))
+        {
+            c = (sub & 0x7F) | 0x80;
+            if (ber_push(b, &c, 1) < 0)
+                return -1;
+        }
+    }
+    return ber_push_header(b, SNMP_TYPE_OID, end - b->pos) < 0 ? -1 : 0;
+}
+
+int snmp_encode(unsigned char *buffer, int size, const char *community, snmp_pdu_t *pdu)
+{
+    berbuf_t       b = { buffer, buffer + size };
+    unsigned char *mark;
+    unsigned char *vbmark;
+    int            i, len;
+
+    if (!buffer || !community || !pdu || pdu->nvarbinds > SNMP_MAXVARBINDS)
+        return (errno = EINVAL, -1);
+
+    /*
+     * VarBindList (reverse order)
+     */
+    mark = b.pos;
+    for (i = pdu->nvarbinds - 1; i >= 0; i--)
+    {
+        snmp_varbind_t *vb = &pdu->varbind[i];
+        vbmark = b.pos;
+        switch (vb->type)
+        {
+            case SNMP_TYPE_INTEGER:
+            case SNMP_TYPE_COUNTER32:
+            case SNMP_TYPE_GAUGE32:
+            case SNMP_TYPE_TIMETICKS:
+                if (ber_push_integer(&b, vb->type, vb->value) < 0)
+                    return (errno = ENOBUFS, -1);
+                break;
+            default:
+                // NULL (requests) and the v2 exception values
+                if (ber_push_header(&b, vb->type ? vb->type : SNMP_TYPE_NULL, 0) < 0)
+                    return (errno = ENOBUFS, -1);
+                break;
+        }
+        if (ber_push_oid(&b, &vb->oid) < 0 ||
+            ber_push_header(&b, SNMP_TYPE_SEQUENCE, vbmark - b.pos) < 0)
+            return (errno = ENOBUFS, -1);
+    }
+    if (ber_push_header(&b, SNMP_TYPE_SEQUENCE, mark - b.pos) < 0)
+        return (errno = ENOBUFS, -1);
+
+    /*
+     * PDU
+     */
+    if (ber_push_integer(&b, SNMP_TYPE_INTEGER, pdu->errindex) < 0  ||
+        ber_push_integer(&b, SNMP_TYPE_INTEGER, pdu->errstatus) < 0 ||
+        ber_push_integer(&b, SNMP_TYPE_INTEGER, pdu->requestid) < 0 ||
+        ber_push_header(&b, pdu->type, mark - b.pos) < 0)
+        return (errno = ENOBUFS, -1);
+
+    /*
+     * Message: version, community, PDU
+     */
+    len = strlen(community);
+    if (ber_push(&b, (const unsigned char *)community, len) < 0      ||
+        ber_push_header(&b, SNMP_TYPE_OCTETSTRING, len) < 0          ||
+        ber_push_integer(&b, SNMP_TYPE_INTEGER, SNMP_VERSION_2C) < 0 ||
+        ber_push_header(&b, SNMP_TYPE_SEQUENCE, mark - b.pos) < 0)
+        return (errno = ENOBUFS, -1);
+
+    len = (buffer + size) - b.pos;
+    memmove(buffer, b.pos, len);
+    return (errno = 0, len);
+}
+
+
+/*****************************************************************************/
+// BER DECODE
+/*****************************************************************************/
+/*
+ * Returns pointer to content octets, or NULL if the TLV does not fit
+ */
+static const unsigned char *ber_header(
+                                      const unsigned char *p,
+                                      const unsigned char *end,
+                                      unsigned char       *type,
+                                      int                 *len
+                                      )
+{
+    int l, k;
+    if (!p || end - p < 2)
+        return NULL;
+    *type = *p++;
+    l     = *p++;
+    if (l & 0x80)
+    {
+        k = l & 0x7F;
+        if (k == 0 || k > 3 || end - p < k)
+            return NULL;
+        for (l = 0; k; k--)
+            l = (l << 8) | *p++;
+    }
+    if (end - p < l)
+        return NULL;
+    *len = l;
+    return p;
+}
+
+static int ber_integer(const unsigned char *p, int len, int is_unsigned, int64_t *value)
+{
+    uint64_t acc;
+    int      i;
+    if (len < 1 || len > 9)
+        return -1;
+    acc = (!is_unsigned && (p[0] & 0x80)) ? ~(uint64_t)0 : 0;
+    for (i = 0; i < len; i++)
+        acc = (acc << 8) | p[i];
+    *value = (int64_t)acc;
+    return 0;
+}
+
+static int ber_oid(const unsigned char *p, int len, snmp_oid_t *oid)
+{
+    uint32_t sub = 0;
+    int      i;
+    oid->len = 0;
+    for (i = 0; i < len; i++)
+    {
+        sub = (sub << 7) | (p[i] & 0x7F);
+        if (p[i] & 0x80)
+            continue;
+        if (oid->len == 0)
+        {
+            oid->sub[0] = sub < 80 ? sub / 40 : 2;
+            oid->sub[1] = sub < 80 ? sub % 40 : sub - 80;
+            oid->len    = 2;
+        }
+        else if (oid->len < SNMP_MAXOIDLEN)
+            oid->sub[oid->len++] = sub;
+        else
+            return -1;
+        sub = 0;
+    }
+    // last octet must not have continuation bit
+    return (len && !(p[len - 1] & 0x80)) ? 0 : -1;
+}
+
+#define EXPECT(t) \
+    ({ \
+        if (!(p = ber_header(p, end, &type, &len)) || type != (t)) \
+            return (errno = EBADMSG, EXIT_FAILURE); \
+    })
+int snmp_decode(const unsigned char *buffer, int buflen, snmp_pdu_t *pdu)
+{
+    const unsigned char *p   = buffer;
+    const unsigned char *end = buffer + buflen;
+    const unsigned char *vbend;
+    unsigned char        type;
+    int                  len;
+    int64_t              value;
+
+    memset(pdu, 0, sizeof(snmp_pdu_t));
+
+    EXPECT(SNMP_TYPE_SEQUENCE);
+    end = p + len;
+    // version
+    EXPECT(SNMP_TYPE_INTEGER);
+    if (ber_integer(p, len, false, &value) || value != SNMP_VERSION_2C)
+        return (errno = EBADMSG, EXIT_FAILURE);
+    p += len;
+    // community (not verified)
+    EXPECT(SNMP_TYPE_OCTETSTRING);
+    p += len;
+    // PDU
+    if (!(p = ber_header(p, end, &type, &len)) || (type & 0xE0) != 0xA0)
+        return (errno = EBADMSG, EXIT_FAILURE);
+    pdu->type = type;
+    end = p + len;
+    EXPECT(SNMP_TYPE_INTEGER);
+    if (ber_integer(p, len, false, &value))
+        return (errno = EBADMSG, EXIT_FAILURE);
+    pdu->requestid = value;
+    p += len;
+    EXPECT(SNMP_TYPE_INTEGER);
+    if (ber_integer(p, len, false, &value))
+        return (errno = EBADMSG, EXIT_FAILURE);
+    pdu->errstatus = value;
+    p += len;
+    EXPECT(SNMP_TYPE_INTEGER);
+    if (ber_integer(p, len, false, &value))
+        return (errno = EBADMSG, EXIT_FAILURE);
+    pdu->errindex = value;
+    p += len;
+    // VarBindList
+    EXPECT(SNMP_TYPE_SEQUENCE);
+    end = p + len;
+    while (p < end)
+    {
+        if (pdu->nvarbinds >= SNMP_MAXVARBINDS)
+            return (errno = EBADMSG, EXIT_FAILURE);
+        snmp_varbind_t *vb = &pdu->varbind[pdu->nvarbinds];
+        EXPECT(SNMP_TYPE_SEQUENCE);
+        vbend = p + len;
+        EXPECT(SNMP_TYPE_OID);
+        if (ber_oid(p, len, &vb->oid))
+            return (errno = EBADMSG, EXIT_FAILURE);
+        p += len;
+        if (!(p = ber_header(p, vbend, &type, &len)))
+            return (errno = EBADMSG, EXIT_FAILURE);
+        vb->type  = type;
+        vb->value = 0;
+        switch (type)
+        {
+            case SNMP_TYPE_INTEGER:
+                if (ber_integer(p, len, false, &vb->value))
+                    return (errno = EBADMSG, EXIT_FAILURE);
+                break;
+            case SNMP_TYPE_COUNTER32:
+            case SNMP_TYPE_GAUGE32:
+            case SNMP_TYPE_TIMETICKS:
+                if (ber_integer(p, len, true, &vb->value))
+                    return (errno = EBADMSG, EXIT_FAILURE);
+                break;
+            default:
+                // NULL, exceptions and anything we do not decode
+                break;
+        }
+        p = vbend;
+        pdu->nvarbinds++;
+    }
+    return (errno = 0, EXIT_SUCCESS);
+}
+#undef EXPECT
+
+int snmp_oid_parse(snmp_oid_t *oid, const char *str)
+{
+    char *endptr;
+    oid->len = 0;
+    while (*str)
+    {
+        if (oid->len >= SNMP_MAXOIDLEN)
+            return (errno = EINVAL, EXIT_FAILURE);
+        oid->sub[oid->len++] = strtoul(str, &endptr, 10);
+        if (endptr == str || (*endptr && *endptr != '.'))
+            return (errno = EINVAL, EXIT_FAILURE);
+        str = *endptr ? endptr + 1 : endptr;
+    }
+    return (errno = 0, oid->len < 2 ? EXIT_FAILURE : EXIT_SUCCESS);
+}
+
+int snmp_oid_prefix(const snmp_oid_t *prefix, const snmp_oid_t *oid)
+{
+    if (oid->len < prefix->len)
+        return false;
+    return memcmp(prefix->sub, oid->sub, prefix->len * sizeof(uint32_t)) == 0;
+}
+
+
+/*****************************************************************************/
+// CLIENT
+/*****************************************************************************/
+/*
+ * host     name or IP
+ * timeout  in milliseconds
+ */
+struct snmp_t *snmp_prepare(const char *host, int port, const char *community, int timeout)
+{
+    struct hostent *hostent;
+    int             i;
+
+    if (!request_oid_parsed)
+    {
+        for (i = 0; i < ROLE_COUNT; i++)
+            snmp_oid_parse(&request_oid[i], request_oidstr[i]);
+        request_oid_parsed = true;
+    }
+
+    struct snmp_t *snmp = calloc(1, sizeof(struct snmp_t));
+    if (!snmp)
+    {
+        logerr("calloc()");
+        return NULL;
+    }
+    snprintf(snmp->community, sizeof(snmp->community), "%s", community);
+
+    /*
+     * Create timer spec and fd
+     */
+    snmp->timeoutspec.it_value.tv_sec     = timeout / 1000;
+    snmp->timeoutspec.it_value.tv_nsec    = (timeout % 1000) * 1000000;
+    snmp->timeoutspec.it_interval.tv_sec  = 0;
+    snmp->timeoutspec.it_interval.tv_nsec = 0;
+    if ((snmp->timeoutfd = timerfd_create(CLOCK_REALTIME, 0)) == -1)
+    {
+        logerr("timerfd_create()");
+        free(snmp);
+        return NULL;
+    }
+
+    if (!(hostent = gethostbyname(host)))
+    {
+        logerr("gethostbyname(\"%s\") could not resolve host!", host);
+        close(snmp->timeoutfd);
+        free(snmp);
+        return (errno = EHOSTUNREACH, NULL);
+    }
+    snmp->socket_address.sin_family      = AF_INET;
+    snmp->socket_address.sin_port        = htons(port);
+    memcpy(&snmp->socket_address.sin_addr, hostent->h_addr, sizeof(struct in_addr));
+
+    /*
+     * Non-blocking UDP socket, connect()'ed so that the kernel
+     * discards datagrams from any other source
+     */
+    if ((snmp->sockfd = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK, 0)) < 0)
+    {
+        logerr("socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK, 0)");
+        close(snmp->timeoutfd);
+        free(snmp);
+        return NULL;
+    }
+    if (connect(snmp->sockfd, (struct sockaddr *)&snmp->socket_address, sizeof(struct sockaddr_in)))
+    {
+        logerr("connect()");
+        snmp_close(snmp);
+        return NULL;
+    }
+    snmp->requestid = (int32_t)((getpid() ^ time(NULL)) & 0x7FFFFFFF);
+    return (errno = 0, snmp);
+}
+
+int snmp_send(struct snmp_t *snmp)
+{
+    snmp_pdu_t *pdu = &snmp->pdu;
+    int         i, len;
+
+    memset(pdu, 0, sizeof(snmp_pdu_t));
+    pdu->type       = SNMP_PDU_GETBULK;
+    pdu->requestid  = ++snmp->requestid;
+    pdu->errstatus  = N_NONREPEATERS;
+    pdu->errindex   = SNMP_MAXREPETITIONS;
+    pdu->nvarbinds  = ROLE_COUNT;
+    for (i = 0; i < ROLE_COUNT; i++)
+    {
+        pdu->varbind[i].oid  = request_oid[i];
+        pdu->varbind[i].type = SNMP_TYPE_NULL;
+    }
+    if ((len = snmp_encode(snmp->buffer, sizeof(snmp->buffer), snmp->community, pdu)) < 0)
+    {
+        logerr("snmp_encode() failed!");
+        return EXIT_FAILURE;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &snmp->timesent);
+    if (send(snmp->sockfd, snmp->buffer, len, 0) != len)
+    {
+        logerr("send()");
+        return EXIT_FAILURE;
+    }
+    snmp->sent_and_listening = true;
+    return (errno = 0, EXIT_SUCCESS);
+}
+
+/*
+ * Sort response varbinds into snmp_docsis_t
+ */
+static void snmp_parse_docsis(struct snmp_t *snmp)
+{
+    snmp_docsis_t *d = &snmp->docsis;
+    int            i, role, row;
+
+    memset(d, 0, sizeof(snmp_docsis_t));
+    for (i = 0; i < snmp->pdu.nvarbinds; i++)
+    {
+        snmp_varbind_t *vb = &snmp->pdu.varbind[i];
+        if (i < N_NONREPEATERS)
+        {
+            role = i;
+            row  = 0;
+        }
+        else
+        {
+            role = N_NONREPEATERS + (i - N_NONREPEATERS) % N_REPEATERS;
+            row  = (i - N_NONREPEATERS) / N_REPEATERS;
+        }
+        // GetNext walked past the column, or agent has no such object
+        if (vb->type >= SNMP_TYPE_NOSUCHOBJECT && vb->type <= SNMP_TYPE_ENDOFMIBVIEW)
+            continue;
+        if (!snmp_oid_prefix(&request_oid[role], &vb->oid))
+            continue;
+        switch (role)
+        {
+            case ROLE_SYSUPTIME:
+                d->sysuptime     = vb->value;
+                d->has_sysuptime = true;
+                break;
+            case ROLE_TXPOWER:
+                d->txpower       = vb->value;
+                d->has_txpower   = true;
+                break;
+            case ROLE_T3TIMEOUTS:
+                d->t3timeouts    = vb->value;
+                d->has_timeouts  = true;
+                break;
+            case ROLE_T4TIMEOUTS:
+                d->t4timeouts    = vb->value;
+                break;
+            case ROLE_DOWNPOWER:
+                if (row < SNMP_MAXDOWNCHANNELS)
+                {
+                    d->down[row].power = vb->value;
+                    d->ndown = row + 1 > d->ndown ? row + 1 : d->ndown;
+                }
+                break;
+            case ROLE_DOWNSNR:
+                if (row < SNMP_MAXDOWNCHANNELS)
+                {
+                    d->down[row].snr     = vb->value;
+                    d->down[row].has_snr = true;
+                }
+                break;
+            case ROLE_UNERROREDS:
+                if (row < SNMP_MAXDOWNCHANNELS)
+                {
+                    d->down[row].unerroreds   = vb->value;
+                    d->down[row].has_counters = true;
+                }
+                break;
+            case ROLE_CORRECTEDS:
+                if (row < SNMP_MAXDOWNCHANNELS)
+                    d->down[row].correcteds = vb->value;
+                break;
+            case ROLE_UNCORRECTABLES:
+                if (row < SNMP_MAXDOWNCHANNELS)
+                    d->down[row].uncorrectables = vb->value;
+                break;
+            case ROLE_UPTXPOWER:
+                if (row < SNMP_MAXUPCHANNELS)
+                {
+                    d->up[row] = vb->value;
+                    d->nup = row + 1 > d->nup ? row + 1 : d->nup;
+                }
+                break;
+        }
+    }
+}
+
+int snmp_receive(struct snmp_t *snmp)
+{
+    int bytes;
+
+    clock_gettime(CLOCK_MONOTONIC, &snmp->timerecv);
+    if ((bytes = recv(snmp->sockfd, snmp->buffer, sizeof(snmp->buffer), 0)) < 0)
+    {
+        if (errno == EAGAIN || errno == EWOULDBLOCK)
+            return (errno = EAGAIN, -1);
+        // ICMP port unreachable shows up here as ECONNREFUSED
+        logerr("recv()");
+        snmp->sent_and_listening = false;
+        return EXIT_FAILURE;
+    }
+    if (snmp_decode(snmp->buffer, bytes, &snmp->pdu))
+    {
+        logerr("Malformed SNMP response (%d bytes)", bytes);
+        snmp->sent_and_listening = false;
+        return (errno = EBADMSG, EXIT_FAILURE);
+    }
+    // Stale response to some earlier request - keep listening
+    if (snmp->pdu.type != SNMP_PDU_RESPONSE || snmp->pdu.requestid != snmp->requestid)
+    {
+        logdev(
+              "Ignoring SNMP PDU 0x%02X (request-id %d, expected %d)",
+              snmp->pdu.type,
+              snmp->pdu.requestid,
+              snmp->requestid
+              );
+        return (errno = EAGAIN, -1);
+    }
+    snmp->sent_and_listening = false;
+    if (snmp->pdu.errstatus)
+    {
+        logerr(
+              "SNMP agent returned error-status %d (error-index %d)",
+              snmp->pdu.errstatus,
+              snmp->pdu.errindex
+              );
+        return (errno = EPROTO, EXIT_FAILURE);
+    }
+    snmp_parse_docsis(snmp);
+    return (errno = 0, EXIT_SUCCESS);
+}
+
+void snmp_cancel(struct snmp_t *snmp)
+{
+    snmp->sent_and_listening = false;
+    snmp->timesent.tv_sec    = 0;
+    snmp->timesent.tv_nsec   = 0;
+}
+
+void snmp_close(struct snmp_t *snmp)
+{
+    if (!snmp)
+        return;
+    if (snmp->sockfd > 0)
+        close(snmp->sockfd);
+    if (snmp->timeoutfd > 0)
+        close(snmp->timeoutfd);
+    free(snmp);
+}
+
+/*
+ * Return request-response delay in milliseconds
+ */
+double snmp_getelapsed(struct snmp_t *snmp)
+{
+    return (snmp->timerecv.tv_sec  - snmp->timesent.tv_sec) * 1.0e3 +
+           (snmp->timerecv.tv_nsec - snmp->timesent.tv_nsec) / 1.0e6;
+}
+
+/*
+ * Store decoded line values into the database record.
+ * Values not provided by the agent are left as they are
+ * (caller initializes them to DATABASE_DOUBLE_NULL_VALUE).
+ */
+int snmp_fill_record(struct snmp_t *snmp, databaserecord_t *rec)
+{
+    snmp_docsis_t *d = &snmp->docsis;
+    int            i, n = 0;
+    double *down_dbmv[SNMP_MAXDOWNCHANNELS] =
+    {
+        &rec->down_ch1_dbmv, &rec->down_ch2_dbmv, &rec->down_ch3_dbmv, &rec->down_ch4_dbmv,
+        &rec->down_ch5_dbmv, &rec->down_ch6_dbmv, &rec->down_ch7_dbmv, &rec->down_ch8_dbmv
+    };
+    double *down_db[SNMP_MAXDOWNCHANNELS] =
+    {
+        &rec->down_ch1_db, &rec->down_ch2_db, &rec->down_ch3_db, &rec->down_ch4_db,
+        &rec->down_ch5_db, &rec->down_ch6_db, &rec->down_ch7_db, &rec->down_ch8_db
+    };
+    double *up_dbmv[SNMP_MAXUPCHANNELS] =
+    {
+        &rec->up_ch1_dbmv, &rec->up_ch2_dbmv, &rec->up_ch3_dbmv, &rec->up_ch4_dbmv
+    };
+
+    for (i = 0; i < d->ndown; i++)
+    {
+        *down_dbmv[i] = d->down[i].power / 10.0;
+        n++;
+        if (d->down[i].has_snr)
+        {
+            *down_db[i] = d->down[i].snr / 10.0;
+            n++;
+        }
+    }
+    for (i = 0; i < d->nup; i++, n++)
+        *up_dbmv[i] = d->up[i] / 10.0;
+    // Pre-DOCSIS 3.0 modems have only the single upstream value
+    if (!d->nup && d->has_txpower)
+    {
+        rec->up_ch1_dbmv = d->txpower / 10.0;
+        n++;
+    }
+    return n;
+}
+
+void snmp_logdev(struct snmp_t *snmp)
+{
+    snmp_docsis_t *d = &snmp->docsis;
+    int            i;
+    logdev(
+          "SNMP response in %.2f ms: sysUpTime %u, T3 %u, T4 %u, %d down, %d up",
+          snmp_getelapsed(snmp),
+          d->sysuptime,
+          d->t3timeouts,
+          d->t4timeouts,
+          d->ndown,
+          d->nup
+          );
+    for (i = 0; i < d->ndown; i++)
+        logdev(
+              "  down[%d] %5.1f dBmV %4.1f dB  unerr %u corr %u uncorr %u%s",
+              i + 1,
+              d->down[i].power / 10.0,
+              d->down[i].snr / 10.0,
+              d->down[i].unerroreds,
+              d->down[i].correcteds,
+              d->down[i].uncorrectables,
+              d->down[i].has_counters ? "" : " (no counters)"
+              );
+}
+
+/* EOF snmp.c */
@@ -0,0 +1,202 @@
+/*
+ * snmp.h - 2016 Jani Tammi <janitammi@gmail.com>
+ *
+ *      Minimal SNMPv2c client for retrieving DOCSIS-MIB line data.
+ *
+ *      This is an alternative to the external scrubber script. Instead of
+ *      fork()'ing a shell script that fetches and parses the modem's WebUI,
+ *      datalogger sends ONE GetBulkRequest to the modem's SNMP agent and
+ *      reads all line values from the single response datagram.
+ *
+ *      Implementation follows icmpecho.c model: prepare, send, listen with
+ *      pselect() (sockfd + timeoutfd) and receive. Socket is non-blocking
+ *      and the timeout is a timerfd, so the datalogger main loop remains
+ *      the only place that waits.
+ *
+ *      Only the subset of BER that SNMPv2c needs for this purpose is
+ *      implemented: INTEGER, OCTET STRING (community), NULL, OBJECT
+ *      IDENTIFIER, Counter32, Gauge32, TimeTicks and the three v2
+ *      exception values. Octet string VALUES are skipped, not decoded.
+ *
+ *      DOCSIS-MIB (RFC 4546) objects retrieved:
+ *
+ *          sysUpTime.0                     TimeTicks (1/100 s)
+ *          docsIfCmStatusTxPower           TenthdBmV (DOCSIS 1.x/2.0 upstream)
+ *          docsIfCmStatusT3Timeouts        Counter32
+ *          docsIfCmStatusT4Timeouts        Counter32
+ *          docsIfDownChannelPower          TenthdBmV   per downstream channel
+ *          docsIfSigQSignalNoise           TenthdB     per downstream channel
+ *          docsIfSigQUnerroreds            Counter32   per downstream channel
+ *          docsIfSigQCorrecteds            Counter32   per downstream channel
+ *          docsIfSigQUncorrectables        Counter32   per downstream channel
+ *          docsIf3CmStatusUsTxPower        TenthdBmV   per upstream channel
+ *
+ *      Codeword counters are optional; modems that do not implement the
+ *      docsIfSigQ counter columns simply leave them unavailable.
+ */
+#include <stdint.h>             /* uint32_t, int64_t                        */
+#include <time.h>               /* struct timespec                          */
+#include <sys/timerfd.h>        /* struct itimerspec                        */
+#include <netinet/in.h>         /* struct sockaddr_in                       */
+
+#include "database.h"           /* databaserecord_t                         */
+
+#ifndef __SNMP_H__
+#define __SNMP_H__
+
+#define SNMP_PORT                   161
+#define SNMP_VERSION_2C             1       // version field value for SNMPv2c
+#define SNMP_BUFFERSIZE             4096    // UDP datagram buffer
+#define SNMP_MAXOIDLEN              32      // sub-identifiers per OID
+#define SNMP_MAXVARBINDS            64
+#define SNMP_MAXCOMMUNITYLEN        32
+#define SNMP_MAXREPETITIONS         8       // GetBulk repetitions (= max downstream channels)
+#define SNMP_MAXDOWNCHANNELS        8
+#define SNMP_MAXUPCHANNELS          4
+
+/*
+ * BER / SNMP type tags
+ */
+#define SNMP_TYPE_INTEGER           0x02
+#define SNMP_TYPE_OCTETSTRING       0x04
+#define SNMP_TYPE_NULL              0x05
+#define SNMP_TYPE_OID               0x06
+#define SNMP_TYPE_SEQUENCE          0x30
+#define SNMP_TYPE_COUNTER32         0x41
+#define SNMP_TYPE_GAUGE32           0x42
+#define SNMP_TYPE_TIMETICKS         0x43
+#define SNMP_TYPE_NOSUCHOBJECT      0x80
+#define SNMP_TYPE_NOSUCHINSTANCE    0x81
+#define SNMP_TYPE_ENDOFMIBVIEW      0x82
+#define SNMP_PDU_GET                0xA0
+#define SNMP_PDU_GETNEXT            0xA1
+#define SNMP_PDU_RESPONSE           0xA2
+#define SNMP_PDU_GETBULK            0xA5
+
+/*
+ * MIB objects (column OIDs, without the instance index)
+ */
+#define SNMP_OID_SYSUPTIME              "1.3.6.1.2.1.1.3"
+#define SNMP_OID_CMSTATUSTXPOWER        "1.3.6.1.2.1.10.127.1.2.2.1.3"
+#define SNMP_OID_CMSTATUST3TIMEOUTS     "1.3.6.1.2.1.10.127.1.2.2.1.12"
+#define SNMP_OID_CMSTATUST4TIMEOUTS     "1.3.6.1.2.1.10.127.1.2.2.1.13"
+#define SNMP_OID_DOWNCHANNELPOWER       "1.3.6.1.2.1.10.127.1.1.1.1.6"
+#define SNMP_OID_SIGQUNERROREDS         "1.3.6.1.2.1.10.127.1.1.4.1.2"
+#define SNMP_OID_SIGQCORRECTEDS         "1.3.6.1.2.1.10.127.1.1.4.1.3"
+#define SNMP_OID_SIGQUNCORRECTABLES     "1.3.6.1.2.1.10.127.1.1.4.1.4"
+#define SNMP_OID_SIGQSIGNALNOISE        "1.3.6.1.2.1.10.127.1.1.4.1.5"
+#define SNMP_OID_CM3USTXPOWER           "1.3.6.1.4.1.4491.2.1.20.1.2.1.1"
+
+typedef struct
+{
+    int             len;
+    uint32_t        sub[SNMP_MAXOIDLEN];
+} snmp_oid_t;
+
+typedef struct
+{
+    snmp_oid_t      oid;
+    unsigned char   type;               // SNMP_TYPE_*
+    int64_t         value;              // integer types only
+} snmp_varbind_t;
+
+/*
+ * For GetBulkRequest, the wire format reuses error-status and error-index
+ * fields as non-repeaters and max-repetitions, respectively.
+ */
+typedef struct
+{
+    unsigned char   type;               // SNMP_PDU_*
+    int32_t         requestid;
+    int32_t         errstatus;          // GETBULK: non-repeaters
+    int32_t         errindex;           // GETBULK: max-repetitions
+    int             nvarbinds;
+    snmp_varbind_t  varbind[SNMP_MAXVARBINDS];
+} snmp_pdu_t;
+
+/*
+ * Decoded DOCSIS line data. Values are as reported by the agent
+ * (tenths of dB/dBmV), conversion takes place in snmp_fill_record().
+ */
+typedef struct
+{
+    uint32_t        sysuptime;          // 1/100 seconds
+    int             txpower;            // docsIfCmStatusTxPower (TenthdBmV)
+    uint32_t        t3timeouts;
+    uint32_t        t4timeouts;
+    unsigned int    has_txpower     : 1;
+    unsigned int    has_sysuptime   : 1;
+    unsigned int    has_timeouts    : 1;
+    int             ndown;
+    struct
+    {
+        int         power;              // TenthdBmV
+        int         snr;                // TenthdB
+        uint32_t    unerroreds;
+        uint32_t    correcteds;
+        uint32_t    uncorrectables;
+        unsigned int has_snr         : 1;
+        unsigned int has_counters    : 1;
+    } down[SNMP_MAXDOWNCHANNELS];
+    int             nup;
+    int             up[SNMP_MAXUPCHANNELS]; // TenthdBmV
+} snmp_docsis_t;
+
+struct snmp_t
+{
+    int                 sockfd;
+    int                 timeoutfd;
+    struct itimerspec   timeoutspec;
+    struct sockaddr_in  socket_address;
+    int                 sent_and_listening;     // TRUE when request is sent and not yet received (or timed out)
+    int32_t             requestid;
+    char                community[SNMP_MAXCOMMUNITYLEN + 1];
+    unsigned char       buffer[SNMP_BUFFERSIZE];
+    snmp_pdu_t          pdu;
+    snmp_docsis_t       docsis;
+    struct timespec     timesent;
+    struct timespec     timerecv;
+};
+
+/*
+ * Client API (see icmpecho.h for the same model)
+ *
+ *  snmp_prepare()      Create socket and timerfd, resolve host.
+ *                      timeout in milliseconds.
+ *  snmp_send()         Send GetBulkRequest. Caller arms ->timeoutfd.
+ *  snmp_receive()      Read datagram from ->sockfd.
+ *                      Returns EXIT_SUCCESS when a valid response was
+ *                      decoded, -1 (errno = EAGAIN) when the datagram was
+ *                      not ours (keep listening) and EXIT_FAILURE on
+ *                      malformed or error response.
+ *  snmp_cancel()       Stop listening (timeout).
+ *  snmp_close()        Close descriptors and free.
+ *  snmp_fill_record()  Store decoded values into databaserecord_t.
+ *                      Returns number of line values stored.
+ */
+struct snmp_t * snmp_prepare(const char *host, int port, const char *community, int timeout);
+int             snmp_send(struct snmp_t *);
+int             snmp_receive(struct snmp_t *);
+void            snmp_cancel(struct snmp_t *);
+void            snmp_close(struct snmp_t *);
+double          snmp_getelapsed(struct snmp_t *);
+int             snmp_fill_record(struct snmp_t *, databaserecord_t *);
+void            snmp_logdev(struct snmp_t *);
+
+/*
+ * BER encode / decode (public for the unit test responder)
+ *
+ *  snmp_encode()       Encode complete SNMPv2c message. Returns length or -1.
+ *  snmp_decode()       Decode complete SNMPv2c message. Returns EXIT_SUCCESS
+ *                      or EXIT_FAILURE (errno = EBADMSG).
+ *  snmp_oid_parse()    "1.3.6.1.2.1.1.3" -> snmp_oid_t
+ *  snmp_oid_prefix()   TRUE if oid is within (or equal to) prefix subtree
+ */
+int             snmp_encode(unsigned char *buffer, int size, const char *community, snmp_pdu_t *pdu);
+int             snmp_decode(const unsigned char *buffer, int len, snmp_pdu_t *pdu);
+int             snmp_oid_parse(snmp_oid_t *oid, const char *str);
+int             snmp_oid_prefix(const snmp_oid_t *prefix, const snmp_oid_t *oid);
+
+#endif /* __SNMP_H__ */
+
+/* EOF snmp.h */
@@ -0,0 +1,393 @@
+/*
+ * spool.c - 2016 Jani Tammi <janitammi@gmail.com>
+ *
+ *      Crash-safe append spool. See spool.h.
+ *
+ *      File layout
+ *
+ *          spool_header_t
+ *          spool_record_t, payload (header.recordsize bytes)
+ *          spool_record_t, payload
+ *          ...
+ *
+ *      Appends are pwrite()'s at the end of file, as observed under the
+ *      record lock (O_APPEND would also redirect the header updates).
+ */
+#include <stdio.h>
+#include <stdlib.h>             // EXIT_SUCCESS, EXIT_FAILURE
+#include <stdint.h>
+#include <stddef.h>             // offsetof()
+#include <string.h>
+#include <unistd.h>             // pread(), pwrite(), fdatasync(), ftruncate()
+#include <fcntl.h>              // open(), fcntl()
+#include <errno.h>
+#include <sys/stat.h>           // fstat()
+
+#include "spool.h"
+#include "logwrite.h"
+#include "util.h"               // xtmr(), crc32()
+
+#define SPOOL_MAGIC             "ICMONDSP"
+#define SPOOL_VERSION           1
+#define SPOOL_CHUNK             65536       // (bytes) read at a time
+
+typedef struct
+{
+    char            magic[8];
+    uint32_t        version;
+    uint32_t        recordsize;             // payload
+    uint64_t        consumed;               // offset, records before it are in the datafile
+} spool_header_t;
+
+typedef struct
+{
+    uint32_t        crc;                    // payload
+    uint32_t        size;                   // payload
+} spool_record_t;
+
+struct spool_t
+{
+    char           *filename;
+    int             fd;
+    uint32_t        recordsize;             // payload
+    size_t          stride;                 // spool_record_t + payload
+    off_t           consumed;
+    off_t           read;                   // next record to read
+    off_t           synced;                 // file size at the last sync
+    uint8_t        *buf;                    // SPOOL_CHUNK
+    spool_stats_t   stats;
+};
+
+/*
+ * POSIX record locks are per process, which is what separates the workers
+ * from each other and from the daemon (flock() and OFD locks would be
+ * shared over fork()).
+ */
+static int spool_lock(spool_t *spool, short type)
+{
+    struct flock fl;
+
+    memset(&fl, 0, sizeof(fl));
+    fl.l_type   = type;
+    fl.l_whence = SEEK_SET;
+    while (fcntl(spool->fd, F_SETLKW, &fl) == -1)
+    {
+        if (errno != EINTR)
+        {
+            logerr("fcntl(\"%s\", F_SETLKW)", spool->filename);
+            return EXIT_FAILURE;
+        }
+    }
+    return (errno = 0, EXIT_SUCCESS);
+}
+
+static off_t spool_size(spool_t *spool)
+{
+    struct stat st;
+
+    if (spool_lock(spool, F_RDLCK))
+        return -1;
+    if (fstat(spool->fd, &st))
+        st.st_size = -1;
+    spool_lock(spool, F_UNLCK);
+    return st.st_size;
+}
+
+static int spool_writeconsumed(spool_t *spool, off_t consumed)
+{
+    uint64_t value = consumed;
+
+    if (pwrite(spool->fd, &value, sizeof(value), offsetof(spool_header_t, consumed)) != sizeof(value) ||
+        fdatasync(spool->fd))
+    {
+        logerr("Unable to update \"%s\"", spool->filename);
+        return EXIT_FAILURE;
+    }
+    spool->consumed = consumed;
+    return (errno = 0, EXIT_SUCCESS);
+}
+
+spool_t *spool_open(char *filename, uint32_t recordsize)
+{
+    spool_header_t header;
+    spool_t       *spool;
+    struct stat    st;
+    off_t          end;
+
+    if (!(spool = calloc(1, sizeof(spool_t))))
+    {
+        logerr("Out of memory");
+        return NULL;
+    }
+    spool->fd         = -1;
+    spool->recordsize = recordsize;
+    spool->stride     = sizeof(spool_record_t) + recordsize;
+    if (!(spool->filename = strdup(filename)) ||
+        !(spool->buf = malloc(SPOOL_CHUNK)) ||
+        spool->stride > SPOOL_CHUNK)
+    {
+        logerr("Out of memory");
+        goto fail;
+    }
+    if ((spool->fd = open(filename, O_RDWR | O_CREAT | O_CLOEXEC, 0644)) == -1 || fstat(spool->fd, &st))
+    {
+        logerr("open(\"%s\")", filename);
+        goto fail;
+    }
+    if (!st.st_size)
+    {
+        memset(&header, 0, sizeof(header));
+        memcpy(header.magic, SPOOL_MAGIC, sizeof(header.magic));
+        header.version    = SPOOL_VERSION;
+        header.recordsize = recordsize;
+        header.consumed   = sizeof(header);
+        if (pwrite(spool->fd, &header, sizeof(header), 0) != sizeof(header) || fdatasync(spool->fd))
+        {
+            logerr("Unable to write \"%s\"", filename);
+            goto fail;
+        }
+        st.st_size = sizeof(header);
+    }
+    if (st.st_size < sizeof(header) ||
+        pread(spool->fd, &header, sizeof(header), 0) != sizeof(header) ||
+        memcmp(header.magic, SPOOL_MAGIC, sizeof(header.magic)) ||
+        header.version != SPOOL_VERSION)
+    {
+        logmsg(LOG_ERR, "\"%s\" is not a spool file", filename);
+        errno = EINVAL;
+        goto fail;
+    }
+    // Left by another build, records cannot be read
+    if (header.recordsize != recordsize)
+    {
+        logmsg(LOG_ERR, "\"%s\" has %u byte records, expected %u", filename, header.recordsize, recordsize);
+        errno = EINVAL;
+        goto fail;
+    }
+    // Torn record from a power cut during an append
+    end = sizeof(header) + (st.st_size - sizeof(header)) / spool->stride * spool->stride;
+    if (end != st.st_size)
+    {
+        logmsg(LOG_ERR, "Spool \"%s\" ends with a torn record, truncating", filename);
+        if (ftruncate(spool->fd, end))
+        {
+            logerr("ftruncate(\"%s\")", filename);
+            goto fail;
+        }
+    }
+    // Truncated, but the header was not updated
+    spool->consumed = header.consumed;
+    if (spool->consumed < sizeof(header) || spool->consumed > end ||
+        (spool->consumed - sizeof(header)) % spool->stride)
+        spool->consumed = spool->consumed > end ? end : sizeof(header);
+    spool->read     = spool->consumed;
+    spool->synced   = end;
+    spool->stats.n_replayed = (end - spool->consumed) / spool->stride;
+    logdev("Spool \"%s\" opened, %u unconsumed records", filename, spool->stats.n_replayed);
+    return (errno = 0, spool);
+fail:
+    end = errno;
+    spool_close(spool);
+    errno = end;
+    return NULL;
+}
+
+int spool_sync(spool_t *spool)
+{
+    struct stat st;
+
+    if (fstat(spool->fd, &st))
+        return EXIT_FAILURE;
+    if (st.st_size == spool->synced)
+        return (errno = 0, EXIT_SUCCESS);
+    if (fdatasync(spool->fd))
+    {
+        logerr("fdatasync(\"%s\")", spool->filename);
+        return EXIT_FAILURE;
+    }
+    spool->synced = st.st_size;
+    spool->stats.n_syncs++;
+    return (errno = 0, EXIT_SUCCESS);
+}
+
+int spool_read(spool_t *spool, void *records, int n)
+{
+    spool_record_t *rec;
+    uint8_t        *out = records;
+    off_t           end;
+    int             i, m, count = 0;
+
+    // Appends are complete under the lock, partial records are not seen
+    if ((end = spool_size(spool)) < 0)
+        return -1;
+    while (count < n && spool->read + spool->stride <= end)
+    {
+        // Records in this chunk
+        m = (end - spool->read) / spool->stride;
+        m = m > SPOOL_CHUNK / spool->stride ? SPOOL_CHUNK / spool->stride : m;
+        m = m > n - count ? n - count : m;
+        if (pread(spool->fd, spool->buf, m * spool->stride, spool->read) != m * spool->stride)
+        {
+            logerr("pread(\"%s\")", spool->filename);
+            return -1;
+        }
+        for (i = 0; i < m; i++)
+        {
+            rec = (spool_record_t *)(spool->buf + i * spool->stride);
+            if (rec->size != spool->recordsize ||
+                crc32(rec + 1, spool->recordsize) != rec->crc)
+            {
+                spool->stats.n_corrupt++;
+                logmsg(LOG_ERR, "Spool \"%s\" record at offset %lld is corrupt, skipped",
+                       spool->filename, (long long)(spool->read + i * spool->stride));
+                continue;
+            }
+            memcpy(out + count++ * spool->recordsize, rec + 1, spool->recordsize);
+        }
+        spool->read += m * spool->stride;
+    }
+    spool->stats.n_read += count;
+    return (errno = 0, count);
+}
+
+int spool_consume(spool_t *spool)
+{
+    struct stat st;
+    int         rc = EXIT_SUCCESS;
+
+    if (spool->read == spool->consumed)
+        return (errno = 0, EXIT_SUCCESS);
+    if (spool_writeconsumed(spool, spool->read))
+        return EXIT_FAILURE;
+    /*
+     * Empty the spool if no worker appended since the read. Truncation is
+     * made durable before the header points back to the first record,
+     * otherwise a crash could replay the whole file.
+     */
+    if (spool_lock(spool, F_WRLCK))
+        return EXIT_FAILURE;
+    if (!fstat(spool->fd, &st) && st.st_size == spool->consumed)
+    {
+        if (ftruncate(spool->fd, sizeof(spool_header_t)) || fdatasync(spool->fd) ||
+            spool_writeconsumed(spool, sizeof(spool_header_t)))
+        {
+            logerr("Unable to truncate \"%s\"", spool->filename);
+            rc = EXIT_FAILURE;
+        }
+        else
+        {
+            spool->read   = sizeof(spool_header_t);
+            spool->synced = sizeof(spool_header_t);
+            spool->stats.n_truncates++;
+        }
+    }
+    spool_lock(spool, F_UNLCK);
+    return rc ? rc : (errno = 0, EXIT_SUCCESS);
+}
+
+void spool_rewind(spool_t *spool)
+{
+    spool->read = spool->consumed;
+}
+
+int spool_pending(spool_t *spool)
+{
+    off_t end = spool_size(spool);
+
+    return end > spool->read ? (end - spool->read) / spool->stride : 0;
+}
+
+void spool_close(spool_t *spool)
+{
+    if (!spool)
+        return;
+    if (spool->fd != -1)
+        close(spool->fd);
+    free(spool->buf);
+    free(spool->filename);
+    free(spool);
+}
+
+spool_stats_t *spool_getstats(spool_t *spool)
+{
+    return &spool->stats;
+}
+
+/*
+ * Worker side
+ */
+int spool_append(spool_t *spool, const void *record)
+{
+    spool_record_t *rec = (spool_record_t *)spool->buf;
+    struct stat     st;
+    int             rc = EXIT_SUCCESS;
+
+    rec->crc  = crc32(record, spool->recordsize);
+    rec->size = spool->recordsize;
+    memcpy(rec + 1, record, spool->recordsize);
+    if (spool_lock(spool, F_WRLCK))
+        return EXIT_FAILURE;
+    if (fstat(spool->fd, &st))
+        rc = EXIT_FAILURE;
+    else if (pwrite(spool->fd, spool->buf, spool->stride, st.st_size) != spool->stride)
+    {
+        logerr("Unable to append into \"%s\"", spool->filename);
+        // Partial record would misalign the records after it
+        if (ftruncate(spool->fd, st.st_size))
+            logerr("ftruncate(\"%s\")", spool->filename);
+        rc = EXIT_FAILURE;
+    }
+    spool_lock(spool, F_UNLCK);
+    return rc ? rc : (errno = 0, EXIT_SUCCESS);
+}
+
+/*
+ * Test spool write performance (worst case)
+ */
+dbperf_t *spool_testwriteperf(char *filename, int nsamples)
+{
+    static dbperf_t  perf;
+    databaserecord_t rec;
+    spool_t         *spool;
+    xtmr_t          *t;
+    double          *ms;
+    int              i;
+
+    if (nsamples < 1)
+        return (errno = EINVAL, NULL);
+    if (!(ms = calloc(nsamples, sizeof(double))))
+    {
+        logerr("calloc()");
+        return NULL;
+    }
+    memset(&rec, 0, sizeof(rec));
+    unlink(filename);
+    if (!(spool = spool_open(filename, sizeof(rec))))
+    {
+        free(ms);
+        return NULL;
+    }
+    t = xtmr();
+    for (i = 0; i < nsamples; i++)
+    {
+        xtmrlap(t);
+        if (spool_append(spool, &rec) || fdatasync(spool->fd))
+        {
+            logerr("Spool write failed!");
+            spool_close(spool);
+            unlink(filename);
+            free(t);
+            free(ms);
+            return NULL;
+        }
+        ms[i] = xtmrlap(t);
+    }
+    free(t);
+    spool_close(spool);
+    unlink(filename);
+    database_perfstats(&perf, ms, nsamples);    // database.c
+    free(ms);
+    return &perf;
+}
+
+/* EOF spool.c */
@@ -0,0 +1,90 @@
+/*
+ * spool.h - 2016 Jani Tammi <janitammi@gmail.com>
+ *
+ *      Crash-safe append spool (cfg.database.spool).
+ *
+ *      tmpfs datafile (cfg.execute.tmpfs) keeps the SQLite3 writes off a
+ *      slow data volume, but it needs root to mount() and everything in it
+ *      is lost when the power is cut. Spool is a plain file on the data
+ *      volume instead:
+ *
+ *      1.  Workers append fixed size, checksummed records into it. One
+ *          pwrite() a row, no fsync(), no SQLite3.
+ *      2.  Daemon syncs the spool on the commit interval; one fdatasync()
+ *          for all the records appended since the last one.
+ *      3.  Daemon drains the spool into the datafile in large transactions
+ *          (dbwriter.c). Records are consumed only after the transaction
+ *          has committed. Whatever a crash or a power cut leaves in the
+ *          spool is replayed when it is opened again.
+ *
+ *          spool_header_t      magic, version, record size, consumed offset
+ *          spool_record_t      checksum, payload
+ *          ...
+ *
+ *      Consumed offset is written (and synced) after the drain commit. A
+ *      crash between the two replays the drained records once more. Sample
+ *      rows merge by timestamp (data view), counters and reboots would be
+ *      duplicated.
+ *
+ *      When everything has been consumed, the spool is truncated back to
+ *      the header. Appends and the truncation are serialized with a POSIX
+ *      record lock (workers are separate processes). A torn record (power
+ *      cut during an append) is truncated away by spool_open(). A record
+ *      that fails its checksum is skipped.
+ */
+#include <stdint.h>             /* uint32_t                                 */
+
+#include "database.h"           /* dbperf_t                                 */
+
+#ifndef __SPOOL_H__
+#define __SPOOL_H__
+
+typedef struct spool_t spool_t;
+
+typedef struct
+{
+    uint32_t        n_replayed;                 // unconsumed in spool_open()
+    uint32_t        n_read;
+    uint32_t        n_corrupt;                  // failed the checksum
+    uint32_t        n_syncs;
+    uint32_t        n_truncates;                // spool emptied
+} spool_stats_t;
+
+/*
+ * Daemon
+ *
+ *  spool_open()        Open or create. Truncates a torn record. NULL on error.
+ *  spool_sync()        fdatasync() if anything was appended since.
+ *  spool_read()        Copy up to n next records (payloads) into records[].
+ *                      Returns number of records, -1 on error.
+ *  spool_consume()     Records read so far are in the datafile. Truncates
+ *                      the spool if nothing else was appended.
+ *  spool_rewind()      Records read so far were not written, read again.
+ *  spool_pending()     Records not yet read.
+ *  spool_close()       Close. Unconsumed records stay in the file.
+ *  spool_getstats()    Totals since open.
+ *
+ * Worker
+ *
+ *  spool_append()      Append a record (recordsize bytes).
+ */
+spool_t *spool_open(char *filename, uint32_t recordsize);
+int     spool_sync(spool_t *spool);
+int     spool_read(spool_t *spool, void *records, int n);
+int     spool_consume(spool_t *spool);
+void    spool_rewind(spool_t *spool);
+int     spool_pending(spool_t *spool);
+void    spool_close(spool_t *spool);
+spool_stats_t *spool_getstats(spool_t *spool);
+int     spool_append(spool_t *spool, const void *record);
+
+/*
+ * Append and fdatasync() each record (worst case, no batching) into a
+ * scratch spool. -testdbwriteperf compares this against the datafile.
+ * Returns pointer to static dbperf_t (do not free).
+ */
+dbperf_t *spool_testwriteperf(char *filename, int nsamples);
+
+#endif /* __SPOOL_H__ */
+
+/* EOF spool.h */
@@ -0,0 +1,433 @@
+/*
+ * storage.c - 2016 Jani Tammi <janitammi@gmail.com>
+ *
+ *      Storage backends. See storage.h.
+ */
+#include <stdlib.h>             // EXIT_SUCCESS, EXIT_FAILURE
+#include <string.h>             // memset(), memmove()
+#include <errno.h>
+
+#include "storage.h"
+#include "logwrite.h"
+#include "util.h"               // xtmr()
+#include "config.h"             // cfg.database.backend, .tmpfsfilename
+
+struct storage_t
+{
+    const storage_backend_t *backend;
+    void                    *store;
+};
+
+/******************************************************************************
+ * SQLite3 backend
+ *
+ *      Appends open a transaction (database_begin() is a no-op if one is
+ *      open), flush commits it. Rollups of the appended rows and counters
+ *      are updated in the same transaction, like the database writer does.
+ */
+typedef struct
+{
+    dbhandle_t     *handle;
+    time_t          first;              // rows appended since the last flush
+    time_t          last;               // (0 == none)
+} sqlitestore_t;
+
+static void sqlite_touch(sqlitestore_t *s, time_t timestamp)
+{
+    s->first = !s->last || timestamp < s->first ? timestamp : s->first;
+    s->last  = timestamp > s->last ? timestamp : s->last;
+}
+
+static void *sqlite_open(char *datafile)
+{
+    sqlitestore_t *s;
+
+    if (!(s = calloc(1, sizeof(sqlitestore_t))))
+    {
+        logerr("calloc()");
+        return NULL;
+    }
+    if (!(s->handle = database_open(datafile)))
+    {
+        free(s);
+        return NULL;
+    }
+    return s;
+}
+
+static int sqlite_append(void *store, databaserecord_t *records, int n)
+{
+    sqlitestore_t *s = store;
+    int            i, rc;
+
+    if ((rc = database_begin(s->handle)))
+        return rc;
+    for (i = 0; i < n; i++)
+    {
+        if ((rc = database_write(s->handle, &records[i])))
+            return rc;
+        sqlite_touch(s, records[i].timestamp);
+    }
+    return 0;
+}
+
+static int sqlite_appendcounters(void *store, databasecounters_t *counters)
+{
+    sqlitestore_t *s = store;
+    int            rc;
+
+    if ((rc = database_begin(s->handle)) ||
+        (rc = database_writecounters(s->handle, counters)))
+        return rc;
+    sqlite_touch(s, counters->timestamp);
+    return 0;
+}
+
+static int sqlite_appendreboot(void *store, databasereboot_t *reboot)
+{
+    sqlitestore_t *s = store;
+    int            rc;
+
+    if ((rc = database_begin(s->handle)))
+        return rc;
+    return database_writereboot(s->handle, reboot);
+}
+
+static int sqlite_flush(void *store)
+{
+    sqlitestore_t *s = store;
+
+    if (!database_intransaction(s->handle))
+        return 0;
+    // Failure is not fatal (-rebuildrollups)
+    if (s->last && database_rollup(s->handle, s->first, s->last))
+        logerr("Rollup update failed, rows are committed without it");
+    s->last = 0;
+    return database_commit(s->handle);
+}
+
+static int sqlite_scan(
+                      void *store,
+                      time_t from,
+                      time_t to,
+                      int (*fn)(databaserecord_t *record, void *arg),
+                      void *arg
+                      )
+{
+    return database_scan(((sqlitestore_t *)store)->handle, from, to, fn, arg);
+}
+
+static void sqlite_close(void *store)
+{
+    sqlitestore_t *s = store;
+
+    sqlite_flush(s);
+    database_close(s->handle);
+    free(s);
+}
+
+const storage_backend_t storage_sqlite =
+{
+    .name           = "SQLITE",
+    .open           = sqlite_open,
+    .append         = sqlite_append,
+    .appendcounters = sqlite_appendcounters,
+    .appendreboot   = sqlite_appendreboot,
+    .flush          = sqlite_flush,
+    .scan           = sqlite_scan,
+    .close          = sqlite_close
+};
+
+/******************************************************************************
+ * Memory backend
+ *
+ *      Rows are kept sorted by timestamp. Rows arrive mostly in order, an
+ *      append is then a copy to the end; a late row is moved into place.
+ *      Counters and reboots are only counted.
+ */
+typedef struct
+{
+    databaserecord_t *rows;
+    int               n_rows;
+    int               size;
+    int               n_counters;
+    int               n_reboots;
+} memorystore_t;
+
+/*
+ * Index of the first row with timestamp >= t
+ */
+static int memory_search(memorystore_t *m, time_t t)
+{
+    int lo = 0, hi = m->n_rows, mid;
+
+    while (lo < hi)
+    {
+        mid = (lo + hi) / 2;
+        if (m->rows[mid].timestamp < t)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+static void *memory_open(char *datafile)
+{
+    memorystore_t *m;
+
+    if (!(m = calloc(1, sizeof(memorystore_t))))
+    {
+        logerr("calloc()");
+        return NULL;
+    }
+    return m;
+}
+
+static int memory_append(void *store, databaserecord_t *records, int n)
+{
+    memorystore_t    *m = store;
+    databaserecord_t *rows;
+    int               i, at, size;
+
+    if (m->n_rows + n > m->size)
+    {
+        for (size = m->size ? m->size : STORAGE_MEMORY_ROWS; size < m->n_rows + n; size *= 2)
+            ;
+        if (!(rows = realloc(m->rows, size * sizeof(databaserecord_t))))
+        {
+            logerr("realloc()");
+            return ENOMEM;
+        }
+        m->rows = rows;
+        m->size = size;
+    }
+    for (i = 0; i < n; i++)
+    {
+        if (!m->n_rows || records[i].timestamp >= m->rows[m->n_rows - 1].timestamp)
+            at = m->n_rows;
+        else
+        {
+            // After the rows of the same timestamp, like the datafile returns them
+            at = memory_search(m, records[i].timestamp + 1);
+            memmove(&m->rows[at + 1], &m->rows[at], (m->n_rows - at) * sizeof(databaserecord_t));
+        }
+        m->rows[at] = records[i];
+        m->n_rows++;
+    }
+    return 0;
+}
+
+static int memory_appendcounters(void *store, databasecounters_t *counters)
+{
+    ((memorystore_t *)store)->n_counters++;
+    return 0;
+}
+
+static int memory_appendreboot(void *store, databasereboot_t *reboot)
+{
+    ((memorystore_t *)store)->n_reboots++;
+    return 0;
+}
+
+static int memory_flush(void *store)
+{
+    return 0;
+}
+
+static int memory_scan(
+                      void *store,
+                      time_t from,
+                      time_t to,
+                      int (*fn)(databaserecord_t *record, void *arg),
+                      void *arg
+                      )
+{
+    memorystore_t *m = store;
+    int            i, n = 0;
+
+    for (i = memory_search(m, from); i < m->n_rows && m->rows[i].timestamp <= to; i++)
+    {
+        n++;
+        if (fn(&m->rows[i], arg))
+            break;
+    }
+    return n;
+}
+
+static void memory_close(void *store)
+{
+    memorystore_t *m = store;
+
+    free(m->rows);
+    free(m);
+}
+
+const storage_backend_t storage_memory =
+{
+    .name           = "MEMORY",
+    .open           = memory_open,
+    .append         = memory_append,
+    .appendcounters = memory_appendcounters,
+    .appendreboot   = memory_appendreboot,
+    .flush          = memory_flush,
+    .scan           = memory_scan,
+    .close          = memory_close
+};
+
+/******************************************************************************
+ * Public
+ */
+const storage_backend_t *storage_backend(int backend)
+{
+    return backend == CFG_BACKEND_MEMORY ? &storage_memory : &storage_sqlite;
+}
+
+char *storage_datafile(time_t t)
+{
+    char *datafile;
+
+    if (cfg.execute.tmpfs)
+        return cfg.database.tmpfsfilename;
+    if (database_preparepartition(datafile = database_partition(t)))   // database.c
+        return NULL;
+    return datafile;
+}
+
+storage_t *storage_open(const storage_backend_t *backend, char *datafile)
+{
+    storage_t *storage;
+
+    if (!(storage = calloc(1, sizeof(storage_t))))
+    {
+        logerr("calloc()");
+        return NULL;
+    }
+    storage->backend = backend;
+    if (!(storage->store = backend->open(datafile)))
+    {
+        logerr("Unable to open %s storage for \"%s\"", backend->name, datafile);
+        free(storage);
+        return NULL;
+    }
+    return storage;
+}
+
+int storage_append(storage_t *storage, databaserecord_t *records, int n)
+{
+    return storage->backend->append(storage->store, records, n);
+}
+
+int storage_appendcounters(storage_t *storage, databasecounters_t *counters)
+{
+    return storage->backend->appendcounters(storage->store, counters);
+}
+
+int storage_appendreboot(storage_t *storage, databasereboot_t *reboot)
+{
+    return storage->backend->appendreboot(storage->store, reboot);
+}
+
+int storage_flush(storage_t *storage)
+{
+    return storage->backend->flush(storage->store);
+}
+
+int storage_scan(
+                storage_t *storage,
+                time_t from,
+                time_t to,
+                int (*fn)(databaserecord_t *record, void *arg),
+                void *arg
+                )
+{
+    return storage->backend->scan(storage->store, from, to, fn, arg);
+}
+
+void storage_close(storage_t *storage)
+{
+    if (!storage)
+        return;
+    storage->backend->close(storage->store);
+    free(storage);
+}
+
+const char *storage_name(storage_t *storage)
+{
+    return storage->backend->name;
+}
+
+/*
+ * Benchmark harness (see storage.h). Rows carry both pings and line
+ * values, like a merged row of the datafile.
+ */
+dbperf_t *storage_testwriteperf(
+                               const storage_backend_t *backend,
+                               char *datafile,
+                               int nsamples,
+                               int batch,
+                               int persistent
+                               )
+{
+    static dbperf_t   perf;
+    databaserecord_t *rows;
+    storage_t        *storage = NULL;
+    xtmr_t           *t;
+    double           *value, *ms;
+    time_t            now = time(NULL);
+    int               i, c, n, b = 0, rc = 0;
+
+    if (nsamples < 1 || batch < 1)
+        return (errno = EINVAL, NULL);
+    rows = calloc(batch, sizeof(databaserecord_t));
+    ms   = calloc((nsamples + batch - 1) / batch, sizeof(double));
+    if (!rows || !ms)
+    {
+        logerr("calloc()");
+        free(rows);
+        free(ms);
+        return NULL;
+    }
+    if (persistent && !(storage = storage_open(backend, datafile)))
+    {
+        free(rows);
+        free(ms);
+        return NULL;
+    }
+    t = xtmr();
+    for (i = 0; i < nsamples && !rc; i += n)
+    {
+        n = nsamples - i < batch ? nsamples - i : batch;
+        for (c = 0; c < n; c++)
+        {
+            rows[c].timestamp = now + i + c;
+            for (value = &rows[c].modemping_ms; value <= &rows[c].up_ch4_dbmv; value++)
+                *value = 1.5 + (i + c) % 50 / 10.0;
+        }
+        xtmrlap(t);
+        // Open per batch is timed too, that is its cost
+        if (!persistent && !(storage = storage_open(backend, datafile)))
+            rc = -1;
+        else if ((rc = storage_append(storage, rows, n)) || (rc = storage_flush(storage)))
+            logerr("%s storage write failed (%d)!", backend->name, rc);
+        if (!persistent)
+        {
+            storage_close(storage);
+            storage = NULL;
+        }
+        ms[b++] = xtmrlap(t);
+    }
+    free(t);
+    storage_close(storage);
+    free(rows);
+    if (rc)
+    {
+        free(ms);
+        return NULL;
+    }
+    database_perfstats(&perf, ms, b);       // database.c
+    free(ms);
+    return &perf;
+}
+
+/* EOF storage.c */
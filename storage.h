@@ -0,0 +1,115 @@
+/*
+ * storage.h - 2016 Jani Tammi <janitammi@gmail.com>
+ *
+ *      Storage backends (cfg.database.backend).
+ *
+ *      Rows used to be written with SQLite3 calls wherever they were
+ *      produced, and the worker picked the datafile (tmpfs or partition)
+ *      itself. A storage backend is a table of functions; the engine
+ *      behind it can be changed without touching the callers:
+ *
+ *          open            Open the store of a datafile.
+ *          append          Batch of sample rows. May be buffered until
+ *                          flush.
+ *          appendcounters  Counter deltas, reboot event. Buffered like the
+ *          appendreboot    samples.
+ *          flush           Everything appended so far is stored.
+ *          scan            Sample rows of a time range, in timestamp order.
+ *                          Rows appended but not yet flushed are included.
+ *          close           Flush and close.
+ *
+ *      Backends
+ *
+ *          storage_sqlite  Datafile (database.c). Appends go into one
+ *                          transaction, flush commits it with the rollups.
+ *          storage_memory  Sorted array in process memory, nothing
+ *                          survives close. Test double, and the baseline
+ *                          of the benchmarks (no storage cost at all).
+ *
+ *      Return values are 0 for success, otherwise an error code of the
+ *      backend (SQLite3 result codes for storage_sqlite).
+ *
+ *      Worker (datalogger.c) writes through the configured backend when
+ *      the database writer is not running. The writer process keeps its
+ *      own SQLite3 connection (group commit, checkpoints, retention, see
+ *      dbwriter.h) and is started only with the SQLite3 backend.
+ */
+#include <time.h>               /* time_t                                   */
+
+#include "database.h"           /* databaserecord_t, dbperf_t               */
+
+#ifndef __STORAGE_H__
+#define __STORAGE_H__
+
+#define STORAGE_MEMORY_ROWS         256         // initial size of the memory store
+
+typedef struct
+{
+    const char     *name;                       // CFG_BACKEND_NAME()
+    void *          (*open)(char *datafile);
+    int             (*append)(void *store, databaserecord_t *records, int n);
+    int             (*appendcounters)(void *store, databasecounters_t *counters);
+    int             (*appendreboot)(void *store, databasereboot_t *reboot);
+    int             (*flush)(void *store);
+    int             (*scan)(
+                           void *store,
+                           time_t from,
+                           time_t to,
+                           int (*fn)(databaserecord_t *record, void *arg),
+                           void *arg
+                           );
+    void            (*close)(void *store);
+} storage_backend_t;
+
+extern const storage_backend_t storage_sqlite;
+extern const storage_backend_t storage_memory;
+
+typedef struct storage_t storage_t;
+
+/*
+ *  storage_backend()   Backend of CFG_BACKEND_* value.
+ *  storage_datafile()  Datafile for the rows of time t: the tmpfs datafile,
+ *                      or the partition (created if it does not exist).
+ *                      Static buffer, NULL on error.
+ *  storage_open()      Open backend store for datafile. NULL on error.
+ *  storage_*()         Call the backend function (see above).
+ *  storage_scan()      fn() returning non-zero stops the scan. Returns
+ *                      number of rows, -1 on error.
+ *  storage_name()      Backend name.
+ */
+const storage_backend_t *storage_backend(int backend);
+char   *storage_datafile(time_t t);
+storage_t *storage_open(const storage_backend_t *backend, char *datafile);
+int     storage_append(storage_t *storage, databaserecord_t *records, int n);
+int     storage_appendcounters(storage_t *storage, databasecounters_t *counters);
+int     storage_appendreboot(storage_t *storage, databasereboot_t *reboot);
+int     storage_flush(storage_t *storage);
+int     storage_scan(
+                    storage_t *storage,
+                    time_t from,
+                    time_t to,
+                    int (*fn)(databaserecord_t *record, void *arg),
+                    void *arg
+                    );
+void    storage_close(storage_t *storage);
+const char *storage_name(storage_t *storage);
+
+/*
+ * Benchmark harness. Appends nsamples rows in batches of batch rows, each
+ * batch followed by a flush, into datafile (a scratch datafile, the caller
+ * creates and removes it). With persistent false, every batch opens and
+ * closes the store (as a worker without the writer does). Timings are per
+ * batch (open + append + flush + close). Returns pointer to static
+ * dbperf_t (do not free), NULL on error.
+ */
+dbperf_t *storage_testwriteperf(
+                               const storage_backend_t *backend,
+                               char *datafile,
+                               int nsamples,
+                               int batch,
+                               int persistent
+                               );
+
+#endif /* __STORAGE_H__ */
+
+/* EOF storage.h */
@@ -0,0 +1,223 @@
+/******************************************************************************
+ * ADAPTIVE COMMIT TEST
+ *
+ *      Database writer switches between direct and batched commits by the
+ *      latency of its own commits (dbwriter.h). Slow commits are made by
+ *      a reader holding its lock for longer than CFG_MAX_INSERT_DELAY_MAX.
+ *
+ *          1.  Profile file: save, load, stale and broken profiles
+ *          2.  DIRECT -> BATCHED on a slow commit, back to DIRECT when
+ *              a window of commits is fast again, profile saved while
+ *              running
+ *          3.  Slow BATCHED commits (per row): spool from the next start,
+ *              profile kept on close
+ *          4.  Reopened writer resumes the saved mode
+ ******************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/wait.h>
+#include <sqlite3.h>
+
+#include "../config.h"
+#include "../database.h"
+#include "../dbwriter.h"
+
+#define DATAFILE    "/tmp/icmond.ut_adaptive.sqlite3"
+#define PROFILE     DATAFILE ".profile"
+#define T0          1475000000
+#define COMMITROWS  4
+#define LOCK_MS     ((int)CFG_MAX_INSERT_DELAY_MAX + 100)
+
+static int n_failed = 0;
+static int n_rows   = 0;
+
+#define CHECK(name, cond) \
+    do { \
+        int ok_ = (cond); \
+        printf("%-40s %s\n", name, ok_ ? "OK" : "NOT OK"); \
+        if (!ok_) n_failed++; \
+    } while (0)
+
+static long long query(const char *sql)
+{
+    sqlite3      *db;
+    sqlite3_stmt *stmt;
+    long long     value = -1;
+
+    sqlite3_open(DATAFILE, &db);
+    sqlite3_busy_timeout(db, 1000);
+    if (sqlite3_prepare_v2(db, sql, -1, &stmt, NULL) == SQLITE_OK)
+    {
+        if (sqlite3_step(stmt) == SQLITE_ROW)
+            value = sqlite3_column_int64(stmt, 0);
+        sqlite3_finalize(stmt);
+    }
+    sqlite3_close(db);
+    return value;
+}
+
+static long long rows()
+{
+    return query("SELECT COUNT(*) FROM samples");
+}
+
+static void sendrows(int n)
+{
+    databaserecord_t rec;
+    double          *value = &rec.modemping_ms;
+    int              c;
+
+    while (n-- > 0)
+    {
+        rec.timestamp = T0 + n_rows++ * 5;
+        for (c = 0; c < DATABASE_SAMPLE_COLUMNS; c++)
+            value[c] = DATABASE_DOUBLE_NULL_VALUE;
+        rec.modemping_ms = 1.5;
+        dbwriter_send(DBWRITER_MSG_RECORD, &rec);
+        dbwriter_process();
+    }
+}
+
+/*
+ * Reader holds its shared lock for ms, the next commit waits for it
+ */
+static pid_t reader(int ms)
+{
+    int   fd[2];
+    char  c = 0;
+    pid_t pid;
+
+    if (pipe(fd))
+        return -1;
+    if ((pid = fork()) == 0)
+    {
+        sqlite3 *db;
+        sqlite3_open(DATAFILE, &db);
+        sqlite3_exec(db, "BEGIN; SELECT COUNT(*) FROM samples;", NULL, NULL, NULL);
+        if (write(fd[1], "x", 1) != 1)
+            _exit(EXIT_FAILURE);
+        usleep(ms * 1000);
+        sqlite3_exec(db, "COMMIT", NULL, NULL, NULL);
+        sqlite3_close(db);
+        _exit(EXIT_SUCCESS);
+    }
+    if (read(fd[0], &c, 1) != 1)
+        n_failed++;
+    close(fd[0]);
+    close(fd[1]);
+    return pid;
+}
+
+static int slowcommit(int n, int ms)
+{
+    pid_t pid;
+    int   status;
+
+    // Reader is fork()'ed, no lock of the writer may be held then
+    dbwriter_flush();
+    pid = reader(ms);
+
+    sendrows(n);
+    return pid > 0 && waitpid(pid, &status, 0) == pid;
+}
+
+static int profilemode()
+{
+    dbwriter_profile_t profile;
+
+    if (dbwriter_loadprofile(PROFILE, &profile))
+        return -1;
+    return profile.mode;
+}
+
+/*
+ * Rows stay in the open transaction (batched commits)
+ */
+static int batched()
+{
+    long long n;
+
+    dbwriter_flush();
+    n = rows();
+    sendrows(COMMITROWS - 1);
+    return rows() == n && !dbwriter_flush() && rows() == n + COMMITROWS - 1;
+}
+
+int main()
+{
+    dbwriter_profile_t profile;
+    FILE              *fp;
+
+    if (system("rm -f " DATAFILE "*"))
+        return EXIT_FAILURE;
+    strcpy(cfg.database.filename, DATAFILE);
+    cfg.database.commitrows     = COMMITROWS;
+    cfg.database.commitinterval = 3600;
+    CHECK("datafile created",               database_initialize(DATAFILE) == EXIT_SUCCESS);
+
+    // 1.
+    CHECK("no profile",                     dbwriter_loadprofile(PROFILE, &profile) == EXIT_FAILURE);
+    profile.mode    = DBWRITER_MODE_BATCHED;
+    profile.mean    = 12.5;
+    profile.max     = 40.0;
+    profile.updated = time(NULL);
+    CHECK("dbwriter_saveprofile()",         dbwriter_saveprofile(PROFILE, &profile) == EXIT_SUCCESS);
+    memset(&profile, 0, sizeof(profile));
+    CHECK("dbwriter_loadprofile()",         dbwriter_loadprofile(PROFILE, &profile) == EXIT_SUCCESS &&
+                                            profile.mode == DBWRITER_MODE_BATCHED &&
+                                            profile.mean == 12.5 && profile.max == 40.0);
+    profile.updated = time(NULL) - DBWRITER_PROFILE_MAXAGE - 1;
+    dbwriter_saveprofile(PROFILE, &profile);
+    CHECK("stale profile",                  dbwriter_loadprofile(PROFILE, &profile) == EXIT_FAILURE);
+    if ((fp = fopen(PROFILE, "w")))
+    {
+        fprintf(fp, "mode = FAST\nmean = 1.0\nmax = 2.0\nupdated = %lld\n", (long long)time(NULL));
+        fclose(fp);
+    }
+    CHECK("unknown mode",                   dbwriter_loadprofile(PROFILE, &profile) == EXIT_FAILURE);
+    unlink(PROFILE);
+
+    // 2.
+    CHECK("dbwriter_adapt()",               dbwriter_adapt(PROFILE, DBWRITER_MODE_DIRECT) == EXIT_SUCCESS);
+    CHECK("dbwriter_open()",                dbwriter_open(DATAFILE) == EXIT_SUCCESS);
+    sendrows(10);
+    CHECK("direct commits",                 rows() == 10);
+    CHECK("slow commit",                    slowcommit(DBWRITER_LATENCY_WINDOW, LOCK_MS));
+    CHECK("switched to BATCHED",            profilemode() == DBWRITER_MODE_BATCHED);
+    CHECK("batched commits",                batched());
+    sendrows(DBWRITER_LATENCY_WINDOW * COMMITROWS);
+    CHECK("back to DIRECT",                 profilemode() == DBWRITER_MODE_DIRECT);
+    CHECK("direct commits",                 (sendrows(1), rows() == n_rows));
+    unlink(PROFILE);
+    sendrows(DBWRITER_PROFILE_SAVE);
+    CHECK("profile saved while running",    profilemode() == DBWRITER_MODE_DIRECT);
+
+    // 3. Batch of COMMITROWS rows as slow as a direct commit is fast enough
+    CHECK("slow commit",                    slowcommit(DBWRITER_LATENCY_WINDOW, LOCK_MS));
+    CHECK("switched to BATCHED",            profilemode() == DBWRITER_MODE_BATCHED);
+    slowcommit(DBWRITER_LATENCY_WINDOW * COMMITROWS, LOCK_MS);
+    CHECK("batch within limits per row",    profilemode() == DBWRITER_MODE_BATCHED);
+    CHECK("slow batched commit",            slowcommit(COMMITROWS, LOCK_MS * COMMITROWS));
+    CHECK("spool from the next start",      profilemode() == DBWRITER_MODE_SPOOL);
+    CHECK("still batched",                  batched());
+    dbwriter_close();
+    CHECK("all rows written",               rows() == n_rows);
+    CHECK("profile kept on close",          profilemode() == DBWRITER_MODE_SPOOL);
+
+    // 4.
+    CHECK("dbwriter_adapt()",               dbwriter_adapt(PROFILE, DBWRITER_MODE_DIRECT) == EXIT_SUCCESS);
+    CHECK("dbwriter_open()",                dbwriter_open(DATAFILE) == EXIT_SUCCESS);
+    CHECK("resumed batched",                batched());
+    dbwriter_close();
+    dbwriter_adapt(NULL, 0);
+
+    if (system("rm -f " DATAFILE "*"))
+        n_failed++;
+    return n_failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+/* EOF ut_adaptive.c */
@@ -0,0 +1,116 @@
+/******************************************************************************
+ * STORAGE BENCHMARK TEST
+ *
+ *          1.  Percentiles (database_perfstats())
+ *          2.  Recommendation: durable, persistent, compact schema only,
+ *              spool when the insert delay limits are missed
+ *          3.  Sweep: every combination in the JSON, configuration
+ *              restored, scratch files removed
+ ******************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <unistd.h>
+
+#include "../config.h"
+#include "../database.h"
+#include "../benchmark.h"
+
+#define DATAFILE    "/tmp/icmond.ut_benchmark.sqlite3"
+#define SPOOLFILE   "/tmp/icmond.ut_benchmark.sqlite3.spool"
+#define ROWS        20
+
+static int n_failed = 0;
+
+#define CHECK(name, cond) \
+    do { \
+        int ok_ = (cond); \
+        printf("%-40s %s\n", name, ok_ ? "OK" : "NOT OK"); \
+        if (!ok_) n_failed++; \
+    } while (0)
+
+static int count(const char *text, const char *what)
+{
+    int n = 0;
+
+    while ((text = strstr(text, what)))
+    {
+        n++;
+        text += strlen(what);
+    }
+    return n;
+}
+
+static benchmark_t result(int synchronous, int persistent, int schema, double rowspersec)
+{
+    benchmark_t r;
+
+    memset(&r, 0, sizeof(r));
+    r.journal     = CFG_JOURNAL_WAL;
+    r.synchronous = synchronous;
+    r.batch       = 10;
+    r.persistent  = persistent;
+    r.schema      = schema;
+    r.rowspersec  = rowspersec;
+    r.perf.mean   = 1.0;
+    r.perf.max    = 2.0;
+    return r;
+}
+
+int main()
+{
+    benchmark_t results[4];
+    dbperf_t    perf;
+    double      ms[200];
+    char        json[32768];
+    FILE       *f;
+    size_t      len;
+    int         i, spool;
+
+    // 1. 1 ... 200 ms, shuffled
+    for (i = 0; i < 200; i++)
+        ms[i] = (i * 37) % 200 + 1;
+    database_perfstats(&perf, ms, 200);
+    CHECK("min, max",                       perf.n == 200 && perf.min == 1.0 && perf.max == 200.0);
+    CHECK("mean",                           perf.mean == 100.5);
+    CHECK("p50, p99",                       perf.p50 == 100.0 && perf.p99 == 198.0);
+    ms[0] = 5.0;
+    database_perfstats(&perf, ms, 1);
+    CHECK("single sample",                  perf.p50 == 5.0 && perf.p99 == 5.0 && perf.stddev == 0.0);
+
+    // 2.
+    results[0] = result(CFG_SYNCHRONOUS_OFF,    true,  DATABASE_SCHEMA_COMPACT, 9000.0);
+    results[1] = result(CFG_SYNCHRONOUS_NORMAL, false, DATABASE_SCHEMA_COMPACT, 8000.0);
+    results[2] = result(CFG_SYNCHRONOUS_NORMAL, true,  DATABASE_SCHEMA_LEGACY,  7000.0);
+    results[3] = result(CFG_SYNCHRONOUS_FULL,   true,  DATABASE_SCHEMA_COMPACT, 100.0);
+    CHECK("benchmark_recommend()",          benchmark_recommend(results, 4, &spool) == 3 && !spool);
+    results[3].perf.max = CFG_MAX_INSERT_DELAY_MAX + 1;
+    CHECK("spool recommended",              benchmark_recommend(results, 4, &spool) == 3 && spool);
+    CHECK("no durable combination",         benchmark_recommend(results, 3, &spool) == -1 && !spool);
+
+    // 3.
+    CHECK("benchmark_writebytes()",         benchmark_writebytes() >= -1);
+    cfg.database.journal     = CFG_JOURNAL_DELETE;
+    cfg.database.synchronous = CFG_SYNCHRONOUS_AUTO;
+    CHECK("benchmark_run()",                (f = tmpfile()) != NULL &&
+                                            benchmark_run(DATAFILE, SPOOLFILE, ROWS, f) == EXIT_SUCCESS);
+    if (!f)
+        return EXIT_FAILURE;
+    rewind(f);
+    len = fread(json, 1, sizeof(json) - 1, f);
+    json[len] = '\0';
+    fclose(f);
+    CHECK("every combination",              count(json, "\"journal\": ") == BENCHMARK_COMBINATIONS + 1);
+    CHECK("percentiles",                    count(json, "\"p99_ms\": ") == BENCHMARK_COMBINATIONS + 2);
+    CHECK("recommendation",                 strstr(json, "\"recommended\": {") != NULL);
+    CHECK("configuration restored",         cfg.database.journal == CFG_JOURNAL_DELETE &&
+                                            cfg.database.synchronous == CFG_SYNCHRONOUS_AUTO);
+    CHECK("scratch files removed",          access(DATAFILE, F_OK) && access(DATAFILE "-wal", F_OK) &&
+                                            access(SPOOLFILE, F_OK));
+    CHECK("invalid row count",              benchmark_run(DATAFILE, SPOOLFILE, 0, NULL) == EXIT_FAILURE);
+
+    return n_failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+/* EOF ut_benchmark.c */
@@ -0,0 +1,261 @@
+/******************************************************************************
+ * BOUNDS TEST
+ *
+ *      Violations of the latest bounds row are stored with each sample
+ *      (database.h):
+ *
+ *          1.  database_violations(): value groups, NULL values, no limit,
+ *              no ping minimum
+ *          2.  No bounds row: Violations is NULL
+ *          3.  Bounds loaded on open, latest row wins, merged rows, query
+ *              uses the partial index
+ *          4.  Upgrade of datafiles without the column (compact and legacy)
+ ******************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <sqlite3.h>
+
+#include "../config.h"
+#include "../database.h"
+
+#define DATAFILE    "/tmp/icmond.ut_bounds.sqlite3"
+#define T0          1475000000
+
+static int n_failed = 0;
+
+#define CHECK(name, cond) \
+    do { \
+        int ok_ = (cond); \
+        printf("%-40s %s\n", name, ok_ ? "OK" : "NOT OK"); \
+        if (!ok_) n_failed++; \
+    } while (0)
+
+static int exec(const char *sql)
+{
+    sqlite3 *db;
+    int      rc;
+
+    sqlite3_open(DATAFILE, &db);
+    rc = sqlite3_exec(db, sql, NULL, NULL, NULL);
+    sqlite3_close(db);
+    return rc;
+}
+
+static long long query(const char *sql)
+{
+    sqlite3      *db;
+    sqlite3_stmt *stmt;
+    long long     value = -1;
+
+    sqlite3_open(DATAFILE, &db);
+    if (sqlite3_prepare_v2(db, sql, -1, &stmt, NULL) == SQLITE_OK)
+    {
+        if (sqlite3_step(stmt) == SQLITE_ROW)
+            value = sqlite3_column_type(stmt, 0) == SQLITE_NULL ? -2 : sqlite3_column_int64(stmt, 0);
+        sqlite3_finalize(stmt);
+    }
+    sqlite3_close(db);
+    return value;
+}
+
+/*
+ * EXPLAIN QUERY PLAN mentions the index
+ */
+static int usesindex(const char *sql, const char *index)
+{
+    sqlite3      *db;
+    sqlite3_stmt *stmt;
+    char          explain[512];
+    int           found = 0;
+
+    snprintf(explain, sizeof(explain), "EXPLAIN QUERY PLAN %s", sql);
+    sqlite3_open(DATAFILE, &db);
+    if (sqlite3_prepare_v2(db, explain, -1, &stmt, NULL) == SQLITE_OK)
+    {
+        while (sqlite3_step(stmt) == SQLITE_ROW)
+            found |= strstr((const char *)sqlite3_column_text(stmt, 3), index) != NULL;
+        sqlite3_finalize(stmt);
+    }
+    sqlite3_close(db);
+    return found;
+}
+
+static void record(databaserecord_t *rec, time_t t)
+{
+    double *value = &rec->modemping_ms;
+    int     c;
+
+    rec->timestamp = t;
+    for (c = 0; c < DATABASE_SAMPLE_COLUMNS; c++)
+        value[c] = DATABASE_DOUBLE_NULL_VALUE;
+}
+
+static void linerecord(databaserecord_t *rec, time_t t)
+{
+    double *value = &rec->down_ch1_dbmv;
+    int     c;
+
+    record(rec, t);
+    for (c = 0; c < 16; c += 2)
+    {
+        value[c]     = 5.0;             // dBmV
+        value[c + 1] = 40.0;            // SNR
+    }
+    rec->up_ch1_dbmv = rec->up_ch2_dbmv = rec->up_ch3_dbmv = rec->up_ch4_dbmv = 40.0;
+}
+
+static int writerow(databaserecord_t *rec)
+{
+    dbhandle_t *h;
+    int         rc;
+
+    if (!(h = database_open(DATAFILE)))
+        return EXIT_FAILURE;
+    rc = database_write(h, rec);
+    database_close(h);
+    return rc;
+}
+
+#define SQL_INSERT_TESTBOUNDS(t, maxping, minsnr, maxsnr) \
+    "INSERT INTO bounds (Timestamp, maxModemPing, maxInetPing, " \
+    "mindCh1dB, maxdCh1dB, mindCh2dB, maxdCh2dB, mindCh3dB, maxdCh3dB, mindCh4dB, maxdCh4dB, " \
+    "mindCh5dB, maxdCh5dB, mindCh6dB, maxdCh6dB, mindCh7dB, maxdCh7dB, mindCh8dB, maxdCh8dB, " \
+    "mindCh1dBbmV, maxdCh1dBbmV, minuCh1dBmV, maxuCh1dBmV) VALUES (" #t ", " #maxping ", 500, " \
+    #minsnr ", " #maxsnr ", " #minsnr ", " #maxsnr ", " #minsnr ", " #maxsnr ", " #minsnr ", " #maxsnr ", " \
+    #minsnr ", " #maxsnr ", " #minsnr ", " #maxsnr ", " #minsnr ", " #maxsnr ", " #minsnr ", " #maxsnr ", " \
+    "3.0, 8.0, 38.0, 50.0)"
+
+#define SQL_SNR_VIOLATIONS \
+    "SELECT COUNT(*) FROM data WHERE Violations > 0 AND Violations & 174760"
+
+int main()
+{
+    databasebounds_t bounds;
+    databaserecord_t rec;
+    int              i;
+
+    // 1.
+    memset(&bounds, 0, sizeof(bounds));
+    for (i = 0; i < DATABASE_SAMPLE_COLUMNS; i++)
+    {
+        bounds.min[i] = -INFINITY;
+        bounds.max[i] = INFINITY;
+    }
+    bounds.max[0] = 200.0;                      // ModemPing
+    for (i = 2; i < 18; i += 2)
+    {
+        bounds.min[i]     = 3.0;                // dBmV
+        bounds.max[i]     = 8.0;
+        bounds.min[i + 1] = 32.0;               // SNR
+        bounds.max[i + 1] = 47.0;
+    }
+    for (i = 18; i < DATABASE_SAMPLE_COLUMNS; i++)
+    {
+        bounds.min[i] = 38.0;                   // upstream dBmV
+        bounds.max[i] = 50.0;
+    }
+    linerecord(&rec, T0);
+    CHECK("in range",                       database_violations(&bounds, &rec) == 0);
+    CHECK("NULL values",                    (record(&rec, T0), database_violations(&bounds, &rec) == 0));
+    rec.modemping_ms = 250.0;
+    rec.inetping_ms  = 10000.0;
+    CHECK("ping, no limit",                 database_violations(&bounds, &rec) == DATABASE_VIOLATION(0));
+    rec.modemping_ms = -1.0;
+    CHECK("no ping minimum",                database_violations(&bounds, &rec) == 0);
+    linerecord(&rec, T0);
+    rec.down_ch2_db = 48.0;
+    rec.down_ch8_db = 20.0;
+    CHECK("downstream SNR",                 database_violations(&bounds, &rec) ==
+                                            (DATABASE_VIOLATION(5) | DATABASE_VIOLATION(17)) &&
+                                            (database_violations(&bounds, &rec) & ~DATABASE_VIOLATIONS_DOWN_SNR) == 0);
+    linerecord(&rec, T0);
+    rec.down_ch1_dbmv = 2.9;
+    rec.up_ch4_dbmv   = 1.0;
+    CHECK("power",                          database_violations(&bounds, &rec) ==
+                                            (DATABASE_VIOLATION(2) | DATABASE_VIOLATION(21)));
+
+    // 2.
+    if (system("rm -f " DATAFILE "*"))
+        return EXIT_FAILURE;
+    strcpy(cfg.database.filename, DATAFILE);
+    CHECK("datafile created",               database_initialize(DATAFILE) == EXIT_SUCCESS);
+    CHECK("no bounds row",                  database_loadbounds(DATAFILE, &bounds) == EXIT_SUCCESS &&
+                                            !bounds.valid);
+    linerecord(&rec, T0);
+    CHECK("database_write()",               writerow(&rec) == SQLITE_OK);
+    CHECK("Violations NULL",                query("SELECT Violations FROM data") == -2);
+
+    // 3.
+    CHECK("bounds row",                     exec(SQL_INSERT_TESTBOUNDS(1, 200, 32, 47)) == SQLITE_OK);
+    CHECK("database_loadbounds()",          database_loadbounds(DATAFILE, &bounds) == EXIT_SUCCESS &&
+                                            bounds.valid && bounds.timestamp == 1 &&
+                                            bounds.max[0] == 200.0 && bounds.min[0] == -INFINITY &&
+                                            bounds.min[3] == 32.0 && bounds.max[3] == 47.0 &&
+                                            bounds.max[2] == 8.0 && bounds.min[4] == -INFINITY &&
+                                            bounds.min[18] == 38.0 && bounds.max[21] == INFINITY);
+    linerecord(&rec, T0 + 5);
+    rec.down_ch3_db = 48.0;
+    CHECK("violation stored",               writerow(&rec) == SQLITE_OK &&
+                                            query("SELECT Violations FROM data WHERE Timestamp = 1475000005") ==
+                                            DATABASE_VIOLATION(7));
+    linerecord(&rec, T0 + 10);
+    CHECK("in range stored",                writerow(&rec) == SQLITE_OK &&
+                                            query("SELECT Violations FROM data WHERE Timestamp = 1475000010") == 0);
+    CHECK("latest bounds row",              exec(SQL_INSERT_TESTBOUNDS(2, 200, 32, 40)) == SQLITE_OK &&
+                                            exec(SQL_INSERT_TESTBOUNDS(0, 200, 32, 30)) == SQLITE_OK);
+    linerecord(&rec, T0 + 15);
+    rec.down_ch1_db = 40.5;
+    CHECK("violation of the latest row",    writerow(&rec) == SQLITE_OK &&
+                                            query("SELECT Violations FROM data WHERE Timestamp = 1475000015") ==
+                                            DATABASE_VIOLATION(3));
+    // Separate ping row of the same second
+    record(&rec, T0 + 15);
+    rec.modemping_ms = 300.0;
+    CHECK("merged row",                     writerow(&rec) == SQLITE_OK &&
+                                            query("SELECT Violations FROM data WHERE Timestamp = 1475000015") ==
+                                            (DATABASE_VIOLATION(0) | DATABASE_VIOLATION(3)));
+    CHECK("SNR violations",                 query(SQL_SNR_VIOLATIONS) == 2);
+    CHECK("partial index used",             usesindex(SQL_SNR_VIOLATIONS, "samples_violations"));
+
+    // 4. Compact datafile of an earlier version
+    if (system("rm -f " DATAFILE "*"))
+        return EXIT_FAILURE;
+    exec(
+        "CREATE TABLE samples (Timestamp INTEGER PRIMARY KEY, ModemRtt INTEGER, InetRtt INTEGER, "
+        "dCh1Power INTEGER, dCh1Snr INTEGER, dCh2Power INTEGER, dCh2Snr INTEGER, "
+        "dCh3Power INTEGER, dCh3Snr INTEGER, dCh4Power INTEGER, dCh4Snr INTEGER, "
+        "dCh5Power INTEGER, dCh5Snr INTEGER, dCh6Power INTEGER, dCh6Snr INTEGER, "
+        "dCh7Power INTEGER, dCh7Snr INTEGER, dCh8Power INTEGER, dCh8Snr INTEGER, "
+        "uCh1Power INTEGER, uCh2Power INTEGER, uCh3Power INTEGER, uCh4Power INTEGER); "
+        "INSERT INTO samples (Timestamp, ModemRtt) VALUES (1475000000, 1500); "
+        "CREATE VIEW data AS SELECT Timestamp, ModemRtt / 1000.0 AS ModemPing FROM samples; "
+        "PRAGMA user_version = 1; "
+        );
+    CHECK("compact upgrade",                database_upgrade(DATAFILE) == EXIT_SUCCESS &&
+                                            query("SELECT COUNT(Violations) FROM data") == 0 &&
+                                            query("SELECT COUNT(*) FROM data") == 1);
+    exec(SQL_INSERT_TESTBOUNDS(1, 200, 32, 47));
+    record(&rec, T0 + 5);
+    rec.modemping_ms = 300.0;
+    CHECK("written after upgrade",          writerow(&rec) == SQLITE_OK &&
+                                            query("SELECT Violations FROM data WHERE Timestamp = 1475000005") == 1);
+    CHECK("upgrade again",                  database_upgrade(DATAFILE) == EXIT_SUCCESS);
+
+    // Legacy data table
+    if (system("rm -f " DATAFILE "*"))
+        return EXIT_FAILURE;
+    exec(SQL_CREATE_TABLE_DATA);
+    CHECK("legacy upgrade",                 database_upgrade(DATAFILE) == EXIT_SUCCESS);
+    exec(SQL_INSERT_TESTBOUNDS(1, 200, 32, 47));
+    CHECK("written into legacy",            writerow(&rec) == SQLITE_OK &&
+                                            query("SELECT Violations FROM data") == 1);
+    CHECK("legacy partial index",           usesindex("SELECT * FROM data WHERE Violations > 0", "data_violations"));
+
+    if (system("rm -f " DATAFILE "*"))
+        n_failed++;
+    return n_failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+/* EOF ut_bounds.c */
@@ -0,0 +1,81 @@
+/******************************************************************************
+ * COLLECTOR BREAKER TEST
+ *
+ *      Walks one breaker through its states:
+ *
+ *          1.  CLOSED, failures below threshold    -> still CLOSED
+ *          2.  Threshold reached                   -> OPEN, attempts refused
+ *          3.  Backoff expires                     -> HALF-OPEN, one trial
+ *          4.  Trial fails                         -> OPEN, doubled backoff
+ *          5.  Trial not made (modem down)         -> next attempt is trial
+ *          6.  Trial succeeds                      -> CLOSED, backoff reset
+ ******************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "../breaker.h"
+
+static int n_failed = 0;
+
+#define CHECK(name, cond) \
+    do { \
+        int ok_ = (cond); \
+        printf("%-40s %s\n", name, ok_ ? "OK" : "NOT OK"); \
+        if (!ok_) n_failed++; \
+    } while (0)
+
+int main()
+{
+    breaker_t b;
+    time_t    now = 1000;
+    int       i;
+
+    breaker_init(&b, "TEST");
+    CHECK("initially closed",               b.state == BREAKER_CLOSED && breaker_allow(&b, now));
+
+    // 1. Below threshold
+    for (i = 0; i < BREAKER_THRESHOLD - 1; i++)
+        breaker_report(&b, BREAKER_FAILURE, now);
+    CHECK("below threshold, closed",        b.state == BREAKER_CLOSED && breaker_allow(&b, now));
+
+    // 2. Threshold
+    breaker_report(&b, BREAKER_FAILURE, now);
+    CHECK("threshold reached, open",        b.state == BREAKER_OPEN && b.n_trips == 1);
+    CHECK("open refuses attempts",          !breaker_allow(&b, now + BREAKER_BACKOFF_MIN - 1));
+    CHECK("refused attempt counted",        b.n_skipped == 1);
+
+    // 3. Backoff expired
+    now += BREAKER_BACKOFF_MIN;
+    CHECK("backoff expired, trial allowed", breaker_allow(&b, now) && b.state == BREAKER_HALFOPEN);
+    CHECK("only one trial",                 !breaker_allow(&b, now));
+
+    // 4. Trial fails
+    breaker_report(&b, BREAKER_FAILURE, now);
+    CHECK("trial failed, open again",       b.state == BREAKER_OPEN && b.n_trips == 2);
+    CHECK("backoff doubled",                !breaker_allow(&b, now + BREAKER_BACKOFF_MIN * 2 - 1));
+    now += BREAKER_BACKOFF_MIN * 2;
+
+    // 5. Trial not made
+    CHECK("second trial allowed",           breaker_allow(&b, now));
+    breaker_report(&b, BREAKER_NORESULT, now);
+    CHECK("no result, still half-open",     b.state == BREAKER_HALFOPEN);
+    CHECK("no result, next is trial",       breaker_allow(&b, now + 1));
+
+    // 6. Trial succeeds
+    breaker_report(&b, BREAKER_SUCCESS, now + 1);
+    CHECK("recovered, closed",              b.state == BREAKER_CLOSED && b.n_failures == 0);
+    CHECK("backoff reset",                  b.backoff == BREAKER_BACKOFF_MIN);
+
+    // Backoff does not grow past maximum
+    for (i = 0; i < 20; i++)
+    {
+        breaker_report(&b, BREAKER_FAILURE, now);
+        now = b.retry;
+        breaker_allow(&b, now);
+    }
+    CHECK("backoff limited",                b.backoff == BREAKER_BACKOFF_MAX);
+
+    return n_failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+/* EOF ut_breaker.c */
@@ -0,0 +1,10 @@
+#!/bin/bash
+
+gcc -D_GNU_SOURCE -D_DEBUG -I../ -g -Wall -c ut_breaker.c       -o ut_breaker.o
+gcc -D_GNU_SOURCE -D_DEBUG -I../ -g -Wall -c ../breaker.c       -o breaker.o
+gcc -D_GNU_SOURCE -D_DEBUG -I../ -g -Wall -c ../logwrite.c      -o logwrite.o
+gcc -D_GNU_SOURCE -D_DEBUG -I../ -g -Wall -c ../util.c          -o util.o
+gcc -D_GNU_SOURCE -D_DEBUG -I../ -g -Wall -c ../user.c          -o user.o
+
+
+gcc -g -Wall -lm -lrt -o breaker ut_breaker.o breaker.o logwrite.o user.o util.o
@@ -0,0 +1,329 @@
+/******************************************************************************
+ * CHANGE-ONLY STORAGE TEST
+ *
+ *      cfg.database.keyframeinterval, .changeepsilon (database.h):
+ *
+ *          1.  Keyframes, unchanged line values not stored, pings stored
+ *              every row, values carried forward by the data view within
+ *              the epsilon, from at most CFG_MAX_DB_KEYFRAMEINTERVAL back
+ *          2.  Failed poll and a missing channel stay NULL
+ *          3.  Rollups as if every value was stored
+ *          4.  Late row does not change the rows after it
+ *          5.  Retention keeps the carried values of the remaining rows
+ *          6.  Failed insert: next row is a keyframe
+ *          7.  tmpfs import: moved rows do not change the carried values
+ *              of the datafile, nor of the rows left in tmpfs
+ *          8.  Upgrade of a compact datafile without the Carried column
+ *          9.  Disabled: every value stored
+ ******************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <stdbool.h>
+#include <sqlite3.h>
+
+#include "../config.h"
+#include "../database.h"
+
+#define DATAFILE    "/tmp/icmond.ut_changeonly.sqlite3"
+#define TMPFSFILE   "/tmp/icmond.ut_changeonly.tmpfs.sqlite3"
+#define T0          1475000000      // 2016-09-27 18:13:20 UTC
+#define ROWS        120             // 10 minutes, 5 s interval
+#define KEYFRAME    60
+#define EPSILON     2               // 0.2 dB
+
+static int n_failed = 0;
+
+#define CHECK(name, cond) \
+    do { \
+        int ok_ = (cond); \
+        printf("%-40s %s\n", name, ok_ ? "OK" : "NOT OK"); \
+        if (!ok_) n_failed++; \
+    } while (0)
+
+static long long queryfile(const char *filename, const char *sql)
+{
+    sqlite3      *db;
+    sqlite3_stmt *stmt;
+    long long     value = -1;
+
+    sqlite3_open(filename, &db);
+    if (sqlite3_prepare_v2(db, sql, -1, &stmt, NULL) == SQLITE_OK)
+    {
+        if (sqlite3_step(stmt) == SQLITE_ROW)
+            value = sqlite3_column_type(stmt, 0) == SQLITE_NULL ? -999 : sqlite3_column_int64(stmt, 0);
+        sqlite3_finalize(stmt);
+    }
+    sqlite3_close(db);
+    return value;
+}
+
+static long long query(const char *sql)
+{
+    return queryfile(DATAFILE, sql);
+}
+
+static int execute(const char *sql)
+{
+    sqlite3 *db;
+    int      rc;
+
+    sqlite3_open(DATAFILE, &db);
+    rc = sqlite3_exec(db, sql, NULL, NULL, NULL);
+    sqlite3_close(db);
+    return rc;
+}
+
+/*
+ * Actual value of dCh1dBbmV: slow drift of 0.1 dB every 4th row
+ */
+static double drift(int i)
+{
+    return -3.5 + (i / 4) * 0.1;
+}
+
+static void record(databaserecord_t *rec, int i)
+{
+    double *value = &rec->modemping_ms;
+    int     c;
+
+    rec->timestamp = T0 + i * 5;
+    for (c = 0; c < DATABASE_SAMPLE_COLUMNS; c++)
+        value[c] = DATABASE_DOUBLE_NULL_VALUE;
+    rec->modemping_ms  = 1.5 + i % 3;
+    rec->inetping_ms   = 12.25;
+    rec->down_ch1_dbmv = drift(i);
+    rec->down_ch1_db   = 37.6;
+    rec->down_ch2_dbmv = -2.0;
+    rec->down_ch2_db   = 37.3;
+    rec->up_ch1_dbmv   = 42.0 + (i % 2);    // changes every row
+    rec->up_ch2_dbmv   = 43.5;
+    // down_ch3 ... : channel not locked, NULL
+}
+
+/*
+ * Largest difference between the data view and the written values (tenths)
+ */
+typedef struct
+{
+    int n;
+    int failed;                     // row index of the failed poll
+    int maxerror;
+    int nulls;                      // dCh1dB NULL in data, other than the failure
+} dense_t;
+
+static int checkrow(databaserecord_t *rec, void *arg)
+{
+    dense_t *d = arg;
+    int      i = (rec->timestamp - T0) / 5;
+    int      e;
+
+    d->n++;
+    if (i == d->failed)
+        return 0;
+    if (rec->down_ch1_db == DATABASE_DOUBLE_NULL_VALUE || rec->down_ch1_dbmv == DATABASE_DOUBLE_NULL_VALUE)
+    {
+        d->nulls++;
+        return 0;
+    }
+    e = (int)lround(fabs(rec->down_ch1_dbmv - drift(i)) * 10);
+    if (e > d->maxerror)
+        d->maxerror = e;
+    if (rec->down_ch1_db != 37.6 || rec->up_ch1_dbmv != 42.0 + (i % 2))
+        d->maxerror = 999;
+    return 0;
+}
+
+int main()
+{
+    databaserecord_t rec;
+    dbhandle_t      *h;
+    dense_t          dense = { .failed = 50 };
+    long long        stored;
+    char             sql[256];
+    int              i, rc, n_deleted;
+    time_t           oldest;
+
+    if (system("rm -f " DATAFILE "*") || database_initialize(DATAFILE))
+        return EXIT_FAILURE;
+    strcpy(cfg.database.filename, DATAFILE);
+    cfg.database.keyframeinterval = KEYFRAME;
+    cfg.database.changeepsilon    = EPSILON;
+
+    // 1. and 2.
+    CHECK("database_open()",                (h = database_open(DATAFILE)) != NULL);
+    if (!h)
+        return EXIT_FAILURE;
+    database_begin(h);
+    for (i = 0; i < ROWS; i++)
+    {
+        record(&rec, i);
+        if (i == dense.failed)
+        {
+            double *value = &rec.down_ch1_dbmv;
+            int     c;
+            for (c = 0; c < DATABASE_LINE_COLUMNS; c++)
+                value[c] = DATABASE_DOUBLE_NULL_VALUE;
+        }
+        database_write(h, &rec);
+    }
+    CHECK("database_rollup()",              database_rollup(h, T0, T0 + ROWS * 5) == SQLITE_OK);
+    database_commit(h);
+
+    CHECK("rows",                           query("SELECT COUNT(*) FROM samples") == ROWS &&
+                                            query("SELECT COUNT(*) FROM data") == ROWS);
+    CHECK("first row is a keyframe",        query("SELECT Carried FROM samples WHERE Timestamp = 1475000000") == -999);
+    CHECK("keyframes",                      query("SELECT COUNT(*) FROM samples WHERE Carried IS NULL") == ROWS / (KEYFRAME / 5) + 1);
+    CHECK("unchanged values not stored",    query("SELECT COUNT(*) FROM samples WHERE dCh1Snr IS NOT NULL") == ROWS / (KEYFRAME / 5) &&
+                                            query("SELECT Carried & 8 FROM samples WHERE Timestamp = 1475000005") == 8);
+    // Not the failed poll, nor the row after it (same value as before the poll)
+    CHECK("changed values stored",          query("SELECT COUNT(uCh1Power) FROM samples") == ROWS - 2);
+    CHECK("pings stored every row",         query("SELECT COUNT(ModemRtt) FROM samples") == ROWS);
+    stored = query("SELECT COUNT(dCh1Power) + COUNT(dCh1Snr) + COUNT(dCh2Power) + COUNT(dCh2Snr) + "
+                   "COUNT(uCh1Power) + COUNT(uCh2Power) FROM samples");
+    printf("line values stored: %lld of %d\n", stored, (ROWS - 1) * 6);
+    CHECK("fewer values stored",            stored > 0 && stored < (ROWS - 1) * 6 / 2);
+    CHECK("database_scan()",                database_scan(h, T0, T0 + ROWS * 5, checkrow, &dense) == ROWS &&
+                                            dense.n == ROWS);
+    CHECK("carried forward",                dense.nulls == 0);
+    CHECK("within epsilon",                 dense.maxerror <= EPSILON);
+    CHECK("failed poll is NULL",            query("SELECT COUNT(*) FROM data WHERE Timestamp = 1475000250 AND "
+                                                  "dCh1dB IS NULL AND uCh1dBmV IS NULL") == 1);
+    CHECK("carried over a failed poll",     query("SELECT ROUND(dCh1dB * 10) FROM data WHERE Timestamp = 1475000255") == 376 &&
+                                            query("SELECT dCh1Snr FROM samples WHERE Timestamp = 1475000255") == -999);
+    CHECK("missing channel is NULL",        query("SELECT COUNT(dCh3dB) + COUNT(uCh4dBmV) FROM data") == 0);
+    snprintf(sql, sizeof(sql), "INSERT INTO samples (Timestamp, Carried) VALUES (%d, 8)", T0 + 10000);
+    execute(sql);
+    CHECK("not carried further back",       query("SELECT COUNT(*) FROM samples_dense WHERE Timestamp = 1475010000 AND "
+                                                  "dCh1Snr IS NULL") == 1);
+    snprintf(sql, sizeof(sql), "DELETE FROM samples WHERE Timestamp = %d", T0 + 10000);
+    execute(sql);
+
+    // 3.
+    CHECK("rollup counts",                  query("SELECT SUM(dCh1SnrN) FROM rollup_1m") == ROWS - 1 &&
+                                            query("SELECT SUM(dCh1SnrSum) FROM rollup_1m") == (ROWS - 1) * 376);
+    CHECK("rollup min, max",                query("SELECT MIN(dCh1PowerMin) FROM rollup_1h") == -35);
+
+    // 4. Between rows 10 and 11, dCh1dB stored into the late row
+    record(&rec, 10);
+    rec.timestamp  += 2;
+    rec.down_ch1_db = 40.0;
+    database_write(h, &rec);
+    CHECK("late row stored in full",        query("SELECT dCh1Snr FROM samples WHERE Timestamp = 1475000052") == 400);
+    CHECK("next row materialized",          query("SELECT dCh1Snr FROM samples WHERE Timestamp = 1475000055") == 376 &&
+                                            query("SELECT Carried FROM samples WHERE Timestamp = 1475000055") == -999);
+    CHECK("rows after it unchanged",        query("SELECT ROUND(dCh1dB * 10) FROM data WHERE Timestamp = 1475000060") == 376);
+
+    // 5. Keyframe at row 0 and 12, cutoff in between
+    for (i = 0; i < 100 && (rc = database_retention(h, T0 + 30, 1000, &n_deleted, &oldest)) == DATABASE_RETENTION_MORE; i++)
+        ;
+    CHECK("database_retention()",           rc == DATABASE_RETENTION_DONE &&
+                                            query("SELECT MIN(Timestamp) FROM samples") == T0 + 30);
+    CHECK("remaining row materialized",     query("SELECT dCh1Snr FROM samples WHERE Timestamp = 1475000030") == 376);
+    CHECK("still carried forward",          query("SELECT COUNT(*) FROM data WHERE Timestamp < 1475000060 AND dCh1dB IS NULL") == 0 &&
+                                            query("SELECT ROUND(dCh1dB * 10) FROM data WHERE Timestamp = 1475000035") == 376);
+
+    // 6. Keyframe at row ROWS, row after it fails
+    snprintf(sql, sizeof(sql), "CREATE TRIGGER fail BEFORE INSERT ON samples WHEN NEW.Timestamp = %d "
+                               "BEGIN SELECT RAISE(ABORT, 'failed'); END", T0 + (ROWS + 1) * 5);
+    execute(sql);
+    for (i = ROWS, rc = 0; i < ROWS + 3; i++)
+    {
+        record(&rec, i);
+        rc |= (database_write(h, &rec) != SQLITE_OK) << (i - ROWS);
+    }
+    CHECK("insert failed",                  rc == 2 && query("SELECT COUNT(*) FROM samples WHERE Timestamp > 1475000595") == 2);
+    CHECK("next row is a keyframe",         query("SELECT Carried FROM samples WHERE Timestamp = 1475000610") == -999 &&
+                                            query("SELECT dCh1Snr FROM samples WHERE Timestamp = 1475000610") == 376);
+    database_close(h);
+
+    // 7. Datafile: keyframe before the moved rows, row carrying it after
+    //    them. tmpfs: rows 0 ... 11 of dCh1dB 40.0, rows up to 6 moved.
+    if (system("rm -f " DATAFILE "* " TMPFSFILE "*") ||
+        database_initialize(DATAFILE) || database_initialize(TMPFSFILE))
+        return EXIT_FAILURE;
+    cfg.execute.tmpfs           = true;
+    cfg.database.tmpfsfilename  = TMPFSFILE;
+    if ((h = database_open(DATAFILE)))
+    {
+        record(&rec, -2);
+        database_write(h, &rec);
+        record(&rec, 8);
+        database_write(h, &rec);
+        database_close(h);
+    }
+    if ((h = database_open(TMPFSFILE)))
+    {
+        for (i = 0; i < 12; i++)
+        {
+            record(&rec, i);
+            rec.down_ch1_db = 40.0;
+            database_write(h, &rec);
+        }
+        database_close(h);
+    }
+    CHECK("datafile row carried",           query("SELECT Carried & 8 FROM samples WHERE Timestamp = 1475000040") == 8);
+    CHECK("database_collecttmpfs()",        database_collecttmpfs(T0 + 30) == EXIT_SUCCESS &&
+                                            query("SELECT COUNT(*) FROM samples") == 9);
+    CHECK("datafile row materialized",      query("SELECT dCh1Snr FROM samples WHERE Timestamp = 1475000040") == 376);
+    CHECK("moved rows carried",             query("SELECT COUNT(*) FROM data WHERE Timestamp BETWEEN 1475000000 AND 1475000030 "
+                                                  "AND ROUND(dCh1dB * 10) = 400") == 7);
+    CHECK("tmpfs row materialized",         queryfile(TMPFSFILE, "SELECT MIN(Timestamp) FROM samples") == T0 + 35 &&
+                                            queryfile(TMPFSFILE, "SELECT dCh1Snr FROM samples WHERE Timestamp = 1475000035") == 400);
+    CHECK("tmpfs rows carried",             queryfile(TMPFSFILE, "SELECT COUNT(*) FROM data WHERE ROUND(dCh1dB * 10) = 400") == 5);
+    cfg.execute.tmpfs           = false;
+    cfg.database.tmpfsfilename  = NULL;
+
+    // 8.
+    if (system("rm -f " DATAFILE "* " TMPFSFILE "*"))
+        n_failed++;
+    {
+        sqlite3 *db;
+        sqlite3_open(DATAFILE, &db);
+        snprintf(sql, sizeof(sql), "INSERT INTO samples (Timestamp, dCh1Snr) VALUES (%d, 376)", T0);
+        sqlite3_exec(
+                    db,
+                    "CREATE TABLE samples (Timestamp INTEGER PRIMARY KEY, " DATABASE_VALUES(SQL_X_SAMPLES) "Violations INTEGER); "
+                    "CREATE VIEW data AS SELECT Timestamp, " DATABASE_VALUES(SQL_X_VIEW) "Violations FROM samples; "
+                    SQL_SET_SCHEMA_COMPACT,
+                    NULL, NULL, NULL
+                    );
+        sqlite3_exec(db, sql, NULL, NULL, NULL);
+        sqlite3_close(db);
+    }
+    CHECK("database_upgrade()",             database_upgrade(DATAFILE) == EXIT_SUCCESS);
+    CHECK("Carried column added",           query("SELECT COUNT(Carried) FROM samples") == 0 &&
+                                            query("SELECT ROUND(dCh1dB * 10) FROM data") == 376);
+    CHECK("writes after upgrade",           (h = database_open(DATAFILE)) != NULL);
+    if (h)
+    {
+        for (i = 1; i < 4; i++)
+        {
+            record(&rec, i);
+            database_write(h, &rec);
+        }
+        database_close(h);
+    }
+    CHECK("carried after upgrade",          query("SELECT COUNT(*) FROM samples WHERE Carried > 0") == 2 &&
+                                            query("SELECT COUNT(*) FROM data WHERE dCh1dB IS NULL") == 0);
+
+    // 9.
+    cfg.database.keyframeinterval = 0;
+    if (system("rm -f " DATAFILE "*") || database_initialize(DATAFILE) || !(h = database_open(DATAFILE)))
+        return EXIT_FAILURE;
+    for (i = 0; i < 20; i++)
+    {
+        record(&rec, i);
+        database_write(h, &rec);
+    }
+    database_close(h);
+    CHECK("disabled",                       query("SELECT COUNT(dCh1Snr) FROM samples") == 20 &&
+                                            query("SELECT COUNT(Carried) FROM samples") == 0);
+
+    if (system("rm -f " DATAFILE "*"))
+        n_failed++;
+    return n_failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+/* EOF ut_changeonly.c */
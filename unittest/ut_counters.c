@@ -0,0 +1,132 @@
+/******************************************************************************
+ * COUNTER DELTA ENGINE TEST
+ *
+ *      Feeds a sequence of decoded SNMP responses through counters_update():
+ *
+ *          1.  First sample                        -> baseline only
+ *          2.  Counters grow                       -> deltas
+ *          3.  Counter32 wraps                     -> modulo 2^32 delta
+ *          4.  Uptime goes backwards               -> reboot, delta = value
+ *          5.  Uptime shorter than the gap         -> reboot
+ *          6.  TimeTicks wrap                      -> not a reboot
+ *          7.  No sysUpTime, counter goes down     -> reset
+ *          8.  Channel appears                     -> NULL until next sample
+ ******************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../counters.h"
+
+static int n_failed = 0;
+
+#define CHECK(name, cond) \
+    do { \
+        int ok_ = (cond); \
+        printf("%-40s %s\n", name, ok_ ? "OK" : "NOT OK"); \
+        if (!ok_) n_failed++; \
+    } while (0)
+
+static void sample(snmp_docsis_t *d, uint32_t uptime, uint32_t corr, uint32_t t3)
+{
+    memset(d, 0, sizeof(snmp_docsis_t));
+    d->sysuptime                = uptime;
+    d->has_sysuptime            = 1;
+    d->t3timeouts               = t3;
+    d->has_timeouts             = 1;
+    d->ndown                    = 1;
+    d->down[0].has_counters     = 1;
+    d->down[0].unerroreds       = corr * 100;
+    d->down[0].correcteds       = corr;
+    d->down[0].uncorrectables   = 0;
+}
+
+int main()
+{
+    snmp_docsis_t       d;
+    databasecounters_t  rec;
+    databasereboot_t    reboot;
+    time_t              now = 100000;
+
+    memset(&d, 0, sizeof(d));
+
+    CHECK("no store, baseline",             counters_update(&d, now, &rec, &reboot) == COUNTERS_BASELINE);
+    CHECK("counters_attach()",              counters_attach() == EXIT_SUCCESS);
+
+    // 1. Baseline
+    sample(&d, 360000, 1000, 5);
+    CHECK("first sample, baseline",         counters_update(&d, now, &rec, &reboot) == COUNTERS_BASELINE);
+
+    // 2. Growth
+    now += 300;
+    sample(&d, 360000 + 30000, 1250, 7);
+    CHECK("second sample, delta",           counters_update(&d, now, &rec, &reboot) == COUNTERS_DELTA);
+    CHECK("delta values",                   rec.seconds == 300 && rec.down[0].correcteds == 250 &&
+                                            rec.t3timeouts == 2 && rec.down[0].uncorrectables == 0);
+    CHECK("missing channel is NULL",        rec.down[1].correcteds == DATABASE_COUNTER_NULL_VALUE);
+
+    // 3. Counter32 wrap
+    now += 300;
+    sample(&d, 360000 + 60000, 0xFFFFFF00, 7);
+    counters_update(&d, now, &rec, &reboot);
+    now += 300;
+    sample(&d, 360000 + 90000, 0x10, 7);
+    CHECK("wrap, delta",                    counters_update(&d, now, &rec, &reboot) == COUNTERS_DELTA);
+    CHECK("wrap, modulo 2^32",              rec.down[0].correcteds == 0x110);
+
+    // 4. Uptime backwards
+    now += 300;
+    sample(&d, 6000, 40, 1);
+    CHECK("uptime backwards, reboot",       counters_update(&d, now, &rec, &reboot) == COUNTERS_REBOOT);
+    CHECK("reboot delta is value",          rec.down[0].correcteds == 40 && rec.t3timeouts == 1);
+    CHECK("reboot seconds is uptime",       rec.seconds == 60);
+    CHECK("reboot event",                   reboot.boottime == now - 60 && reboot.lastuptime == 4500);
+
+    // 5. Rebooted and ran past previous uptime during a gap
+    now += 3600;
+    sample(&d, 12000, 10, 0);
+    CHECK("uptime < gap, reboot",           counters_update(&d, now, &rec, &reboot) == COUNTERS_REBOOT);
+
+    // 6. TimeTicks wrap
+    now += 300;
+    sample(&d, 0xFFFFF000, 20, 0);
+    counters_update(&d, now, &rec, &reboot);
+    now += 300;
+    sample(&d, 0xFFFFF000 + 30000, 30, 0);
+    CHECK("timeticks wrap, no reboot",      counters_update(&d, now, &rec, &reboot) == COUNTERS_DELTA &&
+                                            rec.down[0].correcteds == 10);
+
+    // 7. No sysUpTime
+    now += 300;
+    sample(&d, 0, 500, 0);
+    d.has_sysuptime = 0;
+    counters_update(&d, now, &rec, &reboot);
+    now += 300;
+    sample(&d, 0, 20, 0);
+    d.has_sysuptime = 0;
+    CHECK("no uptime, delta",               counters_update(&d, now, &rec, &reboot) == COUNTERS_DELTA);
+    // unerroreds and correcteds went down, uncorrectables stayed at zero
+    CHECK("no uptime, reset",               rec.down[0].correcteds == 20 &&
+                                            counters_getstore()->total.n_resets == 2);
+
+    // 8. New channel
+    now += 300;
+    sample(&d, 360000, 30, 0);
+    d.ndown = 2;
+    d.down[1].has_counters = 1;
+    d.down[1].correcteds   = 77;
+    counters_update(&d, now, &rec, &reboot);
+    CHECK("new channel, NULL",              rec.down[1].correcteds == DATABASE_COUNTER_NULL_VALUE);
+    now += 300;
+    d.sysuptime += 30000;
+    d.down[1].correcteds = 80;
+    counters_update(&d, now, &rec, &reboot);
+    CHECK("new channel, delta",             rec.down[1].correcteds == 3);
+
+    CHECK("totals",                         counters_getstore()->total.n_reboots == 2 &&
+                                            counters_getstore()->total.n_wraps >= 2);
+    counters_close();
+    return n_failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+/* EOF ut_counters.c */
@@ -0,0 +1,10 @@
+#!/bin/bash
+
+gcc -D_GNU_SOURCE -D_DEBUG -I../ -g -Wall -c ut_counters.c      -o ut_counters.o
+gcc -D_GNU_SOURCE -D_DEBUG -I../ -g -Wall -c ../counters.c      -o counters.o
+gcc -D_GNU_SOURCE -D_DEBUG -I../ -g -Wall -c ../logwrite.c      -o logwrite.o
+gcc -D_GNU_SOURCE -D_DEBUG -I../ -g -Wall -c ../util.c          -o util.o
+gcc -D_GNU_SOURCE -D_DEBUG -I../ -g -Wall -c ../user.c          -o user.o
+
+
+gcc -g -Wall -lm -lrt -o counters ut_counters.o counters.o logwrite.o user.o util.o
@@ -232,6 +232,29 @@ printf("testing insert\n");
     printf("Done!\n");
     ttyanykey("Press any key to continue...");
 
+    printf("=======================================================\n");
+    printf("08b. Aligned interval events (PING 2 s, LINEDATA 60 s)\n");
+    printf("=======================================================\n");
+    time_t ping     = event_create_aligned(EVENT_ACTION_PING, 2);
+    time_t linedata = event_create_aligned(EVENT_ACTION_LINEDATA, 60);
+    if (ping <= t || ping % 2 || linedata <= t || linedata % 60)
+    {
+        printf("event_create_aligned() returned unaligned times (%ld, %ld)!\n", ping, linedata);
+        exit(EXIT_FAILURE);
+    }
+    if (event_create_aligned(EVENT_ACTION_POWEROFF, 60) >= 0)
+    {
+        printf("event_create_aligned() accepted a DAILY action!\n");
+        exit(EXIT_FAILURE);
+    }
+    if (event_remove(EVENT_ACTION_PING) != 1 || event_remove(EVENT_ACTION_LINEDATA) != 1)
+    {
+        printf("event_remove() did not remove exactly one event per action!\n");
+        exit(EXIT_FAILURE);
+    }
+    printf("Done!\n");
+    ttyanykey("Press any key to continue...");
+
     printf("=======================================================\n");
     printf("09. Clearing parsed events\n");
     printf("=======================================================\n");
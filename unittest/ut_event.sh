@@ -15,9 +15,17 @@ gcc -D_GNU_SOURCE -D_DEBUG -I../ -g -Wall -c ../user.c          -o user.o
 gcc -D_GNU_SOURCE -D_DEBUG -I../ -g -Wall -c ../capability.c    -o capability.o
 gcc -D_GNU_SOURCE -D_DEBUG -I../ -g -Wall -c ../datalogger.c    -o datalogger.o
 gcc -D_GNU_SOURCE -D_DEBUG -I../ -g -Wall -c ../icmpecho.c      -o icmpecho.o
+gcc -D_GNU_SOURCE -D_DEBUG -I../ -g -Wall -c ../snmp.c          -o snmp.o
+gcc -D_GNU_SOURCE -D_DEBUG -I../ -g -Wall -c ../webui.c         -o webui.o
+gcc -D_GNU_SOURCE -D_DEBUG -I../ -g -Wall -c ../breaker.c       -o breaker.o
+gcc -D_GNU_SOURCE -D_DEBUG -I../ -g -Wall -c ../counters.c      -o counters.o
+gcc -D_GNU_SOURCE -D_DEBUG -I../ -g -Wall -c ../dbwriter.c      -o dbwriter.o
+gcc -D_GNU_SOURCE -D_DEBUG -I../ -g -Wall -c ../samplelog.c     -o samplelog.o
+gcc -D_GNU_SOURCE -D_DEBUG -I../ -g -Wall -c ../spool.c         -o spool.o
+gcc -D_GNU_SOURCE -D_DEBUG -I../ -g -Wall -c ../storage.c       -o storage.o
 gcc -D_GNU_SOURCE -D_DEBUG -I../ -g -Wall -c ../version.c       -o version.o
 
 
 gcc -g -Wall -lm -lrt -lcap -lsqlite3 -o event ut_event.o event.o eventheap.o \
 	daemon.o config.o logwrite.o database.o util.o power.o keyval.o pidfile.o \
-	user.o capability.o datalogger.o icmpecho.o version.o
+	user.o capability.o datalogger.o icmpecho.o snmp.o webui.o breaker.o counters.o dbwriter.o samplelog.o spool.o storage.o version.o
@@ -0,0 +1,168 @@
+/******************************************************************************
+ * RANGE EXPORT TEST
+ *
+ *      export_run() (export.h) over a datafile and a sample log:
+ *
+ *          1.  CSV: header, inclusive range, NULLs
+ *          2.  JSON lines
+ *          3.  Binary: header, scaled values, NULLs
+ *          4.  Downsampling: buckets, averages, row counts
+ *          5.  Sample log as the source, datafile history before it
+ *          6.  Invalid range
+ ******************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "../config.h"
+#include "../database.h"
+#include "../samplelog.h"
+#include "../export.h"
+
+#define DATAFILE    "/tmp/icmond.ut_export.sqlite3"
+#define SAMPLELOG   "/tmp/icmond.ut_export.samplelog"
+#define T0          1474999980      // multiple of 60
+#define ROWS        100
+#define STEP        60
+
+static int n_failed = 0;
+
+#define CHECK(name, cond) \
+    do { \
+        int ok_ = (cond); \
+        printf("%-40s %s\n", name, ok_ ? "OK" : "NOT OK"); \
+        if (!ok_) n_failed++; \
+    } while (0)
+
+/*
+ * Pings on every row, line data on every other row
+ */
+static void record(databaserecord_t *rec, int i)
+{
+    double *value = &rec->modemping_ms;
+    int     c;
+
+    rec->timestamp = T0 + i * 5;
+    for (c = 0; c < DATABASE_SAMPLE_COLUMNS; c++)
+        value[c] = DATABASE_DOUBLE_NULL_VALUE;
+    rec->modemping_ms = 1.5 + (i % 2);
+    rec->inetping_ms  = 12.25;
+    if (!(i % 2))
+        rec->down_ch1_dbmv = -3.5;
+}
+
+static int count(const char *text, const char *what)
+{
+    int n = 0;
+
+    while ((text = strstr(text, what)))
+    {
+        n++;
+        text += strlen(what);
+    }
+    return n;
+}
+
+/*
+ * Export into text (NUL terminated), return records
+ */
+static long long export(time_t from, time_t to, int format, int step, char *text, size_t size, size_t *len)
+{
+    FILE      *f = tmpfile();
+    long long  n;
+
+    if (!f)
+        return -1;
+    n = export_run(from, to, format, step, f);
+    rewind(f);
+    *len = fread(text, 1, size - 1, f);
+    text[*len] = '\0';
+    fclose(f);
+    return n;
+}
+
+int main()
+{
+    static char      text[1 << 20];
+    databaserecord_t rec;
+    export_header_t *header = (export_header_t *)text;
+    export_record_t *records = (export_record_t *)(text + sizeof(export_header_t));
+    samplelog_t     *log;
+    size_t           len;
+    int              i;
+
+    if (system("rm -f " DATAFILE "* " SAMPLELOG "*") || database_initialize(DATAFILE))
+        return EXIT_FAILURE;
+    strcpy(cfg.database.filename, DATAFILE);
+    cfg.database.samplelog[0] = '\0';
+    for (i = 0; i < ROWS; i++)
+    {
+        record(&rec, i);
+        database_insert(DATAFILE, &rec);
+    }
+
+    // 1.
+    CHECK("CSV",                            export(T0 + 10, T0 + 20, CFG_EXPORT_CSV, 0, text, sizeof(text), &len) == 3);
+    CHECK("header",                         !strncmp(text, "Timestamp,ModemPing,InetPing,dCh1dBbmV,", 39) &&
+                                            !strstr(text, "Rows"));
+    CHECK("inclusive range",                count(text, "\n") == 4 && strstr(text, "\n1474999990,") &&
+                                            strstr(text, "\n1475000000,"));
+    CHECK("values, NULLs",                  strstr(text, "\n1474999990,1.5,12.25,-3.5,,") &&
+                                            strstr(text, "\n1474999995,2.5,12.25,,,"));
+
+    // 2.
+    CHECK("JSON",                           export(0, T0 + ROWS * 5, CFG_EXPORT_JSON, 0, text, sizeof(text), &len) == ROWS);
+    CHECK("one object per line",            count(text, "{\"Timestamp\": ") == ROWS && count(text, "}\n") == ROWS);
+    CHECK("null",                           count(text, "\"dCh1dBbmV\": null") == ROWS / 2 &&
+                                            count(text, "\"dCh1dBbmV\": -3.5") == ROWS / 2);
+
+    // 3.
+    CHECK("binary",                         export(0, T0 + ROWS * 5, CFG_EXPORT_BINARY, 0, text, sizeof(text), &len) == ROWS);
+    CHECK("size",                           len == sizeof(export_header_t) + ROWS * sizeof(export_record_t));
+    CHECK("header",                         !memcmp(header->magic, EXPORT_MAGIC, 8) &&
+                                            header->columns == DATABASE_SAMPLE_COLUMNS && header->step == 0);
+    CHECK("scaled values",                  records[0].timestamp == T0 && records[0].rows == 1 &&
+                                            records[0].value[0] == 1500 && records[0].value[1] == 12250 &&
+                                            records[0].value[2] == -35);
+    CHECK("NULLs",                          records[1].value[2] == EXPORT_NULL &&
+                                            records[1].value[DATABASE_SAMPLE_COLUMNS - 1] == EXPORT_NULL);
+
+    // 4. 12 rows per bucket, last bucket 4 rows
+    CHECK("downsampled",                    export(0, T0 + ROWS * 5, CFG_EXPORT_BINARY, STEP, text, sizeof(text), &len) == 9);
+    CHECK("buckets",                        header->step == STEP && records[0].timestamp == T0 &&
+                                            records[1].timestamp == T0 + STEP && records[8].rows == 4);
+    CHECK("averages",                       records[0].rows == 12 && records[0].value[0] == 2000 &&
+                                            records[0].value[2] == -35 && records[0].value[3] == EXPORT_NULL);
+    CHECK("downsampled CSV",                export(T0, T0 + STEP - 1, CFG_EXPORT_CSV, STEP, text, sizeof(text), &len) == 1 &&
+                                            strstr(text, ",Rows\n") && strstr(text, "\n1474999980,2,12.25,-3.5,") &&
+                                            strstr(text, ",12\n"));
+
+    // 5. Sample log from the middle of the datafile rows, 10 rows past them
+    CHECK("samplelog_open()",               (log = samplelog_open(SAMPLELOG)) != NULL);
+    for (i = ROWS / 2; log && i < ROWS + 10; i++)
+    {
+        record(&rec, i);
+        samplelog_append(log, &rec);
+    }
+    if (log)
+        samplelog_close(log);
+    strcpy(cfg.database.samplelog, SAMPLELOG);
+    CHECK("sample log",                     export(T0 + ROWS * 5, T0 + ROWS * 5 + 100, CFG_EXPORT_CSV, 0,
+                                                   text, sizeof(text), &len) == 10);
+    CHECK("datafile history",               export(0, T0 + ROWS * 5 + 100, CFG_EXPORT_CSV, 0,
+                                                   text, sizeof(text), &len) == ROWS + 10 &&
+                                            strstr(text, "\n1474999990,1.5,12.25,-3.5,,"));
+    CHECK("no duplicates, in order",        count(text, "\n1475000225,") == 1 && count(text, "\n1475000230,") == 1 &&
+                                            strstr(text, "\n1475000225,") < strstr(text, "\n1475000230,"));
+    cfg.database.samplelog[0] = '\0';
+
+    // 6.
+    CHECK("invalid range",                  export_run(T0 + 1, T0, CFG_EXPORT_CSV, 0, stdout) == -1);
+
+    if (system("rm -f " DATAFILE "* " SAMPLELOG "*"))
+        n_failed++;
+    return n_failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+/* EOF ut_export.c */
@@ -0,0 +1,214 @@
+/******************************************************************************
+ * CSV IMPORT TEST
+ *
+ *      import_csv() (import.h) of cisco_docsis_logger history:
+ *
+ *          1.  Header, comma decimals, zero-filled and empty values as NULL,
+ *              malformed and unterminated lines skipped
+ *          2.  Rollups and the samples_violations index after the import
+ *          3.  Repeated import: existing timestamps are kept
+ *          4.  Large file (lines across read blocks), rows/s
+ *          5.  Row imported between a stored value and the rows carrying
+ *              it (change-only storage) does not change them
+ *          6.  Last line without a line terminator is imported if it parses
+ *          7.  Legacy schema is refused
+ ******************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <sqlite3.h>
+
+#include "../config.h"
+#include "../database.h"
+#include "../import.h"
+
+#define DATAFILE    "/tmp/icmond.ut_import.sqlite3"
+#define CSVFILE     "/tmp/icmond.ut_import.csv"
+#define T0          1473000000      // 2016.09.04 14:40:00 UTC
+#define LARGE       50000
+
+static int n_failed = 0;
+
+#define CHECK(name, cond) \
+    do { \
+        int ok_ = (cond); \
+        printf("%-40s %s\n", name, ok_ ? "OK" : "NOT OK"); \
+        if (!ok_) n_failed++; \
+    } while (0)
+
+static long long query(const char *sql)
+{
+    sqlite3      *db;
+    sqlite3_stmt *stmt;
+    long long     value = -1;
+
+    sqlite3_open(DATAFILE, &db);
+    if (sqlite3_prepare_v2(db, sql, -1, &stmt, NULL) == SQLITE_OK)
+    {
+        if (sqlite3_step(stmt) == SQLITE_ROW)
+            value = sqlite3_column_type(stmt, 0) == SQLITE_NULL ? -999 : sqlite3_column_int64(stmt, 0);
+        sqlite3_finalize(stmt);
+    }
+    sqlite3_close(db);
+    return value;
+}
+
+static void header(FILE *f)
+{
+    fprintf(f, "datetime;DnCh1 dBmV;DnCh1 dB;DnCh2 dBmV;DnCh2 dB;DnCh3 dBmV;DnCh3 dB;DnCh4 dBmV;DnCh4 dB;");
+    fprintf(f, "DnCh5 dBmV;DnCh5 dB;DnCh6 dBmV;DnCh6 dB;DnCh7 dBmV;DnCh7 dB;DnCh8 dBmV;DnCh8 dB;");
+    fprintf(f, "UpCh1 dBmV;UpCh2 dBmV;UpCh3 dBmV;UpCh4 dBmV\r\n");
+}
+
+static void row(FILE *f, time_t t, const char *ch1)
+{
+    char date[32];
+
+    strftime(date, sizeof(date), "%Y.%m.%d %H:%M:%S", localtime(&t));
+    fprintf(f, "%s;%s;37,6;-3,1;37,3;-2,8;37,4;-2,5;37,9;-2,2;38,0;-2,0;38,1;-1,8;38,2;-1,5;38,3;", date, ch1);
+    fprintf(f, "42,0;43,5;44,0;45,5\n");
+}
+
+static void zerorow(FILE *f, time_t t)
+{
+    char date[32];
+
+    strftime(date, sizeof(date), "%Y.%m.%d %H:%M:%S", localtime(&t));
+    fprintf(f, "%s;0,0;0,0;0,0;0,0;0,0;0,0;0,0;0,0;0,0;0,0;", date);
+    fprintf(f, "0,0;0,0;0,0;0,0;0,0;0,0;0,0;0,0;0,0;0,0\n");
+}
+
+int main()
+{
+    import_stats_t   stats;
+    databaserecord_t rec;
+    dbhandle_t      *h;
+    FILE            *f;
+    int              i, c;
+
+    setenv("TZ", "UTC", 1);
+    tzset();
+    if (system("rm -f " DATAFILE "* " CSVFILE) || database_initialize(DATAFILE))
+        return EXIT_FAILURE;
+    strcpy(cfg.database.filename, DATAFILE);
+
+    // 1.
+    if (!(f = fopen(CSVFILE, "w")))
+        return EXIT_FAILURE;
+    header(f);
+    for (i = 0; i < 6; i++)
+        row(f, T0 + i * 10, "-3,5");
+    zerorow(f, T0 + 60);
+    row(f, T0 + 70, "");
+    fprintf(f, "2016.09.04 14:41:20;-3,5;37,6\n");     // cut by a power loss
+    row(f, T0 + 90, "-4,0");
+    fprintf(f, "2016.09.04 14:41:40;-3,5;37");          // no line terminator
+    fclose(f);
+    CHECK("import_csv()",                   import_csv(CSVFILE, DATAFILE, &stats) == EXIT_SUCCESS);
+    CHECK("lines",                          stats.n_lines == 12 && stats.n_rows == 9);
+    CHECK("malformed",                      stats.n_malformed == 2);
+    CHECK("zero-filled",                    stats.n_failures == 1);
+    CHECK("imported",                       stats.n_imported == 9 && stats.n_duplicates == 0 &&
+                                            query("SELECT COUNT(*) FROM samples") == 9);
+    CHECK("timestamps",                     query("SELECT MIN(Timestamp) FROM samples") == T0 &&
+                                            query("SELECT MAX(Timestamp) FROM samples") == T0 + 90);
+    CHECK("comma decimals",                 query("SELECT dCh1Power FROM samples WHERE Timestamp = 1473000000") == -35 &&
+                                            query("SELECT dCh1Snr FROM samples WHERE Timestamp = 1473000000") == 376 &&
+                                            query("SELECT uCh4Power FROM samples WHERE Timestamp = 1473000000") == 455 &&
+                                            query("SELECT dCh1Power FROM samples WHERE Timestamp = 1473000090") == -40);
+    CHECK("zero row is NULL",               query("SELECT COUNT(*) FROM samples WHERE Timestamp = 1473000060 AND "
+                                                  "dCh1Power IS NULL AND dCh1Snr IS NULL AND uCh4Power IS NULL") == 1);
+    CHECK("empty value is NULL",            query("SELECT dCh1Power FROM samples WHERE Timestamp = 1473000070") == -999 &&
+                                            query("SELECT dCh1Snr FROM samples WHERE Timestamp = 1473000070") == 376);
+    CHECK("no pings",                       query("SELECT COUNT(*) FROM samples WHERE ModemRtt IS NOT NULL") == 0);
+
+    // 2.
+    CHECK("rollups",                        query("SELECT SUM(Rows) FROM rollup_1h") == 9);
+    CHECK("index created again",            query("SELECT COUNT(*) FROM sqlite_master WHERE name = 'samples_violations'") == 1);
+
+    // 3.
+    CHECK("repeated import",                import_csv(CSVFILE, DATAFILE, &stats) == EXIT_SUCCESS &&
+                                            stats.n_imported == 0 && stats.n_duplicates == 9 &&
+                                            query("SELECT COUNT(*) FROM samples") == 9);
+
+    // 4.
+    if (!(f = fopen(CSVFILE, "w")))
+        return EXIT_FAILURE;
+    header(f);
+    for (i = 0; i < LARGE; i++)
+        if (i % 100 == 99)
+            zerorow(f, T0 + i * 10);
+        else
+            row(f, T0 + i * 10, "-3,5");
+    fclose(f);
+    CHECK("large file",                     import_csv(CSVFILE, DATAFILE, &stats) == EXIT_SUCCESS &&
+                                            stats.n_rows == LARGE && stats.n_malformed == 0 &&
+                                            stats.n_failures == LARGE / 100);
+    CHECK("deduplicated",                   stats.n_duplicates == 9 && stats.n_imported == LARGE - 9 &&
+                                            query("SELECT COUNT(*) FROM samples") == LARGE);
+    CHECK("rollups",                        query("SELECT SUM(Rows) FROM rollup_1d") == LARGE);
+    printf("%d rows in %.1f ms, %.0f rows/s\n", LARGE, stats.ms, LARGE * 1000.0 / stats.ms);
+
+    // 5. Keyframe, then two rows carrying dCh1Power
+    if (system("rm -f " DATAFILE "*") || database_initialize(DATAFILE))
+        return EXIT_FAILURE;
+    cfg.database.keyframeinterval = 60;
+    cfg.database.changeepsilon    = 2;
+    if ((h = database_open(DATAFILE)))
+    {
+        for (i = 0; i < 3; i++)
+        {
+            for (c = 0; c < DATABASE_SAMPLE_COLUMNS; c++)
+                (&rec.modemping_ms)[c] = DATABASE_DOUBLE_NULL_VALUE;
+            rec.timestamp     = T0 + i * 10;
+            rec.down_ch1_dbmv = -3.5;
+            database_write(h, &rec);
+        }
+        database_close(h);
+    }
+    CHECK("carried rows",                   query("SELECT COUNT(*) FROM samples WHERE Carried") == 2);
+    if (!(f = fopen(CSVFILE, "w")))
+        return EXIT_FAILURE;
+    header(f);
+    row(f, T0 + 5, "-4,0");
+    fclose(f);
+    CHECK("import_csv()",                   import_csv(CSVFILE, DATAFILE, &stats) == EXIT_SUCCESS &&
+                                            stats.n_imported == 1);
+    CHECK("next row materialized",          query("SELECT dCh1Power FROM samples WHERE Timestamp = 1473000010") == -35 &&
+                                            query("SELECT COUNT(*) FROM samples WHERE Carried") == 1);
+    CHECK("carried values unchanged",       query("SELECT dCh1Power FROM samples_dense WHERE Timestamp = 1473000020") == -35);
+    cfg.database.keyframeinterval = 0;
+
+    // 6. Line terminator cut off the end of the file
+    if (!(f = fopen(CSVFILE, "w")))
+        return EXIT_FAILURE;
+    header(f);
+    row(f, T0 + 100, "-4,0");
+    i = (int)ftell(f);
+    fclose(f);
+    CHECK("valid unterminated last line",   !truncate(CSVFILE, i - 1) &&
+                                            import_csv(CSVFILE, DATAFILE, &stats) == EXIT_SUCCESS &&
+                                            stats.n_lines == 2 && stats.n_imported == 1 &&
+                                            stats.n_malformed == 0 &&
+                                            query("SELECT uCh4Power FROM samples WHERE Timestamp = 1473000100") == 455);
+
+    // 7.
+    if (system("rm -f " DATAFILE "*"))
+        n_failed++;
+    {
+        sqlite3 *db;
+        sqlite3_open(DATAFILE, &db);
+        sqlite3_exec(db, SQL_CREATE_TABLE_DATA, NULL, NULL, NULL);
+        sqlite3_close(db);
+    }
+    CHECK("legacy schema refused",          import_csv(CSVFILE, DATAFILE, &stats) == EXIT_FAILURE && errno == ENOTSUP);
+
+    if (system("rm -f " DATAFILE "* " CSVFILE))
+        n_failed++;
+    return n_failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+/* EOF ut_import.c */
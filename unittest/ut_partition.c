@@ -0,0 +1,160 @@
+/******************************************************************************
+ * DATAFILE PARTITION TEST
+ *
+ *      Partition naming, period boundaries and retention (database.c):
+ *
+ *          1.  Partition name is inserted before the extension
+ *          2.  Next period starts at local midnight (month and year wrap)
+ *          3.  DST change day is 23 hours long
+ *          4.  Retention removes the oldest partitions, never the base file
+ *          5.  Span connection sees the base file and all partitions
+ *          6.  Span over a legacy base datafile and compact partitions
+ *          7.  tmpfs import watermark carries over the rollover
+ ******************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <sqlite3.h>
+
+#include "../config.h"
+#include "../database.h"
+
+#define TESTDIR "/tmp/icmond.ut_partition"
+#define TMPFSFILE TESTDIR "/tmpfs.sqlite3"
+
+static int n_failed = 0;
+
+#define CHECK(name, cond) \
+    do { \
+        int ok_ = (cond); \
+        printf("%-40s %s\n", name, ok_ ? "OK" : "NOT OK"); \
+        if (!ok_) n_failed++; \
+    } while (0)
+
+static time_t localdate(int year, int month, int day, int hour)
+{
+    struct tm tm;
+    memset(&tm, 0, sizeof(tm));
+    tm.tm_year  = year - 1900;
+    tm.tm_mon   = month - 1;
+    tm.tm_mday  = day;
+    tm.tm_hour  = hour;
+    tm.tm_isdst = -1;
+    return mktime(&tm);
+}
+
+static int spanrows()
+{
+    sqlite3      *db;
+    sqlite3_stmt *stmt;
+    int           n = -1;
+
+    if (!(db = database_openspan()))
+        return -1;
+    if (sqlite3_prepare_v2(db, "SELECT COUNT(*) FROM data", -1, &stmt, NULL) == SQLITE_OK)
+    {
+        if (sqlite3_step(stmt) == SQLITE_ROW)
+            n = sqlite3_column_int(stmt, 0);
+        sqlite3_finalize(stmt);
+    }
+    sqlite3_close(db);
+    return n;
+}
+
+int main()
+{
+    databaserecord_t rec;
+    sqlite3         *db;
+    time_t           t;
+    int              month;
+
+    setenv("TZ", "Europe/Helsinki", 1);
+    tzset();
+    if (system("rm -rf " TESTDIR " && mkdir " TESTDIR))
+        return EXIT_FAILURE;
+    strcpy(cfg.database.filename, TESTDIR "/icmond.sqlite3");
+    CHECK("base datafile created",          database_initialize(cfg.database.filename) == EXIT_SUCCESS);
+
+    // 1. Naming
+    t = localdate(2016, 12, 31, 23);
+    CHECK("NONE is base datafile",          !strcmp(database_partition(t), cfg.database.filename));
+    cfg.database.partition = CFG_PARTITION_MONTH;
+    CHECK("MONTH name",                     !strcmp(database_partition(t), TESTDIR "/icmond.2016-12.sqlite3"));
+    cfg.database.partition = CFG_PARTITION_DAY;
+    CHECK("DAY name",                       !strcmp(database_partition(t), TESTDIR "/icmond.2016-12-31.sqlite3"));
+    cfg.database.partition = CFG_PARTITION_YEAR;
+    CHECK("YEAR name",                      !strcmp(database_partition(t), TESTDIR "/icmond.2016.sqlite3"));
+
+    // 2. Boundaries
+    CHECK("YEAR boundary",                  database_nextpartition(t) == localdate(2017, 1, 1, 0));
+    cfg.database.partition = CFG_PARTITION_MONTH;
+    CHECK("MONTH boundary, year wraps",     database_nextpartition(t) == localdate(2017, 1, 1, 0));
+    cfg.database.partition = CFG_PARTITION_DAY;
+    CHECK("DAY boundary, month wraps",      database_nextpartition(t) == localdate(2017, 1, 1, 0));
+
+    // 3. DST (Europe/Helsinki, 2016-03-27 03:00 -> 04:00)
+    t = localdate(2016, 3, 27, 0);
+    CHECK("DST day is 23 hours",            database_nextpartition(t) - t == 23 * 3600);
+
+    // 4. Five monthly partitions, one row each
+    cfg.database.partition = CFG_PARTITION_MONTH;
+    memset(&rec, 0, sizeof(rec));
+    for (month = 2; month <= 6; month++)
+    {
+        rec.timestamp = localdate(2016, month, 10, 12);
+        database_preparepartition(database_partition(rec.timestamp));
+        database_insert(database_partition(rec.timestamp), &rec);
+    }
+    CHECK("span over 5 partitions",         spanrows() == 5);
+    CHECK("keep 2, removes 3",              database_removepartitions(2) == 3);
+    CHECK("oldest removed",                 access(TESTDIR "/icmond.2016-04.sqlite3", F_OK) != 0);
+    CHECK("newest kept",                    !access(TESTDIR "/icmond.2016-06.sqlite3", F_OK));
+    CHECK("base datafile kept",             !access(cfg.database.filename, F_OK));
+    CHECK("span over 2 partitions",         spanrows() == 2);
+    CHECK("keep 0 removes nothing",         database_removepartitions(0) == 0);
+
+    // 6. Upgraded legacy base datafile (no Carried column), one row
+    unlink(cfg.database.filename);
+    CHECK("legacy base datafile",           !sqlite3_open(cfg.database.filename, &db) &&
+                                            !sqlite3_exec(db, SQL_CREATE_TABLE_DATA
+                                                          "INSERT INTO data (Timestamp) VALUES (1)",
+                                                          NULL, NULL, NULL));
+    sqlite3_close(db);
+    CHECK("legacy base upgraded",           database_upgrade(cfg.database.filename) == EXIT_SUCCESS);
+    CHECK("span over legacy base",          spanrows() == 3);
+    CHECK("legacy rows not carried",        (db = database_openspan()) &&
+                                            !sqlite3_exec(db, "SELECT Violations, Carried FROM data",
+                                                          NULL, NULL, NULL));
+    CHECK("counters and reboots span",      !sqlite3_exec(db, "SELECT dCh8Uncorrectable FROM counters; "
+                                                          "SELECT LastUptime FROM reboots",
+                                                          NULL, NULL, NULL));
+    sqlite3_close(db);
+
+    // 7. June row imported, but left in tmpfs (crash before the delete).
+    //    July row also written into the July partition directly.
+    cfg.execute.tmpfs           = true;
+    cfg.database.tmpfsfilename  = TMPFSFILE;
+    t = localdate(2016, 6, 30, 23);
+    rec.timestamp = t;
+    CHECK("tmpfs datafile created",         database_initialize(TMPFSFILE) == EXIT_SUCCESS &&
+                                            database_insert(TMPFSFILE, &rec) == EXIT_SUCCESS);
+    CHECK("imported into June",             database_collecttmpfs(t + 60) == EXIT_SUCCESS &&
+                                            spanrows() == 4);
+    database_insert(TMPFSFILE, &rec);
+    rec.timestamp = localdate(2016, 7, 1, 1);
+    database_insert(TMPFSFILE, &rec);
+    database_preparepartition(database_partition(rec.timestamp));
+    database_insert(database_partition(rec.timestamp), &rec);
+    CHECK("imported into July",             database_collecttmpfs(rec.timestamp + 60) == EXIT_SUCCESS);
+    CHECK("June row not imported again",    spanrows() == 5);
+    cfg.execute.tmpfs           = false;
+    cfg.database.tmpfsfilename  = NULL;
+
+    if (system("rm -rf " TESTDIR))
+        n_failed++;
+    return n_failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+/* EOF ut_partition.c */
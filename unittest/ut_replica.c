@@ -0,0 +1,211 @@
+/******************************************************************************
+ * READ-ONLY REPLICA TEST
+ *
+ *      database_replicate() copies the datafile with the online backup API
+ *      and renames the copy over the replica.
+ *
+ *          1.  Replica: rows, rollback journal, read-only, no copy left
+ *          2.  Refresh replaces the previous replica
+ *          3.  WAL datafile written during the copy: replica is a
+ *              consistent snapshot, commits are not held off
+ *          4.  Rollback journal datafile changed between every step: copy
+ *              gives up, previous replica is kept
+ *          5.  Missing datafile
+ ******************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <sqlite3.h>
+
+#include "../config.h"
+#include "../database.h"
+#include "../util.h"
+
+#define DATAFILE    "/tmp/icmond.ut_replica.sqlite3"
+#define REPLICA     "/tmp/icmond.ut_replica.replica.sqlite3"
+#define FILLER      400         // 4 kB rows, copy takes several steps
+#define MAXCOMMIT   50.0        // ms
+
+static int n_failed = 0;
+
+#define CHECK(name, cond) \
+    do { \
+        int ok_ = (cond); \
+        printf("%-40s %s\n", name, ok_ ? "OK" : "NOT OK"); \
+        if (!ok_) n_failed++; \
+    } while (0)
+
+static long long query(const char *filename, const char *sql)
+{
+    sqlite3      *db;
+    sqlite3_stmt *stmt;
+    long long     value = -1;
+
+    sqlite3_open_v2(filename, &db, SQLITE_OPEN_READONLY, NULL);
+    if (sqlite3_prepare_v2(db, sql, -1, &stmt, NULL) == SQLITE_OK)
+    {
+        if (sqlite3_step(stmt) == SQLITE_ROW)
+            value = sqlite3_column_int64(stmt, 0);
+        sqlite3_finalize(stmt);
+    }
+    sqlite3_close(db);
+    return value;
+}
+
+static int execute(const char *sql)
+{
+    sqlite3 *db;
+    int      rc;
+
+    sqlite3_open(DATAFILE, &db);
+    rc = sqlite3_exec(db, sql, NULL, NULL, NULL);
+    sqlite3_close(db);
+    return rc;
+}
+
+static int create(const char *journal)
+{
+    char sql[256];
+
+    if (system("rm -f " DATAFILE "* " REPLICA "*") || database_initialize(DATAFILE))
+        return 0;
+    snprintf(
+            sql,
+            sizeof(sql),
+            "PRAGMA journal_mode = %s; CREATE TABLE filler (n INTEGER, x BLOB); "
+            "WITH RECURSIVE r(n) AS (SELECT 1 UNION ALL SELECT n + 1 FROM r WHERE n < %d) "
+            "INSERT INTO filler SELECT n, randomblob(4000) FROM r;",
+            journal,
+            FILLER
+            );
+    return execute(sql) == SQLITE_OK;
+}
+
+/*
+ * File format read / write versions (header offsets 18, 19): 1 rollback
+ * journal, 2 WAL
+ */
+static int rollbackjournal()
+{
+    unsigned char header[20];
+    FILE         *f;
+    int           ok = 0;
+
+    if ((f = fopen(REPLICA, "rb")))
+    {
+        ok = fread(header, 1, sizeof(header), f) == sizeof(header) && header[18] == 1 && header[19] == 1;
+        fclose(f);
+    }
+    return ok;
+}
+
+static int readonly()
+{
+    struct stat st;
+
+    return !stat(REPLICA, &st) && !(st.st_mode & (S_IWUSR | S_IWGRP | S_IWOTH));
+}
+
+/*
+ * Child commits a row every few ms until killed, with the busy handler of
+ * the writer connection. Exit code is the slowest commit in ms (capped at
+ * 255).
+ */
+static volatile sig_atomic_t stop = 0;
+
+static void handle_SIGTERM(int sig)
+{
+    (void)sig;
+    stop = 1;
+}
+
+static pid_t writer()
+{
+    pid_t pid;
+
+    if ((pid = fork()) == 0)
+    {
+        sqlite3 *db;
+        xtmr_t  *t = xtmr();
+        double   ms, max = 0.0;
+
+        signal(SIGTERM, handle_SIGTERM);
+        sqlite3_open(DATAFILE, &db);
+        database_busytimeout(db, 1000);
+        while (!stop)
+        {
+            xtmrlap(t);
+            sqlite3_exec(db, "INSERT INTO filler VALUES (0, randomblob(100))", NULL, NULL, NULL);
+            if ((ms = xtmrlap(t)) > max)
+                max = ms;
+            usleep(5000);
+        }
+        sqlite3_close(db);
+        free(t);
+        _exit(max > 255.0 ? 255 : (int)max);
+    }
+    usleep(20000);
+    return pid;
+}
+
+static int maxcommit(pid_t pid)
+{
+    int status;
+
+    kill(pid, SIGTERM);
+    if (waitpid(pid, &status, 0) != pid || !WIFEXITED(status))
+        return 255;
+    printf("slowest commit during the copy: %d ms\n", WEXITSTATUS(status));
+    return WEXITSTATUS(status);
+}
+
+int main()
+{
+    pid_t pid;
+
+    // 1.
+    CHECK("datafile created",               create("DELETE"));
+    CHECK("database_replicate()",           database_replicate(DATAFILE, REPLICA) == EXIT_SUCCESS);
+    CHECK("rows",                           query(REPLICA, "SELECT COUNT(*) FROM filler") == FILLER);
+    CHECK("schema",                         query(REPLICA, "SELECT COUNT(*) FROM sqlite_master WHERE name = 'samples'") == 1);
+    CHECK("rollback journal",               rollbackjournal());
+    CHECK("read-only",                      readonly());
+    CHECK("no copy left",                   access(REPLICA DATABASE_REPLICA_SUFFIX, F_OK) != 0);
+
+    // 2.
+    execute("DELETE FROM filler WHERE n > 100");
+    CHECK("refresh",                        database_replicate(DATAFILE, REPLICA) == EXIT_SUCCESS);
+    CHECK("replaced",                       query(REPLICA, "SELECT COUNT(*) FROM filler") == 100 && readonly());
+
+    // 3.
+    CHECK("WAL datafile created",           create("WAL"));
+    pid = writer();
+    CHECK("database_replicate() (WAL)",     database_replicate(DATAFILE, REPLICA) == EXIT_SUCCESS);
+    CHECK("commits not held off",           maxcommit(pid) < MAXCOMMIT);
+    CHECK("snapshot",                       query(REPLICA, "PRAGMA integrity_check") != -1 &&
+                                            query(REPLICA, "SELECT COUNT(*) FROM filler WHERE n > 0") == FILLER);
+    CHECK("replica not in WAL mode",        rollbackjournal() && access(REPLICA "-wal", F_OK));
+
+    // 4.
+    CHECK("datafile created",               create("DELETE"));
+    CHECK("database_replicate()",           database_replicate(DATAFILE, REPLICA) == EXIT_SUCCESS);
+    execute("DELETE FROM filler WHERE n > 100");
+    pid = writer();
+    CHECK("gives up on restarts",           database_replicate(DATAFILE, REPLICA) == EXIT_FAILURE);
+    CHECK("commits not held off",           maxcommit(pid) < MAXCOMMIT);
+    CHECK("previous replica kept",          query(REPLICA, "SELECT COUNT(*) FROM filler") == FILLER);
+    CHECK("no copy left",                   access(REPLICA DATABASE_REPLICA_SUFFIX, F_OK) != 0);
+
+    // 5.
+    CHECK("missing datafile",               database_replicate(DATAFILE ".missing", REPLICA) == EXIT_FAILURE);
+
+    if (system("rm -f " DATAFILE "* " REPLICA "*"))
+        n_failed++;
+    return n_failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+/* EOF ut_replica.c */
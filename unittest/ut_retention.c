@@ -0,0 +1,159 @@
+/******************************************************************************
+ * RETENTION TEST
+ *
+ *      Twenty days of rows, retention of ten days:
+ *
+ *          1.  Every chunk holds the write lock for about the limit only
+ *          2.  Rows older than the cutoff are gone, newer ones are not
+ *          3.  Rollups of the deleted days are kept
+ *          4.  Incremental vacuum returns the free pages (file shrinks)
+ *          5.  Full pass through the database writer
+ ******************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/stat.h>
+#include <sqlite3.h>
+
+#include "../config.h"
+#include "../database.h"
+#include "../dbwriter.h"
+#include "../util.h"
+
+#define DATAFILE    "/tmp/icmond.ut_retention.sqlite3"
+#define DAYS        20
+#define STEP        60
+#define MAXLOCK     20      // ms
+#define SLACK       30      // ms, commit (fsync) is not interruptible
+
+static int n_failed = 0;
+
+#define CHECK(name, cond) \
+    do { \
+        int ok_ = (cond); \
+        printf("%-40s %s\n", name, ok_ ? "OK" : "NOT OK"); \
+        if (!ok_) n_failed++; \
+    } while (0)
+
+static long long query(const char *sql)
+{
+    sqlite3      *db;
+    sqlite3_stmt *stmt;
+    long long     value = -1;
+
+    sqlite3_open(DATAFILE, &db);
+    if (sqlite3_prepare_v2(db, sql, -1, &stmt, NULL) == SQLITE_OK)
+    {
+        if (sqlite3_step(stmt) == SQLITE_ROW)
+            value = sqlite3_column_int64(stmt, 0);
+        sqlite3_finalize(stmt);
+    }
+    sqlite3_close(db);
+    return value;
+}
+
+static long long filesize()
+{
+    struct stat st;
+    return stat(DATAFILE, &st) ? -1 : (long long)st.st_size;
+}
+
+static void populate(time_t now)
+{
+    databaserecord_t rec;
+    double          *value = &rec.modemping_ms;
+    time_t           t;
+    int              i;
+
+    CHECK("dbwriter_open()",                dbwriter_open(DATAFILE) == EXIT_SUCCESS);
+    for (t = now - DAYS * 86400; t < now; t += STEP)
+    {
+        rec.timestamp = t;
+        for (i = 0; i < (sizeof(databaserecord_t) - sizeof(time_t)) / sizeof(double); i++)
+            value[i] = 1.0 + (t % 97) / 10.0;
+        dbwriter_send(DBWRITER_MSG_RECORD, &rec);
+        if (t % (STEP * 40) == 0)
+            dbwriter_process();
+    }
+    dbwriter_close();
+}
+
+int main()
+{
+    dbhandle_t *h;
+    xtmr_t     *timer = xtmr();
+    time_t      now = time(NULL) / 86400 * 86400, oldest;
+    time_t      cutoff = now - DAYS / 2 * 86400;
+    double      ms, maxms = 0;
+    long long   before, n_rows, n_days, n_free;
+    char        sql[128];
+    int         rc, n, n_chunks = 0, n_deleted = 0;
+
+    if (system("rm -f " DATAFILE "*"))
+        return EXIT_FAILURE;
+    strcpy(cfg.database.filename, DATAFILE);
+    cfg.database.commitrows = 500;
+    CHECK("datafile created",               database_initialize(DATAFILE) == EXIT_SUCCESS);
+    CHECK("auto_vacuum incremental",        query("PRAGMA auto_vacuum") == DATABASE_AUTOVACUUM_INCREMENTAL);
+    populate(now);
+    n_rows = query("SELECT COUNT(*) FROM samples");
+    n_days = query("SELECT COUNT(*) FROM rollup_1d");
+    CHECK("populated",                      n_rows == DAYS * 86400 / STEP && n_days == DAYS);
+
+    // 1. and 2.
+    CHECK("database_open()",                (h = database_open(DATAFILE)) != NULL);
+    do
+    {
+        xtmrlap(timer);
+        rc = database_retention(h, cutoff, MAXLOCK, &n, &oldest);
+        ms = xtmrlap(timer);
+        maxms = ms > maxms ? ms : maxms;
+        n_deleted += n;
+        n_chunks++;
+    } while (rc == DATABASE_RETENTION_MORE);
+    printf("%d rows in %d chunks, longest %.2f ms\n", n_deleted, n_chunks, maxms);
+    CHECK("retention done",                 rc == DATABASE_RETENTION_DONE);
+    CHECK("lock time bounded",              maxms < MAXLOCK + SLACK);
+    sprintf(sql, "SELECT COUNT(*) FROM samples WHERE Timestamp < %lld", (long long)cutoff);
+    CHECK("old rows deleted",               query(sql) == 0 && n_deleted == n_rows / 2);
+    CHECK("new rows kept",                  query("SELECT COUNT(*) FROM samples") == n_rows / 2);
+
+    // 3.
+    CHECK("rollups kept",                   query("SELECT COUNT(*) FROM rollup_1d") == n_days);
+
+    // 4.
+    n_free = query("PRAGMA freelist_count");
+    before = filesize();
+    CHECK("free pages",                     n_free > 0);
+    do
+        rc = database_incrementalvacuum(h, MAXLOCK, &n);
+    while (rc == DATABASE_RETENTION_MORE);
+    database_close(h);
+    printf("%lld -> %lld bytes\n", before, filesize());
+    CHECK("vacuum done",                    rc == DATABASE_RETENTION_DONE);
+    CHECK("no free pages",                  query("PRAGMA freelist_count") == 0);
+    CHECK("file shrinks",                   filesize() == before - n_free * query("PRAGMA page_size"));
+
+    // 5.
+    cfg.database.retention     = DAYS / 4;
+    cfg.database.retentionlock = MAXLOCK;
+    CHECK("dbwriter_open()",                dbwriter_open(DATAFILE) == EXIT_SUCCESS);
+    CHECK("dbwriter_retention()",           dbwriter_retention() == EXIT_SUCCESS);
+    for (n = 0; n < 10000 && query("PRAGMA freelist_count") != 0; n++)
+        dbwriter_retentionstep();
+    for (n = 0; n < 10000; n++)
+        dbwriter_retentionstep();
+    dbwriter_close();
+    sprintf(sql, "SELECT COUNT(*) FROM samples WHERE Timestamp < %lld",
+            (long long)(time(NULL) - DAYS / 4 * 86400));
+    CHECK("writer pass",                    query(sql) == 0 &&
+                                            query("PRAGMA freelist_count") == 0);
+
+    free(timer);
+    if (system("rm -f " DATAFILE "*"))
+        n_failed++;
+    return n_failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+/* EOF ut_retention.c */
@@ -0,0 +1,147 @@
+/******************************************************************************
+ * ROLLUP TABLE TEST
+ *
+ *      Rows are written through the database writer (group commit) and
+ *      single row inserts, rollups are then recomputed from scratch:
+ *
+ *          1.  Maintained rollups equal the full recomputation
+ *          2.  Ping and line data rows of the same timestamp count once
+ *          3.  Lost pings and T3 timeouts are counted per bucket
+ *          4.  Rebuild detects (and repairs) a tampered bucket
+ ******************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sqlite3.h>
+
+#include "../config.h"
+#include "../database.h"
+#include "../dbwriter.h"
+
+#define DATAFILE    "/tmp/icmond.ut_rollup.sqlite3"
+#define T0          1475000000
+
+static int n_failed = 0;
+
+#define CHECK(name, cond) \
+    do { \
+        int ok_ = (cond); \
+        printf("%-40s %s\n", name, ok_ ? "OK" : "NOT OK"); \
+        if (!ok_) n_failed++; \
+    } while (0)
+
+static long long query(const char *sql)
+{
+    sqlite3      *db;
+    sqlite3_stmt *stmt;
+    long long     value = -1;
+
+    sqlite3_open(DATAFILE, &db);
+    if (sqlite3_prepare_v2(db, sql, -1, &stmt, NULL) == SQLITE_OK)
+    {
+        if (sqlite3_step(stmt) == SQLITE_ROW)
+            value = sqlite3_column_int64(stmt, 0);
+        sqlite3_finalize(stmt);
+    }
+    sqlite3_close(db);
+    return value;
+}
+
+#define CHECKSUM(table) \
+    "SELECT SUM(Bucket * Rows + ModemLost + IFNULL(T3Timeouts, 0) + IFNULL(ModemRttSum, 0) + " \
+    "IFNULL(ModemRttSumSq, 0) + IFNULL(ModemRttMin, 0) * 7 + IFNULL(dCh1PowerMax, 0) * 11 + " \
+    "dCh1PowerN * 13 + IFNULL(uCh1PowerSum, 0)) FROM " table
+
+static const char *checksum[] =
+{
+    CHECKSUM("rollup_1m"),
+    CHECKSUM("rollup_1h"),
+    CHECKSUM("rollup_1d")
+};
+
+static void nullrecord(databaserecord_t *rec, time_t timestamp)
+{
+    double *value = &rec->modemping_ms;
+    int     i;
+
+    rec->timestamp = timestamp;
+    for (i = 0; i < (sizeof(databaserecord_t) - sizeof(time_t)) / sizeof(double); i++)
+        value[i] = DATABASE_DOUBLE_NULL_VALUE;
+}
+
+int main()
+{
+    databaserecord_t   rec;
+    databasecounters_t counters;
+    long long          maintained[3];
+    int                i;
+
+    if (system("rm -f " DATAFILE "*"))
+        return EXIT_FAILURE;
+    strcpy(cfg.database.filename, DATAFILE);
+    CHECK("datafile created",               database_initialize(DATAFILE) == EXIT_SUCCESS);
+    CHECK("dbwriter_open()",                dbwriter_open(DATAFILE) == EXIT_SUCCESS);
+    cfg.database.commitrows = 25;
+
+    // Ping job every 10 s, line data job every minute, 3 hours
+    memset(&counters, 0xff, sizeof(counters));
+    for (i = 0; i < 1080; i++)
+    {
+        nullrecord(&rec, T0 + i * 10);
+        if (i % 4)
+            rec.modemping_ms = 1.5 + (i % 7) / 4.0;     // every 4th ping lost
+        rec.inetping_ms = 12.25;
+        dbwriter_send(DBWRITER_MSG_RECORD, &rec);
+        if (i % 6 == 0)
+        {
+            nullrecord(&rec, T0 + i * 10);
+            rec.down_ch1_dbmv = -4.0 + (i % 9) / 10.0;
+            rec.down_ch1_db   = 38.2;
+            rec.up_ch1_dbmv   = 44.5;
+            dbwriter_send(DBWRITER_MSG_RECORD, &rec);
+            counters.timestamp  = T0 + i * 10;
+            counters.seconds    = 60;
+            counters.t3timeouts = i % 3;
+            counters.t4timeouts = 0;
+            dbwriter_send(DBWRITER_MSG_COUNTERS, &counters);
+        }
+        if (i % 40 == 0)
+            dbwriter_process();
+    }
+    dbwriter_close();
+    // Single row insert (worker without the daemon)
+    nullrecord(&rec, T0 + 1080 * 10);
+    rec.modemping_ms = 3.0;
+    CHECK("database_insert()",              database_insert(DATAFILE, &rec) == SQLITE_OK);
+
+    // 1.
+    for (i = 0; i < 3; i++)
+        maintained[i] = query(checksum[i]);
+    CHECK("rebuild",                        database_rebuildrollups(DATAFILE) == EXIT_SUCCESS);
+    CHECK("1m equals recomputation",        query(checksum[0]) == maintained[0] &&
+                                            query("SELECT COUNT(*) FROM rollup_1m") == 181);
+    CHECK("1h equals recomputation",        query(checksum[1]) == maintained[1]);
+    CHECK("1d equals recomputation",        query(checksum[2]) == maintained[2]);
+
+    // 2. and 3.
+    CHECK("rows counted once",              query("SELECT SUM(Rows) FROM rollup_1h") == 1081);
+    CHECK("lost pings",                     query("SELECT SUM(ModemLost) FROM rollup_1d") == 270);
+    CHECK("T3 timeouts",                    query("SELECT SUM(T3Timeouts) FROM rollup_1h") ==
+                                            query("SELECT SUM(T3Timeouts) FROM counters"));
+    CHECK("day sum equals samples",         query("SELECT SUM(ModemRttSum) FROM rollup_1d") ==
+                                            query("SELECT SUM(ModemRtt) FROM samples"));
+    CHECK("day min equals samples",         query("SELECT MIN(dCh1PowerMin) FROM rollup_1d") ==
+                                            query("SELECT MIN(dCh1Power) FROM samples"));
+
+    // 4. Tamper one bucket, rebuild repairs it
+    query("UPDATE rollup_1m SET Rows = 99 WHERE Bucket = " "1475000040");
+    CHECK("tampered",                       query("SELECT SUM(Rows) FROM rollup_1m") != 1081);
+    CHECK("rebuild",                        database_rebuildrollups(DATAFILE) == EXIT_SUCCESS);
+    CHECK("repaired",                       query("SELECT SUM(Rows) FROM rollup_1m") == 1081);
+
+    if (system("rm -f " DATAFILE "*"))
+        n_failed++;
+    return n_failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+/* EOF ut_rollup.c */
@@ -0,0 +1,262 @@
+/******************************************************************************
+ * SAMPLE LOG TEST
+ *
+ *      Two days of 5 second ping rows and 1 minute line data rows, line data
+ *      arriving late (separate jobs):
+ *
+ *          1.  Rows read back merged, values at compact schema resolution
+ *          2.  Size per row (and a year of it)
+ *          3.  Reopen replays the tail, nothing lost or duplicated
+ *          4.  Torn segment and torn tail row are truncated away
+ *          5.  Interrupted seal is completed or rolled back
+ *          6.  Export into a compact schema datafile
+ *          7.  Database writer sends samples into the log, counters into
+ *              the datafile
+ ******************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sqlite3.h>
+
+#include "../config.h"
+#include "../database.h"
+#include "../samplelog.h"
+#include "../dbwriter.h"
+
+#define LOGFILE     "/tmp/icmond.ut_samplelog"
+#define DATAFILE    "/tmp/icmond.ut_samplelog.sqlite3"
+#define T0          1475002800      // whole hour
+#define ROWS        (2 * 86400 / 5)
+
+static int n_failed = 0;
+
+#define CHECK(name, cond) \
+    do { \
+        int ok_ = (cond); \
+        printf("%-40s %s\n", name, ok_ ? "OK" : "NOT OK"); \
+        if (!ok_) n_failed++; \
+    } while (0)
+
+static long long query(const char *sql)
+{
+    sqlite3      *db;
+    sqlite3_stmt *stmt;
+    long long     value = -1;
+
+    sqlite3_open(DATAFILE, &db);
+    if (sqlite3_prepare_v2(db, sql, -1, &stmt, NULL) == SQLITE_OK)
+    {
+        if (sqlite3_step(stmt) == SQLITE_ROW)
+            value = sqlite3_column_int64(stmt, 0);
+        sqlite3_finalize(stmt);
+    }
+    sqlite3_close(db);
+    return value;
+}
+
+static long long filesize(const char *name)
+{
+    struct stat st;
+    return stat(name, &st) ? -1 : (long long)st.st_size;
+}
+
+static void nullrecord(databaserecord_t *rec, time_t timestamp)
+{
+    double *value = &rec->modemping_ms;
+    int     i;
+
+    rec->timestamp = timestamp;
+    for (i = 0; i < SAMPLELOG_COLUMNS; i++)
+        value[i] = DATABASE_DOUBLE_NULL_VALUE;
+}
+
+static void pingrecord(databaserecord_t *rec, int i)
+{
+    nullrecord(rec, T0 + i * 5);
+    rec->modemping_ms = 1.5 + (i * 7919 % 500) / 1000.0;
+    rec->inetping_ms  = 12.0 + (i * 104729 % 3000) / 1000.0;
+    if (i % 50 == 0)
+        rec->inetping_ms = DATABASE_DOUBLE_NULL_VALUE;      // lost
+}
+
+static void linerecord(databaserecord_t *rec, int i)
+{
+    double *value = &rec->down_ch1_dbmv;
+    int     c;
+
+    nullrecord(rec, T0 + i * 5);
+    for (c = 0; c < 16; c++)
+        value[c] = c % 2 ? 38.0 + (i / 720 + c) % 5 / 10.0 : -4.0 + (i / 360) % 9 / 10.0;
+    rec->up_ch1_dbmv = 44.5;
+}
+
+typedef struct
+{
+    int     n;
+    int     n_mismatch;
+    time_t  previous;
+    int     n_unordered;
+} verify_t;
+
+static int verify(databaserecord_t *rec, void *arg)
+{
+    verify_t        *v = arg;
+    databaserecord_t ping, line;
+    int              i = (rec->timestamp - T0) / 5;
+
+    pingrecord(&ping, i);
+    linerecord(&line, i);
+    if (fabs(rec->modemping_ms - round(ping.modemping_ms * 1000) / 1000) > 1e-9 ||
+        (ping.inetping_ms == DATABASE_DOUBLE_NULL_VALUE ?
+            rec->inetping_ms != DATABASE_DOUBLE_NULL_VALUE :
+            fabs(rec->inetping_ms - ping.inetping_ms) > 1e-9) ||
+        (i % 12 == 0 ?
+            fabs(rec->down_ch1_db - line.down_ch1_db) > 1e-9 || rec->up_ch1_dbmv != 44.5 :
+            rec->down_ch1_db != DATABASE_DOUBLE_NULL_VALUE) ||
+        rec->up_ch4_dbmv != DATABASE_DOUBLE_NULL_VALUE)
+        v->n_mismatch++;
+    if (rec->timestamp <= v->previous)
+        v->n_unordered++;
+    v->previous = rec->timestamp;
+    v->n++;
+    return 0;
+}
+
+static verify_t scan(time_t from, time_t to)
+{
+    verify_t v;
+    memset(&v, 0, sizeof(v));
+    samplelog_scan(LOGFILE, from, to, verify, &v);
+    return v;
+}
+
+static void writetail(const char *name, uint32_t generation)
+{
+    uint32_t header[2] = { 0x4C494154, generation };
+    int      fd = open(name, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+
+    if (write(fd, header, sizeof(header)) != sizeof(header))
+        n_failed++;
+    close(fd);
+}
+
+int main()
+{
+    samplelog_t     *log;
+    databaserecord_t rec, line;
+    databasecounters_t counters;
+    verify_t         v;
+    long long        size;
+    int              i, fd;
+
+    if (system("rm -f " LOGFILE "* " DATAFILE "*"))
+        return EXIT_FAILURE;
+    CHECK("samplelog_open()",               (log = samplelog_open(LOGFILE)) != NULL);
+    for (i = 0; i < ROWS; i++)
+    {
+        pingrecord(&rec, i);
+        samplelog_append(log, &rec);
+        // Line data job finishes after the next ping
+        if (i % 12 == 1)
+        {
+            linerecord(&line, i - 1);
+            samplelog_append(log, &line);
+        }
+        if (i % 1000 == 0)
+            samplelog_sync(log);
+    }
+    CHECK("segments sealed",                samplelog_getstats(log)->n_segments == 47);
+    CHECK("rows merged",                    samplelog_getstats(log)->n_merged == (ROWS + 11) / 12);
+    samplelog_close(log);
+
+    // 1.
+    v = scan(0, INT32_MAX);
+    CHECK("rows read back",                 v.n == ROWS);
+    CHECK("values",                         v.n_mismatch == 0);
+    CHECK("timestamps in order",            v.n_unordered == 0);
+    v = scan(T0 + 7200, T0 + 7200);
+    CHECK("single row",                     v.n == 1 && v.n_mismatch == 0);
+    v = scan(T0 + 3600, T0 + 7199);
+    CHECK("range scan",                     v.n == 720 && v.n_mismatch == 0);
+
+    // 2.
+    size = filesize(LOGFILE);
+    printf("%lld bytes, %.2f bytes/row, %.1f MB/year\n",
+           size, (double)size / ROWS, (double)size / ROWS * 365 * 17280 / 1048576);
+    CHECK("under 8 bytes/row",              size < ROWS * 8LL);
+
+    // 3.
+    CHECK("reopen",                         (log = samplelog_open(LOGFILE)) != NULL);
+    pingrecord(&rec, ROWS + 1);
+    samplelog_append(log, &rec);
+    samplelog_close(log);
+    v = scan(0, INT32_MAX);
+    CHECK("tail replayed",                  v.n == ROWS + 1 && v.n_mismatch == 0);
+    CHECK("size unchanged",                 filesize(LOGFILE) == size);
+
+    // 4. Half written segment and row
+    fd = open(LOGFILE, O_WRONLY | O_APPEND);
+    if (write(fd, "SSEG and then some garbage", 26) != 26)
+        n_failed++;
+    close(fd);
+    fd = open(LOGFILE ".tail", O_WRONLY | O_APPEND);
+    if (write(fd, &rec, 100) != 100)
+        n_failed++;
+    close(fd);
+    v = scan(0, INT32_MAX);
+    CHECK("torn files readable",            v.n == ROWS + 1 && v.n_mismatch == 0);
+    CHECK("reopen",                         (log = samplelog_open(LOGFILE)) != NULL);
+    samplelog_close(log);
+    CHECK("torn segment truncated",         filesize(LOGFILE) == size);
+    v = scan(0, INT32_MAX);
+    CHECK("torn row truncated",             v.n == ROWS + 1);
+
+    // 5. Next tail of a seal that did not make it (generation 48) is removed,
+    //    one of a seal that did (generation 47) replaces the tail
+    writetail(LOGFILE ".tail.new", 48);
+    CHECK("reopen",                         (log = samplelog_open(LOGFILE)) != NULL);
+    samplelog_close(log);
+    CHECK("rolled back",                    access(LOGFILE ".tail.new", F_OK) && scan(0, INT32_MAX).n == ROWS + 1);
+    writetail(LOGFILE ".tail.new", 47);
+    CHECK("reopen",                         (log = samplelog_open(LOGFILE)) != NULL);
+    samplelog_close(log);
+    CHECK("completed",                      access(LOGFILE ".tail.new", F_OK) && scan(0, INT32_MAX).n == 720 * 47);
+
+    // 6.
+    CHECK("samplelog_export()",             samplelog_export(LOGFILE, DATAFILE) == EXIT_SUCCESS);
+    CHECK("exported rows",                  query("SELECT COUNT(*) FROM samples") == 720 * 47);
+    CHECK("exported values",                query("SELECT SUM(ModemRtt) FROM samples") ==
+                                            query("SELECT SUM(ModemRttSum) FROM rollup_1d"));
+    CHECK("exported line data",             query("SELECT COUNT(dCh1Snr) FROM samples") == 60 * 47);
+
+    // 7.
+    if (system("rm -f " LOGFILE " " LOGFILE ".tail"))
+        n_failed++;
+    strcpy(cfg.database.samplelog, LOGFILE);
+    cfg.database.commitrows = 4;
+    CHECK("dbwriter_open()",                dbwriter_open(DATAFILE) == EXIT_SUCCESS);
+    memset(&counters, 0xff, sizeof(counters));
+    for (i = 0; i < 10; i++)
+    {
+        nullrecord(&rec, T0 + 2 * 86400 + i * 5);
+        rec.modemping_ms = 1.5;
+        dbwriter_send(DBWRITER_MSG_RECORD, &rec);
+    }
+    counters.timestamp = T0 + 2 * 86400;
+    counters.seconds   = 60;
+    dbwriter_send(DBWRITER_MSG_COUNTERS, &counters);
+    dbwriter_close();
+    CHECK("samples into the log",           scan(0, INT32_MAX).n == 10 &&
+                                            query("SELECT COUNT(*) FROM samples") == 720 * 47);
+    CHECK("counters into the datafile",     query("SELECT COUNT(*) FROM counters") == 1);
+
+    if (system("rm -f " LOGFILE "* " DATAFILE "*"))
+        n_failed++;
+    return n_failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+/* EOF ut_samplelog.c */
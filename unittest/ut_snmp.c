@@ -0,0 +1,161 @@
+/******************************************************************************
+ * SNMP CLIENT TEST
+ *
+ *      Forks a minimal SNMP "agent" on 127.0.0.1 (ephemeral port) that
+ *      decodes the GetBulkRequest and answers it with a canned response.
+ *      Parent verifies the values stored by snmp_fill_record().
+ ******************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <arpa/inet.h>
+
+#include "../snmp.h"
+#include "../database.h"
+
+static int n_failed = 0;
+
+#define CHECK(name, cond) \
+    do { \
+        int ok_ = (cond); \
+        printf("%-40s %s\n", name, ok_ ? "OK" : "NOT OK"); \
+        if (!ok_) n_failed++; \
+    } while (0)
+
+/*
+ * Append varbind: column OID + ".index"
+ */
+static void add_varbind(snmp_pdu_t *pdu, const char *column, int index, unsigned char type, int64_t value)
+{
+    snmp_varbind_t *vb = &pdu->varbind[pdu->nvarbinds++];
+    char            oid[128];
+    snprintf(oid, sizeof(oid), "%s.%d", column, index);
+    snmp_oid_parse(&vb->oid, oid);
+    vb->type  = type;
+    vb->value = value;
+}
+
+static void agent(int sockfd)
+{
+    unsigned char       buffer[SNMP_BUFFERSIZE];
+    struct sockaddr_in  peer;
+    socklen_t           peerlen = sizeof(peer);
+    snmp_pdu_t          request, response;
+    int                 len, row;
+
+    if ((len = recvfrom(sockfd, buffer, sizeof(buffer), 0, (struct sockaddr *)&peer, &peerlen)) < 0)
+        _exit(EXIT_FAILURE);
+    if (snmp_decode(buffer, len, &request) || request.type != SNMP_PDU_GETBULK)
+        _exit(EXIT_FAILURE);
+
+    memset(&response, 0, sizeof(response));
+    response.type      = SNMP_PDU_RESPONSE;
+    response.requestid = request.requestid;
+    add_varbind(&response, SNMP_OID_SYSUPTIME,          0, SNMP_TYPE_TIMETICKS, 123456);
+    add_varbind(&response, SNMP_OID_CMSTATUSTXPOWER,    2, SNMP_TYPE_INTEGER,   420);
+    add_varbind(&response, SNMP_OID_CMSTATUST3TIMEOUTS, 2, SNMP_TYPE_COUNTER32, 3);
+    add_varbind(&response, SNMP_OID_CMSTATUST4TIMEOUTS, 2, SNMP_TYPE_COUNTER32, 1);
+    // Two downstream channels, one DOCSIS 3.0 upstream
+    for (row = 0; row < 2; row++)
+    {
+        add_varbind(&response, SNMP_OID_DOWNCHANNELPOWER,   3 + row, SNMP_TYPE_INTEGER,   -15 + row);
+        add_varbind(&response, SNMP_OID_SIGQSIGNALNOISE,    3 + row, SNMP_TYPE_INTEGER,   385 + row);
+        add_varbind(&response, SNMP_OID_SIGQUNERROREDS,     3 + row, SNMP_TYPE_COUNTER32, 1000);
+        add_varbind(&response, SNMP_OID_SIGQCORRECTEDS,     3 + row, SNMP_TYPE_COUNTER32, 10);
+        add_varbind(&response, SNMP_OID_SIGQUNCORRECTABLES, 3 + row, SNMP_TYPE_COUNTER32, 1);
+        if (row == 0)
+            add_varbind(&response, SNMP_OID_CM3USTXPOWER,   80, SNMP_TYPE_INTEGER,   445);
+        else
+            add_varbind(&response, "1.3.6.1.6.3.1.1.4",     1,  SNMP_TYPE_ENDOFMIBVIEW, 0);
+    }
+    if ((len = snmp_encode(buffer, sizeof(buffer), "public", &response)) < 0)
+        _exit(EXIT_FAILURE);
+    sendto(sockfd, buffer, len, 0, (struct sockaddr *)&peer, peerlen);
+    _exit(EXIT_SUCCESS);
+}
+
+int main()
+{
+    struct sockaddr_in  addr;
+    socklen_t           addrlen = sizeof(addr);
+    struct snmp_t      *snmp;
+    databaserecord_t    rec;
+    fd_set              readfds;
+    int                 sockfd, rc = -1;
+    pid_t               pid;
+
+    /*
+     * OID helpers
+     */
+    snmp_oid_t prefix, oid;
+    snmp_oid_parse(&prefix, SNMP_OID_DOWNCHANNELPOWER);
+    snmp_oid_parse(&oid, SNMP_OID_DOWNCHANNELPOWER ".3");
+    CHECK("snmp_oid_prefix() within", snmp_oid_prefix(&prefix, &oid));
+    snmp_oid_parse(&oid, SNMP_OID_SIGQSIGNALNOISE ".3");
+    CHECK("snmp_oid_prefix() outside", !snmp_oid_prefix(&prefix, &oid));
+
+    /*
+     * Agent
+     */
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family      = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port        = 0;
+    if ((sockfd = socket(AF_INET, SOCK_DGRAM, 0)) < 0 ||
+        bind(sockfd, (struct sockaddr *)&addr, sizeof(addr)) ||
+        getsockname(sockfd, (struct sockaddr *)&addr, &addrlen))
+    {
+        perror("agent socket");
+        return EXIT_FAILURE;
+    }
+    if (!(pid = fork()))
+        agent(sockfd);
+    close(sockfd);
+
+    /*
+     * Client
+     */
+    if (!(snmp = snmp_prepare("127.0.0.1", ntohs(addr.sin_port), "public", 1000)))
+    {
+        printf("snmp_prepare() failed!\n");
+        return EXIT_FAILURE;
+    }
+    CHECK("snmp_send()", snmp_send(snmp) == EXIT_SUCCESS);
+    timerfd_settime(snmp->timeoutfd, 0, &snmp->timeoutspec, NULL);
+    while (snmp->sent_and_listening)
+    {
+        FD_ZERO(&readfds);
+        FD_SET(snmp->sockfd, &readfds);
+        FD_SET(snmp->timeoutfd, &readfds);
+        if (select((snmp->sockfd > snmp->timeoutfd ? snmp->sockfd : snmp->timeoutfd) + 1,
+                   &readfds, NULL, NULL, NULL) < 0)
+            break;
+        if (FD_ISSET(snmp->sockfd, &readfds))
+            rc = snmp_receive(snmp);
+        if (FD_ISSET(snmp->timeoutfd, &readfds))
+            snmp_cancel(snmp);
+    }
+    waitpid(pid, NULL, 0);
+    CHECK("snmp_receive()", rc == EXIT_SUCCESS);
+
+    memset(&rec, 0, sizeof(rec));
+    rec.down_ch3_dbmv = DATABASE_DOUBLE_NULL_VALUE;
+    rec.up_ch2_dbmv   = DATABASE_DOUBLE_NULL_VALUE;
+    CHECK("snmp_fill_record() count",       snmp_fill_record(snmp, &rec) == 5);
+    CHECK("sysUpTime",                      snmp->docsis.sysuptime == 123456);
+    CHECK("T3 / T4 timeouts",               snmp->docsis.t3timeouts == 3 && snmp->docsis.t4timeouts == 1);
+    CHECK("down ch1 power",                 rec.down_ch1_dbmv == -1.5);
+    CHECK("down ch2 SNR",                   rec.down_ch2_db == 38.6);
+    CHECK("down ch3 untouched",             rec.down_ch3_dbmv == DATABASE_DOUBLE_NULL_VALUE);
+    CHECK("up ch1 (docsIf3) power",         rec.up_ch1_dbmv == 44.5);
+    CHECK("up ch2 untouched",               rec.up_ch2_dbmv == DATABASE_DOUBLE_NULL_VALUE);
+    snmp_close(snmp);
+
+    return n_failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+/* EOF ut_snmp.c */
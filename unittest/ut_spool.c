@@ -0,0 +1,175 @@
+/******************************************************************************
+ * SPOOL TEST
+ *
+ *      Rows are appended into the spool by dbwriter_send() (workers) and
+ *      drained into the datafile by the database writer:
+ *
+ *          1.  Rows wait in the spool until drained, flush only syncs
+ *          2.  Close drains everything and empties the spool
+ *          3.  Records left by a crash are replayed on open, torn record
+ *              truncated and corrupt record skipped
+ *          4.  Worst case tick latency, pipe + group commit against spool
+ ******************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sqlite3.h>
+
+#include "../config.h"
+#include "../database.h"
+#include "../dbwriter.h"
+#include "../spool.h"
+#include "../util.h"
+
+#define DATAFILE    "/tmp/icmond.ut_spool.sqlite3"
+#define SPOOLFILE   "/tmp/icmond.ut_spool.sqlite3.spool"
+#define HEADERSIZE  24
+#define T0          1475000000
+#define ROWS        2000
+
+static int n_failed = 0;
+
+#define CHECK(name, cond) \
+    do { \
+        int ok_ = (cond); \
+        printf("%-40s %s\n", name, ok_ ? "OK" : "NOT OK"); \
+        if (!ok_) n_failed++; \
+    } while (0)
+
+static long long query(const char *sql)
+{
+    sqlite3      *db;
+    sqlite3_stmt *stmt;
+    long long     value = -1;
+
+    sqlite3_open(DATAFILE, &db);
+    if (sqlite3_prepare_v2(db, sql, -1, &stmt, NULL) == SQLITE_OK)
+    {
+        if (sqlite3_step(stmt) == SQLITE_ROW)
+            value = sqlite3_column_int64(stmt, 0);
+        sqlite3_finalize(stmt);
+    }
+    sqlite3_close(db);
+    return value;
+}
+
+static long long filesize(const char *name)
+{
+    struct stat st;
+    return stat(name, &st) ? -1 : (long long)st.st_size;
+}
+
+static void pingrecord(databaserecord_t *rec, int i)
+{
+    double *value = &rec->modemping_ms;
+    int     c;
+
+    rec->timestamp = T0 + i * 5;
+    for (c = 0; c < (sizeof(databaserecord_t) - sizeof(time_t)) / sizeof(double); c++)
+        value[c] = DATABASE_DOUBLE_NULL_VALUE;
+    rec->modemping_ms = 1.5 + (i % 7) / 4.0;
+    rec->inetping_ms  = 12.25;
+}
+
+/*
+ * Rows sent like the workers send them, daemon loop tick after each.
+ * Returns the worst tick (ms).
+ */
+static double ticks(int from, int to, int spool)
+{
+    databaserecord_t   rec;
+    databasecounters_t counters;
+    xtmr_t            *t = xtmr();
+    double             ms, max = 0.0;
+    int                i;
+
+    memset(&counters, 0xff, sizeof(counters));
+    for (i = from; i < to; i++)
+    {
+        xtmrlap(t);
+        pingrecord(&rec, i);
+        dbwriter_send(DBWRITER_MSG_RECORD, &rec);
+        if (i % 12 == 0)
+        {
+            counters.timestamp = rec.timestamp;
+            counters.seconds   = 60;
+            dbwriter_send(DBWRITER_MSG_COUNTERS, &counters);
+        }
+        dbwriter_process();
+        // Commit timer: commitrows worth of rows
+        if (spool && i % cfg.database.commitrows == 0)
+            dbwriter_flush();
+        ms  = xtmrlap(t);
+        max = ms > max ? ms : max;
+    }
+    free(t);
+    return max;
+}
+
+int main()
+{
+    dbwriter_msg_t msg;
+    spool_t       *spool;
+    double         pipe_ms, spool_ms;
+    int            i, fd;
+
+    if (system("rm -f " DATAFILE "*"))
+        return EXIT_FAILURE;
+    strcpy(cfg.database.filename, DATAFILE);
+    strcpy(cfg.database.spool, SPOOLFILE);
+    cfg.database.commitrows = 25;
+    CHECK("datafile created",               database_initialize(DATAFILE) == EXIT_SUCCESS);
+    CHECK("dbwriter_open()",                dbwriter_open(DATAFILE) == EXIT_SUCCESS);
+
+    // 1.
+    spool_ms = ticks(0, ROWS, true);
+    CHECK("rows in the spool",              filesize(SPOOLFILE) > HEADERSIZE &&
+                                            query("SELECT COUNT(*) FROM samples") == 0);
+
+    // 2.
+    dbwriter_close();
+    CHECK("drained",                        query("SELECT COUNT(*) FROM samples") == ROWS &&
+                                            query("SELECT COUNT(*) FROM counters") == (ROWS + 11) / 12);
+    CHECK("rollups",                        query("SELECT SUM(Rows) FROM rollup_1h") == ROWS);
+    CHECK("spool emptied",                  filesize(SPOOLFILE) == HEADERSIZE);
+
+    // 3. Crash: records appended, nothing consumed. Power cut tears the last one.
+    CHECK("spool_open()",                   (spool = spool_open(SPOOLFILE, sizeof(msg))) != NULL);
+    for (i = ROWS; i < ROWS + 10; i++)
+    {
+        memset(&msg, 0, sizeof(msg));
+        msg.type = DBWRITER_MSG_RECORD;
+        pingrecord(&msg.data.record, i);
+        spool_append(spool, &msg);
+    }
+    spool_close(spool);
+    fd = open(SPOOLFILE, O_RDWR);
+    // Flip a payload byte of the 4th record
+    if (pwrite(fd, "X", 1, HEADERSIZE + 3 * (8 + sizeof(msg)) + 8 + 16) != 1 ||
+        pwrite(fd, &msg, 100, filesize(SPOOLFILE)) != 100)
+        n_failed++;
+    close(fd);
+    CHECK("dbwriter_open() replays",        dbwriter_open(DATAFILE) == EXIT_SUCCESS);
+    CHECK("replayed",                       query("SELECT COUNT(*) FROM samples") == ROWS + 9);
+    CHECK("corrupt record skipped",         query("SELECT COUNT(*) FROM samples WHERE Timestamp = " "1475010015") == 0);
+    CHECK("spool emptied",                  filesize(SPOOLFILE) == HEADERSIZE);
+    dbwriter_close();
+
+    // 4. Same rows through the pipe (group commit every commitrows rows)
+    cfg.database.spool[0] = '\0';
+    CHECK("dbwriter_open()",                dbwriter_open(DATAFILE) == EXIT_SUCCESS);
+    pipe_ms = ticks(ROWS + 10, 2 * ROWS + 10, false);
+    dbwriter_close();
+    CHECK("pipe rows written",              query("SELECT COUNT(*) FROM samples") == 2 * ROWS + 9);
+    printf("Worst tick: pipe %.2f ms, spool %.2f ms\n", pipe_ms, spool_ms);
+
+    if (system("rm -f " DATAFILE "*"))
+        n_failed++;
+    return n_failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+/* EOF ut_spool.c */
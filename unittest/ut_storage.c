@@ -0,0 +1,177 @@
+/******************************************************************************
+ * STORAGE BACKEND TEST
+ *
+ *      Same checks against each backend (storage.h):
+ *
+ *          1.  Batch append (a late row included), counters and reboot,
+ *              flush
+ *          2.  Range scan: timestamp order, inclusive range, NULLs, rows
+ *              appended but not flushed, early stop
+ *          3.  Benchmark harness, persistent and open per batch
+ *
+ *      SQLite3 backend also: rows, counters and rollups are in the datafile
+ *      after close.
+ ******************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sqlite3.h>
+
+#include "../config.h"
+#include "../database.h"
+#include "../storage.h"
+
+#define DATAFILE    "/tmp/icmond.ut_storage.sqlite3"
+#define T0          1475000000
+#define ROWS        100
+
+static int n_failed = 0;
+
+#define CHECK(name, cond) \
+    do { \
+        int ok_ = (cond); \
+        printf("%-40s %s\n", name, ok_ ? "OK" : "NOT OK"); \
+        if (!ok_) n_failed++; \
+    } while (0)
+
+static long long query(const char *sql)
+{
+    sqlite3      *db;
+    sqlite3_stmt *stmt;
+    long long     value = -1;
+
+    sqlite3_open(DATAFILE, &db);
+    if (sqlite3_prepare_v2(db, sql, -1, &stmt, NULL) == SQLITE_OK)
+    {
+        if (sqlite3_step(stmt) == SQLITE_ROW)
+            value = sqlite3_column_int64(stmt, 0);
+        sqlite3_finalize(stmt);
+    }
+    sqlite3_close(db);
+    return value;
+}
+
+static void pingrecord(databaserecord_t *rec, int i)
+{
+    double *value = &rec->modemping_ms;
+    int     c;
+
+    rec->timestamp = T0 + i * 5;
+    for (c = 0; c < DATABASE_SAMPLE_COLUMNS; c++)
+        value[c] = DATABASE_DOUBLE_NULL_VALUE;
+    rec->modemping_ms = 1.5 + (i % 7) / 4.0;
+    rec->inetping_ms  = 12.25;
+}
+
+typedef struct
+{
+    int     n;
+    int     stopat;             // 0 == scan all
+    time_t  previous;
+    int     ordered;
+    int     nulls;              // line values returned as NULL
+    double  sum;                // modemping_ms
+} scan_t;
+
+static int scanrow(databaserecord_t *record, void *arg)
+{
+    scan_t *scan = arg;
+
+    scan->ordered  &= record->timestamp >= scan->previous;
+    scan->previous  = record->timestamp;
+    scan->nulls    += record->down_ch1_dbmv == DATABASE_DOUBLE_NULL_VALUE;
+    scan->sum      += record->modemping_ms;
+    return ++scan->n == scan->stopat;
+}
+
+static void backendtest(const storage_backend_t *backend)
+{
+    databaserecord_t   rows[ROWS];
+    databasecounters_t counters;
+    databasereboot_t   reboot = { T0 + 100, T0 - 3600, 86400 };
+    storage_t         *storage;
+    scan_t             scan;
+    dbperf_t          *perf;
+    double             sum = 0.0;
+    int                i;
+    char               name[64];
+
+    printf("--- %s\n", backend->name);
+    if (system("rm -f " DATAFILE "*") || database_initialize(DATAFILE))
+    {
+        n_failed++;
+        return;
+    }
+    CHECK("storage_open()",                 (storage = storage_open(backend, DATAFILE)) != NULL);
+    if (!storage)
+        return;
+    CHECK("storage_name()",                 !strcmp(storage_name(storage), backend->name));
+
+    // 1. Rows 1 ... ROWS-1 in one batch, row 0 arrives late
+    for (i = 0; i < ROWS; i++)
+    {
+        pingrecord(&rows[i], i);
+        sum += rows[i].modemping_ms;
+    }
+    memset(&counters, 0xff, sizeof(counters));
+    counters.timestamp = T0 + 60;
+    counters.seconds   = 60;
+    CHECK("storage_append() batch",         storage_append(storage, &rows[1], ROWS - 1) == 0);
+    CHECK("storage_append() late row",      storage_append(storage, &rows[0], 1) == 0);
+    CHECK("storage_appendcounters()",       storage_appendcounters(storage, &counters) == 0);
+    CHECK("storage_appendreboot()",         storage_appendreboot(storage, &reboot) == 0);
+
+    // 2. Before the flush
+    memset(&scan, 0, sizeof(scan));
+    scan.ordered = 1;
+    CHECK("scan includes unflushed rows",   storage_scan(storage, 0, T0 + ROWS * 5, scanrow, &scan) == ROWS &&
+                                            scan.n == ROWS);
+    CHECK("storage_flush()",                storage_flush(storage) == 0);
+    memset(&scan, 0, sizeof(scan));
+    scan.ordered = 1;
+    CHECK("scan all",                       storage_scan(storage, 0, T0 + ROWS * 5, scanrow, &scan) == ROWS);
+    CHECK("timestamp order",                scan.ordered && scan.previous == T0 + (ROWS - 1) * 5);
+    CHECK("values",                         scan.sum > sum - 0.01 && scan.sum < sum + 0.01);
+    CHECK("NULLs",                          scan.nulls == ROWS);
+    memset(&scan, 0, sizeof(scan));
+    CHECK("inclusive range",                storage_scan(storage, T0 + 10, T0 + 20, scanrow, &scan) == 3);
+    memset(&scan, 0, sizeof(scan));
+    scan.stopat = 5;
+    CHECK("early stop",                     storage_scan(storage, 0, T0 + ROWS * 5, scanrow, &scan) == 5);
+    memset(&scan, 0, sizeof(scan));
+    CHECK("empty range",                    storage_scan(storage, T0 + ROWS * 5, T0 + ROWS * 10, scanrow, &scan) == 0);
+    storage_close(storage);
+
+    if (backend == &storage_sqlite)
+    {
+        CHECK("rows in datafile",           query("SELECT COUNT(*) FROM samples") == ROWS);
+        CHECK("counters in datafile",       query("SELECT COUNT(*) FROM counters") == 1);
+        CHECK("reboot in datafile",         query("SELECT COUNT(*) FROM reboots") == 1);
+        CHECK("rollups",                    query("SELECT SUM(Rows) FROM rollup_1h") == ROWS);
+    }
+
+    // 3.
+    snprintf(name, sizeof(name), "harness (%s)", backend->name);
+    CHECK(name,                             (perf = storage_testwriteperf(backend, DATAFILE, 50, 8, 1)) != NULL &&
+                                            perf->n == 7 && perf->min <= perf->mean && perf->mean <= perf->max &&
+                                            perf->min <= perf->p50 && perf->p50 <= perf->p99 && perf->p99 <= perf->max);
+    if (perf)
+        printf("%s: %d batches, mean %.3f ms, max %.3f ms\n", backend->name, perf->n, perf->mean, perf->max);
+    snprintf(name, sizeof(name), "harness, open per batch (%s)", backend->name);
+    CHECK(name,                             (perf = storage_testwriteperf(backend, DATAFILE, 20, 1, 0)) != NULL &&
+                                            perf->n == 20);
+}
+
+int main()
+{
+    CHECK("storage_backend()",              storage_backend(CFG_BACKEND_SQLITE) == &storage_sqlite &&
+                                            storage_backend(CFG_BACKEND_MEMORY) == &storage_memory);
+    backendtest(&storage_sqlite);
+    backendtest(&storage_memory);
+
+    if (system("rm -f " DATAFILE "*"))
+        n_failed++;
+    return n_failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+/* EOF ut_storage.c */
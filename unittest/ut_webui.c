@@ -0,0 +1,165 @@
+/******************************************************************************
+ * WEBUI COLLECTOR TEST
+ *
+ *      Forks a minimal HTTP/1.1 server on 127.0.0.1 (ephemeral port) that
+ *      answers three requests over ONE keep-alive connection:
+ *
+ *          1.  Page A (Content-Length)             -> parsed
+ *          2.  Page A (chunked)                    -> unchanged
+ *          3.  Page B (Content-Length, close)      -> parsed, not kept alive
+ ******************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <arpa/inet.h>
+
+#include "../webui.h"
+#include "../database.h"
+
+static int n_failed = 0;
+
+#define CHECK(name, cond) \
+    do { \
+        int ok_ = (cond); \
+        printf("%-40s %s\n", name, ok_ ? "OK" : "NOT OK"); \
+        if (!ok_) n_failed++; \
+    } while (0)
+
+#define PAGE(down1, up1) \
+    "<html><body><p>Uptime changes every request 1234</p>\n" \
+    "<table class=\"std\" summary=\"Downstream Channels\">\n" \
+    "<tr><td><script>dw(vs_channel);</script> 1</td><td>" down1 " dBmV</td><td>38.6 dB</td></tr>\n" \
+    "<tr><td><script>dw(vs_channel);</script> 2</td><td>2.1 dBmV</td><td>37.9 dB</td></tr>\n" \
+    "</table>\n<p>Something else</p>\n" \
+    "<table class=\"std\" summary=\"Upstream Channels\">\n" \
+    "<tr><td><script>dw(vs_channel);</script> 1</td><td>" up1 " dBmV</td></tr>\n" \
+    "</table></body></html>\n"
+
+static const char *page_a = PAGE("-1.5", "44.5");
+static const char *page_b = PAGE("-2.0", "45.0");
+
+/*
+ * Read one request (up to the empty line)
+ */
+static int read_request(int fd)
+{
+    char buffer[1024];
+    int  len = 0, n;
+    while ((n = read(fd, buffer + len, sizeof(buffer) - 1 - len)) > 0)
+    {
+        len += n;
+        buffer[len] = '\0';
+        if (strstr(buffer, "\r\n\r\n"))
+            return 0;
+    }
+    return -1;
+}
+
+static void server(int listenfd)
+{
+    char header[256];
+    int  fd, half;
+
+    if ((fd = accept(listenfd, NULL, NULL)) < 0)
+        _exit(EXIT_FAILURE);
+
+    // 1. Content-Length
+    if (read_request(fd))
+        _exit(EXIT_FAILURE);
+    snprintf(header, sizeof(header), "HTTP/1.1 200 OK\r\nContent-Length: %d\r\n\r\n", (int)strlen(page_a));
+    write(fd, header, strlen(header));
+    write(fd, page_a, strlen(page_a));
+
+    // 2. Chunked, in two chunks
+    if (read_request(fd))
+        _exit(EXIT_FAILURE);
+    half = strlen(page_a) / 2;
+    snprintf(header, sizeof(header), "HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n\r\n%x\r\n", half);
+    write(fd, header, strlen(header));
+    write(fd, page_a, half);
+    snprintf(header, sizeof(header), "\r\n%x\r\n", (int)strlen(page_a) - half);
+    write(fd, header, strlen(header));
+    write(fd, page_a + half, strlen(page_a) - half);
+    write(fd, "\r\n0\r\n\r\n", 7);
+
+    // 3. Changed page, server closes
+    if (read_request(fd))
+        _exit(EXIT_FAILURE);
+    snprintf(header, sizeof(header), "HTTP/1.1 200 OK\r\nConnection: close\r\nContent-Length: %d\r\n\r\n", (int)strlen(page_b));
+    write(fd, header, strlen(header));
+    write(fd, page_b, strlen(page_b));
+    close(fd);
+    _exit(EXIT_SUCCESS);
+}
+
+int main()
+{
+    struct sockaddr_in  addr;
+    socklen_t           addrlen = sizeof(addr);
+    webui_session_t    *s;
+    databaserecord_t    rec;
+    double              value[WEBUI_NVALUES];
+    int                 listenfd;
+    pid_t               pid;
+
+    /*
+     * Parser
+     */
+    CHECK("webui_parse() count",            webui_parse(page_a, value) == 5);
+    CHECK("webui_parse() down ch1 (signed)", value[0] == -1.5 && value[1] == 38.6);
+    CHECK("webui_parse() down ch3 missing", value[4] == DATABASE_DOUBLE_NULL_VALUE);
+    CHECK("webui_parse() up ch1",           value[WEBUI_NDOWN * 2] == 44.5);
+    CHECK("webui_tablehash() differs",      webui_tablehash(page_a) != webui_tablehash(page_b));
+    CHECK("webui_tablehash() no tables",    webui_tablehash("<html></html>") == 0);
+
+    /*
+     * Server
+     */
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family      = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if ((listenfd = socket(AF_INET, SOCK_STREAM, 0)) < 0 ||
+        bind(listenfd, (struct sockaddr *)&addr, sizeof(addr)) ||
+        listen(listenfd, 1) ||
+        getsockname(listenfd, (struct sockaddr *)&addr, &addrlen))
+    {
+        perror("server socket");
+        return EXIT_FAILURE;
+    }
+    if (!(pid = fork()))
+        server(listenfd);
+    close(listenfd);
+
+    /*
+     * Client (as the daemon would: connect before each scrape)
+     */
+    CHECK("webui_connect()", webui_connect("127.0.0.1", ntohs(addr.sin_port)) == EXIT_SUCCESS);
+    s = webui_getsession();
+
+    CHECK("scrape 1",                       webui_scrape("/Docsis_system.asp", 1000) == WEBUI_SUCCESS);
+    CHECK("scrape 1 parsed, new connection", !s->tick.unchanged && !s->tick.reused && s->connected);
+
+    webui_connect("127.0.0.1", ntohs(addr.sin_port));
+    CHECK("scrape 2 (chunked)",             webui_scrape("/Docsis_system.asp", 1000) == WEBUI_SUCCESS);
+    CHECK("scrape 2 unchanged, kept-alive", s->tick.unchanged && s->tick.reused && s->connected);
+
+    webui_connect("127.0.0.1", ntohs(addr.sin_port));
+    CHECK("scrape 3",                       webui_scrape("/Docsis_system.asp", 1000) == WEBUI_SUCCESS);
+    CHECK("scrape 3 parsed, connection closed", !s->tick.unchanged && s->tick.reused && !s->connected);
+
+    memset(&rec, 0, sizeof(rec));
+    CHECK("webui_fill_record()",            webui_fill_record(&rec) == 5);
+    CHECK("record values",                  rec.down_ch1_dbmv == -2.0 && rec.up_ch1_dbmv == 45.0);
+    CHECK("record missing channel",         rec.down_ch3_dbmv == DATABASE_DOUBLE_NULL_VALUE);
+    CHECK("totals",                         s->total.n_requests == 3 && s->total.n_parsed == 2 &&
+                                            s->total.n_unchanged == 1 && s->total.n_connects == 1);
+
+    waitpid(pid, NULL, 0);
+    webui_close();
+    return n_failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+/* EOF ut_webui.c */
@@ -0,0 +1,190 @@
+/******************************************************************************
+ * DATABASE WRITER PROCESS TEST
+ *
+ *      Rows are sent by concurrent workers (fork()'ed like the daemon does)
+ *      to the writer process started with dbwriter_start():
+ *
+ *          1.  Rows of all workers written, control messages (flush) are
+ *              run in order behind the rows
+ *          2.  Close waits for the writer to commit and exit
+ *          3.  Restart (SIGHUP) closes the writer, dbwriter_exited() starts
+ *              it again and rows sent in between are not lost
+ *          4.  Writer killed right after the start is not restarted,
+ *              workers fall back to inserting directly
+ *          5.  Writer stopped, control messages do not block on the full
+ *              pipe: flush is dropped, close is deferred and sent on close
+ ******************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <signal.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <sqlite3.h>
+
+#include "../config.h"
+#include "../database.h"
+#include "../dbwriter.h"
+
+#define DATAFILE    "/tmp/icmond.ut_writer.sqlite3"
+#define T0          1475000000
+#define WORKERS     4
+#define ROWS        500         // per worker
+
+static int n_failed = 0;
+
+#define CHECK(name, cond) \
+    do { \
+        int ok_ = (cond); \
+        printf("%-40s %s\n", name, ok_ ? "OK" : "NOT OK"); \
+        if (!ok_) n_failed++; \
+    } while (0)
+
+static long long query(const char *sql)
+{
+    sqlite3      *db;
+    sqlite3_stmt *stmt;
+    long long     value = -1;
+
+    sqlite3_open(DATAFILE, &db);
+    sqlite3_busy_timeout(db, 1000);
+    if (sqlite3_prepare_v2(db, sql, -1, &stmt, NULL) == SQLITE_OK)
+    {
+        if (sqlite3_step(stmt) == SQLITE_ROW)
+            value = sqlite3_column_int64(stmt, 0);
+        sqlite3_finalize(stmt);
+    }
+    sqlite3_close(db);
+    return value;
+}
+
+/*
+ * Writer runs asynchronously, wait (at most 5 s) for the rows to show up
+ */
+static long long waitrows(long long n)
+{
+    long long rows = -1;
+    int       i;
+
+    for (i = 0; i < 500 && (rows = query("SELECT COUNT(*) FROM samples")) != n; i++)
+        usleep(10000);
+    return rows;
+}
+
+static void pingrecord(databaserecord_t *rec, int i)
+{
+    double *value = &rec->modemping_ms;
+    int     c;
+
+    rec->timestamp = T0 + i * 5;
+    for (c = 0; c < (sizeof(databaserecord_t) - sizeof(time_t)) / sizeof(double); c++)
+        value[c] = DATABASE_DOUBLE_NULL_VALUE;
+    rec->modemping_ms = 1.5 + (i % 7) / 4.0;
+    rec->inetping_ms  = 12.25;
+}
+
+static int sendrows(int from, int to)
+{
+    databaserecord_t rec;
+    int              i;
+
+    for (i = from; i < to; i++)
+    {
+        pingrecord(&rec, i);
+        if (dbwriter_send(DBWRITER_MSG_RECORD, &rec))
+            return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
+
+/*
+ * Workers send their rows at the same time. Returns number of workers
+ * that failed.
+ */
+static int workers(int from)
+{
+    pid_t pid[WORKERS];
+    int   w, status, n = 0;
+
+    for (w = 0; w < WORKERS; w++)
+        if ((pid[w] = fork()) == 0)
+            _exit(sendrows(from + w * ROWS, from + (w + 1) * ROWS));
+    for (w = 0; w < WORKERS; w++)
+        if (pid[w] < 0 || waitpid(pid[w], &status, 0) != pid[w] || !WIFEXITED(status) || WEXITSTATUS(status))
+            n++;
+    return n;
+}
+
+int main()
+{
+    pid_t pid;
+    int   status, i, n;
+
+    if (system("rm -f " DATAFILE "*"))
+        return EXIT_FAILURE;
+    strcpy(cfg.database.filename, DATAFILE);
+    cfg.database.commitrows     = 25;
+    cfg.database.commitinterval = 3600;
+    CHECK("datafile created",               database_initialize(DATAFILE) == EXIT_SUCCESS);
+    CHECK("dbwriter_start()",               dbwriter_start(DATAFILE) == EXIT_SUCCESS &&
+                                            (pid = dbwriter_getpid()) > 0);
+
+    // 1.
+    CHECK("workers sent their rows",        workers(0) == 0);
+    CHECK("dbwriter_flush()",               dbwriter_flush() == EXIT_SUCCESS);
+    CHECK("rows written",                   waitrows(WORKERS * ROWS) == WORKERS * ROWS);
+    CHECK("rollups",                        query("SELECT SUM(Rows) FROM rollup_1h") == WORKERS * ROWS);
+
+    // 2. Last rows are in the open transaction (commitrows)
+    CHECK("partial transaction sent",       sendrows(WORKERS * ROWS, WORKERS * ROWS + 10) == EXIT_SUCCESS);
+    dbwriter_close();
+    CHECK("writer exited",                  dbwriter_getpid() == 0 && kill(pid, 0) == -1 && errno == ESRCH);
+    CHECK("committed on close",             query("SELECT COUNT(*) FROM samples") == WORKERS * ROWS + 10);
+    CHECK("dbwriter_send() without writer", dbwriter_send(DBWRITER_MSG_RECORD, &(databaserecord_t){ 0 }) &&
+                                            errno == ENOTCONN);
+
+    // 3.
+    CHECK("dbwriter_start()",               dbwriter_start(DATAFILE) == EXIT_SUCCESS &&
+                                            (pid = dbwriter_getpid()) > 0);
+    CHECK("dbwriter_restart()",             dbwriter_restart() == EXIT_SUCCESS);
+    // Fits in the pipe, written by whichever writer reads them
+    CHECK("rows sent during restart",       sendrows(10000, 10200) == EXIT_SUCCESS);
+    CHECK("writer closed",                  waitpid(pid, &status, 0) == pid && WIFEXITED(status) &&
+                                            WEXITSTATUS(status) == EXIT_SUCCESS);
+    CHECK("dbwriter_exited() restarts",     dbwriter_exited(pid, status) && dbwriter_getpid() > 0 &&
+                                            dbwriter_getpid() != pid);
+    CHECK("other pid is not the writer",    !dbwriter_exited(pid, status));
+    CHECK("workers sent their rows",        workers(20000) == 0);
+    dbwriter_close();
+    CHECK("rows of both writers",           query("SELECT COUNT(*) FROM samples") == 2 * WORKERS * ROWS + 210);
+
+    // 4.
+    CHECK("dbwriter_start()",               dbwriter_start(DATAFILE) == EXIT_SUCCESS &&
+                                            (pid = dbwriter_getpid()) > 0);
+    kill(pid, SIGKILL);
+    CHECK("writer killed",                  waitpid(pid, &status, 0) == pid && WIFSIGNALED(status));
+    CHECK("not restarted",                  dbwriter_exited(pid, status) && dbwriter_getpid() == 0);
+    CHECK("workers insert directly",        dbwriter_send(DBWRITER_MSG_RECORD, &(databaserecord_t){ 0 }) &&
+                                            errno == ENOTCONN);
+    dbwriter_close();
+
+    // 5. Far more than the pipe holds
+    CHECK("dbwriter_start()",               dbwriter_start(DATAFILE) == EXIT_SUCCESS &&
+                                            (pid = dbwriter_getpid()) > 0);
+    kill(pid, SIGSTOP);
+    for (i = n = 0; i < 10000; i++)
+        n += dbwriter_flush() == EXIT_SUCCESS;
+    CHECK("flush does not block",           n == 10000);
+    CHECK("dbwriter_restart() deferred",    dbwriter_restart() == EXIT_SUCCESS);
+    kill(pid, SIGCONT);
+    dbwriter_close();
+    CHECK("writer closed",                  dbwriter_getpid() == 0 && kill(pid, 0) == -1 && errno == ESRCH);
+
+    if (system("rm -f " DATAFILE "*"))
+        n_failed++;
+    return n_failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+/* EOF ut_writer.c */
@@ -12,6 +12,7 @@
 #include <ctype.h>          // isspace()
 #include <limits.h>         // PATH_MAX
 #include <sys/stat.h>       // struct stat 
+#include <sys/mman.h>       // mmap(), munmap()
 #include <sys/timerfd.h>    // timerfd_settime()
 #include <arpa/inet.h>      // inet_ntop()
 
@@ -772,6 +773,55 @@ char *bsprint_heap(char **buffer, void *address)
     return bsprint_mem(buffer, address, malloc_usable_size(address));
 }
 
+/*****************************************************************************/
+// SHARED MEMORY
+/*****************************************************************************/
+/*
+ * Anonymous shared mapping is inherited over fork(), so a structure allocated
+ * by the daemon before creating workers is visible (read & write) to all of
+ * them. Memory is zero-filled.
+ */
+void *shmalloc(size_t size)
+{
+    void *p = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (p == MAP_FAILED)
+    {
+        logerr("mmap(NULL, %d, ..., MAP_SHARED | MAP_ANONYMOUS, -1, 0)", (int)size);
+        return NULL;
+    }
+    return (errno = 0, p);
+}
+
+void shfree(void *p, size_t size)
+{
+    if (p)
+        munmap(p, size);
+}
+
+/*****************************************************************************/
+// CHECKSUM
+/*****************************************************************************/
+uint32_t crc32(const void *data, size_t n)
+{
+    static uint32_t table[256];
+    const uint8_t  *p   = data;
+    uint32_t        crc = 0xFFFFFFFF, c;
+    int             i, k;
+
+    if (!table[1])
+    {
+        for (i = 0; i < 256; i++)
+        {
+            for (c = i, k = 0; k < 8; k++)
+                c = c & 1 ? 0xEDB88320 ^ (c >> 1) : c >> 1;
+            table[i] = c;
+        }
+    }
+    while (n--)
+        crc = table[(crc ^ *p++) & 0xFF] ^ (crc >> 8);
+    return crc ^ 0xFFFFFFFF;
+}
+
 /*****************************************************************************/
 #ifdef _UNITTEST
 /*****************************************************************************/
@@ -3,6 +3,7 @@
  */
 #include <stdio.h>      // printf()
 #include <time.h>       // clock_gettime(), struct timerspec
+#include <stdint.h>     // uint32_t
 
 #ifndef __UTIL_H__
 #define __UTIL_H__
@@ -332,6 +333,25 @@ int file_useraccess(const char *filename, char *username, int accessflags);
 int mkdir_recursive(const char *path);
 
 
+/******************************************************************************
+ * Shared memory
+ *
+ *      Zero-filled anonymous MAP_SHARED memory. Allocate before fork() and
+ *      the block is shared between the daemon and its child processes.
+ *      shfree() must be given the same size as shmalloc().
+ */
+void *  shmalloc(size_t size);
+void    shfree(void *p, size_t size);
+
+
+/******************************************************************************
+ * Checksum
+ *
+ *      CRC-32 (IEEE 802.3, as zlib), for records written into files.
+ */
+uint32_t crc32(const void *data, size_t n);
+
+
 #endif /* __UTIL_H__ */
 
 /* EOF util.h */
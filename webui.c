@@ -0,0 +1,569 @@
+/*
+ * webui.c - 2016 Jani Tammi <janitammi@gmail.com>
+ *
+ *      Built-in keep-alive modem WebUI collector. See webui.h for details.
+ *
+ *      NOTE: Socket is non-blocking (it is connected by the daemon, which
+ *            must never block), so the collector child waits with poll()
+ *            against a deadline derived from the collector timeout.
+ */
+#include <stdio.h>
+#include <unistd.h>             // close()
+#include <stdlib.h>             // malloc(), strtol(), strtod()
+#include <stdbool.h>            // true, false
+#include <string.h>             // memset(), memcpy(), memmem()
+#include <strings.h>            // strncasecmp()
+#include <ctype.h>              // isdigit()
+#include <errno.h>
+#include <poll.h>               // poll()
+#include <time.h>               // clock_gettime()
+#include <sys/socket.h>         // socket(), connect(), send(), recv()
+#include <arpa/inet.h>          // inet_pton(), htons()
+
+#include "webui.h"
+#include "logwrite.h"
+#include "util.h"               // shmalloc()
+
+static webui_session_t *session = NULL;
+
+/*
+ * Parsed response (webui_request())
+ */
+typedef struct
+{
+    int     bytes;              // total received
+    int     status;             // HTTP status code
+    int     keepalive;          // server did not ask to close
+    char   *body;               // NUL terminated, within the buffer
+    int     bodylen;
+} response_t;
+
+static double elapsed_ms(struct timespec *start)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec  - start->tv_sec) * 1.0e3 +
+           (now.tv_nsec - start->tv_nsec) / 1.0e6;
+}
+
+
+/*****************************************************************************/
+// DAEMON SIDE
+/*****************************************************************************/
+/*
+ * Non-blocking TCP connect. Returns socket or -1.
+ */
+static int webui_socket(const char *host, int port)
+{
+    struct sockaddr_in addr;
+    int                fd;
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port   = htons(port);
+    if (inet_pton(AF_INET, host, &addr.sin_addr) != 1)
+    {
+        logerr("Modem address \"%s\" is not an IPv4 address!", host);
+        return (errno = EINVAL, -1);
+    }
+    if ((fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0)) < 0)
+    {
+        logerr("socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0)");
+        return -1;
+    }
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) && errno != EINPROGRESS)
+    {
+        logerr("connect(\"%s\")", host);
+        close(fd);
+        return -1;
+    }
+    return (errno = 0, fd);
+}
+
+int webui_connect(const char *host, int port)
+{
+    if (!session)
+    {
+        if (!(session = shmalloc(sizeof(webui_session_t))))
+            return EXIT_FAILURE;
+        session->sockfd = -1;
+    }
+    if (session->connected && !strcmp(session->host, host) && session->port == port)
+        return (errno = 0, EXIT_SUCCESS);
+
+    if (session->sockfd >= 0)
+        close(session->sockfd);
+    session->connected = false;
+    session->nrequests = 0;
+    if (strcmp(session->host, host) || session->port != port)
+    {
+        // Different modem, previous page is no reference
+        snprintf(session->host, sizeof(session->host), "%s", host);
+        session->port      = port;
+        session->tablehash = 0;
+        session->hasvalues = false;
+    }
+    if ((session->sockfd = webui_socket(host, port)) < 0)
+        return EXIT_FAILURE;
+    session->connected = true;
+    session->total.n_connects++;
+    logdev("WebUI connection to %s:%d opened (fd: %d)", host, port, session->sockfd);
+    return (errno = 0, EXIT_SUCCESS);
+}
+
+void webui_close()
+{
+    if (!session)
+        return;
+    if (session->sockfd >= 0)
+        close(session->sockfd);
+    shfree(session, sizeof(webui_session_t));
+    session = NULL;
+}
+
+void webui_logstats()
+{
+    if (!session || !session->total.n_requests)
+        return;
+    logmsg(
+          LOG_INFO,
+          "WebUI: %u requests over %u connections, %llu bytes (%.0f per request)",
+          session->total.n_requests,
+          session->total.n_connects,
+          (unsigned long long)session->total.bytes,
+          (double)session->total.bytes / session->total.n_requests
+          );
+    logmsg(
+          LOG_INFO,
+          "WebUI: %u parsed, %u unchanged. Mean fetch %.2f ms, mean parse %.2f ms",
+          session->total.n_parsed,
+          session->total.n_unchanged,
+          session->total.fetch_ms / session->total.n_requests,
+          session->total.parse_ms / session->total.n_requests
+          );
+}
+
+webui_session_t *webui_getsession()
+{
+    return session;
+}
+
+
+/*****************************************************************************/
+// HTTP/1.1 (collector child)
+/*****************************************************************************/
+/*
+ * poll() single fd until deadline. Returns 0 when ready, -1 on timeout
+ * (errno = ETIMEDOUT) or error.
+ */
+static int wait_fd(int fd, short events, struct timespec *start, int timeout)
+{
+    struct pollfd pfd = { .fd = fd, .events = events };
+    int           remaining = timeout - (int)elapsed_ms(start);
+    int           rc;
+    if (remaining <= 0)
+        return (errno = ETIMEDOUT, -1);
+    if ((rc = poll(&pfd, 1, remaining)) < 0)
+        return -1;
+    if (rc == 0)
+        return (errno = ETIMEDOUT, -1);
+    return (errno = 0, 0);
+}
+
+/*
+ * Scan chunked body. Returns number of bytes making up the complete
+ * chunked body (terminating chunk and trailer included), 0 if incomplete
+ * or -1 if malformed. If decode is true, data is compacted in place and
+ * *decodedlen receives the data length.
+ */
+static int chunked(char *p, int len, int decode, int *decodedlen)
+{
+    char *lineend, *end;
+    long  size;
+    int   off = 0, out = 0;
+    for (;;)
+    {
+        if (!(lineend = memmem(p + off, len - off, "\r\n", 2)))
+            return 0;
+        size = strtol(p + off, &end, 16);
+        if (end == p + off || size < 0)
+            return -1;
+        off = (lineend - p) + 2;
+        if (size == 0)
+        {
+            // optional trailer, ends with an empty line
+            if (!(lineend = memmem(p + off - 2, len - off + 2, "\r\n\r\n", 4)))
+                return 0;
+            if (decode)
+            {
+                p[out] = '\0';
+                *decodedlen = out;
+            }
+            return (lineend - p) + 4;
+        }
+        if (len - off < size + 2)
+            return 0;
+        if (decode)
+            memmove(p + out, p + off, size);
+        out += size;
+        off += size + 2;
+    }
+}
+
+/*
+ * Parse status line and headers. Returns header length (body offset)
+ * or 0 if headers are not yet complete.
+ */
+static int parse_headers(char *buffer, int len, response_t *r, int *contentlength, int *is_chunked)
+{
+    char *hdrend, *line, *next;
+    if (!(hdrend = memmem(buffer, len, "\r\n\r\n", 4)))
+        return 0;
+    *contentlength = -1;
+    *is_chunked    = false;
+    r->keepalive   = true;
+    if (sscanf(buffer, "HTTP/1.%*d %d", &r->status) != 1)
+        r->status = 0;
+    if (!strncmp(buffer, "HTTP/1.0", 8))
+        r->keepalive = false;
+    for (line = strstr(buffer, "\r\n") + 2; line < hdrend; line = next + 2)
+    {
+        next = strstr(line, "\r\n");
+        if (!strncasecmp(line, "Content-Length:", 15))
+            *contentlength = atoi(line + 15);
+        else if (!strncasecmp(line, "Transfer-Encoding:", 18))
+        {
+            char *c = strcasestr(line, "chunked");
+            *is_chunked = (c && c < next);
+        }
+        else if (!strncasecmp(line, "Connection:", 11))
+        {
+            char *v = line + 11;
+            while (*v == ' ')
+                v++;
+            if (!strncasecmp(v, "close", 5))
+                r->keepalive = false;
+            else if (!strncasecmp(v, "keep-alive", 10))
+                r->keepalive = true;
+        }
+    }
+    return (hdrend - buffer) + 4;
+}
+
+/*
+ * Send GET and read complete response into buffer.
+ * Returns EXIT_SUCCESS (any HTTP status) or EXIT_FAILURE.
+ */
+static int webui_request(
+                        int             fd,
+                        const char     *host,
+                        const char     *path,
+                        char           *buffer,
+                        response_t     *r,
+                        struct timespec *start,
+                        int             timeout
+                        )
+{
+    int       len, n, hdrlen = 0, contentlength = -1, is_chunked = false, done = false;
+    int       soerror;
+    socklen_t solen = sizeof(soerror);
+
+    memset(r, 0, sizeof(response_t));
+
+    // Connection may still be in progress (or have failed)
+    if (wait_fd(fd, POLLOUT, start, timeout))
+        return EXIT_FAILURE;
+    if (getsockopt(fd, SOL_SOCKET, SO_ERROR, &soerror, &solen) || soerror)
+        return (errno = soerror, EXIT_FAILURE);
+
+    len = snprintf(
+                  buffer,
+                  WEBUI_MAXHEADERSIZE,
+                  "GET %s HTTP/1.1\r\n"
+                  "Host: %s\r\n"
+                  "Connection: keep-alive\r\n"
+                  "Accept-Encoding: identity\r\n"
+                  "\r\n",
+                  path,
+                  host
+                  );
+    if (send(fd, buffer, len, MSG_NOSIGNAL) != len)
+        return EXIT_FAILURE;
+
+    len = 0;
+    while (!done)
+    {
+        if (len >= WEBUI_BUFFERSIZE - 1)
+            return (errno = ENOBUFS, EXIT_FAILURE);
+        n = recv(fd, buffer + len, WEBUI_BUFFERSIZE - 1 - len, 0);
+        if (n < 0)
+        {
+            if (errno != EAGAIN && errno != EWOULDBLOCK)
+                return EXIT_FAILURE;
+            if (wait_fd(fd, POLLIN, start, timeout))
+                return EXIT_FAILURE;
+            continue;
+        }
+        if (n == 0)
+        {
+            // Body delimited by connection close is the only valid case
+            if (hdrlen && contentlength < 0 && !is_chunked)
+            {
+                r->keepalive = false;
+                break;
+            }
+            return (errno = ECONNRESET, EXIT_FAILURE);
+        }
+        len += n;
+        buffer[len] = '\0';
+        r->bytes = len;
+        if (!hdrlen && !(hdrlen = parse_headers(buffer, len, r, &contentlength, &is_chunked)))
+            continue;
+        if (is_chunked)
+        {
+            if ((n = chunked(buffer + hdrlen, len - hdrlen, false, NULL)) < 0)
+                return (errno = EBADMSG, EXIT_FAILURE);
+            done = n > 0;
+        }
+        else if (contentlength >= 0)
+            done = (len - hdrlen >= contentlength);
+    }
+
+    r->body    = buffer + hdrlen;
+    r->bodylen = len - hdrlen;
+    if (is_chunked)
+        chunked(r->body, r->bodylen, true, &r->bodylen);
+    else if (contentlength >= 0)
+        r->bodylen = contentlength;
+    r->body[r->bodylen] = '\0';
+    return (errno = 0, EXIT_SUCCESS);
+}
+
+int webui_scrape(const char *path, int timeout)
+{
+    struct timespec start;
+    response_t      r;
+    char           *buffer;
+    const char     *host;
+    int             fd, own = -1, reused, rc;
+    uint32_t        hash;
+
+    if (!session)
+        return WEBUI_ERROR_CONNECTION;
+    host = session->host;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    memset(&session->tick, 0, sizeof(session->tick));
+    if (!(buffer = malloc(WEBUI_BUFFERSIZE)))
+        return WEBUI_ERROR_CONNECTION;
+
+    /*
+     * Daemon will reconnect unless this request completes cleanly
+     * (also covers being SIGKILL'ed in the middle of the response).
+     */
+    reused = session->connected && session->nrequests > 0;
+    if (session->connected && session->sockfd >= 0)
+        fd = session->sockfd;
+    else if ((fd = own = webui_socket(host, session->port)) < 0)
+    {
+        free(buffer);
+        return WEBUI_ERROR_CONNECTION;
+    }
+    session->connected = false;
+
+    rc = webui_request(fd, host, path, buffer, &r, &start, timeout);
+    if (rc && reused && !r.bytes && errno != ETIMEDOUT)
+    {
+        // Server had closed the idle keep-alive connection. Retry once,
+        // with a connection of our own (daemon will reconnect for next tick)
+        logdev("WebUI keep-alive connection was closed by the modem, retrying...");
+        reused = false;
+        if ((fd = own = webui_socket(host, session->port)) >= 0)
+            rc = webui_request(fd, host, path, buffer, &r, &start, timeout);
+    }
+    if (own >= 0)
+        close(own);
+    else if (!rc && r.keepalive)
+    {
+        session->connected = true;
+        session->nrequests++;
+    }
+    session->tick.bytes    = r.bytes;
+    session->tick.fetch_ms = elapsed_ms(&start);
+    session->tick.reused   = reused;
+    session->total.n_requests++;
+    session->total.bytes    += r.bytes;
+    session->total.fetch_ms += session->tick.fetch_ms;
+    if (rc)
+    {
+        logerr("WebUI request \"http://%s%s\" failed!", host, path);
+        free(buffer);
+        return WEBUI_ERROR_CONNECTION;
+    }
+    if (r.status != 200)
+    {
+        logerr("WebUI request \"http://%s%s\" returned HTTP status %d", host, path, r.status);
+        free(buffer);
+        return WEBUI_ERROR_CONNECTION;
+    }
+
+    /*
+     * Cheap change detection
+     */
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    rc = WEBUI_SUCCESS;
+    if (!(hash = webui_tablehash(r.body)))
+    {
+        logerr("WebUI page \"%s\" does not contain channel tables!", path);
+        rc = WEBUI_ERROR_DATA;
+    }
+    else if (session->hasvalues && hash == session->tablehash)
+    {
+        session->tick.unchanged = true;
+        session->total.n_unchanged++;
+    }
+    else
+    {
+        double value[WEBUI_NVALUES];
+        if (!webui_parse(r.body, value))
+        {
+            logerr("WebUI page \"%s\" channel tables contain no values!", path);
+            rc = WEBUI_ERROR_DATA;
+        }
+        else
+        {
+            memcpy(session->value, value, sizeof(value));
+            session->tablehash = hash;
+            session->hasvalues = true;
+            session->total.n_parsed++;
+        }
+    }
+    session->tick.parse_ms = elapsed_ms(&start);
+    session->total.parse_ms += session->tick.parse_ms;
+    free(buffer);
+    return rc;
+}
+
+
+/*****************************************************************************/
+// PAGE PARSING
+/*****************************************************************************/
+/*
+ * 32-bit FNV-1a over the channel table region. Never returns 0 for a found
+ * region (0 is "not found").
+ */
+uint32_t webui_tablehash(const char *page)
+{
+    const char *start, *end;
+    uint32_t    hash = 2166136261u;
+    if (!(start = strstr(page, WEBUI_TABLE_DOWNSTREAM)) ||
+        !(end = strstr(start, WEBUI_TABLE_UPSTREAM))    ||
+        !(end = strstr(end, WEBUI_TABLE_END)))
+        return 0;
+    for (end += strlen(WEBUI_TABLE_END); start < end; start++)
+    {
+        hash ^= (unsigned char)*start;
+        hash *= 16777619u;
+    }
+    return hash ? hash : 1;
+}
+
+/*
+ * Next decimal value (-?[0-9]*\.[0-9]+) before limit. Integers are skipped,
+ * just like the scrubber script does.
+ */
+static int next_decimal(char **p, const char *limit, double *value)
+{
+    char *s = *p, *end;
+    while (s < limit && *s)
+    {
+        if (isdigit(*s) || ((*s == '-' || *s == '.') && (isdigit(s[1]) || s[1] == '.')))
+        {
+            double d = strtod(s, &end);
+            if (end > s && end <= limit && memchr(s, '.', end - s))
+            {
+                *value = d;
+                *p     = end;
+                return true;
+            }
+            s = end > s ? end : s + 1;
+            continue;
+        }
+        s++;
+    }
+    return false;
+}
+
+/*
+ * Strip tags from one table and read nvalues per channel marker.
+ */
+static void parse_table(const char *page, const char *table, int nvalues, int nchannels, double *value)
+{
+    const char *start, *end, *s;
+    char       *text, *t, *p, *limit;
+    int         intag = false, ch, i;
+
+    if (!(start = strstr(page, table)))
+        return;
+    if (!(end = strstr(start, WEBUI_TABLE_END)))
+        end = start + strlen(start);
+    if (!(text = malloc(end - start + 1)))
+        return;
+    for (s = start, t = text; s < end; s++)
+    {
+        if (*s == '<')
+            intag = true;
+        else if (*s == '>')
+        {
+            intag = false;
+            *t++  = ' ';
+        }
+        else if (!intag)
+            *t++ = *s;
+    }
+    *t = '\0';
+
+    for (p = strstr(text, WEBUI_CHANNEL_MARKER); p; p = limit)
+    {
+        p    += strlen(WEBUI_CHANNEL_MARKER);
+        limit = strstr(p, WEBUI_CHANNEL_MARKER);
+        ch    = strtol(p, &p, 10);
+        if (ch < 1 || ch > nchannels)
+            continue;
+        for (i = 0; i < nvalues; i++)
+            if (!next_decimal(&p, limit ? limit : p + strlen(p), &value[(ch - 1) * nvalues + i]))
+                break;
+    }
+    free(text);
+}
+
+int webui_parse(const char *page, double *value)
+{
+    int i, n = 0;
+    for (i = 0; i < WEBUI_NVALUES; i++)
+        value[i] = DATABASE_DOUBLE_NULL_VALUE;
+    parse_table(page, WEBUI_TABLE_DOWNSTREAM, 2, WEBUI_NDOWN, value);
+    parse_table(page, WEBUI_TABLE_UPSTREAM,   1, WEBUI_NUP,   value + WEBUI_NDOWN * 2);
+    for (i = 0; i < WEBUI_NVALUES; i++)
+        if (value[i] != DATABASE_DOUBLE_NULL_VALUE)
+            n++;
+    return n;
+}
+
+int webui_fill_record(databaserecord_t *rec)
+{
+    int     i, n = 0;
+#define FIELD(f, c, s, k) &rec->f,
+    double *field[WEBUI_NVALUES] = { DATABASE_LINE_VALUES(FIELD) };     // database.h
+#undef FIELD
+    if (!session || !session->hasvalues)
+        return 0;
+    for (i = 0; i < WEBUI_NVALUES; i++)
+    {
+        *field[i] = session->value[i];
+        if (session->value[i] != DATABASE_DOUBLE_NULL_VALUE)
+            n++;
+    }
+    return n;
+}
+
+/* EOF webui.c */
@@ -0,0 +1,132 @@
+/*
+ * webui.h - 2016 Jani Tammi <janitammi@gmail.com>
+ *
+ *      Built-in modem WebUI collector (cfg.modem.collector == HTTP).
+ *
+ *      The external scrubber script spawns wget, opens a new TCP connection,
+ *      downloads the whole status page and runs a dozen sed's over it - on
+ *      every interval tick. Line values, however, change far less often than
+ *      we poll and the modem's web server does not take load gracefully.
+ *
+ *      This collector keeps ONE HTTP/1.1 keep-alive connection to the modem
+ *      for the whole lifetime of the daemon and only parses the channel
+ *      tables when they have changed:
+ *
+ *      1.  Daemon owns the session. It is allocated from shared memory
+ *          (util.c:shmalloc()) and the socket is connected by the daemon
+ *          (webui_connect(), non-blocking) just before worker is fork()'ed.
+ *          Worker and its collector child inherit both.
+ *      2.  Collector child (datalogger.c, in place of the scrubber script)
+ *          calls webui_scrape(), which sends the request over the inherited
+ *          connection and reads the response.
+ *      3.  The channel table region (Downstream table start -> Upstream table
+ *          end) is hashed (32-bit FNV-1a). If the hash equals the hash of the
+ *          previous parsed page, parsing is skipped and the previous values
+ *          are reused ("unchanged").
+ *      4.  Any failure, timeout (child is SIGKILL'ed) or "Connection: close"
+ *          leaves .connected false and the daemon reconnects before the next
+ *          worker is created.
+ *
+ *      Per tick byte and timing counters (.tick) and totals (.total) allow
+ *      the savings to be measured. Totals are logged by the daemon with the
+ *      execution statistics (webui_logstats()).
+ *
+ *      Parsing replicates the scrubber (scrubber/icmond.scrubber.cisco_epc3825)
+ *      rules: within each table, tags are stripped and each channel marker
+ *      "dw(vs_channel); N" is followed by decimal values (downstream: power
+ *      and SNR, upstream: power). Unlike the script, negative values keep
+ *      their sign and channels not present remain NULL.
+ */
+#include <stdint.h>             /* uint32_t, uint64_t                       */
+#include <netinet/in.h>         /* INET_ADDRSTRLEN                          */
+
+#include "database.h"           /* databaserecord_t                         */
+
+#ifndef __WEBUI_H__
+#define __WEBUI_H__
+
+#define WEBUI_PORT                  80
+#define WEBUI_BUFFERSIZE            (128 * 1024)    // whole response must fit
+#define WEBUI_MAXHEADERSIZE         4096
+#define WEBUI_NDOWN                 8
+#define WEBUI_NUP                   4
+#define WEBUI_NVALUES               (WEBUI_NDOWN * 2 + WEBUI_NUP)
+#define WEBUI_TABLE_DOWNSTREAM      "<table class=\"std\" summary=\"Downstream Channels\">"
+#define WEBUI_TABLE_UPSTREAM        "<table class=\"std\" summary=\"Upstream Channels\">"
+#define WEBUI_TABLE_END             "</table>"
+#define WEBUI_CHANNEL_MARKER        "dw(vs_channel);"
+
+/*
+ * webui_scrape() return values (collector child exit code)
+ */
+#define WEBUI_SUCCESS               0
+#define WEBUI_ERROR_CONNECTION      1       // send/recv failure, timeout, HTTP error
+#define WEBUI_ERROR_DATA            2       // tables not found / no channel values
+
+typedef struct
+{
+    int             sockfd;                 // keep-alive connection (daemon owned)
+    int             connected;              // false -> daemon reconnects
+    int             nrequests;              // requests sent over current connection
+    char            host[INET_ADDRSTRLEN + 1];
+    int             port;
+    uint32_t        tablehash;              // FNV-1a of channel tables (last parse)
+    int             hasvalues;
+    double          value[WEBUI_NVALUES];   // down1 dBmV, down1 dB ... down8 dB, up1..4 dBmV
+    struct
+    {
+        int         bytes;                  // response size, headers included
+        double      fetch_ms;               // request sent -> response complete
+        double      parse_ms;               // hash + (possible) parse
+        int         unchanged;              // true if parse was skipped
+        int         reused;                 // true if connection was kept alive
+    } tick;
+    struct
+    {
+        uint32_t    n_requests;
+        uint32_t    n_parsed;
+        uint32_t    n_unchanged;
+        uint32_t    n_connects;
+        uint64_t    bytes;
+        double      fetch_ms;
+        double      parse_ms;
+    } total;
+} webui_session_t;
+
+/*
+ * Daemon side
+ *
+ *  webui_connect()     Allocates the shared session on first call and
+ *                      (re)connects if the session is not connected or the
+ *                      host has changed. Non-blocking; connection completes
+ *                      while the worker is being created.
+ *  webui_close()       Close connection and release shared session.
+ *  webui_logstats()    Log session totals.
+ *
+ * Collector child side
+ *
+ *  webui_scrape()      Fetch path from session host and update session
+ *                      values (if changed). timeout in milliseconds.
+ *                      Returns WEBUI_* code.
+ *  webui_fill_record() Copy session values into databaserecord_t. Returns
+ *                      the number of values stored.
+ *  webui_getsession()  Shared session, NULL before webui_connect().
+ *
+ * Exposed for the unit test
+ *
+ *  webui_parse()       Parse channel tables from (NUL terminated) page.
+ *                      Returns number of values found.
+ *  webui_tablehash()   FNV-1a of the channel table region, 0 if not found.
+ */
+int                 webui_connect(const char *host, int port);
+void                webui_close(void);
+void                webui_logstats(void);
+int                 webui_scrape(const char *path, int timeout);
+int                 webui_fill_record(databaserecord_t *rec);
+webui_session_t *   webui_getsession(void);
+int                 webui_parse(const char *page, double *value);
+uint32_t            webui_tablehash(const char *page);
+
+#endif /* __WEBUI_H__ */
+
+/* EOF webui.h */